@@ -0,0 +1,1628 @@
+/**
+ * Copyright (c) 2007, Emir Uner
+ * All rights reserved.
+ * 
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ * 
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/**
+ * Measures the cost of the core truecrypt paths against the stub
+ * truecrypt and mount executables, so no root or real volumes are needed.
+ *
+ * Usage: bench_easytc [max volumes]
+ *        bench_easytc --stress [threads]
+ *        bench_easytc --fill <file> [MB]
+ *        bench_easytc --warm <directory> [threads]
+ *        bench_easytc --soak [cycles]
+ *        bench_easytc --filesystems <directory> [MB]
+ *        bench_easytc --vectors
+ *        bench_easytc --secrets
+ *        bench_easytc --dmflags
+ *        bench_easytc --tuning
+ *
+ * The stress mode runs random mounts, unmounts and listings of a few images
+ * on many threads with the stub's race check on, which fails any truecrypt
+ * run that overlaps a conflicting one.
+ *
+ * The fill mode measures the random fill of new images with one generator
+ * thread and with the default number, writing a file of the given size
+ * (1024 MB by default) on the drive to be measured.
+ *
+ * The warm mode compares a serial stat walk of a mounted volume with cold
+ * caches, the cache warm-up itself, and the same walk after the warm-up.
+ * Dropping the caches needs root; without it the cold walk is not cold.
+ *
+ * The soak mode runs mount, list and unmount cycles (100000 by default)
+ * against the stubs and fails if the anonymous memory or the number of
+ * open descriptors grew after the first tenth of the run, which is left to
+ * caches and the allocator to settle.
+ *
+ * The filesystems mode creates an image of the given size (512 MB by
+ * default) in the directory for each filesystem choice of new images, FAT,
+ * ext4 with and without a journal and xfs, mounts it and runs the volume
+ * benchmark on it: large-file throughput with the sequential and random
+ * tests, small-file throughput with the metadata tests. It runs the real
+ * truecrypt and mkfs, so it needs root.
+ *
+ * The vectors mode checks the in-process header reader against known
+ * answers: PBKDF2 with every header key hash, and headers generated here
+ * with a known password, salt and master key, which must open with the
+ * right password only and fail their checksums once a byte is changed.
+ *
+ * The secrets mode counts the heap allocations on the way of a password
+ * from the mount dialog to the truecrypt child, checks that none of the
+ * blocks freed on the way held the password, that a released or cleared
+ * secret reads back as zeros, and that the secret arena grows past its
+ * first chunk and fails clearly when full.
+ *
+ * The dmflags mode mounts with each dm-crypt flag and with all of them
+ * against the stubs, and checks the table dmsetup was given, which must
+ * carry the volume key and exactly the flags, the flags the crypto report
+ * shows afterwards, and that no block freed during the mount held the key.
+ *
+ * The tuning mode builds a fake sysfs tree with a dm device and the loop
+ * device under it, tunes the device there and checks that the values are
+ * written, that the values they replaced are saved, also across a second
+ * tuning, and that reverting puts them back.
+ */
+
+#include "Benchmark.hpp"
+#include "BlockStats.hpp"
+#include "CacheWarmer.hpp"
+#include "CryptoAcceleration.hpp"
+#include "DmCrypt.hpp"
+#include "ImageFill.hpp"
+#include "MountInfo.hpp"
+#include "Posix.hpp"
+#include "QueueTuning.hpp"
+#include "Statistics.hpp"
+#include "TrueCrypt.hpp"
+#include "VolumeHeader.hpp"
+
+#include <dirent.h>
+#include <fcntl.h>
+#include <ftw.h>
+#include <malloc.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+#include <openssl/evp.h>
+
+#include <algorithm>
+#include <fstream>
+#include <iostream>
+#include <iomanip>
+#include <map>
+#include <sstream>
+
+namespace
+{
+
+/**
+ * Allocations made through operator new, and while a needle is set, the
+ * number of blocks that held it when they were freed.
+ */
+long allocations = 0;
+char const* scanNeedle = 0;
+size_t scanLength = 0;
+long needleBlocks = 0;
+
+} // namespace <unnamed>
+
+void* operator new(size_t size)
+{
+    void* memory = malloc(size > 0 ? size : 1);
+    
+    if(memory == 0)
+    {
+        throw std::bad_alloc();
+    }
+    
+    __atomic_add_fetch(&allocations, 1, __ATOMIC_RELAXED);
+    
+    return memory;
+}
+
+void operator delete(void* memory) throw()
+{
+    if(memory != 0 && scanNeedle != 0 && memmem(memory, malloc_usable_size(memory), scanNeedle, scanLength) != 0)
+    {
+        __atomic_add_fetch(&needleBlocks, 1, __ATOMIC_RELAXED);
+    }
+    
+    free(memory);
+}
+
+namespace
+{
+
+const long long timeBudget = 500000;
+const int maxIterations = 200;
+const int minIterations = 3;
+const int stressImages = 4;
+const int stressIterations = 200;
+const int soakRows = 10;
+
+/**
+ * Growth of the anonymous memory a soak run tolerates, allocator noise.
+ */
+const long soakSlackKBytes = 256;
+
+struct Environment
+{
+    std::string directory;
+    
+    Environment()
+    {
+        char pattern[] = "/tmp/easytc-bench.XXXXXX";
+        
+        if(mkdtemp(pattern) == 0)
+        {
+            throw unix_error(errno);
+        }
+        
+        directory = pattern;
+        
+        std::string path = std::string(STUB_DIRECTORY) + ":" + getenv("PATH");
+        
+        setenv("PATH", path.c_str(), 1);
+        setenv("HOME", directory.c_str(), 1);
+        setenv("EASYTC_STUB_STATE", (directory + "/state").c_str(), 1);
+    }
+    
+    ~Environment()
+    {
+        int exitCode;
+        
+        executeCommand("rm", "-rf", directory, exitCode);
+    }
+};
+
+void printRow(int volumes, std::string operation, std::vector<double>& samples)
+{
+    double sum = 0;
+    
+    for(std::vector<double>::const_iterator it = samples.begin(); it != samples.end(); ++it)
+    {
+        sum += *it;
+    }
+    
+    const size_t count = samples.size();
+    
+    std::cout << std::setw(8) << volumes << "  " << std::left << std::setw(10) << operation << std::right
+              << std::setw(8) << count << std::setw(12) << sum / count
+              << std::setw(12) << percentile(samples, 0.5) << std::setw(12) << percentile(samples, 0.99)
+              << std::endl;
+}
+
+/**
+ * Calls the functor repeatedly until the time budget is used up and
+ * returns the duration of each call in microseconds.
+ */
+template <typename FunctorT>
+std::vector<double> measure(FunctorT functor)
+{
+    std::vector<double> samples;
+    const long long deadline = monotonicMicroseconds() + timeBudget;
+    
+    while(samples.size() < static_cast<size_t>(minIterations)
+          || (samples.size() < static_cast<size_t>(maxIterations) && monotonicMicroseconds() < deadline))
+    {
+        const long long start = monotonicMicroseconds();
+        
+        functor();
+        samples.push_back(static_cast<double>(monotonicMicroseconds() - start));
+    }
+    
+    return samples;
+}
+
+struct List
+{
+    size_t expected;
+    
+    void operator()()
+    {
+        if(getMountInfo().size() != expected)
+        {
+            throw std::runtime_error("stub listed an unexpected number of volumes");
+        }
+    }
+};
+
+struct Parse
+{
+    std::vector<std::string> const* tcOutput;
+    std::vector<std::string> const* mntOutput;
+    
+    void operator()()
+    {
+        parseMountInfo(*tcOutput, *mntOutput);
+    }
+};
+
+struct Mount
+{
+    void operator()()
+    {
+        Secret password;
+        
+        password.assign("password", 8);
+        mount("/bench/image.tc", "/bench/mnt", password);
+    }
+};
+
+struct Unmount
+{
+    void operator()()
+    {
+        unmount("/bench/image.tc");
+    }
+};
+
+struct SampleStats
+{
+    BlockStatSampler* sampler;
+    
+    void operator()()
+    {
+        sampler->sample();
+    }
+};
+
+/**
+ * Fake stat files, one per volume, so the sampler cost can be measured at
+ * volume counts the host does not have devices for.
+ */
+std::vector<std::string> createStatFiles(int volumes)
+{
+    std::vector<std::string> paths;
+    const std::string directory = std::string(getenv("HOME")) + "/sys";
+    
+    mkdir(directory.c_str(), 0700);
+    
+    for(int i = 0; i < volumes; ++i)
+    {
+        std::ostringstream oss;
+        
+        oss << directory << "/stat" << i;
+        paths.push_back(oss.str());
+        
+        std::ofstream out(oss.str().c_str());
+        
+        out << "   13524     5312  1489240     6188    61412    50061  2618264    98104        0    82184   104292"
+            << "        0        0        0        0     4107    13215\n";
+    }
+    
+    return paths;
+}
+
+struct MountUnmount
+{
+    void operator()()
+    {
+        Mount()();
+        Unmount()();
+    }
+};
+
+void benchmarkVolumes(int volumes)
+{
+    std::ostringstream oss;
+    
+    oss << volumes;
+    setenv("EASYTC_STUB_VOLUMES", oss.str().c_str(), 1);
+    
+    std::vector<std::string> tcOutput;
+    std::vector<std::string> mntOutput;
+    
+    for(int i = 0; i < volumes; ++i)
+    {
+        std::ostringstream tcLine;
+        std::ostringstream mntLine;
+        
+        tcLine << "/dev/mapper/truecrypt" << i << " /stub/image" << i << ".tc";
+        mntLine << "/dev/mapper/truecrypt" << i << " on /stub/mnt" << i << " type vfat (rw)";
+        tcOutput.push_back(tcLine.str());
+        mntOutput.push_back(mntLine.str());
+    }
+    
+    List list = { static_cast<size_t>(volumes) };
+    Parse parse = { &tcOutput, &mntOutput };
+    
+    std::vector<double> samples = measure(parse);
+    printRow(volumes, "parse", samples);
+    
+    samples = measure(list);
+    printRow(volumes, "list", samples);
+    
+    samples = measure(MountUnmount());
+    printRow(volumes, "mount+unm", samples);
+    
+    // mount and unmount separately, alternating so the stub state stays small
+    std::vector<double> mountSamples;
+    std::vector<double> unmountSamples;
+    
+    for(int i = 0; i < minIterations * 5; ++i)
+    {
+        long long start = monotonicMicroseconds();
+        
+        Mount()();
+        mountSamples.push_back(static_cast<double>(monotonicMicroseconds() - start));
+        
+        start = monotonicMicroseconds();
+        Unmount()();
+        unmountSamples.push_back(static_cast<double>(monotonicMicroseconds() - start));
+    }
+    
+    printRow(volumes, "mount", mountSamples);
+    printRow(volumes, "unmount", unmountSamples);
+    
+    BlockStatSampler sampler;
+    SampleStats sampleStats = { &sampler };
+    
+    sampler.setStatFiles(createStatFiles(volumes));
+    samples = measure(sampleStats);
+    printRow(volumes, "stats", samples);
+}
+
+std::string getStressPath(char const* prefix, int index)
+{
+    std::ostringstream oss;
+    
+    oss << prefix << index;
+    
+    return oss.str();
+}
+
+/**
+ * Failures the stub answers correctly, like unmounting an image that is
+ * not mounted, as opposed to races.
+ */
+bool isRefusal(std::string const& message)
+{
+    return message.find("already mapped") != std::string::npos
+           || message.find("No such volume") != std::string::npos
+           || message.find("No volumes mapped") != std::string::npos;
+}
+
+struct StressWorker
+{
+    unsigned int seed;
+    int operations;
+    int refused;
+    std::string error;
+    
+    void operator()()
+    {
+        Secret password;
+        
+        password.assign("password", 8);
+        
+        for(int i = 0; i < stressIterations && error.empty(); ++i)
+        {
+            const int image = rand_r(&seed) % stressImages;
+            const int operation = rand_r(&seed) % 20;
+            
+            try
+            {
+                if(operation < 8)
+                {
+                    mount(getStressPath("/stress/image", image), getStressPath("/stress/mnt", image), password);
+                }
+                else if(operation < 16)
+                {
+                    unmount(getStressPath("/stress/image", image).c_str());
+                }
+                else if(operation < 19)
+                {
+                    getMountInfo();
+                }
+                else
+                {
+                    unmountAll();
+                }
+            }
+            catch(std::runtime_error const& ex)
+            {
+                if(isRefusal(ex.what()))
+                {
+                    ++refused;
+                }
+                else
+                {
+                    error = ex.what();
+                }
+            }
+            
+            ++operations;
+        }
+    }
+};
+
+/**
+ * @return false if an operation failed for any other reason than being
+ *         refused by the stub
+ */
+bool stress(int threads)
+{
+    StressWorker worker = { 0, 0, 0, "" };
+    std::vector<StressWorker> workers(threads, worker);
+    
+    for(int i = 0; i < threads; ++i)
+    {
+        workers[i].seed = static_cast<unsigned int>(monotonicMicroseconds()) + i;
+    }
+    
+    const long long start = monotonicMicroseconds();
+    
+    runThreads(workers);
+    
+    const double seconds = (monotonicMicroseconds() - start) / 1e6;
+    int operations = 0;
+    int refused = 0;
+    bool passed = true;
+    
+    for(std::vector<StressWorker>::const_iterator it = workers.begin(); it != workers.end(); ++it)
+    {
+        operations += it->operations;
+        refused += it->refused;
+        
+        if(!it->error.empty())
+        {
+            std::cerr << "bench_easytc: " << it->error << std::endl;
+            passed = false;
+        }
+    }
+    
+    std::cout << std::setw(8) << threads << std::setw(12) << operations << std::setw(12) << refused
+              << std::setw(12) << seconds << std::setw(12) << operations / seconds << std::endl;
+    
+    return passed;
+}
+
+int runStress(int maxThreads)
+{
+    Environment environment;
+    bool passed = true;
+    
+    setenv("EASYTC_STUB_RACE_CHECK", "1", 1);
+    setenv("EASYTC_STUB_LATENCY_MS", "5", 1);
+    std::cout << std::fixed << std::setprecision(1);
+    std::cout << std::setw(8) << "threads" << std::setw(12) << "operations" << std::setw(12) << "refused"
+              << std::setw(12) << "seconds" << std::setw(12) << "ops/s" << std::endl;
+    
+    for(int threads = 1; threads <= maxThreads && passed; threads *= 2)
+    {
+        passed = stress(threads);
+    }
+    
+    return passed ? 0 : 1;
+}
+
+int runFill(std::string path, long long mbytes)
+{
+    const int fd = open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0600);
+    
+    if(fd == -1 || ftruncate(fd, mbytes * 1048576) == -1)
+    {
+        throw std::runtime_error(path + ": " + strerror(errno));
+    }
+    
+    close(fd);
+    std::cout << std::fixed << std::setprecision(1);
+    std::cout << std::setw(10) << "threads" << std::setw(12) << "MB/s" << std::setw(10) << "io_uring" << std::endl;
+    
+    for(int threads = 1; threads >= 0; --threads)
+    {
+        FillOptions options;
+        
+        options.threads = threads;
+        
+        const FillResult result = fillRandom(path, 0, mbytes * 1048576, options);
+        
+        std::cout << std::setw(10) << (threads > 0 ? "1" : "default") << std::setw(12) << result.mbPerSecond
+                  << std::setw(10) << (result.usedIoRing ? "yes" : "no") << std::endl;
+    }
+    
+    unlink(path.c_str());
+    
+    return 0;
+}
+
+/**
+ * Resident anonymous memory. File mappings are left out: the operation log
+ * is append-only and its mapping grows by one record per operation.
+ */
+long getAnonymousRssKBytes()
+{
+    std::ifstream in("/proc/self/status");
+    std::string line;
+    
+    while(std::getline(in, line))
+    {
+        if(line.compare(0, 8, "RssAnon:") == 0)
+        {
+            return atol(line.c_str() + 8);
+        }
+    }
+    
+    throw std::runtime_error("/proc/self/status has no RssAnon");
+}
+
+int countOpenDescriptors()
+{
+    DIR* dir = opendir("/proc/self/fd");
+    
+    if(dir == 0)
+    {
+        throw unix_error(errno);
+    }
+    
+    // not counting the descriptor the listing itself uses
+    int count = -1;
+    
+    for(struct dirent* entry = readdir(dir); entry != 0; entry = readdir(dir))
+    {
+        if(entry->d_name[0] != '.')
+        {
+            ++count;
+        }
+    }
+    
+    closedir(dir);
+    
+    return count;
+}
+
+void printSoakRow(int cycle, long rssKBytes, int descriptors, double seconds)
+{
+    std::cout << std::setw(10) << cycle << std::setw(12) << rssKBytes << std::setw(8) << descriptors
+              << std::setw(12) << seconds << std::endl;
+}
+
+int runSoak(int cycles)
+{
+    Environment environment;
+    List list = { 1 };
+    const int settled = std::max(1, cycles / 10);
+    const int rowEvery = std::max(1, cycles / soakRows);
+    const long long start = monotonicMicroseconds();
+    long baselineKBytes = 0;
+    int baselineDescriptors = 0;
+    
+    unsetenv("EASYTC_STUB_VOLUMES");
+    std::cout << std::fixed << std::setprecision(1);
+    std::cout << std::setw(10) << "cycles" << std::setw(12) << "anon KB" << std::setw(8) << "fds"
+              << std::setw(12) << "seconds" << std::endl;
+    
+    for(int cycle = 1; cycle <= cycles; ++cycle)
+    {
+        Mount()();
+        list();
+        Unmount()();
+        
+        if(cycle == settled)
+        {
+            baselineKBytes = getAnonymousRssKBytes();
+            baselineDescriptors = countOpenDescriptors();
+        }
+        
+        if(cycle % rowEvery == 0 || cycle == settled)
+        {
+            printSoakRow(cycle, getAnonymousRssKBytes(), countOpenDescriptors(),
+                         (monotonicMicroseconds() - start) / 1e6);
+        }
+    }
+    
+    const long grownKBytes = getAnonymousRssKBytes() - baselineKBytes;
+    const int grownDescriptors = countOpenDescriptors() - baselineDescriptors;
+    const bool passed = grownKBytes <= soakSlackKBytes && grownDescriptors == 0;
+    
+    std::cout << (passed ? "passed" : "FAILED") << ": " << grownKBytes << " KB and " << grownDescriptors
+              << " descriptors more than after cycle " << settled << std::endl;
+    
+    return passed ? 0 : 1;
+}
+
+int countEntry(char const*, struct stat const*, int, struct FTW*)
+{
+    return 0;
+}
+
+/**
+ * Milliseconds a serial lstat walk of the tree takes, the way a file
+ * manager or backup tool first looks at a freshly mounted volume.
+ */
+double timeWalk(std::string directory)
+{
+    const long long start = monotonicMicroseconds();
+    
+    if(nftw(directory.c_str(), countEntry, 64, FTW_PHYS | FTW_MOUNT) == -1)
+    {
+        throw std::runtime_error(directory + ": " + strerror(errno));
+    }
+    
+    return (monotonicMicroseconds() - start) / 1000.0;
+}
+
+bool dropCaches()
+{
+    sync();
+    
+    std::ofstream out("/proc/sys/vm/drop_caches");
+    
+    out << "3" << std::endl;
+    
+    return !out.fail();
+}
+
+int runWarm(std::string directory, int threads)
+{
+    if(!dropCaches())
+    {
+        std::cerr << "bench_easytc: cannot drop the caches, the cold walk runs on warm caches" << std::endl;
+    }
+    
+    const double cold = timeWalk(directory);
+    
+    dropCaches();
+    
+    WarmOptions options = getWarmOptions();
+    
+    options.threads = threads > 0 ? threads : options.threads;
+    options.budgetMillis = 3600000;
+    
+    const WarmResult result = warmCache(directory, options);
+    const double warm = timeWalk(directory);
+    
+    std::cout << std::fixed << std::setprecision(1);
+    std::cout << std::setw(16) << "cold walk ms" << std::setw(16) << "warm-up ms"
+              << std::setw(16) << "warm walk ms" << std::setw(12) << "entries" << std::endl;
+    std::cout << std::setw(16) << cold << std::setw(16) << result.seconds * 1000 << std::setw(16) << warm
+              << std::setw(12) << result.directories + result.files << std::endl;
+    
+    return 0;
+}
+
+struct FilesystemCase
+{
+    char const* name;
+    Filesystem filesystem;
+    bool journal;
+};
+
+const FilesystemCase filesystemCases[] =
+{
+    { "FAT", FilesystemFAT, true },
+    { "ext4", FilesystemExt4, true },
+    { "ext4 nojournal", FilesystemExt4, false },
+    { "xfs", FilesystemXfs, true }
+};
+
+/**
+ * The result of the test whose name starts with the prefix, the benchmark
+ * marks buffered runs with a suffix.
+ */
+BenchmarkResult const& findResult(BenchmarkResultVec const& results, std::string prefix)
+{
+    for(BenchmarkResultVec::const_iterator it = results.begin(); it != results.end(); ++it)
+    {
+        if(it->test.compare(0, prefix.size(), prefix) == 0)
+        {
+            return *it;
+        }
+    }
+    
+    throw std::runtime_error("the benchmark did not run " + prefix);
+}
+
+BenchmarkResultVec benchmarkFilesystem(FilesystemCase const& fsCase, std::string image, std::string mountPoint,
+                                       int mbytes)
+{
+    Secret password;
+    FilesystemOptions fsOptions;
+    BenchmarkOptions options;
+    
+    password.assign("bench-password", 14);
+    fsOptions.filesystem = fsCase.filesystem;
+    fsOptions.journal = fsCase.journal;
+    
+    // the test file gets a quarter of the volume, FAT caps files at 4 GB
+    options.fileMBytes = std::min(mbytes / 4, 4095);
+    options.secondsPerTest = 2;
+    options.queueDepths.clear();
+    options.queueDepths.push_back(1);
+    options.queueDepths.push_back(32);
+    
+    try
+    {
+        createImage(image, password, mbytes, fsOptions);
+        mount(image, mountPoint, password);
+    }
+    catch(...)
+    {
+        unlink(image.c_str());
+        throw;
+    }
+    
+    BenchmarkResultVec results;
+    
+    try
+    {
+        results = runBenchmark(mountPoint, options);
+    }
+    catch(...)
+    {
+        unmount(image.c_str(), mountPoint);
+        unlink(image.c_str());
+        throw;
+    }
+    
+    unmount(image.c_str(), mountPoint);
+    unlink(image.c_str());
+    
+    return results;
+}
+
+int runFilesystems(std::string directory, int mbytes)
+{
+    const std::string image = directory + "/easytc-bench-fs.tc";
+    const std::string mountPoint = directory + "/easytc-bench-fs.mnt";
+    
+    if(mkdir(mountPoint.c_str(), 0700) == -1 && errno != EEXIST)
+    {
+        throw std::runtime_error(mountPoint + ": " + strerror(errno));
+    }
+    
+    std::cout << std::fixed << std::setprecision(1);
+    std::cout << std::left << std::setw(16) << "filesystem" << std::right
+              << std::setw(14) << "write MB/s" << std::setw(14) << "read MB/s" << std::setw(14) << "4K QD32 IOPS"
+              << std::setw(14) << "create/s" << std::setw(14) << "stat/s" << std::setw(14) << "delete/s"
+              << std::endl;
+    
+    int failed = 0;
+    
+    for(size_t i = 0; i < sizeof(filesystemCases) / sizeof(filesystemCases[0]); ++i)
+    {
+        try
+        {
+            const BenchmarkResultVec results = benchmarkFilesystem(filesystemCases[i], image, mountPoint, mbytes);
+            
+            std::cout << std::left << std::setw(16) << filesystemCases[i].name << std::right
+                      << std::setw(14) << findResult(results, "seq-write").mbPerSecond
+                      << std::setw(14) << findResult(results, "seq-read").mbPerSecond
+                      << std::setw(14) << findResult(results, "rand-read 4K QD32").iops
+                      << std::setw(14) << findResult(results, "create").iops
+                      << std::setw(14) << findResult(results, "stat").iops
+                      << std::setw(14) << findResult(results, "delete").iops << std::endl;
+        }
+        catch(std::exception const& ex)
+        {
+            std::cerr << "bench_easytc: " << filesystemCases[i].name << ": " << ex.what() << std::endl;
+            ++failed;
+        }
+    }
+    
+    rmdir(mountPoint.c_str());
+    
+    return failed == 0 ? 0 : 1;
+}
+
+struct KdfVector
+{
+    char const* hash;
+    char const* key;
+};
+
+/**
+ * PBKDF2 of "password" with the salt 12345678 and 5 iterations, the first
+ * four bytes, as in the TrueCrypt self tests.
+ */
+const KdfVector kdfVectors[] =
+{
+    { "RIPEMD-160", "7a3d7c03" },
+    { "SHA-512", "1364aef8" },
+    { "Whirlpool", "507c366f" },
+    { "SHA-1", "5c75cef0" }
+};
+
+std::string toHex(unsigned char const* data, int length)
+{
+    std::ostringstream oss;
+    
+    for(int i = 0; i < length; ++i)
+    {
+        oss << std::hex << std::setw(2) << std::setfill('0') << static_cast<int>(data[i]);
+    }
+    
+    return oss.str();
+}
+
+uint32_t headerCrc32(unsigned char const* data, int length)
+{
+    uint32_t crc = 0xFFFFFFFFu;
+    
+    for(int i = 0; i < length; ++i)
+    {
+        crc ^= data[i];
+        
+        for(int bit = 0; bit < 8; ++bit)
+        {
+            crc = (crc & 1) ? (crc >> 1) ^ 0xEDB88320u : crc >> 1;
+        }
+    }
+    
+    return crc ^ 0xFFFFFFFFu;
+}
+
+void putBigEndian(unsigned char* data, unsigned long long value, int bytes)
+{
+    for(int i = bytes - 1; i >= 0; --i)
+    {
+        data[i] = static_cast<unsigned char>(value);
+        value >>= 8;
+    }
+}
+
+/**
+ * Builds a version 4 header the way truecrypt writes one: salt, then the
+ * fields and master key area encrypted with AES-XTS under the key derived
+ * from the password with the hash.
+ */
+bool buildHeader(std::string hash, Secret const& password, unsigned char* header)
+{
+    unsigned char plain[volumeHeaderSize];
+    unsigned char key[64];
+    
+    memset(plain, 0, sizeof(plain));
+    
+    for(int i = 0; i < 64; ++i)
+    {
+        plain[i] = static_cast<unsigned char>(i * 3 + 1);
+        plain[256 + i] = static_cast<unsigned char>(i * 7 + 5);
+    }
+    
+    memcpy(plain + 64, "TRUE", 4);
+    putBigEndian(plain + 68, 4, 2);
+    putBigEndian(plain + 70, 0x600, 2);
+    putBigEndian(plain + 100, 1048576, 8);
+    putBigEndian(plain + 108, 131072, 8);
+    putBigEndian(plain + 116, 1048576, 8);
+    putBigEndian(plain + 72, headerCrc32(plain + 256, 256), 4);
+    putBigEndian(plain + 252, headerCrc32(plain + 64, 188), 4);
+    
+    if(!deriveHeaderKey(hash, password, plain, 64, 0, key, sizeof(key)))
+    {
+        return false;
+    }
+    
+    EVP_CIPHER_CTX* ctx = EVP_CIPHER_CTX_new();
+    unsigned char tweak[16] = { 0 };
+    int length = 0;
+    
+    const bool ok = ctx != 0
+                    && EVP_EncryptInit_ex(ctx, EVP_aes_256_xts(), 0, key, tweak) == 1
+                    && EVP_EncryptUpdate(ctx, header + 64, &length, plain + 64, volumeHeaderSize - 64) == 1;
+    
+    EVP_CIPHER_CTX_free(ctx);
+    memcpy(header, plain, 64);
+    
+    return ok && length == volumeHeaderSize - 64;
+}
+
+bool checkKdfVectors()
+{
+    Secret password;
+    const unsigned char salt[] = { 0x12, 0x34, 0x56, 0x78 };
+    bool passed = true;
+    
+    password.assign("password", 8);
+    
+    for(size_t i = 0; i < sizeof(kdfVectors) / sizeof(kdfVectors[0]); ++i)
+    {
+        unsigned char key[4];
+        
+        std::cout << std::left << std::setw(12) << kdfVectors[i].hash << std::setw(10) << "PBKDF2" << std::right;
+        
+        if(!deriveHeaderKey(kdfVectors[i].hash, password, salt, sizeof(salt), 5, key, sizeof(key)))
+        {
+            std::cout << "not in this OpenSSL" << std::endl;
+        }
+        else if(toHex(key, sizeof(key)) == kdfVectors[i].key)
+        {
+            std::cout << "passed" << std::endl;
+        }
+        else
+        {
+            std::cout << "FAILED: " << toHex(key, sizeof(key)) << " instead of " << kdfVectors[i].key << std::endl;
+            passed = false;
+        }
+    }
+    
+    return passed;
+}
+
+bool checkHeaderVectors()
+{
+    const std::vector<std::string> hashes = getHeaderKeyHashes();
+    Secret password;
+    Secret wrongPassword;
+    bool passed = true;
+    
+    password.assign("easytc test vector", 18);
+    wrongPassword.assign("easytc test vectoR", 18);
+    
+    for(std::vector<std::string>::const_iterator it = hashes.begin(); it != hashes.end(); ++it)
+    {
+        unsigned char header[volumeHeaderSize];
+        VolumeHeaderInfo info;
+        Secret masterKey;
+        std::string failure;
+        
+        std::cout << std::left << std::setw(12) << *it << std::setw(10) << "header" << std::right;
+        
+        if(!buildHeader(*it, password, header))
+        {
+            std::cout << "not in this OpenSSL" << std::endl;
+            continue;
+        }
+        
+        if(!decryptVolumeHeader(header, password, info, &masterKey))
+        {
+            failure = "the right password did not open it";
+        }
+        else if(info.hash != *it || info.encryption != "AES" || info.version != 4 || info.hidden
+                || info.volumeSize != 1048576 || info.encryptedAreaStart != 131072
+                || info.encryptedAreaSize != 1048576)
+        {
+            failure = "wrong fields, hash " + info.hash;
+        }
+        else if(masterKey.size() != static_cast<size_t>(masterKeySize)
+                || static_cast<unsigned char>(masterKey.data()[1]) != 12)
+        {
+            failure = "wrong master key";
+        }
+        else if(decryptVolumeHeader(header, wrongPassword, info))
+        {
+            failure = "a wrong password opened it";
+        }
+        else
+        {
+            // a changed byte in the key area must fail the checksum, not just garble the key
+            header[300] ^= 1;
+            
+            if(decryptVolumeHeader(header, password, info))
+            {
+                failure = "opened with a changed key area";
+            }
+        }
+        
+        std::cout << (failure.empty() ? "passed" : "FAILED: " + failure) << std::endl;
+        passed = passed && failure.empty();
+    }
+    
+    return passed;
+}
+
+int runVectors()
+{
+    const bool kdfPassed = checkKdfVectors();
+    const bool headerPassed = checkHeaderVectors();
+    
+    return kdfPassed && headerPassed ? 0 : 1;
+}
+
+bool printCheck(char const* name, bool passed, std::string detail = "")
+{
+    std::cout << std::left << std::setw(44) << name << std::right << (passed ? "passed" : "FAILED");
+    std::cout << (detail.empty() ? "" : ", " + detail) << std::endl;
+    
+    return passed;
+}
+
+bool isWiped(char const* memory)
+{
+    for(size_t i = 0; i < Secret::capacity; ++i)
+    {
+        if(memory[i] != 0)
+        {
+            return false;
+        }
+    }
+    
+    return true;
+}
+
+/**
+ * The mount dialog hands the password over character by character and
+ * the mount task takes it over with swap, neither may allocate.
+ */
+bool checkHandOverAllocations(char const* text)
+{
+    const long before = allocations;
+    
+    {
+        Secret typed;
+        Secret taken;
+        
+        for(char const* ch = text; *ch != 0; ++ch)
+        {
+            typed.append(*ch);
+        }
+        
+        taken.swap(typed);
+    }
+    
+    const long count = allocations - before;
+    std::ostringstream oss;
+    
+    oss << count << " allocations";
+    
+    return printCheck("dialog to task without allocating", count == 0, oss.str());
+}
+
+/**
+ * Every block freed during a mount is searched for the password, after
+ * checking that the search finds a copy that is there.
+ */
+bool checkMountHeapCopies(char const* text)
+{
+    Secret password;
+    
+    password.assign(text, strlen(text));
+    scanLength = strlen(text);
+    scanNeedle = text;
+    delete new std::string(text);
+    
+    const long planted = needleBlocks;
+    
+    needleBlocks = 0;
+    
+    const long before = allocations;
+    
+    mount("/bench/secret.tc", "/bench/secret-mnt", password);
+    
+    const long count = allocations - before;
+    const long copies = needleBlocks;
+    
+    scanNeedle = 0;
+    unmount("/bench/secret.tc");
+    
+    std::ostringstream oss;
+    
+    oss << count << " allocations, " << copies << " held the password";
+    
+    return printCheck("heap copy search finds a planted copy", planted > 0)
+           && printCheck("mount leaves no password on the heap", copies == 0, oss.str());
+}
+
+bool checkWipe()
+{
+    char const* slot;
+    
+    {
+        Secret secret;
+        
+        secret.assign("wipe me on release", 18);
+        slot = secret.data();
+    }
+    
+    // the slot stays mapped in the arena after release
+    const bool released = isWiped(slot);
+    Secret secret;
+    
+    secret.assign("a longer password, then cleared", 31);
+    secret.clear();
+    
+    return printCheck("released secret reads back as zeros", released)
+           && printCheck("cleared secret reads back as zeros", isWiped(secret.data()));
+}
+
+bool checkArenaLimit()
+{
+    std::vector<Secret*> secrets;
+    std::string error;
+    
+    // the bench itself holds no secrets at this point
+    try
+    {
+        while(secrets.size() < maxSecrets)
+        {
+            secrets.push_back(new Secret());
+        }
+        
+        secrets.push_back(new Secret());
+    }
+    catch(std::runtime_error const& ex)
+    {
+        error = ex.what();
+    }
+    
+    const size_t held = secrets.size();
+    bool reused = false;
+    
+    delete secrets.back();
+    secrets.pop_back();
+    
+    try
+    {
+        secrets.push_back(new Secret());
+        reused = true;
+    }
+    catch(std::runtime_error const&)
+    {
+    }
+    
+    for(std::vector<Secret*>::const_iterator it = secrets.begin(); it != secrets.end(); ++it)
+    {
+        delete *it;
+    }
+    
+    std::ostringstream oss;
+    
+    oss << held << " held";
+    
+    return printCheck("arena grows to its limit", held == maxSecrets, oss.str())
+           && printCheck("full arena fails clearly", error.find("too many passwords") != std::string::npos, error)
+           && printCheck("released slot is taken again", reused);
+}
+
+int runSecrets()
+{
+    Environment environment;
+    char const* text = "correct horse battery staple";
+    
+    unsetenv("EASYTC_STUB_VOLUMES");
+    printCheck("arena locked into RAM", true, isSecretMemoryLocked() ? "yes" : "no, RLIMIT_MEMLOCK");
+    
+    const bool handOver = checkHandOverAllocations(text);
+    const bool heapCopies = checkMountHeapCopies(text);
+    const bool wipe = checkWipe();
+    const bool arenaLimit = checkArenaLimit();
+    
+    return handOver && heapCopies && wipe && arenaLimit ? 0 : 1;
+}
+
+std::vector<std::string> splitWords(std::string const& text)
+{
+    std::istringstream in(text);
+    std::vector<std::string> words;
+    std::string word;
+    
+    while(in >> word)
+    {
+        words.push_back(word);
+    }
+    
+    return words;
+}
+
+/**
+ * The table the dmsetup stub was last given for the device, empty if none.
+ */
+std::string getStubTable(std::string const& device)
+{
+    std::ifstream in((std::string(getenv("EASYTC_STUB_STATE")) + ".dm").c_str());
+    const std::string name = device.substr(device.rfind('/') + 1);
+    std::string entry;
+    std::string table;
+    
+    while(in >> entry && std::getline(in, table))
+    {
+        if(entry == name)
+        {
+            return table.substr(1);
+        }
+    }
+    
+    return "";
+}
+
+/**
+ * Mounts with the flags; the table must be the plain one with the flags
+ * appended as optional parameters.
+ */
+bool checkDmCryptFlags(std::string const& name, int flags, std::string const& plainTable, std::string const& key)
+{
+    char const* image = "/bench/dmflags.tc";
+    Secret password;
+    MountProfile profile;
+    
+    password.assign("dm-crypt flags", 14);
+    profile.dmCryptFlags = flags;
+    scanLength = key.size();
+    scanNeedle = key.c_str();
+    needleBlocks = 0;
+    mount(image, "/bench/dmflags-mnt", password, profile);
+    
+    const long copies = needleBlocks;
+    
+    scanNeedle = 0;
+    
+    const std::string device = getMappedDevice(image);
+    const MountInfoVec infos = getMountInfo();
+    const CryptoReportVec reports = getCryptoReports(infos);
+    int shown = -1;
+    
+    for(size_t i = 0; i < infos.size(); ++i)
+    {
+        if(infos[i].imageFile == image)
+        {
+            shown = reports[i].dmCryptFlags;
+        }
+    }
+    
+    unmount(image);
+    
+    std::ostringstream expected;
+    int count = 0;
+    
+    for(int i = 0; i < dmCryptFlagCount; ++i)
+    {
+        count += (flags & (1 << i)) != 0 ? 1 : 0;
+    }
+    
+    expected << plainTable << ' ' << count;
+    
+    for(int i = 0; i < dmCryptFlagCount; ++i)
+    {
+        if(flags & (1 << i))
+        {
+            expected << ' ' << getDmCryptFlagName(1 << i);
+        }
+    }
+    
+    const std::string table = getStubTable(device);
+    std::ostringstream oss;
+    
+    oss << copies << " held the key";
+    
+    return printCheck((name + ": reloaded table").c_str(), table == expected.str(), table == expected.str() ? "" : table)
+           && printCheck((name + ": flags shown").c_str(), shown == flags, formatDmCryptFlags(shown))
+           && printCheck((name + ": no key on the heap").c_str(), copies == 0, oss.str());
+}
+
+int runDmCryptFlags()
+{
+    Environment environment;
+    char const* image = "/bench/dmflags.tc";
+    Secret password;
+    int exitCode;
+    
+    unsetenv("EASYTC_STUB_VOLUMES");
+    password.assign("dm-crypt flags", 14);
+    
+    // the table as mapped, key included, for the checks to compare with
+    mount(image, "/bench/dmflags-mnt", password);
+    
+    const std::string device = getMappedDevice(image);
+    const std::string shown = executeCommand("dmsetup", "table", "--showkeys", device.substr(device.rfind('/') + 1),
+                                             exitCode);
+    
+    unmount(image);
+    
+    const std::vector<std::string> words = splitWords(shown);
+    
+    if(exitCode != 0 || words.size() != 8 || words[2] != "crypt")
+    {
+        throw std::runtime_error("unexpected dm table: " + shown);
+    }
+    
+    std::string plainTable = words[0];
+    
+    for(size_t i = 1; i < words.size(); ++i)
+    {
+        plainTable += " " + words[i];
+    }
+    
+    bool passed = true;
+    
+    for(int i = 0; i < dmCryptFlagCount; ++i)
+    {
+        passed = checkDmCryptFlags(getDmCryptFlagName(1 << i), 1 << i, plainTable, words[4]) && passed;
+    }
+    
+    return checkDmCryptFlags("all flags", (1 << dmCryptFlagCount) - 1, plainTable, words[4]) && passed ? 0 : 1;
+}
+
+typedef std::map<std::string, std::string> AttributeMap;
+
+void writeText(std::string const& path, std::string const& text)
+{
+    std::ofstream out(path.c_str(), std::ios::trunc);
+    
+    out << text;
+    
+    if(!out)
+    {
+        throw std::runtime_error("cannot write " + path);
+    }
+}
+
+/**
+ * The value of a sysfs attribute, the active one for the scheduler.
+ */
+std::string readAttributeValue(std::string const& path)
+{
+    std::ifstream in(path.c_str());
+    std::string value;
+    
+    std::getline(in, value);
+    
+    const std::string::size_type active = value.find('[');
+    
+    if(active != std::string::npos)
+    {
+        value = value.substr(active + 1, value.find(']', active) - active - 1);
+    }
+    
+    return value;
+}
+
+/**
+ * Builds <root>/class/block/dm-7 with loop3 as its slave, the way a
+ * mounted image looks, and a /dev/mapper link resolving to dm-7. Returns
+ * the original value of every attribute by path.
+ */
+AttributeMap createSysfsTree(std::string const& root, std::string const& devices)
+{
+    static char const* const files[][3] =
+    {
+        { "dm-7", "read_ahead_kb", "128\n" },
+        { "dm-7", "max_sectors_kb", "1280\n" },
+        { "dm-7", "scheduler", "none\n" },
+        { "loop3", "read_ahead_kb", "128\n" },
+        { "loop3", "nr_requests", "64\n" },
+        { "loop3", "max_sectors_kb", "1280\n" },
+        { "loop3", "scheduler", "[mq-deadline] none\n" }
+    };
+    
+    std::vector<std::string> args;
+    int exitCode;
+    
+    args.push_back("-p");
+    args.push_back(root + "/class/block/dm-7/queue");
+    args.push_back(root + "/class/block/dm-7/slaves/loop3");
+    args.push_back(root + "/class/block/loop3/queue");
+    args.push_back(devices + "/mapper");
+    
+    const std::string output = executeCommand("mkdir", args, exitCode);
+    
+    if(exitCode != 0)
+    {
+        throw std::runtime_error(output);
+    }
+    
+    AttributeMap originals;
+    
+    for(size_t i = 0; i < sizeof(files) / sizeof(files[0]); ++i)
+    {
+        const std::string path = root + "/class/block/" + files[i][0] + "/queue/" + files[i][1];
+        
+        writeText(path, files[i][2]);
+        originals[path] = readAttributeValue(path);
+    }
+    
+    writeText(devices + "/dm-7", "");
+    unix_error::check(symlink((devices + "/dm-7").c_str(), (devices + "/mapper/truecrypt7").c_str()));
+    
+    return originals;
+}
+
+/**
+ * The values saved for reverting, by path.
+ */
+AttributeMap readSavedSettings(std::string const& image)
+{
+    std::ifstream in((getDataDirectory() + "/tuning-saved").c_str());
+    std::string line;
+    AttributeMap saved;
+    
+    while(std::getline(in, line))
+    {
+        const std::string::size_type first = line.find('\t');
+        const std::string::size_type second = line.find('\t', first + 1);
+        
+        if(second != std::string::npos && line.substr(0, first) == image)
+        {
+            saved[line.substr(first + 1, second - first - 1)] = line.substr(second + 1);
+        }
+    }
+    
+    return saved;
+}
+
+/**
+ * Compares the attributes with the values, listing those that differ.
+ */
+std::string findMismatches(AttributeMap const& expected)
+{
+    std::string mismatches;
+    
+    for(AttributeMap::const_iterator it = expected.begin(); it != expected.end(); ++it)
+    {
+        const std::string value = readAttributeValue(it->first);
+        
+        if(value != it->second)
+        {
+            mismatches += (mismatches.empty() ? "" : ", ") + it->first + "=" + value;
+        }
+    }
+    
+    return mismatches;
+}
+
+/**
+ * The values the tuning writes into the tree, settings a device lacks left
+ * out.
+ */
+AttributeMap getTunedValues(AttributeMap const& originals, QueueTuning const& tuning)
+{
+    std::istringstream in(formatQueueTuning(tuning));
+    std::string setting;
+    AttributeMap values;
+    
+    while(in >> setting)
+    {
+        const std::string::size_type equals = setting.find('=');
+        const std::string name = "/" + setting.substr(0, equals);
+        
+        for(AttributeMap::const_iterator it = originals.begin(); it != originals.end(); ++it)
+        {
+            const std::string::size_type start = it->first.size() - name.size();
+            
+            if(it->first.size() > name.size() && it->first.compare(start, name.size(), name) == 0)
+            {
+                values[it->first] = setting.substr(equals + 1);
+            }
+        }
+    }
+    
+    return values;
+}
+
+int runTuning()
+{
+    Environment environment;
+    const std::string root = environment.directory + "/sys";
+    const std::string devices = environment.directory + "/dev";
+    const std::string image = "/bench/tuned.tc";
+    const AttributeMap originals = createSysfsTree(root, devices);
+    const std::string device = devices + "/mapper/truecrypt7";
+    const QueueTuning random = getQueueTuning("Random small I/O");
+    const QueueTuning streaming = getQueueTuning("Sequential streaming");
+    struct stat st;
+    
+    setSysfsRoot(root);
+    applyQueueTuning(image, device, random);
+    
+    const std::string applied = findMismatches(getTunedValues(originals, random));
+    const bool missingSkipped = stat((root + "/class/block/dm-7/queue/nr_requests").c_str(), &st) == -1;
+    const bool saved = readSavedSettings(image) == originals;
+    
+    // a second tuning over the first must keep the values found first
+    applyQueueTuning(image, device, streaming);
+    
+    const std::string reapplied = findMismatches(getTunedValues(originals, streaming));
+    const bool savedKept = readSavedSettings(image) == originals;
+    
+    revertQueueTuning(image);
+    
+    const std::string reverted = findMismatches(originals);
+    const bool forgotten = readSavedSettings(image).empty();
+    
+    setSysfsRoot("/sys");
+    
+    const bool passed = printCheck("tuning written to dm and loop queues", applied.empty(), applied)
+                        & printCheck("missing attribute skipped", missingSkipped)
+                        & printCheck("replaced values saved", saved)
+                        & printCheck("second tuning written", reapplied.empty(), reapplied)
+                        & printCheck("second tuning keeps the first values", savedKept)
+                        & printCheck("revert restores the values", reverted.empty(), reverted)
+                        & printCheck("revert forgets the saved values", forgotten);
+    
+    return passed ? 0 : 1;
+}
+
+int runVolumes(int maxVolumes)
+{
+    Environment environment;
+    
+    std::cout << std::fixed << std::setprecision(1);
+    std::cout << std::setw(8) << "volumes" << "  " << std::left << std::setw(10) << "operation" << std::right
+              << std::setw(8) << "runs" << std::setw(12) << "mean us"
+              << std::setw(12) << "p50 us" << std::setw(12) << "p99 us" << std::endl;
+    
+    for(int volumes = 1; volumes <= maxVolumes; volumes *= 10)
+    {
+        benchmarkVolumes(volumes);
+    }
+    
+    return 0;
+}
+
+int runMode(int argc, char* argv[])
+{
+    const std::string mode = argc > 1 ? argv[1] : "";
+    
+    if(mode == "--stress")
+    {
+        return runStress(argc > 2 ? atoi(argv[2]) : 16);
+    }
+    else if(mode == "--fill" && argc > 2)
+    {
+        return runFill(argv[2], argc > 3 ? atoll(argv[3]) : 1024);
+    }
+    else if(mode == "--warm" && argc > 2)
+    {
+        return runWarm(argv[2], argc > 3 ? atoi(argv[3]) : 0);
+    }
+    else if(mode == "--soak")
+    {
+        return runSoak(argc > 2 ? atoi(argv[2]) : 100000);
+    }
+    else if(mode == "--filesystems" && argc > 2)
+    {
+        return runFilesystems(argv[2], argc > 3 ? atoi(argv[3]) : 512);
+    }
+    else if(mode == "--vectors")
+    {
+        return runVectors();
+    }
+    else if(mode == "--secrets")
+    {
+        return runSecrets();
+    }
+    else if(mode == "--dmflags")
+    {
+        return runDmCryptFlags();
+    }
+    else if(mode == "--tuning")
+    {
+        return runTuning();
+    }
+    else if(mode.compare(0, 2, "--") == 0)
+    {
+        throw std::runtime_error("unknown mode or missing argument: " + mode);
+    }
+    
+    return runVolumes(argc > 1 ? atoi(argv[1]) : 10000);
+}
+
+} // namespace <unnamed>
+
+int main(int argc, char* argv[])
+{
+    try
+    {
+        return runMode(argc, argv);
+    }
+    catch(std::exception const& ex)
+    {
+        std::cerr << "bench_easytc: " << ex.what() << std::endl;
+        return 1;
+    }
+}
@@ -0,0 +1,269 @@
+/**
+ * Copyright (c) 2007, Emir Uner
+ * All rights reserved.
+ * 
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ * 
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/**
+ * Stand-in for dmsetup(8). "dmsetup table" lists a crypt target for every
+ * stub volume, with the cipher from EASYTC_STUB_CIPHER (aes-xts-plain64 by
+ * default). "table --showkeys <name>", "reload <name>" with the table on
+ * standard input and "resume <name>" work on single volumes; reloaded
+ * tables live in the ".dm" file next to the state, waiting ones in
+ * ".dm.inactive", as "name table" lines.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <iostream>
+#include <map>
+
+#include "StubState.hpp"
+
+namespace
+{
+
+const char stubKey[] = "6b6579206f66207468652073747562206465766963652c206e6f7420736563726574207265616c6c79206e6f7221";
+
+typedef std::map<std::string, std::string> TableMap;
+
+std::string getTablePath(char const* suffix)
+{
+    return getenv("EASYTC_STUB_STATE") != 0 ? std::string(getenv("EASYTC_STUB_STATE")) + suffix : "";
+}
+
+TableMap readTables(char const* suffix)
+{
+    TableMap tables;
+    std::ifstream in(getTablePath(suffix).c_str());
+    std::string name;
+    std::string table;
+    
+    while(in >> name && std::getline(in, table))
+    {
+        tables[name] = table.substr(1);
+    }
+    
+    return tables;
+}
+
+void writeTables(char const* suffix, TableMap const& tables)
+{
+    std::ofstream out(getTablePath(suffix).c_str(), std::ios::trunc);
+    
+    for(TableMap::const_iterator it = tables.begin(); it != tables.end(); ++it)
+    {
+        out << it->first << ' ' << it->second << '\n';
+    }
+}
+
+std::string getName(std::string const& device)
+{
+    return device.substr(device.rfind('/') + 1);
+}
+
+std::string getDefaultTable(int minor, bool showKeys)
+{
+    char const* cipher = getenv("EASYTC_STUB_CIPHER") != 0 ? getenv("EASYTC_STUB_CIPHER") : "aes-xts-plain64";
+    std::ostringstream oss;
+    
+    oss << "0 2097152 crypt " << cipher << ' ' << (showKeys ? stubKey : std::string(sizeof(stubKey) - 1, '0'))
+        << " 256 7:" << minor << " 256";
+    
+    return oss.str();
+}
+
+/**
+ * The loaded table with the key hidden unless asked for, like dmsetup.
+ */
+std::string getTable(TableMap const& tables, std::string const& name, int minor, bool showKeys)
+{
+    TableMap::const_iterator it = tables.find(name);
+    
+    if(it == tables.end())
+    {
+        return getDefaultTable(minor, showKeys);
+    }
+    
+    std::string table = it->second;
+    const std::string::size_type key = table.find(stubKey);
+    
+    if(!showKeys && key != std::string::npos)
+    {
+        table.replace(key, sizeof(stubKey) - 1, std::string(sizeof(stubKey) - 1, '0'));
+    }
+    
+    return table;
+}
+
+/**
+ * Lists the devices as "name minor".
+ */
+std::vector<std::pair<std::string, int> > getDevices()
+{
+    const int synthetic = getStubSetting("EASYTC_STUB_VOLUMES", 0);
+    const StubVolumeVec volumes = readStubState();
+    std::vector<std::pair<std::string, int> > devices;
+    
+    for(int i = 0; i < synthetic; ++i)
+    {
+        devices.push_back(std::make_pair(getName(getSyntheticDevice(i)), i));
+    }
+    
+    for(StubVolumeVec::const_iterator it = volumes.begin(); it != volumes.end(); ++it)
+    {
+        devices.push_back(std::make_pair(getName(it->device), static_cast<int>(it - volumes.begin()) + synthetic));
+    }
+    
+    return devices;
+}
+
+int table(std::vector<std::string> const& args)
+{
+    const bool showKeys = args.size() > 1 && args[1] == "--showkeys";
+    const std::string only = args.size() > (showKeys ? 2u : 1u) ? args.back() : "";
+    const std::vector<std::pair<std::string, int> > devices = getDevices();
+    const TableMap tables = readTables(".dm");
+    
+    if(devices.empty() && only.empty())
+    {
+        printf("No devices found\n");
+        return 0;
+    }
+    
+    for(std::vector<std::pair<std::string, int> >::const_iterator it = devices.begin(); it != devices.end(); ++it)
+    {
+        const std::string table = getTable(tables, it->first, it->second, showKeys);
+        
+        if(only.empty())
+        {
+            printf("%s: %s\n", it->first.c_str(), table.c_str());
+        }
+        else if(only == it->first)
+        {
+            printf("%s\n", table.c_str());
+            return 0;
+        }
+    }
+    
+    if(!only.empty())
+    {
+        printf("device-mapper: table ioctl on %s failed: No such device or address\n", only.c_str());
+        return 1;
+    }
+    
+    return 0;
+}
+
+/**
+ * Accepts a single crypt line whose parameter count is right.
+ */
+bool isValidTable(std::string const& table)
+{
+    std::istringstream in(table);
+    std::vector<std::string> words;
+    std::string word;
+    
+    while(in >> word)
+    {
+        words.push_back(word);
+    }
+    
+    return (words.size() == 8 || (words.size() > 9 && atoi(words[8].c_str()) == static_cast<int>(words.size()) - 9))
+           && words[2] == "crypt";
+}
+
+int reload(std::string const& name)
+{
+    std::string table;
+    
+    std::getline(std::cin, table);
+    
+    if(!isValidTable(table))
+    {
+        printf("device-mapper: reload ioctl on %s failed: Invalid argument\n", name.c_str());
+        return 1;
+    }
+    
+    TableMap inactive = readTables(".dm.inactive");
+    
+    inactive[name] = table;
+    writeTables(".dm.inactive", inactive);
+    
+    return 0;
+}
+
+int resume(std::string const& name)
+{
+    TableMap inactive = readTables(".dm.inactive");
+    TableMap::iterator it = inactive.find(name);
+    
+    if(it != inactive.end())
+    {
+        TableMap tables = readTables(".dm");
+        
+        tables[name] = it->second;
+        inactive.erase(it);
+        writeTables(".dm", tables);
+        writeTables(".dm.inactive", inactive);
+    }
+    
+    return 0;
+}
+
+} // namespace <unnamed>
+
+int main(int argc, char* argv[])
+{
+    stubDelay();
+    
+    std::vector<std::string> args(argv + 1, argv + argc);
+    
+    StubStateLock lock;
+    
+    if(!args.empty() && args[0] == "table")
+    {
+        return table(args);
+    }
+    
+    if(getenv("EASYTC_STUB_STATE") == 0 || args.empty())
+    {
+        fprintf(stderr, "dmsetup stub: EASYTC_STUB_STATE and a command are needed\n");
+        return 2;
+    }
+    
+    if(args[0] == "reload" && args.size() == 2)
+    {
+        return reload(args[1]);
+    }
+    
+    if(args[0] == "resume" && args.size() == 2)
+    {
+        return resume(args[1]);
+    }
+    
+    fprintf(stderr, "dmsetup stub: unsupported arguments\n");
+    return 2;
+}
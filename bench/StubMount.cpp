@@ -0,0 +1,69 @@
+/**
+ * Copyright (c) 2007, Emir Uner
+ * All rights reserved.
+ * 
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ * 
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/**
+ * Stand-in for mount(8) without arguments: lists the mounted stub volumes
+ * among a configurable number of unrelated filesystems.
+ */
+
+#include <stdio.h>
+
+#include "StubState.hpp"
+
+int main()
+{
+    stubDelay();
+    
+    const int unrelated = getStubSetting("EASYTC_STUB_MOUNTS", 30);
+    const int synthetic = getStubSetting("EASYTC_STUB_VOLUMES", 0);
+    StubVolumeVec volumes;
+    
+    {
+        StubStateLock lock;
+        
+        volumes = readStubState();
+    }
+    
+    for(int i = 0; i < unrelated; ++i)
+    {
+        printf("tmpfs on /run/stub%d type tmpfs (rw,nosuid,nodev)\n", i);
+    }
+    
+    for(int i = 0; i < synthetic; ++i)
+    {
+        printf("%s on /stub/mnt%d type vfat (rw)\n", getSyntheticDevice(i).c_str(), i);
+    }
+    
+    for(StubVolumeVec::const_iterator it = volumes.begin(); it != volumes.end(); ++it)
+    {
+        if(it->mountPoint != "-")
+        {
+            printf("%s on %s type vfat (%s)\n", it->device.c_str(), it->mountPoint.c_str(), it->options.c_str());
+        }
+    }
+    
+    return 0;
+}
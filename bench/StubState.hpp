@@ -0,0 +1,283 @@
+/**
+ * Copyright (c) 2007, Emir Uner
+ * All rights reserved.
+ * 
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ * 
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef EASYTC_STUBSTATE_HPP_INCLUDED
+#define EASYTC_STUBSTATE_HPP_INCLUDED
+
+#include <fcntl.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/file.h>
+
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+/**
+ * State shared by the stub truecrypt and mount executables. Mapped volumes
+ * live in the file named by EASYTC_STUB_STATE, one "device image mountpoint
+ * options" line each (mount point "-" when only mapped). The stubs are configured through the
+ * environment:
+ *
+ *   EASYTC_STUB_STATE       state file, required
+ *   EASYTC_STUB_VOLUMES     synthetic volumes that are always mapped and mounted
+ *   EASYTC_STUB_LATENCY_MS  delay before every stub answers
+ *   EASYTC_STUB_OUTPUT      bytes of chatter printed by mount/unmount/create
+ *   EASYTC_STUB_MOUNTS      unrelated filesystems listed by mount
+ *   EASYTC_STUB_RACE_CHECK  fail operations that overlap conflicting ones
+ *   EASYTC_STUB_CIPHER      cipher dmsetup reports for every volume
+ */
+struct StubVolume
+{
+    std::string device;
+    std::string image;
+    std::string mountPoint;
+    std::string options;
+};
+
+typedef std::vector<StubVolume> StubVolumeVec;
+
+inline int getStubSetting(char const* name, int defaultValue)
+{
+    char const* value = getenv(name);
+    
+    return value != 0 ? atoi(value) : defaultValue;
+}
+
+inline void stubDelay()
+{
+    const int millis = getStubSetting("EASYTC_STUB_LATENCY_MS", 0);
+    
+    if(millis > 0)
+    {
+        struct timespec ts;
+        
+        ts.tv_sec = millis / 1000;
+        ts.tv_nsec = (millis % 1000) * 1000000L;
+        nanosleep(&ts, 0);
+    }
+}
+
+inline std::string getSyntheticDevice(int index)
+{
+    std::ostringstream oss;
+    
+    oss << "/dev/mapper/truecrypt" << index;
+    
+    return oss.str();
+}
+
+/**
+ * Holds an exclusive lock on the state file while alive.
+ */
+class StubStateLock
+{
+    int fd;
+    
+public:
+    StubStateLock()
+    : fd(-1)
+    {
+        char const* path = getenv("EASYTC_STUB_STATE");
+        
+        if(path != 0)
+        {
+            fd = open((std::string(path) + ".lock").c_str(), O_RDWR | O_CREAT, 0600);
+            
+            if(fd != -1)
+            {
+                flock(fd, LOCK_EX);
+            }
+        }
+    }
+    
+    ~StubStateLock()
+    {
+        if(fd != -1)
+        {
+            close(fd);
+        }
+    }
+};
+
+inline StubVolumeVec readStubState()
+{
+    StubVolumeVec volumes;
+    char const* path = getenv("EASYTC_STUB_STATE");
+    
+    if(path == 0)
+    {
+        return volumes;
+    }
+    
+    std::ifstream in(path);
+    StubVolume volume;
+    
+    while(in >> volume.device >> volume.image >> volume.mountPoint >> volume.options)
+    {
+        volumes.push_back(volume);
+    }
+    
+    return volumes;
+}
+
+inline void writeStubState(StubVolumeVec const& volumes)
+{
+    char const* path = getenv("EASYTC_STUB_STATE");
+    
+    if(path == 0)
+    {
+        return;
+    }
+    
+    std::ofstream out(path, std::ios::trunc);
+    
+    for(StubVolumeVec::const_iterator it = volumes.begin(); it != volumes.end(); ++it)
+    {
+        out << it->device << ' ' << it->image << ' ' << it->mountPoint << ' ' << it->options << '\n';
+    }
+}
+
+/**
+ * Registers a running truecrypt operation in the ".active" file next to
+ * the state while alive. With EASYTC_STUB_RACE_CHECK set an operation
+ * that overlaps a conflicting one, which easytc should have ordered, exits
+ * with an error instead. The key is the image, "*" for all volumes or ""
+ * for a listing, which only conflicts with "*".
+ */
+class StubActiveOperation
+{
+    std::string path;
+    
+    static bool conflicts(std::string const& a, std::string const& b)
+    {
+        return a == "*" || b == "*" || (!a.empty() && a == b);
+    }
+    
+    static std::vector<std::string> readLines(std::string const& path)
+    {
+        std::vector<std::string> lines;
+        std::ifstream in(path.c_str());
+        std::string line;
+        
+        while(std::getline(in, line))
+        {
+            lines.push_back(line);
+        }
+        
+        return lines;
+    }
+    
+    static void writeLines(std::string const& path, std::vector<std::string> const& lines)
+    {
+        std::ofstream out(path.c_str(), std::ios::trunc);
+        
+        for(std::vector<std::string>::const_iterator it = lines.begin(); it != lines.end(); ++it)
+        {
+            out << *it << '\n';
+        }
+    }
+    
+public:
+    explicit StubActiveOperation(std::string const& key)
+    {
+        char const* statePath = getenv("EASYTC_STUB_STATE");
+        
+        if(statePath == 0 || getStubSetting("EASYTC_STUB_RACE_CHECK", 0) == 0)
+        {
+            return;
+        }
+        
+        StubStateLock lock;
+        std::vector<std::string> lines = readLines(std::string(statePath) + ".active");
+        std::vector<std::string> alive;
+        
+        for(std::vector<std::string>::const_iterator it = lines.begin(); it != lines.end(); ++it)
+        {
+            const std::string::size_type space = it->find(' ');
+            const pid_t pid = atoi(it->c_str());
+            
+            // operations of stubs that died do not count
+            if(space == std::string::npos || kill(pid, 0) == -1)
+            {
+                continue;
+            }
+            
+            if(conflicts(it->substr(space + 1), key))
+            {
+                printf("truecrypt stub: overlapping operations on %s\n", key.empty() ? "the list" : key.c_str());
+                exit(3);
+            }
+            
+            alive.push_back(*it);
+        }
+        
+        std::ostringstream oss;
+        
+        oss << getpid() << ' ' << key;
+        alive.push_back(oss.str());
+        path = std::string(statePath) + ".active";
+        writeLines(path, alive);
+    }
+    
+    ~StubActiveOperation()
+    {
+        if(path.empty())
+        {
+            return;
+        }
+        
+        StubStateLock lock;
+        std::vector<std::string> lines = readLines(path);
+        std::vector<std::string> others;
+        
+        for(std::vector<std::string>::const_iterator it = lines.begin(); it != lines.end(); ++it)
+        {
+            if(atoi(it->c_str()) != getpid())
+            {
+                others.push_back(*it);
+            }
+        }
+        
+        writeLines(path, others);
+    }
+};
+
+inline void printStubChatter()
+{
+    const int bytes = getStubSetting("EASYTC_STUB_OUTPUT", 0);
+    
+    for(int i = 0; i < bytes; ++i)
+    {
+        putchar(i % 64 == 63 ? '\n' : '.');
+    }
+}
+
+#endif
@@ -0,0 +1,275 @@
+/**
+ * Copyright (c) 2007, Emir Uner
+ * All rights reserved.
+ * 
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ * 
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/**
+ * Stand-in for the truecrypt executable. Understands the command lines
+ * easytc produces and keeps mapped volumes in the stub state file.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <algorithm>
+
+#include "StubState.hpp"
+
+namespace
+{
+
+int list()
+{
+    const int synthetic = getStubSetting("EASYTC_STUB_VOLUMES", 0);
+    StubVolumeVec volumes = readStubState();
+    
+    if(synthetic == 0 && volumes.empty())
+    {
+        printf("No volumes mapped\n");
+        return 1;
+    }
+    
+    for(int i = 0; i < synthetic; ++i)
+    {
+        printf("%s /stub/image%d.tc\n", getSyntheticDevice(i).c_str(), i);
+    }
+    
+    for(StubVolumeVec::const_iterator it = volumes.begin(); it != volumes.end(); ++it)
+    {
+        printf("%s %s\n", it->device.c_str(), it->image.c_str());
+    }
+    
+    return 0;
+}
+
+int dismount(char const* image)
+{
+    StubVolumeVec volumes = readStubState();
+    StubVolumeVec remaining;
+    
+    for(StubVolumeVec::const_iterator it = volumes.begin(); it != volumes.end(); ++it)
+    {
+        if(image != 0 && it->image != image && it->device != image)
+        {
+            remaining.push_back(*it);
+        }
+    }
+    
+    if(image != 0 && remaining.size() == volumes.size())
+    {
+        printf("No such volume is mapped\n");
+        return 1;
+    }
+    
+    writeStubState(remaining);
+    printStubChatter();
+    
+    return 0;
+}
+
+int map(char const* password, char const* image, char const* mountPoint, std::string options)
+{
+    StubVolumeVec volumes = readStubState();
+    
+    if(password[0] == '\0')
+    {
+        printf("Incorrect password or not a TrueCrypt volume\n");
+        return 1;
+    }
+    
+    for(StubVolumeVec::const_iterator it = volumes.begin(); it != volumes.end(); ++it)
+    {
+        if(it->image == image)
+        {
+            printf("Volume already mapped\n");
+            return 1;
+        }
+    }
+    
+    // synthetic volumes take the low device numbers
+    int index = getStubSetting("EASYTC_STUB_VOLUMES", 0);
+    bool used = true;
+    
+    while(used)
+    {
+        used = false;
+        
+        for(StubVolumeVec::const_iterator it = volumes.begin(); it != volumes.end(); ++it)
+        {
+            if(it->device == getSyntheticDevice(index))
+            {
+                used = true;
+                ++index;
+                break;
+            }
+        }
+    }
+    
+    StubVolume volume;
+    
+    volume.device = getSyntheticDevice(index);
+    volume.image = image;
+    volume.mountPoint = mountPoint != 0 ? mountPoint : "-";
+    volume.options = options;
+    volumes.push_back(volume);
+    
+    writeStubState(volumes);
+    printStubChatter();
+    
+    return 0;
+}
+
+/**
+ * Returns what the operation works on, as StubActiveOperation wants it.
+ */
+std::string getOperationKey(std::vector<std::string> const& args)
+{
+    if(args.size() == 1 && args[0] == "-l")
+    {
+        return "";
+    }
+    
+    if(args.size() >= 1 && args[0] == "-d")
+    {
+        return args.size() > 1 ? args[1] : "*";
+    }
+    
+    if(std::find(args.begin(), args.end(), "--create") != args.end())
+    {
+        return args.back();
+    }
+    
+    for(std::vector<std::string>::size_type i = 0; i < args.size(); ++i)
+    {
+        if(args[i] == "--mount-options")
+        {
+            ++i;
+        }
+        else if(args[i].compare(0, 2, "--") != 0)
+        {
+            return args[i];
+        }
+    }
+    
+    return "";
+}
+
+/**
+ * Creates the container as a sparse file of the size asked for, e.g.
+ * "--size 100M", so that easytc can go on to fill or map it.
+ */
+int create(std::vector<std::string> const& args)
+{
+    std::vector<std::string>::const_iterator size = std::find(args.begin(), args.end(), "--size");
+    const long long bytes = size != args.end() && size + 1 != args.end() ? atoll((size + 1)->c_str()) * 1048576 : 0;
+    const int fd = open(args.back().c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0600);
+    
+    if(fd == -1 || ftruncate(fd, bytes) == -1)
+    {
+        fprintf(stderr, "truecrypt stub: could not create %s\n", args.back().c_str());
+        
+        if(fd != -1)
+        {
+            close(fd);
+        }
+        
+        return 1;
+    }
+    
+    close(fd);
+    printStubChatter();
+    
+    return 0;
+}
+
+} // namespace <unnamed>
+
+int main(int argc, char* argv[])
+{
+    std::vector<std::string> args(argv + 1, argv + argc);
+    StubActiveOperation active(getOperationKey(args));
+    
+    stubDelay();
+    
+    StubStateLock lock;
+    
+    if(args.size() == 1 && args[0] == "-l")
+    {
+        return list();
+    }
+    
+    if(args.size() >= 1 && args[0] == "-d")
+    {
+        return dismount(args.size() > 1 ? argv[2] : 0);
+    }
+    
+    for(std::vector<std::string>::const_iterator it = args.begin(); it != args.end(); ++it)
+    {
+        if(*it == "--create")
+        {
+            return create(args);
+        }
+    }
+    
+    // mount flags come before the image
+    std::string options = "rw";
+    std::vector<std::string>::size_type first = 0;
+    
+    while(first < args.size() && args[first].compare(0, 2, "--") == 0)
+    {
+        if(args[first] == "--read-only")
+        {
+            options = "ro";
+        }
+        else if(args[first] == "--mount-options" && first + 1 < args.size())
+        {
+            options += "," + args[++first];
+        }
+        else
+        {
+            break;
+        }
+        
+        ++first;
+    }
+    
+    const std::vector<std::string>::size_type rest = args.size() - first;
+    
+    if(rest == 1 || rest == 2)
+    {
+        // the password is answered to the prompt on standard input
+        char password[256] = "";
+        
+        if(fgets(password, sizeof(password), stdin) != 0)
+        {
+            password[strcspn(password, "\n")] = '\0';
+        }
+        
+        return map(password, args[first].c_str(), rest == 2 ? args[first + 1].c_str() : 0, options);
+    }
+    
+    fprintf(stderr, "truecrypt stub: unsupported arguments\n");
+    return 2;
+}
@@ -0,0 +1,402 @@
+/**
+ * Copyright (c) 2007, Emir Uner
+ * All rights reserved.
+ * 
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ * 
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "AutoMounter.hpp"
+#include "Config.hpp"
+#include "OperationLog.hpp"
+#include "Posix.hpp"
+#include "TrueCryptTasks.hpp"
+
+#include <dirent.h>
+#include <fcntl.h>
+#include <time.h>
+#include <sys/stat.h>
+
+#include <stdexcept>
+
+namespace
+{
+
+void readPasswordFile(std::string path, Secret& password)
+{
+    struct stat st;
+    
+    if(stat(path.c_str(), &st) == -1)
+    {
+        throw std::runtime_error(path + ": " + strerror(errno));
+    }
+    
+    if((st.st_mode & 077) != 0)
+    {
+        throw std::runtime_error(path + " must not be accessible by group or others");
+    }
+    
+    // read with plain read(2) so the password only lands in the secret
+    const int fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    char ch;
+    
+    if(fd == -1)
+    {
+        throw std::runtime_error(path + ": " + strerror(errno));
+    }
+    
+    password.clear();
+    
+    try
+    {
+        while(read(fd, &ch, 1) == 1 && ch != '\n')
+        {
+            password.append(ch);
+        }
+    }
+    catch(...)
+    {
+        close(fd);
+        throw;
+    }
+    
+    close(fd);
+}
+
+std::string getMountName(std::string image)
+{
+    std::string name = image.substr(image.rfind('/') + 1);
+    const std::string::size_type dot = name.rfind('.');
+    
+    return dot != std::string::npos && dot > 0 ? name.substr(0, dot) : name;
+}
+
+} // namespace <unnamed>
+
+AutoMounter::AutoMounter(TaskScheduler& schedulerp, QObject* parent)
+: QObject(parent), scheduler(schedulerp), watcher(0), notifier(0), quietMillis(2000), lastRead(0)
+{
+    timer.setSingleShot(true);
+    
+    QObject::connect(&timer, SIGNAL(timeout()), this, SLOT(mountSettledImages()));
+}
+
+AutoMounter::~AutoMounter()
+{
+    stop();
+}
+
+void AutoMounter::start()
+{
+    stop();
+    
+    Config config(getConfigPath("automount.conf"));
+    std::vector<std::string> directories = config.getAll("", "watch");
+    
+    mountRoot = config.get("", "mountroot");
+    passwordFile = config.get("", "passwordfile");
+    extensions = config.getAll("", "extension");
+    quietMillis = config.getInt("", "quiet", 2000);
+    profile = getMountProfile(config.get("", "profile", MountProfile().name));
+    
+    if(directories.empty() || mountRoot.empty() || passwordFile.empty())
+    {
+        throw std::runtime_error("automount.conf needs watch, mountroot and passwordfile entries");
+    }
+    
+    // fail early on a bad password file rather than on the first image
+    Secret password;
+    
+    readPasswordFile(passwordFile, password);
+    
+    watcher = new DirectoryWatcher();
+    
+    try
+    {
+        for(std::vector<std::string>::const_iterator it = directories.begin(); it != directories.end(); ++it)
+        {
+            watcher->addDirectory(*it);
+        }
+    }
+    catch(...)
+    {
+        delete watcher;
+        watcher = 0;
+        throw;
+    }
+    
+    lastRead = time(0);
+    notifier = new QSocketNotifier(watcher->getFd(), QSocketNotifier::Read, this);
+    
+    QObject::connect(notifier, SIGNAL(activated(int)), this, SLOT(readEvents()));
+}
+
+void AutoMounter::stop()
+{
+    timer.stop();
+    pending.clear();
+    
+    delete notifier;
+    notifier = 0;
+    
+    delete watcher;
+    watcher = 0;
+}
+
+bool AutoMounter::isImageName(std::string path) const
+{
+    const std::string name = path.substr(path.rfind('/') + 1);
+    
+    if(name.empty() || name[0] == '.')
+    {
+        return false;
+    }
+    
+    if(extensions.empty())
+    {
+        return true;
+    }
+    
+    for(std::vector<std::string>::const_iterator it = extensions.begin(); it != extensions.end(); ++it)
+    {
+        if(name.size() > it->size() && name.compare(name.size() - it->size(), it->size(), *it) == 0)
+        {
+            return true;
+        }
+    }
+    
+    return false;
+}
+
+void AutoMounter::addPending(std::string path, struct stat const& st, long long time, bool complete)
+{
+    PendingImage& image = pending[path];
+    
+    image.lastEvent = time;
+    image.size = st.st_size;
+    image.mtime = st.st_mtime;
+    
+    if(complete)
+    {
+        image.complete = true;
+        image.closeTime = time;
+    }
+    else
+    {
+        // a new writer, wait for it to close the file
+        image.complete = false;
+    }
+}
+
+/**
+ * Finds the images changed since the given time after inotify dropped
+ * events. Whether their writers are done is unknown, the quiet period and
+ * the size and mtime checks have to tell.
+ */
+void AutoMounter::rescanDirectories(time_t since)
+{
+    const std::vector<std::string> directories = watcher->getDirectories();
+    const long long now = monotonicMicroseconds();
+    
+    for(std::vector<std::string>::const_iterator it = directories.begin(); it != directories.end(); ++it)
+    {
+        DIR* dir = opendir(it->c_str());
+        
+        if(dir == 0)
+        {
+            continue;
+        }
+        
+        for(struct dirent* entry = readdir(dir); entry != 0; entry = readdir(dir))
+        {
+            const std::string path = *it + "/" + entry->d_name;
+            struct stat st;
+            
+            if(isImageName(path) && stat(path.c_str(), &st) == 0 && S_ISREG(st.st_mode) && st.st_mtime >= since
+               && pending.find(path) == pending.end() && mounting.find(path) == mounting.end())
+            {
+                addPending(path, st, now, true);
+            }
+        }
+        
+        closedir(dir);
+    }
+}
+
+void AutoMounter::readEvents()
+{
+    if(watcher == 0)
+    {
+        return;
+    }
+    
+    // mtimes have whole seconds, so look back one more
+    const time_t since = lastRead - 1;
+    WatchEventVec events;
+    bool overflowed = false;
+    
+    lastRead = time(0);
+    
+    try
+    {
+        events = watcher->readEvents(overflowed);
+    }
+    catch(std::runtime_error const& ex)
+    {
+        // the notifier would keep firing on the broken descriptor
+        notifier->setEnabled(false);
+        emit mountFailed("new images", QString("automount stopped, cannot read directory changes: ") + ex.what());
+        return;
+    }
+    
+    for(WatchEventVec::const_iterator it = events.begin(); it != events.end(); ++it)
+    {
+        if(!isImageName(it->path))
+        {
+            continue;
+        }
+        
+        struct stat st;
+        
+        if(stat(it->path.c_str(), &st) == -1)
+        {
+            pending.erase(it->path);
+            continue;
+        }
+        
+        addPending(it->path, st, it->time, it->complete);
+    }
+    
+    if(overflowed)
+    {
+        rescanDirectories(since);
+    }
+    
+    if(!pending.empty())
+    {
+        timer.start(quietMillis);
+    }
+}
+
+void AutoMounter::mountSettledImages()
+{
+    const long long now = monotonicMicroseconds();
+    const long long quiet = quietMillis * 1000LL;
+    long long nextDue = -1;
+    
+    for(std::map<std::string, PendingImage>::iterator it = pending.begin(); it != pending.end(); )
+    {
+        PendingImage& image = it->second;
+        struct stat st;
+        
+        if(stat(it->first.c_str(), &st) == -1)
+        {
+            pending.erase(it++);
+            continue;
+        }
+        
+        if(st.st_size != image.size || st.st_mtime != image.mtime)
+        {
+            // written to without us hearing about it yet, start over
+            image.lastEvent = now;
+            image.size = st.st_size;
+            image.mtime = st.st_mtime;
+        }
+        
+        if(image.complete && now - image.lastEvent >= quiet)
+        {
+            mountImage(it->first, image.closeTime);
+            pending.erase(it++);
+            continue;
+        }
+        
+        const long long due = image.lastEvent + quiet - now;
+        
+        if(nextDue == -1 || due < nextDue)
+        {
+            nextDue = due;
+        }
+        
+        ++it;
+    }
+    
+    if(nextDue >= 0)
+    {
+        timer.start(static_cast<int>(nextDue / 1000) + 1);
+    }
+}
+
+void AutoMounter::mountImage(std::string image, long long closeTime)
+{
+    if(mounting.find(image) != mounting.end())
+    {
+        return;
+    }
+    
+    const std::string mountPoint = mountRoot + "/" + getMountName(image);
+    
+    try
+    {
+        if(mkdir(mountPoint.c_str(), 0700) == -1 && errno != EEXIST)
+        {
+            throw std::runtime_error(mountPoint + ": " + strerror(errno));
+        }
+        
+        Secret password;
+        
+        readPasswordFile(passwordFile, password);
+        
+        MountTask* task = new MountTask(image, mountPoint, password, profile);
+        
+        QObject::connect(task, SIGNAL(finished()), this, SLOT(mountFinished()));
+        mounting[image] = closeTime;
+        scheduler.submit(task);
+    }
+    catch(std::runtime_error ex)
+    {
+        emit mountFailed(image.c_str(), ex.what());
+    }
+}
+
+void AutoMounter::mountFinished()
+{
+    MountTask* task = static_cast<MountTask*>(sender());
+    const std::map<std::string, long long>::iterator it = mounting.find(task->getImage());
+    
+    if(it == mounting.end())
+    {
+        return;
+    }
+    
+    const long long latency = monotonicMicroseconds() - it->second;
+    
+    mounting.erase(it);
+    
+    if(task->succeeded())
+    {
+        recordOperation(OperationAutoMount, task->getImage(), wallClockMicroseconds() - latency, latency, 0, 0);
+        emit imageMounted(task->getImage().c_str(), task->getMountPoint().c_str(), latency / 1000.0);
+    }
+    else
+    {
+        emit mountFailed(task->getImage().c_str(), task->getErrorMessage().c_str());
+    }
+}
@@ -0,0 +1,120 @@
+/**
+ * Copyright (c) 2007, Emir Uner
+ * All rights reserved.
+ * 
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ * 
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef EASYTC_AUTOMOUNTER_HPP_INCLUDED
+#define EASYTC_AUTOMOUNTER_HPP_INCLUDED
+
+#include <QtCore/QObject>
+#include <QtCore/QSocketNotifier>
+#include <QtCore/QTimer>
+
+#include "DirectoryWatcher.hpp"
+#include "MountProfile.hpp"
+#include "TaskScheduler.hpp"
+
+#include <sys/stat.h>
+#include <sys/types.h>
+
+#include <map>
+#include <string>
+#include <vector>
+
+/**
+ * Mounts images that appear in the directories listed in
+ * ~/.easytc/automount.conf:
+ *
+ *   watch = /srv/images            (repeatable)
+ *   mountroot = /mnt/auto          images are mounted to mountroot/<name>
+ *   passwordfile = /root/.tcpass   must not be readable by group or others
+ *   extension = .tc                (optional, repeatable)
+ *   quiet = 2000                   milliseconds without writes before mounting
+ *   profile = Scratch              mount profile from profiles.conf (optional)
+ *
+ * Directory changes arrive through inotify, nothing is polled. An image is
+ * mounted only after its writer closed it and it stayed unchanged for the
+ * quiet period, so half written files are left alone. If inotify drops
+ * events the directories are listed and images changed since the last
+ * read are treated as closed. A read error stops the watching and is
+ * reported through mountFailed.
+ */
+class AutoMounter : public QObject
+{
+    Q_OBJECT
+
+public:
+    AutoMounter(TaskScheduler& scheduler, QObject* parent = 0);
+    ~AutoMounter();
+    
+    /**
+     * Reads the configuration and starts watching. Throws
+     * std::runtime_error if the configuration is not usable.
+     */
+    void start();
+    void stop();
+    
+private:
+    struct PendingImage
+    {
+        long long lastEvent;
+        long long closeTime;
+        bool complete;
+        off_t size;
+        time_t mtime;
+    };
+    
+    TaskScheduler& scheduler;
+    DirectoryWatcher* watcher;
+    QSocketNotifier* notifier;
+    QTimer timer;
+    std::map<std::string, PendingImage> pending;
+    std::map<std::string, long long> mounting;
+    std::string mountRoot;
+    std::string passwordFile;
+    std::vector<std::string> extensions;
+    int quietMillis;
+    MountProfile profile;
+    
+    /**
+     * Wall clock time of the last read of events.
+     */
+    time_t lastRead;
+    
+    bool isImageName(std::string path) const;
+    void addPending(std::string path, struct stat const& st, long long time, bool complete);
+    void rescanDirectories(time_t since);
+    void mountImage(std::string image, long long closeTime);
+    
+private slots:
+    void readEvents();
+    void mountSettledImages();
+    void mountFinished();
+    
+signals:
+    void imageMounted(QString image, QString mountPoint, double latencyMillis);
+    void mountFailed(QString image, QString message);
+};
+
+#endif
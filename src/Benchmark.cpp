@@ -0,0 +1,535 @@
+/**
+ * Copyright (c) 2007, Emir Uner
+ * All rights reserved.
+ * 
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ * 
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "Benchmark.hpp"
+#include "CryptoAcceleration.hpp"
+#include "DmCrypt.hpp"
+#include "IoRing.hpp"
+#include "Posix.hpp"
+#include "Statistics.hpp"
+
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <sys/stat.h>
+
+#include <fstream>
+#include <iomanip>
+#include <sstream>
+
+namespace
+{
+
+const int blockSize = 4096;
+const int sequentialChunk = 1024 * 1024;
+
+class AlignedBuffer
+{
+    void* data;
+    
+    AlignedBuffer(AlignedBuffer const&);
+    AlignedBuffer& operator=(AlignedBuffer const&);
+    
+public:
+    explicit AlignedBuffer(size_t size)
+    : data(0)
+    {
+        const int errorCode = posix_memalign(&data, blockSize, size);
+        
+        if(errorCode != 0)
+        {
+            throw unix_error(errorCode);
+        }
+        
+        memset(data, 0xA5, size);
+    }
+    
+    ~AlignedBuffer()
+    {
+        free(data);
+    }
+    
+    char* get()
+    {
+        return static_cast<char*>(data);
+    }
+};
+
+class TestFile
+{
+    std::string path;
+    int fd;
+    bool direct;
+    
+    TestFile(TestFile const&);
+    TestFile& operator=(TestFile const&);
+    
+public:
+    explicit TestFile(std::string pathp)
+    : path(pathp), direct(true)
+    {
+        fd = open(path.c_str(), O_RDWR | O_CREAT | O_TRUNC | O_DIRECT, 0600);
+        
+        if(fd == -1 && errno == EINVAL)
+        {
+            // tmpfs and a few others refuse O_DIRECT, measure buffered I/O there
+            direct = false;
+            fd = open(path.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0600);
+        }
+        
+        unix_error::check(fd);
+    }
+    
+    ~TestFile()
+    {
+        close(fd);
+        unlink(path.c_str());
+    }
+    
+    int getFd()
+    {
+        return fd;
+    }
+    
+    bool isDirect()
+    {
+        return direct;
+    }
+    
+    void dropCache()
+    {
+        if(!direct)
+        {
+            fdatasync(fd);
+            posix_fadvise(fd, 0, 0, POSIX_FADV_DONTNEED);
+        }
+    }
+};
+
+/**
+ * xorshift generator, good enough to scatter offsets and cheap to run
+ * one per thread.
+ */
+struct Random
+{
+    unsigned long long state;
+    
+    explicit Random(unsigned long long seed)
+    : state(seed | 1)
+    {
+    }
+    
+    unsigned long long next()
+    {
+        state ^= state << 13;
+        state ^= state >> 7;
+        state ^= state << 17;
+        
+        return state;
+    }
+};
+
+BenchmarkResult makeResult(std::string test, long long bytes, long long elapsed, std::vector<double>& latencies)
+{
+    BenchmarkResult result;
+    const double seconds = elapsed > 0 ? elapsed / 1e6 : 1e-6;
+    
+    result.test = test;
+    result.mbPerSecond = bytes / seconds / (1024 * 1024);
+    result.iops = latencies.size() / seconds;
+    result.latencyP50 = percentile(latencies, 0.50);
+    result.latencyP95 = percentile(latencies, 0.95);
+    result.latencyP99 = percentile(latencies, 0.99);
+    
+    return result;
+}
+
+BenchmarkResult runSequential(TestFile& file, long long fileBytes, bool write)
+{
+    AlignedBuffer buffer(sequentialChunk);
+    std::vector<double> latencies;
+    const long long start = monotonicMicroseconds();
+    
+    for(long long offset = 0; offset < fileBytes; offset += sequentialChunk)
+    {
+        const long long opStart = monotonicMicroseconds();
+        const ssize_t count = write ? pwrite(file.getFd(), buffer.get(), sequentialChunk, offset)
+                                    : pread(file.getFd(), buffer.get(), sequentialChunk, offset);
+        
+        unix_error::check(static_cast<int>(count));
+        latencies.push_back(static_cast<double>(monotonicMicroseconds() - opStart));
+    }
+    
+    if(write)
+    {
+        unix_error::check(fdatasync(file.getFd()));
+    }
+    
+    return makeResult(write ? "seq-write 1M" : "seq-read 1M", fileBytes, monotonicMicroseconds() - start, latencies);
+}
+
+struct RandomWorker
+{
+    int fd;
+    bool write;
+    long long blocks;
+    long long deadline;
+    std::vector<double> latencies;
+    
+    void operator()()
+    {
+        AlignedBuffer buffer(blockSize);
+        Random random(reinterpret_cast<unsigned long long>(this) ^ monotonicMicroseconds());
+        
+        while(monotonicMicroseconds() < deadline)
+        {
+            const off_t offset = static_cast<off_t>(random.next() % blocks) * blockSize;
+            const long long opStart = monotonicMicroseconds();
+            const ssize_t count = write ? pwrite(fd, buffer.get(), blockSize, offset)
+                                        : pread(fd, buffer.get(), blockSize, offset);
+            
+            unix_error::check(static_cast<int>(count));
+            latencies.push_back(static_cast<double>(monotonicMicroseconds() - opStart));
+        }
+    }
+};
+
+void runRandomThreads(int fd, bool write, long long blocks, int queueDepth, long long deadline,
+                      std::vector<double>& latencies)
+{
+    std::vector<RandomWorker> workers(queueDepth);
+    
+    for(int i = 0; i < queueDepth; ++i)
+    {
+        workers[i].fd = fd;
+        workers[i].write = write;
+        workers[i].blocks = blocks;
+        workers[i].deadline = deadline;
+    }
+    
+    runThreads(workers);
+    
+    for(int i = 0; i < queueDepth; ++i)
+    {
+        latencies.insert(latencies.end(), workers[i].latencies.begin(), workers[i].latencies.end());
+    }
+}
+
+void runRandomRing(int fd, bool write, long long blocks, int queueDepth, long long deadline,
+                   std::vector<double>& latencies)
+{
+    // declared first, so that the ring waits for the requests in flight
+    // before the buffers are freed, also when a failed one throws
+    AlignedBuffer buffers(static_cast<size_t>(queueDepth) * blockSize);
+    IoRing ring(queueDepth);
+    std::vector<long long> started(queueDepth);
+    Random random(monotonicMicroseconds());
+    
+    for(int slot = 0; slot < queueDepth; ++slot)
+    {
+        const off_t offset = static_cast<off_t>(random.next() % blocks) * blockSize;
+        char* buffer = buffers.get() + slot * blockSize;
+        
+        started[slot] = monotonicMicroseconds();
+        
+        if(write)
+        {
+            ring.prepareWrite(fd, buffer, blockSize, offset, slot);
+        }
+        else
+        {
+            ring.prepareRead(fd, buffer, blockSize, offset, slot);
+        }
+    }
+    
+    while(ring.getPending() > 0)
+    {
+        const IoCompletion completion = ring.submitAndWait();
+        const int slot = static_cast<int>(completion.userData);
+        const long long now = monotonicMicroseconds();
+        
+        if(completion.result < 0)
+        {
+            throw unix_error(-completion.result);
+        }
+        
+        latencies.push_back(static_cast<double>(now - started[slot]));
+        
+        if(now < deadline)
+        {
+            const off_t offset = static_cast<off_t>(random.next() % blocks) * blockSize;
+            char* buffer = buffers.get() + slot * blockSize;
+            
+            started[slot] = now;
+            
+            if(write)
+            {
+                ring.prepareWrite(fd, buffer, blockSize, offset, slot);
+            }
+            else
+            {
+                ring.prepareRead(fd, buffer, blockSize, offset, slot);
+            }
+        }
+    }
+}
+
+BenchmarkResult runRandom(TestFile& file, long long fileBytes, bool write, int queueDepth, int seconds)
+{
+    const long long blocks = fileBytes / blockSize;
+    const long long start = monotonicMicroseconds();
+    const long long deadline = start + seconds * 1000000LL;
+    std::vector<double> latencies;
+    
+    if(IoRing::isSupported())
+    {
+        runRandomRing(file.getFd(), write, blocks, queueDepth, deadline, latencies);
+    }
+    else
+    {
+        runRandomThreads(file.getFd(), write, blocks, queueDepth, deadline, latencies);
+    }
+    
+    if(write)
+    {
+        unix_error::check(fdatasync(file.getFd()));
+    }
+    
+    std::ostringstream oss;
+    
+    oss << (write ? "rand-write 4K QD" : "rand-read 4K QD") << queueDepth;
+    
+    return makeResult(oss.str(), static_cast<long long>(latencies.size()) * blockSize,
+                      monotonicMicroseconds() - start, latencies);
+}
+
+/**
+ * Removes the files of a metadata run and its directory when going out of
+ * scope, however the run ended.
+ */
+class MetadataDirectory
+{
+    std::string path;
+    std::vector<std::string> names;
+    
+    MetadataDirectory(MetadataDirectory const&);
+    MetadataDirectory& operator=(MetadataDirectory const&);
+    
+public:
+    MetadataDirectory(std::string directory, int fileCount)
+    {
+        std::string pattern = directory + "/.easytc-benchmark.XXXXXX";
+        
+        if(mkdtemp(&pattern[0]) == 0)
+        {
+            throw unix_error(errno);
+        }
+        
+        path = pattern;
+        
+        for(int i = 0; i < fileCount; ++i)
+        {
+            std::ostringstream oss;
+            
+            oss << path << "/f" << i;
+            names.push_back(oss.str());
+        }
+    }
+    
+    ~MetadataDirectory()
+    {
+        for(std::vector<std::string>::const_iterator it = names.begin(); it != names.end(); ++it)
+        {
+            unlink(it->c_str());
+        }
+        
+        rmdir(path.c_str());
+    }
+    
+    std::string const& getName(int index) const
+    {
+        return names[index];
+    }
+};
+
+void runMetadata(std::string directory, int fileCount, BenchmarkResultVec& results)
+{
+    MetadataDirectory testDirectory(directory, fileCount);
+    std::vector<double> latencies;
+    long long start = monotonicMicroseconds();
+    
+    for(int i = 0; i < fileCount; ++i)
+    {
+        const long long opStart = monotonicMicroseconds();
+        const int fd = open(testDirectory.getName(i).c_str(), O_WRONLY | O_CREAT | O_EXCL, 0600);
+        
+        unix_error::check(fd);
+        close(fd);
+        latencies.push_back(static_cast<double>(monotonicMicroseconds() - opStart));
+    }
+    
+    results.push_back(makeResult("create", 0, monotonicMicroseconds() - start, latencies));
+    latencies.clear();
+    start = monotonicMicroseconds();
+    
+    for(int i = 0; i < fileCount; ++i)
+    {
+        struct stat st;
+        const long long opStart = monotonicMicroseconds();
+        
+        unix_error::check(stat(testDirectory.getName(i).c_str(), &st));
+        latencies.push_back(static_cast<double>(monotonicMicroseconds() - opStart));
+    }
+    
+    results.push_back(makeResult("stat", 0, monotonicMicroseconds() - start, latencies));
+    latencies.clear();
+    start = monotonicMicroseconds();
+    
+    for(int i = 0; i < fileCount; ++i)
+    {
+        const long long opStart = monotonicMicroseconds();
+        
+        unix_error::check(unlink(testDirectory.getName(i).c_str()));
+        latencies.push_back(static_cast<double>(monotonicMicroseconds() - opStart));
+    }
+    
+    results.push_back(makeResult("delete", 0, monotonicMicroseconds() - start, latencies));
+}
+
+void reportProgress(Progress* progress, int done, int total)
+{
+    if(progress != 0)
+    {
+        progress->report(done * 100 / total);
+    }
+    
+    operation_cancelled::check(progress);
+}
+
+} // namespace <unnamed>
+
+BenchmarkResultVec runBenchmark(std::string directory, BenchmarkOptions options, Progress* progress)
+{
+    BenchmarkResultVec results;
+    const long long fileBytes = static_cast<long long>(options.fileMBytes) * 1024 * 1024;
+    const int testCount = 3 + 2 * static_cast<int>(options.queueDepths.size());
+    
+    {
+        TestFile file(directory + "/.easytc-benchmark");
+        
+        results.push_back(runSequential(file, fileBytes, true));
+        reportProgress(progress, results.size(), testCount);
+        file.dropCache();
+        results.push_back(runSequential(file, fileBytes, false));
+        reportProgress(progress, results.size(), testCount);
+        
+        for(unsigned int i = 0; i < options.queueDepths.size(); ++i)
+        {
+            file.dropCache();
+            results.push_back(runRandom(file, fileBytes, false, options.queueDepths[i], options.secondsPerTest));
+            reportProgress(progress, results.size(), testCount);
+        }
+        
+        for(unsigned int i = 0; i < options.queueDepths.size(); ++i)
+        {
+            results.push_back(runRandom(file, fileBytes, true, options.queueDepths[i], options.secondsPerTest));
+            reportProgress(progress, results.size(), testCount);
+        }
+        
+        if(!file.isDirect())
+        {
+            for(BenchmarkResultVec::iterator it = results.begin(); it != results.end(); ++it)
+            {
+                it->test += " (buffered)";
+            }
+        }
+    }
+    
+    runMetadata(directory, options.metadataFiles, results);
+    reportProgress(progress, testCount, testCount);
+    
+    return results;
+}
+
+std::string formatBenchmarkResults(BenchmarkResultVec const& results)
+{
+    std::ostringstream oss;
+    
+    oss << std::fixed << std::setprecision(1);
+    oss << std::left << std::setw(28) << "Test" << std::right
+        << std::setw(10) << "MB/s" << std::setw(10) << "IOPS"
+        << std::setw(10) << "p50 us" << std::setw(10) << "p95 us" << std::setw(10) << "p99 us" << "\n";
+    
+    for(BenchmarkResultVec::const_iterator it = results.begin(); it != results.end(); ++it)
+    {
+        oss << std::left << std::setw(28) << it->test << std::right
+            << std::setw(10) << it->mbPerSecond << std::setw(10) << it->iops
+            << std::setw(10) << it->latencyP50 << std::setw(10) << it->latencyP95
+            << std::setw(10) << it->latencyP99 << "\n";
+    }
+    
+    return oss.str();
+}
+
+void saveBenchmarkResults(MountInfo const& mountInfo, BenchmarkResultVec const& results)
+{
+    const std::string resultsFile = getDataDirectory() + "/benchmarks.tsv";
+    const CryptoReportVec reports = getCryptoReports(MountInfoVec(1, mountInfo));
+    std::string ciphers;
+    std::string drivers;
+    std::string flags;
+    
+    if(!reports.empty())
+    {
+        for(CipherInfoVec::const_iterator it = reports[0].ciphers.begin(); it != reports[0].ciphers.end(); ++it)
+        {
+            ciphers += (ciphers.empty() ? "" : ",") + it->cipher;
+            drivers += (drivers.empty() ? "" : ",") + (it->driver.empty() ? std::string("unknown") : it->driver);
+        }
+        
+        flags = formatDmCryptFlags(reports[0].dmCryptFlags);
+    }
+    
+    std::ofstream out(resultsFile.c_str(), std::ios::app);
+    char host[256] = "";
+    
+    gethostname(host, sizeof(host) - 1);
+    
+    for(BenchmarkResultVec::const_iterator it = results.begin(); it != results.end(); ++it)
+    {
+        out << time(0) << '\t' << host << '\t' << mountInfo.imageFile << '\t' << mountInfo.filesystem << '\t'
+            << it->test << '\t' << it->mbPerSecond << '\t' << it->iops << '\t'
+            << it->latencyP50 << '\t' << it->latencyP95 << '\t' << it->latencyP99 << '\t'
+            << (ciphers.empty() ? "unknown" : ciphers) << '\t' << (drivers.empty() ? "unknown" : drivers) << '\t'
+            << (flags.empty() ? "none" : flags) << '\n';
+    }
+    
+    if(!out)
+    {
+        throw std::runtime_error("could not write benchmark results to " + resultsFile);
+    }
+}
@@ -0,0 +1,113 @@
+/**
+ * Copyright (c) 2007, Emir Uner
+ * All rights reserved.
+ * 
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ * 
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef EASYTC_BENCHMARK_HPP_INCLUDED
+#define EASYTC_BENCHMARK_HPP_INCLUDED
+
+#include "MountInfo.hpp"
+#include "Progress.hpp"
+
+#include <string>
+#include <vector>
+
+struct BenchmarkOptions
+{
+    /**
+     * Size of the test file used by the sequential and random tests.
+     */
+    int fileMBytes;
+    
+    /**
+     * Upper bound for the run time of each random I/O test.
+     */
+    int secondsPerTest;
+    
+    /**
+     * Queue depths the 4K random tests are run at.
+     */
+    std::vector<int> queueDepths;
+    
+    /**
+     * Number of files the metadata tests create, stat and delete.
+     */
+    int metadataFiles;
+    
+    inline BenchmarkOptions()
+    : fileMBytes(256), secondsPerTest(3), metadataFiles(5000)
+    {
+        queueDepths.push_back(1);
+        queueDepths.push_back(4);
+        queueDepths.push_back(16);
+        queueDepths.push_back(32);
+    }
+};
+
+struct BenchmarkResult
+{
+    std::string test;
+    double mbPerSecond;
+    double iops;
+    
+    /**
+     * Per operation latency percentiles in microseconds.
+     */
+    double latencyP50;
+    double latencyP95;
+    double latencyP99;
+};
+
+typedef std::vector<BenchmarkResult> BenchmarkResultVec;
+
+/**
+ * Runs the sequential, 4K random and metadata tests in the given directory,
+ * normally the mount point of a volume. Data is transferred with O_DIRECT
+ * where the filesystem supports it and the random tests are queued through
+ * io_uring, or through one thread per queue slot when io_uring is missing.
+ */
+BenchmarkResultVec runBenchmark(std::string directory, BenchmarkOptions options = BenchmarkOptions(),
+                                Progress* progress = 0);
+
+/**
+ * Formats the results as a human readable table.
+ */
+std::string formatBenchmarkResults(BenchmarkResultVec const& results);
+
+/**
+ * Appends the results to ~/.easytc/benchmarks.tsv so that runs can be
+ * compared across cipher, filesystem and host later. Each test is a line
+ * of tab separated columns:
+ *
+ *   time (seconds since the epoch), host, image, filesystem, test,
+ *   MB/s, IOPS, p50, p95 and p99 latency (microseconds), cipher, kernel
+ *   crypto driver, dm-crypt flags
+ *
+ * Cipher and driver are "unknown" if the dm table cannot be read, which
+ * needs root; several are separated by commas. Flags are "none" if unset.
+ * Lines written before the last three columns were added end after p99.
+ */
+void saveBenchmarkResults(MountInfo const& mountInfo, BenchmarkResultVec const& results);
+
+#endif
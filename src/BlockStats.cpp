@@ -0,0 +1,200 @@
+/**
+ * Copyright (c) 2007, Emir Uner
+ * All rights reserved.
+ * 
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ * 
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "BlockStats.hpp"
+#include "Posix.hpp"
+
+#include <fcntl.h>
+#include <stdlib.h>
+#include <sys/stat.h>
+#include <sys/sysmacros.h>
+
+#include <algorithm>
+#include <sstream>
+
+namespace
+{
+
+/**
+ * Parses the leading fields of a stat file: reads, read merges, sectors
+ * read, read ticks, writes, write merges, sectors written, write ticks,
+ * in flight and io ticks. Newer kernels append more fields.
+ */
+bool parseStatLine(char const* line, unsigned long long* fields, int count)
+{
+    char* end;
+    
+    for(int i = 0; i < count; ++i)
+    {
+        fields[i] = strtoull(line, &end, 10);
+        
+        if(end == line)
+        {
+            return false;
+        }
+        
+        line = end;
+    }
+    
+    return true;
+}
+
+} // namespace <unnamed>
+
+std::string getBlockStatPath(std::string device)
+{
+    struct stat st;
+    
+    if(stat(device.c_str(), &st) == -1 || !S_ISBLK(st.st_mode))
+    {
+        return "";
+    }
+    
+    std::ostringstream oss;
+    
+    oss << "/sys/dev/block/" << major(st.st_rdev) << ":" << minor(st.st_rdev) << "/stat";
+    
+    return oss.str();
+}
+
+BlockStatSampler::BlockStatSampler(size_t historyLengthp)
+: historyLength(historyLengthp)
+{
+}
+
+BlockStatSampler::~BlockStatSampler()
+{
+    setStatFiles(std::vector<std::string>());
+}
+
+void BlockStatSampler::setStatFiles(std::vector<std::string> const& paths)
+{
+    for(StatFileMap::iterator it = statFiles.begin(); it != statFiles.end();)
+    {
+        if(std::find(paths.begin(), paths.end(), it->first) == paths.end())
+        {
+            if(it->second.fd != -1)
+            {
+                close(it->second.fd);
+            }
+            
+            statFiles.erase(it++);
+        }
+        else
+        {
+            ++it;
+        }
+    }
+    
+    for(std::vector<std::string>::const_iterator it = paths.begin(); it != paths.end(); ++it)
+    {
+        if(it->empty() || statFiles.find(*it) != statFiles.end())
+        {
+            continue;
+        }
+        
+        StatFile& statFile = statFiles[*it];
+        
+        statFile.fd = open(it->c_str(), O_RDONLY | O_CLOEXEC);
+        statFile.primed = false;
+        statFile.lastTime = 0;
+    }
+}
+
+void BlockStatSampler::sample()
+{
+    const long long now = monotonicMicroseconds();
+    
+    for(StatFileMap::iterator it = statFiles.begin(); it != statFiles.end(); ++it)
+    {
+        if(it->second.fd != -1)
+        {
+            sampleFile(it->second, now);
+        }
+    }
+}
+
+void BlockStatSampler::sampleFile(StatFile& statFile, long long now)
+{
+    char buf[512];
+    const ssize_t length = pread(statFile.fd, buf, sizeof(buf) - 1, 0);
+    unsigned long long fields[10];
+    
+    if(length <= 0)
+    {
+        return;
+    }
+    
+    buf[length] = '\0';
+    
+    if(!parseStatLine(buf, fields, 10))
+    {
+        return;
+    }
+    
+    Counters counters;
+    
+    counters.reads = fields[0];
+    counters.sectorsRead = fields[2];
+    counters.writes = fields[4];
+    counters.sectorsWritten = fields[6];
+    counters.inFlight = fields[8];
+    counters.ioTicks = fields[9];
+    
+    const double seconds = (now - statFile.lastTime) / 1000000.0;
+    
+    if(statFile.primed && seconds > 0)
+    {
+        // stat sectors are always 512 bytes
+        const double sectorsPerMByte = 2048.0;
+        BlockStatSample sample;
+        
+        sample.readMBytesPerSecond = (counters.sectorsRead - statFile.last.sectorsRead) / sectorsPerMByte / seconds;
+        sample.writeMBytesPerSecond = (counters.sectorsWritten - statFile.last.sectorsWritten) / sectorsPerMByte
+                                      / seconds;
+        sample.iops = (counters.reads - statFile.last.reads + counters.writes - statFile.last.writes) / seconds;
+        sample.inFlight = static_cast<double>(counters.inFlight);
+        sample.utilisation = std::min(100.0, (counters.ioTicks - statFile.last.ioTicks) / 10.0 / seconds);
+        
+        if(statFile.history.size() == historyLength)
+        {
+            statFile.history.pop_front();
+        }
+        
+        statFile.history.push_back(sample);
+    }
+    
+    statFile.last = counters;
+    statFile.lastTime = now;
+    statFile.primed = true;
+}
+
+BlockStatHistory const& BlockStatSampler::getHistory(std::string path) const
+{
+    StatFileMap::const_iterator it = statFiles.find(path);
+    
+    return it != statFiles.end() ? it->second.history : emptyHistory;
+}
@@ -0,0 +1,123 @@
+/**
+ * Copyright (c) 2007, Emir Uner
+ * All rights reserved.
+ * 
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ * 
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef EASYTC_BLOCKSTATS_HPP_INCLUDED
+#define EASYTC_BLOCKSTATS_HPP_INCLUDED
+
+#include <deque>
+#include <map>
+#include <string>
+#include <vector>
+
+/**
+ * Activity of a block device over one sampling interval.
+ */
+struct BlockStatSample
+{
+    double readMBytesPerSecond;
+    double writeMBytesPerSecond;
+    double iops;
+    
+    /**
+     * Requests in flight when the sample was taken.
+     */
+    double inFlight;
+    
+    /**
+     * Percentage of the interval the device was busy.
+     */
+    double utilisation;
+};
+
+typedef std::deque<BlockStatSample> BlockStatHistory;
+
+/**
+ * Returns the /sys/dev/block/<major>:<minor>/stat file of the block
+ * device, or "" if the path is not a block device.
+ */
+std::string getBlockStatPath(std::string device);
+
+/**
+ * Samples block device stat files and keeps a short history of each. The
+ * files stay open between samples and are read with a single pread, so a
+ * sample costs one system call per device.
+ */
+class BlockStatSampler
+{
+public:
+    explicit BlockStatSampler(size_t historyLength = 60);
+    ~BlockStatSampler();
+    
+    /**
+     * Sets the stat files to sample. Files already sampled keep their
+     * descriptor and history, the others are opened or closed.
+     */
+    void setStatFiles(std::vector<std::string> const& paths);
+    
+    /**
+     * Reads every stat file and appends the activity since the previous
+     * sample to its history.
+     */
+    void sample();
+    
+    /**
+     * Oldest sample first. Empty for unknown or unreadable files.
+     */
+    BlockStatHistory const& getHistory(std::string path) const;
+    
+private:
+    BlockStatSampler(BlockStatSampler const&);
+    BlockStatSampler& operator=(BlockStatSampler const&);
+    
+    struct Counters
+    {
+        unsigned long long reads;
+        unsigned long long sectorsRead;
+        unsigned long long writes;
+        unsigned long long sectorsWritten;
+        unsigned long long inFlight;
+        unsigned long long ioTicks;
+    };
+    
+    struct StatFile
+    {
+        int fd;
+        bool primed;
+        Counters last;
+        long long lastTime;
+        BlockStatHistory history;
+    };
+    
+    typedef std::map<std::string, StatFile> StatFileMap;
+    
+    size_t historyLength;
+    StatFileMap statFiles;
+    BlockStatHistory emptyHistory;
+    
+    void sampleFile(StatFile& statFile, long long now);
+};
+
+#endif
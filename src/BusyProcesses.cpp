@@ -0,0 +1,372 @@
+/**
+ * Copyright (c) 2007, Emir Uner
+ * All rights reserved.
+ * 
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ * 
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "BusyProcesses.hpp"
+#include "Posix.hpp"
+
+#include <dirent.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <sys/stat.h>
+#include <sys/sysmacros.h>
+
+#include <sstream>
+
+namespace
+{
+
+std::string readProcFile(std::string path)
+{
+    const int fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    std::string contents;
+    
+    if(fd == -1)
+    {
+        return contents;
+    }
+    
+    char buf[4096];
+    ssize_t count;
+    
+    while((count = read(fd, buf, sizeof(buf))) > 0)
+    {
+        contents.append(buf, count);
+    }
+    
+    close(fd);
+    
+    return contents;
+}
+
+std::string readLink(std::string path)
+{
+    char buf[4096];
+    const ssize_t length = readlink(path.c_str(), buf, sizeof(buf));
+    
+    return length > 0 ? std::string(buf, length) : std::string();
+}
+
+/**
+ * Reads the state (field 3) and start time (field 22) from
+ * /proc/<pid>/stat. The command in field 2 may contain spaces and
+ * parentheses, so counting starts after its closing parenthesis.
+ */
+unsigned long long readStartTime(std::string procDir, char* state = 0)
+{
+    const std::string stat = readProcFile(procDir + "/stat");
+    const std::string::size_type paren = stat.rfind(')');
+    
+    if(paren == std::string::npos)
+    {
+        return 0;
+    }
+    
+    std::istringstream iss(stat.substr(paren + 1));
+    std::string field;
+    
+    for(int i = 3; i <= 21 && iss >> field; ++i)
+    {
+        if(i == 3 && state != 0)
+        {
+            *state = field[0];
+        }
+    }
+    
+    unsigned long long startTime = 0;
+    
+    iss >> startTime;
+    
+    return startTime;
+}
+
+std::string readCommand(std::string procDir)
+{
+    std::string command = readProcFile(procDir + "/cmdline");
+    
+    if(command.empty())
+    {
+        // kernel threads and zombies have no command line
+        command = readProcFile(procDir + "/comm");
+    }
+    
+    for(std::string::size_type i = 0; i < command.size(); ++i)
+    {
+        if(command[i] == '\0' || command[i] == '\n')
+        {
+            command[i] = ' ';
+        }
+    }
+    
+    const std::string::size_type last = command.find_last_not_of(' ');
+    
+    return last == std::string::npos ? "" : command.substr(0, last + 1);
+}
+
+struct ProcessScanner
+{
+    std::vector<pid_t> const* pids;
+    volatile int* nextIndex;
+    dev_t device;
+    BusyProcessVec found;
+    
+    void operator()()
+    {
+        for(int i = __atomic_fetch_add(nextIndex, 1, __ATOMIC_RELAXED); i < static_cast<int>(pids->size());
+            i = __atomic_fetch_add(nextIndex, 1, __ATOMIC_RELAXED))
+        {
+            scanProcess((*pids)[i]);
+        }
+    }
+    
+    bool isOnDevice(std::string const& path)
+    {
+        struct stat st;
+        
+        return stat(path.c_str(), &st) == 0 && st.st_dev == device;
+    }
+    
+    void scanProcess(pid_t pid)
+    {
+        std::ostringstream oss;
+        
+        oss << "/proc/" << pid;
+        
+        const std::string procDir = oss.str();
+        BusyProcess process;
+        
+        if(isOnDevice(procDir + "/cwd"))
+        {
+            process.uses.push_back("cwd");
+        }
+        
+        if(isOnDevice(procDir + "/root"))
+        {
+            process.uses.push_back("root");
+        }
+        
+        scanFileDescriptors(procDir, process.uses);
+        scanMappings(procDir, process.uses);
+        
+        if(!process.uses.empty())
+        {
+            process.pid = pid;
+            process.command = readCommand(procDir);
+            process.startTime = readStartTime(procDir);
+            found.push_back(process);
+        }
+    }
+    
+    void scanFileDescriptors(std::string const& procDir, std::vector<std::string>& uses)
+    {
+        const std::string fdDir = procDir + "/fd";
+        DIR* dir = opendir(fdDir.c_str());
+        
+        if(dir == 0)
+        {
+            return;
+        }
+        
+        for(struct dirent* entry = readdir(dir); entry != 0; entry = readdir(dir))
+        {
+            if(entry->d_name[0] == '.')
+            {
+                continue;
+            }
+            
+            const std::string fdPath = fdDir + "/" + entry->d_name;
+            
+            // stat follows the link to the open file, wherever it is now
+            if(isOnDevice(fdPath))
+            {
+                uses.push_back(std::string("fd ") + entry->d_name + ": " + readLink(fdPath));
+            }
+        }
+        
+        closedir(dir);
+    }
+    
+    void scanMappings(std::string const& procDir, std::vector<std::string>& uses)
+    {
+        // "start-end perms offset major:minor inode path", no stat needed
+        std::istringstream maps(readProcFile(procDir + "/maps"));
+        std::string line;
+        std::string lastPath;
+        
+        while(std::getline(maps, line))
+        {
+            unsigned int major;
+            unsigned int minor;
+            int pathStart = 0;
+            
+            if(sscanf(line.c_str(), "%*s %*s %*s %x:%x %*s %n", &major, &minor, &pathStart) < 2
+               || makedev(major, minor) != device || pathStart == 0)
+            {
+                continue;
+            }
+            
+            const std::string path = line.substr(pathStart);
+            
+            // a mapped file usually shows up as several consecutive regions
+            if(path != lastPath)
+            {
+                uses.push_back("mapped: " + path);
+                lastPath = path;
+            }
+        }
+    }
+};
+
+std::vector<pid_t> listProcesses()
+{
+    std::vector<pid_t> pids;
+    DIR* dir = opendir("/proc");
+    
+    if(dir == 0)
+    {
+        throw unix_error(errno);
+    }
+    
+    const pid_t self = getpid();
+    
+    for(struct dirent* entry = readdir(dir); entry != 0; entry = readdir(dir))
+    {
+        char* end;
+        const long pid = strtol(entry->d_name, &end, 10);
+        
+        if(*end == '\0' && pid > 0 && pid != self)
+        {
+            pids.push_back(static_cast<pid_t>(pid));
+        }
+    }
+    
+    closedir(dir);
+    
+    return pids;
+}
+
+/**
+ * Whether the process is still running. Zombies have released their files
+ * already and count as gone.
+ */
+bool isSameProcess(BusyProcess const& process)
+{
+    std::ostringstream oss;
+    char state = 'Z';
+    
+    oss << "/proc/" << process.pid;
+    
+    return readStartTime(oss.str(), &state) == process.startTime && state != 'Z';
+}
+
+} // namespace <unnamed>
+
+BusyProcessVec findBusyProcesses(std::string mountPoint)
+{
+    struct stat st;
+    
+    unix_error::check(stat(mountPoint.c_str(), &st));
+    
+    const std::vector<pid_t> pids = listProcesses();
+    volatile int nextIndex = 0;
+    std::vector<ProcessScanner> scanners(getProcessorCount() * 2 < 16 ? getProcessorCount() * 2 : 16);
+    
+    for(unsigned int i = 0; i < scanners.size(); ++i)
+    {
+        scanners[i].pids = &pids;
+        scanners[i].nextIndex = &nextIndex;
+        scanners[i].device = st.st_dev;
+    }
+    
+    runThreads(scanners);
+    
+    BusyProcessVec processes;
+    
+    for(unsigned int i = 0; i < scanners.size(); ++i)
+    {
+        processes.insert(processes.end(), scanners[i].found.begin(), scanners[i].found.end());
+    }
+    
+    return processes;
+}
+
+void terminateProcesses(BusyProcessVec const& processes, int timeoutMillis)
+{
+    BusyProcessVec alive;
+    
+    for(BusyProcessVec::const_iterator it = processes.begin(); it != processes.end(); ++it)
+    {
+        if(isSameProcess(*it) && kill(it->pid, SIGTERM) == 0)
+        {
+            alive.push_back(*it);
+        }
+    }
+    
+    const long long deadline = monotonicMicroseconds() + timeoutMillis * 1000LL;
+    
+    while(!alive.empty() && monotonicMicroseconds() < deadline)
+    {
+        struct timespec ts = { 0, 20 * 1000000L };
+        
+        nanosleep(&ts, 0);
+        
+        BusyProcessVec remaining;
+        
+        for(BusyProcessVec::const_iterator it = alive.begin(); it != alive.end(); ++it)
+        {
+            if(isSameProcess(*it))
+            {
+                remaining.push_back(*it);
+            }
+        }
+        
+        alive.swap(remaining);
+    }
+    
+    if(!alive.empty())
+    {
+        throw std::runtime_error("These processes did not exit:\n" + formatBusyProcesses(alive));
+    }
+}
+
+std::string formatBusyProcesses(BusyProcessVec const& processes)
+{
+    std::ostringstream oss;
+    
+    for(BusyProcessVec::const_iterator it = processes.begin(); it != processes.end(); ++it)
+    {
+        oss << it->pid << " " << it->command << "\n";
+        
+        for(std::vector<std::string>::const_iterator use = it->uses.begin(); use != it->uses.end(); ++use)
+        {
+            oss << "    " << *use << "\n";
+        }
+    }
+    
+    return oss.str();
+}
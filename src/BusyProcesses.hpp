@@ -0,0 +1,77 @@
+/**
+ * Copyright (c) 2007, Emir Uner
+ * All rights reserved.
+ * 
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ * 
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef EASYTC_BUSYPROCESSES_HPP_INCLUDED
+#define EASYTC_BUSYPROCESSES_HPP_INCLUDED
+
+#include <sys/types.h>
+
+#include <string>
+#include <vector>
+
+/**
+ * A process that keeps a filesystem busy.
+ */
+struct BusyProcess
+{
+    pid_t pid;
+    std::string command;
+    
+    /**
+     * Start time from /proc/<pid>/stat, tells a reused pid apart.
+     */
+    unsigned long long startTime;
+    
+    /**
+     * What the process holds: "cwd", "root", "fd 3: <path>" or
+     * "mapped: <path>".
+     */
+    std::vector<std::string> uses;
+};
+
+typedef std::vector<BusyProcess> BusyProcessVec;
+
+/**
+ * Finds the processes with open files, working or root directories or
+ * file mappings on the filesystem mounted at mountPoint. /proc is walked on
+ * several threads. Processes that cannot be inspected, usually those of
+ * other users when not running as root, are skipped.
+ */
+BusyProcessVec findBusyProcesses(std::string mountPoint);
+
+/**
+ * Sends SIGTERM to the processes and waits up to timeoutMillis for them to
+ * exit. Processes whose pid has been reused meanwhile are left alone.
+ * Throws std::runtime_error naming the processes still alive.
+ */
+void terminateProcesses(BusyProcessVec const& processes, int timeoutMillis);
+
+/**
+ * One line per process with its pid, command and uses.
+ */
+std::string formatBusyProcesses(BusyProcessVec const& processes);
+
+#endif
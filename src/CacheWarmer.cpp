@@ -0,0 +1,386 @@
+/**
+ * Copyright (c) 2007, Emir Uner
+ * All rights reserved.
+ * 
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ * 
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "CacheWarmer.hpp"
+#include "Config.hpp"
+#include "Posix.hpp"
+#include "Trace.hpp"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <fnmatch.h>
+#include <pthread.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+
+#include <algorithm>
+#include <deque>
+#include <sstream>
+#include <stdexcept>
+
+namespace
+{
+
+const size_t directoryBufferSize = 32768;
+
+/**
+ * The record getdents64 fills the buffer with.
+ */
+struct LinuxDirent64
+{
+    unsigned long long d_ino;
+    long long d_off;
+    unsigned short d_reclen;
+    unsigned char d_type;
+    char d_name[1];
+};
+
+struct WarmState
+{
+    int rootFd;
+    unsigned int rootDevMajor;
+    unsigned int rootDevMinor;
+    WarmOptions options;
+    long long deadline;
+    Progress* progress;
+    
+    pthread_mutex_t mutex;
+    pthread_cond_t changed;
+    
+    /**
+     * Directories waiting to be read, relative to the root.
+     */
+    std::deque<std::string> pending;
+    int busy;
+    bool stopped;
+    bool timedOut;
+    
+    volatile long long directories;
+    volatile long long files;
+    volatile long long readaheadBytes;
+};
+
+/**
+ * Hands out the next directory, waiting while others may still find more.
+ * False once the crawl is over.
+ */
+bool takeDirectory(WarmState* state, std::string& directory)
+{
+    pthread_mutex_lock(&state->mutex);
+    
+    while(!state->stopped && state->pending.empty() && state->busy > 0)
+    {
+        pthread_cond_wait(&state->changed, &state->mutex);
+    }
+    
+    const bool taken = !state->stopped && !state->pending.empty();
+    
+    if(taken)
+    {
+        directory = state->pending.front();
+        state->pending.pop_front();
+        ++state->busy;
+    }
+    
+    pthread_mutex_unlock(&state->mutex);
+    
+    return taken;
+}
+
+void finishDirectory(WarmState* state, std::vector<std::string> const& subdirectories)
+{
+    pthread_mutex_lock(&state->mutex);
+    state->pending.insert(state->pending.end(), subdirectories.begin(), subdirectories.end());
+    --state->busy;
+    pthread_cond_broadcast(&state->changed);
+    pthread_mutex_unlock(&state->mutex);
+}
+
+void stop(WarmState* state, bool timedOut)
+{
+    pthread_mutex_lock(&state->mutex);
+    state->stopped = true;
+    state->timedOut = state->timedOut || timedOut;
+    pthread_cond_broadcast(&state->changed);
+    pthread_mutex_unlock(&state->mutex);
+}
+
+bool isHotFile(WarmState* state, std::string const& path)
+{
+    for(std::vector<std::string>::const_iterator it = state->options.hotFiles.begin();
+        it != state->options.hotFiles.end(); ++it)
+    {
+        if(fnmatch(it->c_str(), path.c_str(), 0) == 0)
+        {
+            return true;
+        }
+    }
+    
+    return false;
+}
+
+/**
+ * Reads the file ahead if it still fits into the readahead allowance.
+ */
+void readAhead(WarmState* state, int directoryFd, char const* name, long long size)
+{
+    const long long limit = state->options.maxReadaheadMBytes * 1048576LL;
+    
+    if(__atomic_add_fetch(&state->readaheadBytes, size, __ATOMIC_RELAXED) > limit)
+    {
+        __atomic_sub_fetch(&state->readaheadBytes, size, __ATOMIC_RELAXED);
+        return;
+    }
+    
+    const int fd = openat(directoryFd, name, O_RDONLY | O_CLOEXEC | O_NOFOLLOW | O_NOATIME);
+    
+    // O_NOATIME is only allowed on files we own
+    const int readFd = fd == -1 && errno == EPERM ? openat(directoryFd, name, O_RDONLY | O_CLOEXEC | O_NOFOLLOW) : fd;
+    
+    if(readFd == -1 || readahead(readFd, 0, size) == -1)
+    {
+        __atomic_sub_fetch(&state->readaheadBytes, size, __ATOMIC_RELAXED);
+    }
+    
+    if(readFd != -1)
+    {
+        close(readFd);
+    }
+}
+
+/**
+ * Looks at one entry, which is what brings its inode into the cache.
+ * Returns true for a directory on the same filesystem.
+ */
+bool warmEntry(WarmState* state, int directoryFd, std::string const& path, char const* name)
+{
+    struct statx stx;
+    
+    if(statx(directoryFd, name, AT_SYMLINK_NOFOLLOW | AT_NO_AUTOMOUNT, STATX_TYPE | STATX_SIZE, &stx) == -1)
+    {
+        return false;
+    }
+    
+    if(S_ISDIR(stx.stx_mode))
+    {
+        return stx.stx_dev_major == state->rootDevMajor && stx.stx_dev_minor == state->rootDevMinor;
+    }
+    
+    __atomic_add_fetch(&state->files, 1, __ATOMIC_RELAXED);
+    
+    if(S_ISREG(stx.stx_mode) && stx.stx_size > 0 && isHotFile(state, path))
+    {
+        readAhead(state, directoryFd, name, static_cast<long long>(stx.stx_size));
+    }
+    
+    return false;
+}
+
+void warmDirectory(WarmState* state, std::string const& directory, char* buffer,
+                   std::vector<std::string>& subdirectories)
+{
+    const int fd = openat(state->rootFd, directory.empty() ? "." : directory.c_str(),
+                          O_RDONLY | O_DIRECTORY | O_CLOEXEC | O_NOFOLLOW);
+    
+    if(fd == -1)
+    {
+        return;
+    }
+    
+    __atomic_add_fetch(&state->directories, 1, __ATOMIC_RELAXED);
+    
+    for(;;)
+    {
+        const long count = syscall(SYS_getdents64, fd, buffer, directoryBufferSize);
+        
+        if(count <= 0)
+        {
+            break;
+        }
+        
+        for(long offset = 0; offset < count;)
+        {
+            LinuxDirent64 const* entry = reinterpret_cast<LinuxDirent64 const*>(buffer + offset);
+            char const* name = entry->d_name;
+            
+            offset += entry->d_reclen;
+            
+            if(strcmp(name, ".") == 0 || strcmp(name, "..") == 0)
+            {
+                continue;
+            }
+            
+            const std::string path = directory.empty() ? name : directory + "/" + name;
+            
+            if(warmEntry(state, fd, path, name))
+            {
+                subdirectories.push_back(path);
+            }
+        }
+        
+        if(monotonicMicroseconds() > state->deadline)
+        {
+            stop(state, true);
+            break;
+        }
+    }
+    
+    close(fd);
+}
+
+struct WarmWorker
+{
+    WarmState* state;
+    
+    void operator()()
+    {
+        TRACE_SCOPE("warm worker");
+        
+        std::vector<char> buffer(directoryBufferSize);
+        std::string directory;
+        
+        while(takeDirectory(state, directory))
+        {
+            std::vector<std::string> subdirectories;
+            
+            if(state->progress != 0 && state->progress->isCancelled())
+            {
+                stop(state, false);
+            }
+            else
+            {
+                warmDirectory(state, directory, &buffer[0], subdirectories);
+            }
+            
+            finishDirectory(state, subdirectories);
+        }
+    }
+};
+
+} // namespace <unnamed>
+
+WarmOptions getWarmOptions()
+{
+    Config config(getConfigPath("warm.conf"));
+    WarmOptions options;
+    
+    options.threads = std::max(1, config.getInt("", "threads", options.threads));
+    options.budgetMillis = std::max(0, config.getInt("", "budgetms", options.budgetMillis));
+    options.maxReadaheadMBytes = std::max(0, config.getInt("", "readaheadmb", options.maxReadaheadMBytes));
+    
+    return options;
+}
+
+WarmResult warmCache(std::string mountPoint, WarmOptions const& options, Progress* progress)
+{
+    TRACE_SCOPE("warm cache");
+    
+    const long long start = monotonicMicroseconds();
+    const int rootFd = open(mountPoint.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    struct statx stx;
+    
+    if(rootFd == -1 || statx(rootFd, "", AT_EMPTY_PATH, STATX_TYPE, &stx) == -1)
+    {
+        const int errorCode = errno;
+        
+        if(rootFd != -1)
+        {
+            close(rootFd);
+        }
+        
+        throw std::runtime_error(mountPoint + ": " + strerror(errorCode));
+    }
+    
+    WarmState state;
+    
+    state.rootFd = rootFd;
+    state.rootDevMajor = stx.stx_dev_major;
+    state.rootDevMinor = stx.stx_dev_minor;
+    state.options = options;
+    state.deadline = start + options.budgetMillis * 1000LL;
+    state.progress = progress;
+    state.pending.push_back("");
+    state.busy = 0;
+    state.stopped = false;
+    state.timedOut = false;
+    state.directories = 0;
+    state.files = 0;
+    state.readaheadBytes = 0;
+    pthread_mutex_init(&state.mutex, 0);
+    pthread_cond_init(&state.changed, 0);
+    
+    WarmWorker worker;
+    
+    worker.state = &state;
+    
+    std::vector<WarmWorker> workers(std::max(1, options.threads), worker);
+    
+    try
+    {
+        runThreads(workers);
+    }
+    catch(...)
+    {
+        pthread_cond_destroy(&state.changed);
+        pthread_mutex_destroy(&state.mutex);
+        close(rootFd);
+        throw;
+    }
+    
+    pthread_cond_destroy(&state.changed);
+    pthread_mutex_destroy(&state.mutex);
+    close(rootFd);
+    operation_cancelled::check(progress);
+    
+    WarmResult result;
+    
+    result.directories = state.directories;
+    result.files = state.files;
+    result.readaheadBytes = state.readaheadBytes;
+    result.seconds = (monotonicMicroseconds() - start) / 1e6;
+    result.timedOut = state.timedOut;
+    
+    return result;
+}
+
+std::string formatWarmResult(WarmResult const& result)
+{
+    std::ostringstream oss;
+    
+    oss << "Warmed " << result.directories << " directories and " << result.files << " files";
+    
+    if(result.readaheadBytes > 0)
+    {
+        oss << ", read ahead " << result.readaheadBytes / (1024 * 1024) << " MB";
+    }
+    
+    oss << " in " << static_cast<int>(result.seconds * 1000) << " ms"
+        << (result.timedOut ? " before the time budget ran out." : ".");
+    
+    return oss.str();
+}
@@ -0,0 +1,94 @@
+/**
+ * Copyright (c) 2007, Emir Uner
+ * All rights reserved.
+ * 
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ * 
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef EASYTC_CACHEWARMER_HPP_INCLUDED
+#define EASYTC_CACHEWARMER_HPP_INCLUDED
+
+#include "Progress.hpp"
+
+#include <string>
+#include <vector>
+
+struct WarmOptions
+{
+    /**
+     * Number of directories read at the same time.
+     */
+    int threads;
+    
+    /**
+     * The crawl stops when this time is up.
+     */
+    int budgetMillis;
+    
+    /**
+     * Patterns of files, relative to the mount point, that are read ahead.
+     * A "*" also matches across directories.
+     */
+    std::vector<std::string> hotFiles;
+    
+    /**
+     * The most the hot files are read ahead in total.
+     */
+    int maxReadaheadMBytes;
+    
+    inline WarmOptions()
+    : threads(8), budgetMillis(5000), maxReadaheadMBytes(256)
+    {
+    }
+};
+
+struct WarmResult
+{
+    long long directories;
+    long long files;
+    long long readaheadBytes;
+    double seconds;
+    
+    /**
+     * Whether the budget ran out before the whole tree was seen.
+     */
+    bool timedOut;
+};
+
+/**
+ * Reads the warm-up options from ~/.easytc/warm.conf, the keys are
+ * threads, budgetms and readaheadmb.
+ */
+WarmOptions getWarmOptions();
+
+/**
+ * Walks the filesystem mounted on the directory with a number of threads,
+ * reading each directory with getdents64 and each entry with statx, so that
+ * later lookups through the crypto layer find the dentries and inodes in
+ * the cache. Hot files are read ahead into the page cache. Mount points
+ * below the directory are not entered.
+ */
+WarmResult warmCache(std::string mountPoint, WarmOptions const& options, Progress* progress = 0);
+
+std::string formatWarmResult(WarmResult const& result);
+
+#endif
@@ -0,0 +1,139 @@
+/**
+ * Copyright (c) 2007, Emir Uner
+ * All rights reserved.
+ * 
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ * 
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "Config.hpp"
+#include "Posix.hpp"
+
+#include <stdlib.h>
+
+#include <algorithm>
+#include <fstream>
+
+namespace
+{
+
+std::string trim(std::string str)
+{
+    const std::string::size_type first = str.find_first_not_of(" \t\r");
+    
+    if(first == std::string::npos)
+    {
+        return "";
+    }
+    
+    return str.substr(first, str.find_last_not_of(" \t\r") - first + 1);
+}
+
+} // namespace <unnamed>
+
+Config::Config(std::string path)
+{
+    std::ifstream in(path.c_str());
+    std::string line;
+    std::string section;
+    
+    while(std::getline(in, line))
+    {
+        line = trim(line);
+        
+        if(line.empty() || line[0] == '#')
+        {
+            continue;
+        }
+        
+        if(line[0] == '[' && line[line.size() - 1] == ']')
+        {
+            section = trim(line.substr(1, line.size() - 2));
+            
+            if(std::find(sections.begin(), sections.end(), section) == sections.end())
+            {
+                sections.push_back(section);
+            }
+            
+            continue;
+        }
+        
+        const std::string::size_type equals = line.find('=');
+        
+        if(equals == std::string::npos)
+        {
+            continue;
+        }
+        
+        Entry entry;
+        
+        entry.section = section;
+        entry.key = trim(line.substr(0, equals));
+        entry.value = trim(line.substr(equals + 1));
+        entries.push_back(entry);
+    }
+}
+
+std::vector<std::string> Config::getSections() const
+{
+    return sections;
+}
+
+std::string Config::get(std::string section, std::string key, std::string defaultValue) const
+{
+    // the last one wins when a single value is asked for
+    for(std::vector<Entry>::const_reverse_iterator it = entries.rbegin(); it != entries.rend(); ++it)
+    {
+        if(it->section == section && it->key == key)
+        {
+            return it->value;
+        }
+    }
+    
+    return defaultValue;
+}
+
+int Config::getInt(std::string section, std::string key, int defaultValue) const
+{
+    const std::string value = get(section, key);
+    
+    return value.empty() ? defaultValue : atoi(value.c_str());
+}
+
+std::vector<std::string> Config::getAll(std::string section, std::string key) const
+{
+    std::vector<std::string> values;
+    
+    for(std::vector<Entry>::const_iterator it = entries.begin(); it != entries.end(); ++it)
+    {
+        if(it->section == section && it->key == key)
+        {
+            values.push_back(it->value);
+        }
+    }
+    
+    return values;
+}
+
+std::string getConfigPath(std::string name)
+{
+    return getDataDirectory() + "/" + name;
+}
@@ -0,0 +1,69 @@
+/**
+ * Copyright (c) 2007, Emir Uner
+ * All rights reserved.
+ * 
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ * 
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef EASYTC_CONFIG_HPP_INCLUDED
+#define EASYTC_CONFIG_HPP_INCLUDED
+
+#include <string>
+#include <vector>
+
+/**
+ * Reads simple configuration files made of "[section]" headers and
+ * "key = value" lines. Lines starting with '#' are comments, keys may be
+ * repeated and keys before the first header belong to the "" section.
+ */
+class Config
+{
+public:
+    /**
+     * Reads the file. A missing file gives an empty configuration.
+     */
+    explicit Config(std::string path);
+    
+    std::vector<std::string> getSections() const;
+    
+    std::string get(std::string section, std::string key, std::string defaultValue = "") const;
+    int getInt(std::string section, std::string key, int defaultValue) const;
+    std::vector<std::string> getAll(std::string section, std::string key) const;
+    
+private:
+    struct Entry
+    {
+        std::string section;
+        std::string key;
+        std::string value;
+    };
+    
+    std::vector<Entry> entries;
+    std::vector<std::string> sections;
+};
+
+/**
+ * Returns the path of the named configuration file in ~/.easytc.
+ */
+std::string getConfigPath(std::string name);
+
+#endif
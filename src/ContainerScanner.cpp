@@ -0,0 +1,471 @@
+/**
+ * Copyright (c) 2007, Emir Uner
+ * All rights reserved.
+ * 
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ * 
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "ContainerScanner.hpp"
+#include "Posix.hpp"
+
+#include <dirent.h>
+#include <fcntl.h>
+#include <math.h>
+#include <sys/stat.h>
+
+#include <fstream>
+#include <map>
+
+namespace
+{
+
+const long long minimumSize = 256 * 1024;
+const int headerSample = 512;
+const int bodySample = 4096;
+const int bodySamples = 3;
+
+/**
+ * Random data gives about 7.6 bits per byte over 512 bytes and 7.99 over
+ * the whole sample; file formats with readable headers fall well below.
+ */
+const double headerEntropyThreshold = 7.2;
+const double sampleEntropyThreshold = 7.95;
+
+struct CacheKey
+{
+    dev_t device;
+    ino_t inode;
+    
+    bool operator<(CacheKey const& other) const
+    {
+        return device != other.device ? device < other.device : inode < other.inode;
+    }
+};
+
+struct CacheEntry
+{
+    long long size;
+    long long mtime;
+    double entropy;
+    bool candidate;
+    
+    /**
+     * Where the walk last found the file, for dropping it once it is gone.
+     */
+    std::string path;
+};
+
+typedef std::map<CacheKey, CacheEntry> ScanCache;
+
+std::string getCachePath()
+{
+    return getDataDirectory() + "/scan-cache";
+}
+
+ScanCache loadCache()
+{
+    ScanCache cache;
+    std::ifstream in(getCachePath().c_str());
+    unsigned long long device;
+    unsigned long long inode;
+    CacheEntry entry;
+    
+    while(in >> device >> inode >> entry.size >> entry.mtime >> entry.entropy >> entry.candidate
+          && std::getline(in, entry.path))
+    {
+        CacheKey key;
+        
+        key.device = static_cast<dev_t>(device);
+        key.inode = static_cast<ino_t>(inode);
+        entry.path.erase(0, 1);
+        
+        // written before paths were kept, sampled again
+        if(!entry.path.empty())
+        {
+            cache[key] = entry;
+        }
+    }
+    
+    return cache;
+}
+
+void saveCache(ScanCache const& cache)
+{
+    const std::string path = getCachePath();
+    const std::string temporary = path + ".new";
+    std::ofstream out(temporary.c_str(), std::ios::trunc);
+    
+    for(ScanCache::const_iterator it = cache.begin(); it != cache.end(); ++it)
+    {
+        // the path ends the line
+        if(it->second.path.find('\n') != std::string::npos)
+        {
+            continue;
+        }
+        
+        out << static_cast<unsigned long long>(it->first.device) << ' '
+            << static_cast<unsigned long long>(it->first.inode) << ' '
+            << it->second.size << ' ' << it->second.mtime << ' '
+            << it->second.entropy << ' ' << it->second.candidate << ' ' << it->second.path << '\n';
+    }
+    
+    out.close();
+    
+    if(out)
+    {
+        rename(temporary.c_str(), path.c_str());
+    }
+}
+
+double computeEntropy(unsigned int const* histogram, long long total)
+{
+    double entropy = 0;
+    
+    for(int i = 0; i < 256; ++i)
+    {
+        if(histogram[i] != 0)
+        {
+            const double p = static_cast<double>(histogram[i]) / total;
+            
+            entropy -= p * log(p) / log(2.0);
+        }
+    }
+    
+    return entropy;
+}
+
+void addToHistogram(unsigned int* histogram, unsigned char const* data, int length)
+{
+    for(int i = 0; i < length; ++i)
+    {
+        ++histogram[data[i]];
+    }
+}
+
+bool readSample(int fd, unsigned char* buffer, int length, long long offset)
+{
+    ssize_t result;
+    
+    do
+    {
+        result = pread(fd, buffer, length, offset);
+    }
+    while(result == -1 && errno == EINTR);
+    
+    return result == length;
+}
+
+/**
+ * Samples the header and a few body blocks of the file and decides whether
+ * it looks encrypted. The blocks are read rather than mapped, a file that
+ * shrinks in the meantime would fault a mapping; it is not a candidate.
+ */
+bool sampleFile(int dirFd, char const* name, long long size, double& entropy)
+{
+    const int fd = openat(dirFd, name, O_RDONLY | O_NOATIME | O_CLOEXEC);
+    const int fallbackFd = fd == -1 && errno == EPERM ? openat(dirFd, name, O_RDONLY | O_CLOEXEC) : fd;
+    
+    entropy = 0;
+    
+    if(fallbackFd == -1)
+    {
+        return false;
+    }
+    
+    unsigned char buffer[bodySample];
+    unsigned int histogram[256] = { 0 };
+    bool candidate = readSample(fallbackFd, buffer, headerSample, 0);
+    
+    if(candidate)
+    {
+        addToHistogram(histogram, buffer, headerSample);
+        entropy = computeEntropy(histogram, headerSample);
+        candidate = entropy >= headerEntropyThreshold;
+    }
+    
+    for(int i = 1; candidate && i <= bodySamples; ++i)
+    {
+        const long long offset = (size * i / (bodySamples + 1)) & ~static_cast<long long>(bodySample - 1);
+        
+        candidate = readSample(fallbackFd, buffer, bodySample, offset);
+        addToHistogram(histogram, buffer, candidate ? bodySample : 0);
+    }
+    
+    if(candidate)
+    {
+        entropy = computeEntropy(histogram, headerSample + bodySamples * bodySample);
+        candidate = entropy >= sampleEntropyThreshold;
+    }
+    
+    close(fallbackFd);
+    
+    return candidate;
+}
+
+struct WalkState
+{
+    pthread_mutex_t mutex;
+    pthread_cond_t cond;
+    std::vector<std::string> directories;
+    int busy;
+    dev_t device;
+    ScanCache const* cache;
+    Progress* progress;
+    
+    WalkState()
+    : busy(0)
+    {
+        pthread_mutex_init(&mutex, 0);
+        pthread_cond_init(&cond, 0);
+    }
+    
+    ~WalkState()
+    {
+        pthread_cond_destroy(&cond);
+        pthread_mutex_destroy(&mutex);
+    }
+};
+
+struct Walker
+{
+    WalkState* state;
+    ContainerCandidateVec candidates;
+    ScanCache newCache;
+    ScanStats stats;
+    
+    void operator()()
+    {
+        stats.directories = stats.files = stats.sampled = stats.cached = 0;
+        
+        std::string directory;
+        
+        while(nextDirectory(directory))
+        {
+            std::vector<std::string> subdirectories;
+            
+            if(!state->progress || !state->progress->isCancelled())
+            {
+                scanDirectory(directory, subdirectories);
+            }
+            
+            finishDirectory(subdirectories);
+        }
+    }
+    
+    bool nextDirectory(std::string& directory)
+    {
+        pthread_mutex_lock(&state->mutex);
+        
+        while(state->directories.empty() && state->busy > 0)
+        {
+            pthread_cond_wait(&state->cond, &state->mutex);
+        }
+        
+        const bool found = !state->directories.empty();
+        
+        if(found)
+        {
+            directory = state->directories.back();
+            state->directories.pop_back();
+            ++state->busy;
+        }
+        
+        pthread_mutex_unlock(&state->mutex);
+        
+        return found;
+    }
+    
+    void finishDirectory(std::vector<std::string> const& subdirectories)
+    {
+        pthread_mutex_lock(&state->mutex);
+        
+        state->directories.insert(state->directories.end(), subdirectories.begin(), subdirectories.end());
+        --state->busy;
+        pthread_cond_broadcast(&state->cond);
+        
+        pthread_mutex_unlock(&state->mutex);
+    }
+    
+    void scanDirectory(std::string const& directory, std::vector<std::string>& subdirectories)
+    {
+        const int dirFd = open(directory.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+        
+        if(dirFd == -1)
+        {
+            return;
+        }
+        
+        DIR* dir = fdopendir(dirFd);
+        
+        if(dir == 0)
+        {
+            close(dirFd);
+            return;
+        }
+        
+        ++stats.directories;
+        
+        for(struct dirent* entry = readdir(dir); entry != 0; entry = readdir(dir))
+        {
+            char const* name = entry->d_name;
+            
+            if(name[0] == '.' && (name[1] == '\0' || (name[1] == '.' && name[2] == '\0')))
+            {
+                continue;
+            }
+            
+            if(entry->d_type != DT_DIR && entry->d_type != DT_REG && entry->d_type != DT_UNKNOWN)
+            {
+                continue;
+            }
+            
+            struct stat st;
+            
+            if(fstatat(dirFd, name, &st, AT_SYMLINK_NOFOLLOW) == -1 || st.st_dev != state->device)
+            {
+                continue;
+            }
+            
+            if(S_ISDIR(st.st_mode))
+            {
+                subdirectories.push_back(directory + "/" + name);
+            }
+            else if(S_ISREG(st.st_mode))
+            {
+                ++stats.files;
+                checkFile(dirFd, directory, name, st);
+            }
+        }
+        
+        closedir(dir);
+    }
+    
+    void checkFile(int dirFd, std::string const& directory, char const* name, struct stat const& st)
+    {
+        if(st.st_size < minimumSize || st.st_size % 512 != 0)
+        {
+            return;
+        }
+        
+        CacheKey key;
+        
+        key.device = st.st_dev;
+        key.inode = st.st_ino;
+        
+        ScanCache::const_iterator cached = state->cache->find(key);
+        CacheEntry entry;
+        
+        if(cached != state->cache->end() && cached->second.size == st.st_size
+           && cached->second.mtime == st.st_mtime)
+        {
+            entry = cached->second;
+            ++stats.cached;
+        }
+        else
+        {
+            entry.size = st.st_size;
+            entry.mtime = st.st_mtime;
+            entry.candidate = sampleFile(dirFd, name, st.st_size, entry.entropy);
+            ++stats.sampled;
+        }
+        
+        entry.path = directory + "/" + name;
+        newCache[key] = entry;
+        
+        if(entry.candidate)
+        {
+            ContainerCandidate candidate;
+            
+            candidate.path = directory + "/" + name;
+            candidate.size = st.st_size;
+            candidate.entropy = entry.entropy;
+            candidates.push_back(candidate);
+        }
+    }
+};
+
+} // namespace <unnamed>
+
+ContainerCandidateVec scanForContainers(std::string root, ScanStats& stats, Progress* progress)
+{
+    struct stat st;
+    
+    if(stat(root.c_str(), &st) == -1 || !S_ISDIR(st.st_mode))
+    {
+        throw std::runtime_error(root + " is not a directory");
+    }
+    
+    const ScanCache cache = loadCache();
+    WalkState state;
+    
+    const std::string top = root.size() > 1 && root[root.size() - 1] == '/' ? root.substr(0, root.size() - 1) : root;
+    
+    state.directories.push_back(top);
+    state.device = st.st_dev;
+    state.cache = &cache;
+    state.progress = progress;
+    
+    // directory reads and stats block on I/O, so use more threads than cores
+    std::vector<Walker> walkers(getProcessorCount() * 2 < 32 ? getProcessorCount() * 2 : 32);
+    
+    for(unsigned int i = 0; i < walkers.size(); ++i)
+    {
+        walkers[i].state = &state;
+    }
+    
+    runThreads(walkers);
+    operation_cancelled::check(progress);
+    
+    ContainerCandidateVec candidates;
+    ScanCache newCache;
+    const std::string prefix = top + "/";
+    
+    // entries of other trees stay, those under root only if the walk found them
+    for(ScanCache::const_iterator it = cache.begin(); it != cache.end(); ++it)
+    {
+        if(it->second.path.compare(0, prefix.size(), prefix) != 0)
+        {
+            newCache.insert(*it);
+        }
+    }
+    
+    stats.directories = stats.files = stats.sampled = stats.cached = 0;
+    
+    for(unsigned int i = 0; i < walkers.size(); ++i)
+    {
+        candidates.insert(candidates.end(), walkers[i].candidates.begin(), walkers[i].candidates.end());
+        
+        for(ScanCache::const_iterator it = walkers[i].newCache.begin(); it != walkers[i].newCache.end(); ++it)
+        {
+            newCache[it->first] = it->second;
+        }
+        
+        stats.directories += walkers[i].stats.directories;
+        stats.files += walkers[i].stats.files;
+        stats.sampled += walkers[i].stats.sampled;
+        stats.cached += walkers[i].stats.cached;
+    }
+    
+    saveCache(newCache);
+    
+    return candidates;
+}
@@ -0,0 +1,69 @@
+/**
+ * Copyright (c) 2007, Emir Uner
+ * All rights reserved.
+ * 
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ * 
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef EASYTC_CONTAINERSCANNER_HPP_INCLUDED
+#define EASYTC_CONTAINERSCANNER_HPP_INCLUDED
+
+#include "Progress.hpp"
+
+#include <string>
+#include <vector>
+
+struct ContainerCandidate
+{
+    std::string path;
+    long long size;
+    
+    /**
+     * Shannon entropy of the sampled data in bits per byte.
+     */
+    double entropy;
+};
+
+typedef std::vector<ContainerCandidate> ContainerCandidateVec;
+
+struct ScanStats
+{
+    long long directories;
+    long long files;
+    long long sampled;
+    long long cached;
+};
+
+/**
+ * Walks the directory tree under root on several threads, staying on the
+ * root's filesystem, and returns the files that look like TrueCrypt
+ * containers: a size that is a multiple of 512 bytes and at least the
+ * header area, and a random looking header and body. Only a few sampled
+ * blocks of each file are read, files that shrink meanwhile are skipped.
+ *
+ * Verdicts are cached by device, inode, size and mtime in
+ * ~/.easytc/scan-cache, so rescans only sample files that changed. Entries
+ * under root that the walk no longer finds are dropped.
+ */
+ContainerCandidateVec scanForContainers(std::string root, ScanStats& stats, Progress* progress = 0);
+
+#endif
@@ -0,0 +1,400 @@
+/**
+ * Copyright (c) 2007, Emir Uner
+ * All rights reserved.
+ * 
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ * 
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "CryptoAcceleration.hpp"
+#include "DmCrypt.hpp"
+#include "Posix.hpp"
+#include "Trace.hpp"
+
+#include <stdlib.h>
+
+#include <fstream>
+#include <map>
+#include <sstream>
+
+namespace
+{
+
+struct DmTargets
+{
+    std::vector<std::string> ciphers;
+    int flags;
+    
+    inline DmTargets()
+    : flags(0)
+    {
+    }
+};
+
+typedef std::map<std::string, DmTargets> CipherMap;
+
+char const* const cryptoFlags[] =
+{
+    "aes", "vaes", "pclmulqdq", "vpclmulqdq", "avx", "avx2", "avx512f", "sha_ni", "pmull", "sha2"
+};
+
+std::string readFile(char const* path)
+{
+    std::ifstream in(path);
+    std::ostringstream oss;
+    
+    oss << in.rdbuf();
+    
+    return oss.str();
+}
+
+std::string trim(std::string const& str)
+{
+    const std::string::size_type first = str.find_first_not_of(" \t");
+    const std::string::size_type last = str.find_last_not_of(" \t");
+    
+    return first == std::string::npos ? "" : str.substr(first, last - first + 1);
+}
+
+/**
+ * Collects the cipher and flags of every crypt target from "dmsetup
+ * table", which prints "name: start length crypt cipher key iv_offset
+ * device offset [count params...]" lines.
+ */
+CipherMap parseDmTable(std::string const& output)
+{
+    CipherMap ciphers;
+    std::istringstream lines(output);
+    std::string line;
+    
+    while(std::getline(lines, line))
+    {
+        std::istringstream words(line);
+        std::string name;
+        std::string start;
+        std::string length;
+        std::string target;
+        std::string cipher;
+        
+        if(words >> name >> start >> length >> target >> cipher && target == "crypt"
+           && name[name.size() - 1] == ':')
+        {
+            DmTargets& targets = ciphers[name.substr(0, name.size() - 1)];
+            std::string param;
+            
+            targets.ciphers.push_back(cipher);
+            
+            while(words >> param)
+            {
+                targets.flags |= getDmCryptFlag(param);
+            }
+        }
+    }
+    
+    return ciphers;
+}
+
+/**
+ * Returns the ciphers of the mapping and of the inner mappings truecrypt
+ * stacks under it for cascades, which are named "<name>_<n>".
+ */
+DmTargets getTargets(CipherMap const& ciphers, std::string const& device)
+{
+    const std::string name = device.substr(device.rfind('/') + 1);
+    DmTargets result;
+    
+    for(CipherMap::const_iterator it = ciphers.begin(); it != ciphers.end(); ++it)
+    {
+        if(it->first == name || it->first.compare(0, name.size() + 1, name + "_") == 0)
+        {
+            result.ciphers.insert(result.ciphers.end(), it->second.ciphers.begin(), it->second.ciphers.end());
+            
+            // the flags are set on the outer mapping
+            if(it->first == name)
+            {
+                result.flags = it->second.flags;
+            }
+        }
+    }
+    
+    return result;
+}
+
+} // namespace <unnamed>
+
+CryptoDriverVec parseProcCrypto(std::string const& contents)
+{
+    CryptoDriverVec drivers;
+    std::istringstream lines(contents);
+    std::string line;
+    CryptoDriver driver;
+    
+    driver.priority = 0;
+    
+    // entries are separated by blank lines
+    while(std::getline(lines, line))
+    {
+        const std::string::size_type colon = line.find(':');
+        
+        if(colon == std::string::npos)
+        {
+            if(!driver.name.empty())
+            {
+                drivers.push_back(driver);
+            }
+            
+            driver = CryptoDriver();
+            driver.priority = 0;
+            continue;
+        }
+        
+        const std::string key = trim(line.substr(0, colon));
+        const std::string value = trim(line.substr(colon + 1));
+        
+        if(key == "name")
+        {
+            driver.name = value;
+        }
+        else if(key == "driver")
+        {
+            driver.driver = value;
+        }
+        else if(key == "priority")
+        {
+            driver.priority = atoi(value.c_str());
+        }
+    }
+    
+    if(!driver.name.empty())
+    {
+        drivers.push_back(driver);
+    }
+    
+    return drivers;
+}
+
+std::string getCryptoApiName(std::string dmCipher)
+{
+    // "capi:xts(aes)-plain64"
+    if(dmCipher.compare(0, 5, "capi:") == 0)
+    {
+        const std::string::size_type dash = dmCipher.rfind('-');
+        
+        return dmCipher.substr(5, dash == std::string::npos || dash < 5 ? std::string::npos : dash - 5);
+    }
+    
+    // "aes-xts-plain64", "aes-cbc-essiv:sha256", "aes"
+    const std::string::size_type dash = dmCipher.find('-');
+    
+    if(dash == std::string::npos)
+    {
+        return "cbc(" + dmCipher + ")";
+    }
+    
+    const std::string::size_type second = dmCipher.find('-', dash + 1);
+    
+    return dmCipher.substr(dash + 1, second == std::string::npos ? std::string::npos : second - dash - 1)
+           + "(" + dmCipher.substr(0, dash) + ")";
+}
+
+CryptoDriver const* findCryptoDriver(CryptoDriverVec const& drivers, std::string name)
+{
+    CryptoDriver const* best = 0;
+    
+    for(CryptoDriverVec::const_iterator it = drivers.begin(); it != drivers.end(); ++it)
+    {
+        if(it->name == name && (best == 0 || it->priority > best->priority))
+        {
+            best = &*it;
+        }
+    }
+    
+    return best;
+}
+
+bool isAcceleratedDriver(std::string const& driver)
+{
+    // "aes-generic" and the cache timing hardened "aes-fixed-time" are C
+    return !driver.empty() && driver.find("generic") == std::string::npos
+           && driver.find("fixed-time") == std::string::npos;
+}
+
+std::string getCpuCryptoFlags(std::string const& cpuinfo)
+{
+    std::istringstream lines(cpuinfo);
+    std::string line;
+    
+    // x86 calls them flags, ARM features; the first processor is enough
+    while(std::getline(lines, line))
+    {
+        const std::string::size_type colon = line.find(':');
+        
+        if(colon == std::string::npos)
+        {
+            continue;
+        }
+        
+        const std::string key = trim(line.substr(0, colon));
+        
+        if(key != "flags" && key != "Features")
+        {
+            continue;
+        }
+        
+        std::istringstream words(line.substr(colon + 1));
+        std::vector<std::string> present;
+        std::string word;
+        std::string result;
+        
+        while(words >> word)
+        {
+            present.push_back(word);
+        }
+        
+        for(size_t i = 0; i < sizeof(cryptoFlags) / sizeof(cryptoFlags[0]); ++i)
+        {
+            for(std::vector<std::string>::const_iterator it = present.begin(); it != present.end(); ++it)
+            {
+                if(*it == cryptoFlags[i])
+                {
+                    result += result.empty() ? *it : " " + *it;
+                    break;
+                }
+            }
+        }
+        
+        return result;
+    }
+    
+    return "";
+}
+
+CryptoReportVec getCryptoReports(MountInfoVec const& mountInfos)
+{
+    TRACE_SCOPE("crypto reports");
+    
+    CryptoReportVec reports;
+    
+    if(mountInfos.empty())
+    {
+        return reports;
+    }
+    
+    int exitCode;
+    const std::string table = executeCommand("dmsetup", "table", exitCode);
+    const CipherMap ciphers = exitCode == 0 ? parseDmTable(table) : CipherMap();
+    const CryptoDriverVec drivers = parseProcCrypto(readFile("/proc/crypto"));
+    const std::string cpuFlags = getCpuCryptoFlags(readFile("/proc/cpuinfo"));
+    
+    for(MountInfoVec::const_iterator it = mountInfos.begin(); it != mountInfos.end(); ++it)
+    {
+        const DmTargets targets = getTargets(ciphers, it->device);
+        CryptoReport report;
+        
+        report.accelerated = !targets.ciphers.empty();
+        report.dmCryptFlags = targets.flags;
+        report.cpuFlags = cpuFlags;
+        
+        for(std::vector<std::string>::const_iterator cipher = targets.ciphers.begin();
+            cipher != targets.ciphers.end(); ++cipher)
+        {
+            const std::string name = getCryptoApiName(*cipher);
+            CryptoDriver const* driver = findCryptoDriver(drivers, name);
+            const std::string::size_type open = name.rfind('(');
+            
+            // the mode may not be listed yet, the block cipher decides anyway
+            if(driver == 0 && open != std::string::npos)
+            {
+                driver = findCryptoDriver(drivers, name.substr(open + 1, name.find(')', open) - open - 1));
+            }
+            
+            CipherInfo info;
+            
+            info.cipher = *cipher;
+            info.driver = driver != 0 ? driver->driver : "";
+            info.accelerated = isAcceleratedDriver(info.driver);
+            report.accelerated = report.accelerated && info.accelerated;
+            report.ciphers.push_back(info);
+        }
+        
+        reports.push_back(report);
+    }
+    
+    return reports;
+}
+
+std::string formatCryptoReport(CryptoReport const& report)
+{
+    if(report.ciphers.empty())
+    {
+        return "unknown";
+    }
+    
+    std::string text;
+    
+    for(CipherInfoVec::const_iterator it = report.ciphers.begin(); it != report.ciphers.end(); ++it)
+    {
+        text += (text.empty() ? "" : ", ") + (it->driver.empty() ? it->cipher : it->driver);
+    }
+    
+    if(report.dmCryptFlags != 0)
+    {
+        text += " [" + formatDmCryptFlags(report.dmCryptFlags) + "]";
+    }
+    
+    return report.accelerated ? text : text + " (software!)";
+}
+
+std::string describeCryptoReport(CryptoReport const& report)
+{
+    std::ostringstream oss;
+    
+    if(report.ciphers.empty())
+    {
+        oss << "The dm table of the volume could not be read, dmsetup needs root.";
+    }
+    
+    for(CipherInfoVec::const_iterator it = report.ciphers.begin(); it != report.ciphers.end(); ++it)
+    {
+        oss << it->cipher << " runs on " << (it->driver.empty() ? "an unlisted driver" : it->driver)
+            << (it->accelerated ? ".\n" : ", a portable software implementation.\n");
+    }
+    
+    if(report.dmCryptFlags != 0)
+    {
+        oss << "dm-crypt flags: " << formatDmCryptFlags(report.dmCryptFlags) << "\n";
+    }
+    
+    oss << "CPU crypto flags: " << (report.cpuFlags.empty() ? "none" : report.cpuFlags);
+    
+    if(!report.ciphers.empty() && !report.accelerated)
+    {
+        oss << "\nExpect several times lower throughput.";
+        
+        if((" " + report.cpuFlags + " ").find(" aes ") != std::string::npos)
+        {
+            oss << " The CPU has AES instructions, loading the accelerated module"
+                << " (aesni_intel on x86, aes_ce_blk on ARM) and remounting should fix this.";
+        }
+    }
+    
+    return oss.str();
+}
@@ -0,0 +1,134 @@
+/**
+ * Copyright (c) 2007, Emir Uner
+ * All rights reserved.
+ * 
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ * 
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef EASYTC_CRYPTOACCELERATION_HPP_INCLUDED
+#define EASYTC_CRYPTOACCELERATION_HPP_INCLUDED
+
+#include "MountInfo.hpp"
+
+#include <string>
+#include <vector>
+
+/**
+ * One entry of /proc/crypto.
+ */
+struct CryptoDriver
+{
+    /**
+     * Algorithm name as the crypto API knows it, e.g. "xts(aes)".
+     */
+    std::string name;
+    
+    /**
+     * The implementation, e.g. "xts-aes-aesni" or "xts(ecb(aes-generic))".
+     */
+    std::string driver;
+    int priority;
+};
+
+typedef std::vector<CryptoDriver> CryptoDriverVec;
+
+/**
+ * A dm-crypt target behind a volume, cascades have several.
+ */
+struct CipherInfo
+{
+    /**
+     * Cipher specification from the dm table, e.g. "aes-xts-plain64".
+     */
+    std::string cipher;
+    
+    /**
+     * Driver the kernel picks for it, empty if /proc/crypto does not list one.
+     */
+    std::string driver;
+    bool accelerated;
+};
+
+typedef std::vector<CipherInfo> CipherInfoVec;
+
+struct CryptoReport
+{
+    /**
+     * Empty if the dm table of the volume could not be read.
+     */
+    CipherInfoVec ciphers;
+    bool accelerated;
+    
+    /**
+     * DmCryptFlag values set on the mapping.
+     */
+    int dmCryptFlags;
+    
+    /**
+     * Crypto related CPU flags, e.g. "aes avx2 vaes".
+     */
+    std::string cpuFlags;
+};
+
+typedef std::vector<CryptoReport> CryptoReportVec;
+
+CryptoDriverVec parseProcCrypto(std::string const& contents);
+
+/**
+ * Translates a dm-crypt cipher specification to the crypto API name,
+ * "aes-xts-plain64" to "xts(aes)".
+ */
+std::string getCryptoApiName(std::string dmCipher);
+
+/**
+ * Returns the driver the kernel uses for the algorithm, the one with the
+ * highest priority, or 0 if there is none.
+ */
+CryptoDriver const* findCryptoDriver(CryptoDriverVec const& drivers, std::string name);
+
+/**
+ * Whether the driver is more than the portable C implementation.
+ */
+bool isAcceleratedDriver(std::string const& driver);
+
+/**
+ * Picks the crypto related flags out of /proc/cpuinfo.
+ */
+std::string getCpuCryptoFlags(std::string const& cpuinfo);
+
+/**
+ * Finds out which cipher drivers back the mapped volumes, combining
+ * "dmsetup table" with /proc/crypto. Returns one report per volume.
+ */
+CryptoReportVec getCryptoReports(MountInfoVec const& mountInfos);
+
+/**
+ * Short text for the mount table.
+ */
+std::string formatCryptoReport(CryptoReport const& report);
+
+/**
+ * Longer explanation, including what to do about software crypto.
+ */
+std::string describeCryptoReport(CryptoReport const& report);
+
+#endif
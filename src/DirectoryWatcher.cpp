@@ -0,0 +1,114 @@
+/**
+ * Copyright (c) 2007, Emir Uner
+ * All rights reserved.
+ * 
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ * 
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "DirectoryWatcher.hpp"
+#include "Posix.hpp"
+
+#include <sys/inotify.h>
+
+DirectoryWatcher::DirectoryWatcher()
+{
+    fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+    unix_error::check(fd);
+}
+
+DirectoryWatcher::~DirectoryWatcher()
+{
+    close(fd);
+}
+
+void DirectoryWatcher::addDirectory(std::string directory)
+{
+    const int wd = inotify_add_watch(fd, directory.c_str(), IN_CLOSE_WRITE | IN_MOVED_TO | IN_MODIFY | IN_ONLYDIR);
+    
+    if(wd == -1)
+    {
+        throw std::runtime_error(directory + ": " + strerror(errno));
+    }
+    
+    directories[wd] = directory;
+}
+
+int DirectoryWatcher::getFd() const
+{
+    return fd;
+}
+
+std::vector<std::string> DirectoryWatcher::getDirectories() const
+{
+    std::vector<std::string> result;
+    
+    for(std::map<int, std::string>::const_iterator it = directories.begin(); it != directories.end(); ++it)
+    {
+        result.push_back(it->second);
+    }
+    
+    return result;
+}
+
+WatchEventVec DirectoryWatcher::readEvents(bool& overflowed)
+{
+    WatchEventVec events;
+    
+    overflowed = false;
+    char buffer[16 * 1024] __attribute__((aligned(__alignof__(struct inotify_event))));
+    
+    for(;;)
+    {
+        const ssize_t count = read(fd, buffer, sizeof(buffer));
+        
+        if(count == -1 && (errno == EAGAIN || errno == EINTR))
+        {
+            break;
+        }
+        
+        unix_error::check(static_cast<int>(count));
+        
+        const long long now = monotonicMicroseconds();
+        
+        for(char* ptr = buffer; ptr < buffer + count; )
+        {
+            struct inotify_event const* event = reinterpret_cast<struct inotify_event const*>(ptr);
+            std::map<int, std::string>::const_iterator dir = directories.find(event->wd);
+            
+            overflowed = overflowed || (event->mask & IN_Q_OVERFLOW) != 0;
+            
+            if(dir != directories.end() && event->len > 0 && (event->mask & IN_ISDIR) == 0)
+            {
+                WatchEvent watchEvent;
+                
+                watchEvent.path = dir->second + "/" + event->name;
+                watchEvent.complete = (event->mask & (IN_CLOSE_WRITE | IN_MOVED_TO)) != 0;
+                watchEvent.time = now;
+                events.push_back(watchEvent);
+            }
+            
+            ptr += sizeof(struct inotify_event) + event->len;
+        }
+    }
+    
+    return events;
+}
@@ -0,0 +1,85 @@
+/**
+ * Copyright (c) 2007, Emir Uner
+ * All rights reserved.
+ * 
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ * 
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef EASYTC_DIRECTORYWATCHER_HPP_INCLUDED
+#define EASYTC_DIRECTORYWATCHER_HPP_INCLUDED
+
+#include <map>
+#include <string>
+#include <vector>
+
+struct WatchEvent
+{
+    std::string path;
+    
+    /**
+     * True when a writer closed the file or it was moved in complete,
+     * false for a plain modification that may be followed by more.
+     */
+    bool complete;
+    
+    /**
+     * Monotonic time the event was read, see monotonicMicroseconds().
+     */
+    long long time;
+};
+
+typedef std::vector<WatchEvent> WatchEventVec;
+
+/**
+ * Watches directories for files being written or moved into them using
+ * inotify. The descriptor is non-blocking and meant to be put in the
+ * caller's event loop.
+ */
+class DirectoryWatcher
+{
+public:
+    DirectoryWatcher();
+    ~DirectoryWatcher();
+    
+    void addDirectory(std::string directory);
+    
+    int getFd() const;
+    
+    std::vector<std::string> getDirectories() const;
+    
+    /**
+     * Returns the events that are ready without blocking. Sets overflowed
+     * if the kernel's queue was full and events were dropped, the
+     * directories then have to be listed to find what was missed. Throws
+     * unix_error if the events cannot be read.
+     */
+    WatchEventVec readEvents(bool& overflowed);
+    
+private:
+    DirectoryWatcher(DirectoryWatcher const&);
+    DirectoryWatcher& operator=(DirectoryWatcher const&);
+    
+    int fd;
+    std::map<int, std::string> directories;
+};
+
+#endif
@@ -0,0 +1,299 @@
+/**
+ * Copyright (c) 2007, Emir Uner
+ * All rights reserved.
+ * 
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ * 
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "DmCrypt.hpp"
+#include "Posix.hpp"
+#include "Trace.hpp"
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <algorithm>
+#include <sstream>
+#include <stdexcept>
+#include <vector>
+
+namespace
+{
+
+char const* const flagNames[dmCryptFlagCount] =
+{
+    "no_read_workqueue", "no_write_workqueue", "same_cpu_crypt", "submit_from_crypt_cpus", "allow_discards"
+};
+
+/**
+ * A word of a dm table, pointing into the secret holding it so that the
+ * key is never copied.
+ */
+struct Word
+{
+    char const* data;
+    size_t length;
+};
+
+Word makeWord(char const* text)
+{
+    const Word word = { text, strlen(text) };
+    
+    return word;
+}
+
+bool isWord(Word const& word, char const* text)
+{
+    return word.length == strlen(text) && memcmp(word.data, text, word.length) == 0;
+}
+
+int findFlag(Word const& word)
+{
+    for(int i = 0; i < dmCryptFlagCount; ++i)
+    {
+        if(isWord(word, flagNames[i]))
+        {
+            return 1 << i;
+        }
+    }
+    
+    return 0;
+}
+
+void append(Secret& secret, char const* data, size_t length)
+{
+    if(secret.size() + length > Secret::capacity)
+    {
+        throw std::runtime_error("the dm table is too long");
+    }
+    
+    for(size_t i = 0; i < length; ++i)
+    {
+        secret.append(data[i]);
+    }
+}
+
+/**
+ * Rewrites "start length crypt cipher key iv_offset device offset
+ * [count params...]" into the result.
+ */
+void setFlagsInLine(char const* line, size_t length, int flags, Secret& result)
+{
+    std::vector<Word> words;
+    
+    for(size_t i = 0; i < length;)
+    {
+        if(line[i] == ' ' || line[i] == '\t')
+        {
+            ++i;
+            continue;
+        }
+        
+        const Word word = { line + i, 0 };
+        
+        words.push_back(word);
+        
+        for(; i < length && line[i] != ' ' && line[i] != '\t'; ++i)
+        {
+            ++words.back().length;
+        }
+    }
+    
+    if(words.size() < 8 || !isWord(words[2], "crypt"))
+    {
+        append(result, line, length);
+        return;
+    }
+    
+    std::vector<Word> params;
+    
+    for(size_t i = 9; i < words.size(); ++i)
+    {
+        if(findFlag(words[i]) == 0)
+        {
+            params.push_back(words[i]);
+        }
+    }
+    
+    for(int i = 0; i < dmCryptFlagCount; ++i)
+    {
+        if(flags & (1 << i))
+        {
+            params.push_back(makeWord(flagNames[i]));
+        }
+    }
+    
+    for(size_t i = 0; i < 8; ++i)
+    {
+        append(result, " ", i > 0 ? 1 : 0);
+        append(result, words[i].data, words[i].length);
+    }
+    
+    if(!params.empty())
+    {
+        char count[16];
+        
+        snprintf(count, sizeof(count), " %u", static_cast<unsigned int>(params.size()));
+        append(result, count, strlen(count));
+        
+        for(std::vector<Word>::const_iterator it = params.begin(); it != params.end(); ++it)
+        {
+            append(result, " ", 1);
+            append(result, it->data, it->length);
+        }
+    }
+}
+
+} // namespace <unnamed>
+
+int getDmCryptFlag(std::string const& name)
+{
+    for(int i = 0; i < dmCryptFlagCount; ++i)
+    {
+        if(name == flagNames[i])
+        {
+            return 1 << i;
+        }
+    }
+    
+    return 0;
+}
+
+char const* getDmCryptFlagName(int flag)
+{
+    for(int i = 0; i < dmCryptFlagCount; ++i)
+    {
+        if(flag == 1 << i)
+        {
+            return flagNames[i];
+        }
+    }
+    
+    return "unknown";
+}
+
+int parseDmCryptFlags(std::string names)
+{
+    for(std::string::iterator it = names.begin(); it != names.end(); ++it)
+    {
+        if(*it == ',')
+        {
+            *it = ' ';
+        }
+    }
+    
+    std::istringstream in(names);
+    std::string name;
+    int flags = 0;
+    
+    while(in >> name)
+    {
+        const int flag = getDmCryptFlag(name);
+        
+        if(flag == 0)
+        {
+            throw std::runtime_error("unknown dm-crypt flag: " + name);
+        }
+        
+        flags |= flag;
+    }
+    
+    return flags;
+}
+
+std::string formatDmCryptFlags(int flags)
+{
+    std::string names;
+    
+    for(int i = 0; i < dmCryptFlagCount; ++i)
+    {
+        if(flags & (1 << i))
+        {
+            names += (names.empty() ? "" : ",") + std::string(flagNames[i]);
+        }
+    }
+    
+    return names;
+}
+
+void setDmCryptFlagsInTable(Secret const& table, int flags, Secret& result)
+{
+    char const* data = table.data();
+    char const* end = data + table.size();
+    
+    result.clear();
+    
+    while(data != end)
+    {
+        char const* newline = std::find(data, end, '\n');
+        
+        setFlagsInLine(data, newline - data, flags, result);
+        append(result, "\n", 1);
+        data = newline != end ? newline + 1 : end;
+    }
+}
+
+void setDmCryptFlags(std::string device, int flags)
+{
+    TRACE_SCOPE("set dm-crypt flags");
+    
+    const std::string name = device.substr(device.rfind('/') + 1);
+    std::vector<std::string> args;
+    int exitCode;
+    
+    args.push_back("table");
+    args.push_back("--showkeys");
+    args.push_back(name);
+    
+    // the table carries the volume key, so it stays in secrets
+    Secret table;
+    Secret newTable;
+    
+    executeCommand("dmsetup", args, table, exitCode);
+    
+    if(exitCode != 0)
+    {
+        throw std::runtime_error("dmsetup table failed: " + std::string(table.data(), table.size()));
+    }
+    
+    setDmCryptFlagsInTable(table, flags, newTable);
+    table.clear();
+    args.clear();
+    args.push_back("reload");
+    args.push_back(name);
+    
+    std::string output = executeCommand("dmsetup", args, newTable.data(), newTable.size(), exitCode);
+    
+    newTable.clear();
+    
+    if(exitCode != 0)
+    {
+        throw std::runtime_error("dmsetup reload failed, the kernel may not know these flags: " + output);
+    }
+    
+    output = executeCommand("dmsetup", "resume", name, exitCode);
+    
+    if(exitCode != 0)
+    {
+        throw std::runtime_error("dmsetup resume failed: " + output);
+    }
+}
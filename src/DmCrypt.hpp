@@ -0,0 +1,104 @@
+/**
+ * Copyright (c) 2007, Emir Uner
+ * All rights reserved.
+ * 
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ * 
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef EASYTC_DMCRYPT_HPP_INCLUDED
+#define EASYTC_DMCRYPT_HPP_INCLUDED
+
+#include "Secret.hpp"
+
+#include <string>
+
+/**
+ * Optional parameters of a dm-crypt mapping that trade its defaults for
+ * lower latency or discard support.
+ */
+enum DmCryptFlag
+{
+    /**
+     * Decrypt in the completion path instead of the kcryptd workqueue.
+     */
+    DmCryptNoReadWorkqueue = 1,
+    
+    /**
+     * Encrypt in the submitting context instead of a workqueue.
+     */
+    DmCryptNoWriteWorkqueue = 2,
+    
+    /**
+     * Encrypt on the CPU that submitted the I/O.
+     */
+    DmCryptSameCpuCrypt = 4,
+    
+    /**
+     * Submit writes from the encrypting CPUs rather than a single thread.
+     */
+    DmCryptSubmitFromCryptCpus = 8,
+    
+    /**
+     * Pass discards through, which reveals which blocks are unused.
+     */
+    DmCryptAllowDiscards = 16
+};
+
+const int dmCryptFlagCount = 5;
+
+/**
+ * Returns the dm table name of the flag, e.g. "no_read_workqueue".
+ */
+char const* getDmCryptFlagName(int flag);
+
+/**
+ * Returns the flag with the dm table name, 0 if there is none.
+ */
+int getDmCryptFlag(std::string const& name);
+
+/**
+ * Parses flag names separated by spaces or commas. Throws
+ * std::runtime_error for unknown names.
+ */
+int parseDmCryptFlags(std::string names);
+
+/**
+ * Returns the names of the flags joined by commas.
+ */
+std::string formatDmCryptFlags(int flags);
+
+/**
+ * Rewrites the crypt lines of a dm table into the result so that the
+ * managed flags are exactly the given ones, keeping any other optional
+ * parameters such as sector_size. Other targets are copied unchanged.
+ * Throws std::runtime_error if the result does not fit into a secret.
+ */
+void setDmCryptFlagsInTable(Secret const& table, int flags, Secret& result);
+
+/**
+ * Reloads the mapping of the device with the flags and resumes it, which
+ * swaps the tables without unmounting. The table carries the volume key,
+ * so it is only held in secrets and passed to dmsetup on standard input.
+ */
+void setDmCryptFlags(std::string device, int flags);
+
+#endif
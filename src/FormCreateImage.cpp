@@ -41,6 +41,8 @@ FormCreateImage::FormCreateImage(QDialog* parent)
                      this, SLOT(enableDisableButtons()));
     QObject::connect(ui.inputPassword, SIGNAL(textChanged(const QString&)),
                      this, SLOT(enableDisableButtons()));
+    QObject::connect(ui.inputFilesystem, SIGNAL(currentIndexChanged(int)),
+                     this, SLOT(enableDisableButtons()));
 }
 
 void FormCreateImage::selectImageFile()
@@ -56,9 +58,15 @@ void FormCreateImage::selectImageFile()
 void FormCreateImage::enableDisableButtons()
 {
     bool imageFileEmpty = getImageFile().length() == 0;
-    bool passwordEmpty = getPassword().length() == 0;
+    bool passwordEmpty = ui.inputPassword->text().isEmpty();
     
     ui.buttonBox->button(QDialogButtonBox::Ok)->setEnabled(!imageFileEmpty && !passwordEmpty);
+    
+    const Filesystem filesystem = getFilesystemOptions().filesystem;
+    
+    ui.inputStripeSize->setEnabled(filesystem != FilesystemFAT);
+    ui.inputLazyInit->setEnabled(filesystem == FilesystemExt4);
+    ui.inputJournal->setEnabled(filesystem == FilesystemExt4);
 }
 
 std::string FormCreateImage::getImageFile()
@@ -66,12 +74,34 @@ std::string FormCreateImage::getImageFile()
     return ui.inputImageFile->text().trimmed().toStdString();
 }
 
-std::string FormCreateImage::getPassword()
+void FormCreateImage::getPassword(Secret& password)
 {
-    return ui.inputPassword->text().toStdString();
+    // character by character, the text is shared with the line edit and
+    // the password is not copied anywhere else
+    const QString text = ui.inputPassword->text();
+    
+    password.clear();
+    
+    for(int i = 0; i < text.size(); ++i)
+    {
+        password.append(text[i].toLatin1());
+    }
 }
 
 int FormCreateImage::getImageSize()
 {
     return ui.inputImageSize->value();
 }
+
+FilesystemOptions FormCreateImage::getFilesystemOptions()
+{
+    FilesystemOptions fsOptions;
+    
+    fsOptions.filesystem = static_cast<Filesystem>(ui.inputFilesystem->currentIndex());
+    fsOptions.lazyInit = ui.inputLazyInit->isChecked();
+    fsOptions.journal = ui.inputJournal->isChecked();
+    fsOptions.stripeKBytes = ui.inputStripeSize->value();
+    fsOptions.randomFill = ui.inputRandomFill->isChecked();
+    
+    return fsOptions;
+}
@@ -30,6 +30,8 @@
 #include <QtGui/QDialog>
 
 #include "ui_FormCreateImage.h"
+#include "Secret.hpp"
+#include "TrueCrypt.hpp"
 
 class FormCreateImage : public QDialog
 {
@@ -39,8 +41,9 @@ public:
     FormCreateImage(QDialog* parent = 0);
     
     std::string getImageFile();
-    std::string getPassword();
+    void getPassword(Secret& password);
     int getImageSize();
+    FilesystemOptions getFilesystemOptions();
 
 private:
     Ui::FormCreateImage ui;
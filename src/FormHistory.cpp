@@ -0,0 +1,105 @@
+/**
+ * Copyright (c) 2007, Emir Uner
+ * All rights reserved.
+ * 
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ * 
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "FormHistory.hpp"
+#include "OperationLog.hpp"
+
+#include <QtGui/QHeaderView>
+
+namespace
+{
+
+const int64_t microsPerDay = 24LL * 60 * 60 * 1000000;
+
+QTableWidgetItem* createTableItem(QString str)
+{
+    QTableWidgetItem* item = new QTableWidgetItem(str);
+    item->setFlags(Qt::ItemIsEnabled);
+            
+    return item;
+}
+
+int64_t getPeriodStart(int periodIndex)
+{
+    switch(periodIndex)
+    {
+    case 1:
+        return wallClockMicroseconds() - 30 * microsPerDay;
+    case 2:
+        return wallClockMicroseconds() - 7 * microsPerDay;
+    case 3:
+        return wallClockMicroseconds() - microsPerDay;
+    default:
+        return 0;
+    }
+}
+    
+} // namespace <unnamed>
+
+FormHistory::FormHistory(QDialog* parent)
+: QDialog(parent)
+{
+    ui.setupUi(this);
+    
+    ui.tableStats->setHorizontalHeaderLabels(QStringList() << "Operation" << "Count" << "Mean ms"
+                                             << "p50 ms" << "p90 ms" << "p99 ms" << "Max ms");
+    ui.tableStats->horizontalHeader()->setResizeMode(QHeaderView::Stretch);
+    
+    updateTableStats();
+    
+    QObject::connect(ui.inputPeriod, SIGNAL(currentIndexChanged(int)), this, SLOT(updateTableStats()));
+}
+
+void FormHistory::updateTableStats()
+{
+    ui.tableStats->setRowCount(0);
+    
+    OperationLog* log = getOperationLog();
+    
+    if(log == 0)
+    {
+        ui.labelRecordCount->setText("Operation log is not available.");
+        return;
+    }
+    
+    OperationStatsVec stats = log->computeStats(getPeriodStart(ui.inputPeriod->currentIndex()));
+    
+    for(OperationStatsVec::const_iterator it = stats.begin(); it != stats.end(); ++it)
+    {
+        const int row = ui.tableStats->rowCount();
+        ui.tableStats->insertRow(row);
+        
+        ui.tableStats->setItem(row, 0, createTableItem(getOperationName(it->kind)));
+        ui.tableStats->setItem(row, 1, createTableItem(QString::number(it->count)));
+        ui.tableStats->setItem(row, 2, createTableItem(QString::number(it->meanMillis, 'f', 1)));
+        ui.tableStats->setItem(row, 3, createTableItem(QString::number(it->p50Millis, 'f', 1)));
+        ui.tableStats->setItem(row, 4, createTableItem(QString::number(it->p90Millis, 'f', 1)));
+        ui.tableStats->setItem(row, 5, createTableItem(QString::number(it->p99Millis, 'f', 1)));
+        ui.tableStats->setItem(row, 6, createTableItem(QString::number(it->maxMillis, 'f', 1)));
+    }
+    
+    ui.labelRecordCount->setText(QString("%1 operations logged").arg(log->getRecordCount()));
+}
@@ -25,16 +25,28 @@
  */
 
 #include "FormMain.hpp"
-#include "MountInfo.hpp"
-#include "TrueCrypt.hpp"
+#include "TrueCryptTasks.hpp"
 #include "FormMountImage.hpp"
 #include "FormCreateImage.hpp"
+#include "FormHistory.hpp"
+#include "Posix.hpp"
+#include "QueueTuning.hpp"
+#include "Trace.hpp"
 
+#include <QtGui/QFileDialog>
 #include <QtGui/QHeaderView>
+#include <QtGui/QInputDialog>
+#include <QtGui/QLineEdit>
 #include <QtGui/QMessageBox>
-#include <QtCore/QThread>
+#include <QtGui/QPushButton>
+#include <QtGui/QPainter>
+#include <QtGui/QPixmap>
+#include <QtGui/QStyle>
 
-#include <stdexcept>
+#include <time.h>
+
+#include <algorithm>
+#include <sstream>
 
 namespace
 {
@@ -47,68 +59,104 @@ QTableWidgetItem* createTableItem(std::string str)
     return item;
 }
 
-class CreateImageFileThread : public QThread
+const int cipherColumn = 3;
+const int statsColumn = 4;
+const int statsIntervalMillis = 1000;
+const int defaultTrimIntervalHours = 24;
+const int maxTrimIntervalHours = 596;
+
+/**
+ * Draws the history of one field of the samples, scaled to its maximum.
+ */
+QPixmap drawSparkline(BlockStatHistory const& history, double BlockStatSample::* field, double minimumScale)
 {
-    std::string imageFile_;
-    std::string password_;
-    int size_;
-    int result;
-    std::string errorMessage;
+    const int width = 60;
+    const int height = 16;
+    QPixmap pixmap(width, height);
     
-public:
-    enum Result
-    {
-        Success,
-        Failure
-    };
+    pixmap.fill(Qt::transparent);
     
-    CreateImageFileThread(std::string imageFile, std::string password, int size)
-    : imageFile_(imageFile), password_(password), size_(size)
+    if(history.size() < 2)
     {
+        return pixmap;
     }
     
-    int getResult()
+    double scale = minimumScale;
+    
+    for(BlockStatHistory::const_iterator it = history.begin(); it != history.end(); ++it)
     {
-        return result;
+        scale = std::max(scale, (*it).*field);
     }
     
-    std::string getErrorMessage()
+    QPolygonF line;
+    const double step = static_cast<double>(width - 1) / (history.size() - 1);
+    
+    for(BlockStatHistory::size_type i = 0; i < history.size(); ++i)
     {
-        return errorMessage;
+        line << QPointF(i * step, (height - 1) * (1.0 - history[i].*field / scale));
     }
     
-    void run()
+    QPainter painter(&pixmap);
+    
+    painter.setRenderHint(QPainter::Antialiasing);
+    painter.setPen(QColor(40, 110, 200));
+    painter.drawPolyline(line);
+    
+    return pixmap;
+}
+
+void setStatItem(QTableWidget* table, int row, int column, BlockStatHistory const& history,
+                 double BlockStatSample::* field, double minimumScale, int precision)
+{
+    QTableWidgetItem* item = table->item(row, column);
+    
+    if(item == 0)
     {
-        try
-        {
-            ::createImage(imageFile_, password_, size_);
-            result = Success;
-        }
-        catch(std::runtime_error ex)
-        {
-            result = Failure;
-            errorMessage = ex.what();
-        }
+        item = createTableItem("");
+        table->setItem(row, column, item);
     }
-};
+    
+    item->setText(history.empty() ? QString("-") : QString::number(history.back().*field, 'f', precision));
+    item->setData(Qt::DecorationRole, drawSparkline(history, field, minimumScale));
+}
     
 } // namespace <unnamed>
 
 FormMain::FormMain(QMainWindow* parent)
-: QMainWindow(parent), formPleaseWait(0), imageCreationThread(0)
+: QMainWindow(parent), formPleaseWait(0), autoMounter(scheduler)
 {
     ui.setupUi(this);
     
-    ui.tableMounts->setHorizontalHeaderLabels(QStringList() << "Image File" << "Mount Point");
+    ui.tableMounts->setHorizontalHeaderLabels(QStringList() << "Image File" << "Mount Point" << "Options"
+                                              << "Cipher" << "Read MB/s" << "Write MB/s" << "IOPS"
+                                              << "In Flight" << "Util %");
     ui.tableMounts->horizontalHeader()->setResizeMode(QHeaderView::Stretch);
-
-    updateTableMounts();
-
-    if(ui.tableMounts->rowCount() > 1)
+    
+    for(int column = cipherColumn; column < ui.tableMounts->columnCount(); ++column)
     {
-        ui.tableMounts->selectRow(1);
+        ui.tableMounts->horizontalHeader()->setResizeMode(column, QHeaderView::ResizeToContents);
     }
+    
+    const QueueTuningVec tunings = getQueueTunings();
+    
+    ui.comboQueueTuning->addItem("No tuning");
+    
+    for(QueueTuningVec::const_iterator it = tunings.begin(); it != tunings.end(); ++it)
+    {
+        ui.comboQueueTuning->addItem(it->name.c_str());
+        ui.comboQueueTuning->setItemData(ui.comboQueueTuning->count() - 1, formatQueueTuning(*it).c_str(),
+                                         Qt::ToolTipRole);
+    }
+    
+    statsTimer.start(statsIntervalMillis);
+    
+#ifndef EASYTC_TRACING
+    ui.actionTrace->setEnabled(false);
+    ui.actionTrace->setToolTip("Tracing was not compiled in, see the EASYTC_TRACING CMake option.");
+#endif
+    ui.actionTrace->setChecked(isTracingEnabled());
 
+    updateTableMounts();
     enableDisableButtons();
     
     QObject::connect(ui.tableMounts, SIGNAL(itemSelectionChanged()), this, SLOT(enableDisableButtons()));
@@ -116,35 +164,126 @@ FormMain::FormMain(QMainWindow* parent)
     QObject::connect(ui.pushButtonUnmountAll, SIGNAL(clicked()), this, SLOT(unmountAll()));
     QObject::connect(ui.pushButtonMountImage, SIGNAL(clicked()), this, SLOT(mountImage()));
     QObject::connect(ui.pushButtonCreateImage, SIGNAL(clicked()), this, SLOT(createImage()));
+    QObject::connect(ui.pushButtonCloneImage, SIGNAL(clicked()), this, SLOT(cloneImage()));
+    QObject::connect(ui.pushButtonBenchmark, SIGNAL(clicked()), this, SLOT(benchmark()));
+    QObject::connect(ui.comboQueueTuning, SIGNAL(activated(int)), this, SLOT(tuneQueues(int)));
+    QObject::connect(ui.actionBackupImage, SIGNAL(triggered()), this, SLOT(backupImage()));
+    QObject::connect(ui.actionRestoreImage, SIGNAL(triggered()), this, SLOT(restoreImage()));
+    QObject::connect(ui.actionVerifyImage, SIGNAL(triggered()), this, SLOT(verifyImage()));
+    QObject::connect(ui.actionExtractFiles, SIGNAL(triggered()), this, SLOT(extractFiles()));
+    QObject::connect(ui.actionTrimVolumes, SIGNAL(triggered()), this, SLOT(trimVolumes()));
+    QObject::connect(ui.actionScheduledTrim, SIGNAL(toggled(bool)), this, SLOT(toggleScheduledTrim(bool)));
+    QObject::connect(&trimTimer, SIGNAL(timeout()), this, SLOT(scheduledTrim()));
+    QObject::connect(ui.actionHistory, SIGNAL(triggered()), this, SLOT(showHistory()));
+    QObject::connect(&statsTimer, SIGNAL(timeout()), this, SLOT(updateStats()));
+    QObject::connect(ui.actionAutoMount, SIGNAL(toggled(bool)), this, SLOT(toggleAutoMount(bool)));
+    QObject::connect(ui.actionTrace, SIGNAL(toggled(bool)), this, SLOT(toggleTracing(bool)));
+    QObject::connect(&autoMounter, SIGNAL(imageMounted(QString, QString, double)),
+                     this, SLOT(imageAutoMounted(QString, QString, double)));
+    QObject::connect(&autoMounter, SIGNAL(mountFailed(QString, QString)),
+                     this, SLOT(autoMountFailed(QString, QString)));
+    
+    // an interval in trim.conf turns the schedule on from the start
+    ui.actionScheduledTrim->setChecked(getTrimOptions().intervalHours > 0);
 }
 
 void FormMain::updateTableMounts()
-{    
-    for(int i = 1; i < ui.tableMounts->rowCount(); ++i)
-    {
-        ui.tableMounts->removeRow(1);
-    }
+{
+    TRACE_SCOPE("gui: refresh mounts");
+    
+    ListTask* task = new ListTask();
+    
+    QObject::connect(task, SIGNAL(finished()), this, SLOT(mountsListed()));
+    scheduler.submit(task);
+}
+
+void FormMain::mountsListed()
+{
+    TRACE_SCOPE("repaint mount table");
+    
+    ListTask* task = static_cast<ListTask*>(sender());
+    
     ui.tableMounts->setRowCount(0);
-  
-    try
+    mountInfos = task->getMountInfos();
+    
+    const CryptoReportVec cryptoReports = task->getCryptoReports();
+    
+    queueTunings = task->getQueueTunings();
+    
+    for(MountInfoVec::const_iterator it = mountInfos.begin(); it != mountInfos.end(); ++it)
     {
-        MountInfoVec miVec = getMountInfo();
+        const int row = ui.tableMounts->rowCount();
+        ui.tableMounts->insertRow(row);
+        
+        ui.tableMounts->setItem(row, 0, createTableItem(it->imageFile));
+        ui.tableMounts->setItem(row, 1, createTableItem(it->mountPoint));
+        ui.tableMounts->setItem(row, 2, createTableItem(it->options));
         
-        for(MountInfoVec::const_iterator it = miVec.begin(); it != miVec.end(); ++it)
+        if(row < static_cast<int>(cryptoReports.size()))
         {
-            const int row = ui.tableMounts->rowCount();
-            ui.tableMounts->insertRow(row);
+            CryptoReport const& report = cryptoReports[row];
+            QTableWidgetItem* item = createTableItem(formatCryptoReport(report));
             
-            ui.tableMounts->setItem(row, 0, createTableItem(it->imageFile));
-            ui.tableMounts->setItem(row, 1, createTableItem(it->mountPoint));
+            item->setToolTip(describeCryptoReport(report).c_str());
+            
+            if(!report.ciphers.empty() && !report.accelerated)
+            {
+                item->setIcon(style()->standardIcon(QStyle::SP_MessageBoxWarning));
+                item->setForeground(Qt::red);
+            }
+            
+            ui.tableMounts->setItem(row, cipherColumn, item);
         }
     }
-    catch(std::runtime_error ex)
-    { 
-        if(std::string(ex.what()).find("No volumes mapped") == std::string::npos)
-        {
-            QMessageBox::critical(0, "Error!", ex.what());
-        }
+    
+    // resolved once per listing so that sampling stays a pread per volume
+    statPaths.clear();
+    
+    for(MountInfoVec::const_iterator it = mountInfos.begin(); it != mountInfos.end(); ++it)
+    {
+        statPaths.push_back(getBlockStatPath(it->device));
+    }
+    
+    blockStats.setStatFiles(statPaths);
+    updateStats();
+    
+    if(!task->succeeded() && task->getErrorMessage().find("No volumes mapped") == std::string::npos)
+    {
+        QMessageBox::critical(0, "Error!", task->getErrorMessage().c_str());
+    }
+    
+    enableDisableButtons();
+}
+
+void FormMain::operationFinished()
+{
+    TRACE_SCOPE("gui: operation finished");
+    
+    Task* task = static_cast<Task*>(sender());
+    
+    if(!task->succeeded())
+    {
+        QMessageBox::critical(0, "Error!", task->getErrorMessage().c_str());
+    }
+    
+    updateTableMounts();
+}
+
+void FormMain::updateStats()
+{
+    TRACE_SCOPE("repaint stats");
+    
+    blockStats.sample();
+    
+    for(int row = 0; row < ui.tableMounts->rowCount() && row < static_cast<int>(statPaths.size()); ++row)
+    {
+        BlockStatHistory const& history = blockStats.getHistory(statPaths[row]);
+        
+        setStatItem(ui.tableMounts, row, statsColumn, history, &BlockStatSample::readMBytesPerSecond, 1, 1);
+        setStatItem(ui.tableMounts, row, statsColumn + 1, history, &BlockStatSample::writeMBytesPerSecond, 1, 1);
+        setStatItem(ui.tableMounts, row, statsColumn + 2, history, &BlockStatSample::iops, 10, 0);
+        setStatItem(ui.tableMounts, row, statsColumn + 3, history, &BlockStatSample::inFlight, 1, 0);
+        setStatItem(ui.tableMounts, row, statsColumn + 4, history, &BlockStatSample::utilisation, 100, 0);
     }
 }
 
@@ -152,83 +291,586 @@ void FormMain::enableDisableButtons()
 {
     ui.pushButtonUnmount->setEnabled(ui.tableMounts->currentRow() != -1);
     ui.pushButtonUnmountAll->setEnabled(ui.tableMounts->rowCount() > 0);
+    ui.pushButtonBenchmark->setEnabled(ui.tableMounts->currentRow() != -1);
+    
+    const int row = ui.tableMounts->currentRow();
+    const bool tuned = row >= 0 && row < static_cast<int>(queueTunings.size()) && !queueTunings[row].empty();
+    
+    ui.comboQueueTuning->setEnabled(row != -1);
+    ui.comboQueueTuning->setCurrentIndex(tuned ? std::max(ui.comboQueueTuning->findText(queueTunings[row].c_str()), 0)
+                                               : 0);
 }
 
 void FormMain::unmount()
 {
-    try
+    TRACE_SCOPE("gui: unmount");
+    
+    const int row = ui.tableMounts->currentRow();
+    
+    if(row < 0 || row >= static_cast<int>(mountInfos.size()))
     {
-        ::unmount(ui.tableMounts->item(ui.tableMounts->currentRow(), 0)->text().toStdString().c_str());
-        updateTableMounts();
-    }
-    catch(std::runtime_error ex)
-    { 
-        QMessageBox::critical(0, "Error!", ex.what());
+        return;
     }
+    
+    UnmountTask* task = new UnmountTask(mountInfos[row].imageFile, mountInfos[row].mountPoint);
+    
+    QObject::connect(task, SIGNAL(finished()), this, SLOT(unmountFinished()));
+    scheduler.submit(task);
 }
 
-void FormMain::unmountAll()
+void FormMain::unmountFinished()
 {
-    try 
+    TRACE_SCOPE("gui: unmount finished");
+    
+    UnmountTask* task = static_cast<UnmountTask*>(sender());
+    BusyProcessVec busyProcesses = task->getBusyProcesses();
+    
+    if(task->succeeded() || busyProcesses.empty())
     {
-        ::unmountAll();
-        updateTableMounts();
+        operationFinished();
+        return;
     }
-    catch(std::runtime_error ex)
-    { 
-        QMessageBox::critical(0, "Error!", ex.what());
+    
+    QMessageBox messageBox(QMessageBox::Critical, "Error!",
+                           QString("%1 is in use by %2 processes.").arg(task->getMountPoint().c_str())
+                           .arg(busyProcesses.size()));
+    QPushButton* terminateButton = messageBox.addButton("Terminate and Retry", QMessageBox::DestructiveRole);
+    
+    messageBox.addButton(QMessageBox::Cancel);
+    messageBox.setInformativeText(task->getErrorMessage().c_str());
+    messageBox.setDetailedText(formatBusyProcesses(busyProcesses).c_str());
+    messageBox.exec();
+    
+    if(messageBox.clickedButton() == terminateButton)
+    {
+        UnmountTask* retry = new UnmountTask(task->getImage(), task->getMountPoint(), busyProcesses);
+        
+        QObject::connect(retry, SIGNAL(finished()), this, SLOT(unmountFinished()));
+        scheduler.submit(retry);
+    }
+    else
+    {
+        updateTableMounts();
     }
 }
 
+void FormMain::unmountAll()
+{
+    TRACE_SCOPE("gui: unmount all");
+    
+    UnmountAllTask* task = new UnmountAllTask();
+    
+    QObject::connect(task, SIGNAL(finished()), this, SLOT(operationFinished()));
+    scheduler.submit(task);
+}
+
 void FormMain::mountImage()
 {
-    FormMountImage* formMountImage = new FormMountImage();
+    FormMountImage formMountImage(scheduler);
 
-    if(formMountImage->exec() == QDialog::Accepted)
+    if(formMountImage.exec() == QDialog::Accepted)
     {
-        try 
-        {
-            ::mount(formMountImage->getImageFile(), formMountImage->getMountPoint(), formMountImage->getPassword());
-            updateTableMounts();            
-        }
-        catch(std::runtime_error ex)
-        { 
-            QMessageBox::critical(0, "Error!", ex.what());
-        }
+        TRACE_SCOPE("gui: mount image");
+        
+        Secret password;
+        
+        formMountImage.getPassword(password);
+        
+        MountTask* task = new MountTask(formMountImage.getImageFile(), formMountImage.getMountPoint(),
+                                        password, formMountImage.getMountProfile());
+        
+        QObject::connect(task, SIGNAL(finished()), this, SLOT(imageMounted()));
+        scheduler.submit(task);
     }
 }
 
-void FormMain::createImage()
+void FormMain::imageMounted()
 {
-    FormCreateImage* form = new FormCreateImage();
-
-    if(form->exec() == QDialog::Accepted)
+    MountTask* task = static_cast<MountTask*>(sender());
+    
+    if(task->succeeded() && !task->getWarmSummary().empty())
     {
-        CreateImageFileThread* thread = new CreateImageFileThread(form->getImageFile(), form->getPassword(),
-                                                                  form->getImageSize());
-        QObject::connect(thread, SIGNAL(finished()), this, SLOT(imageCreated()));
+        ui.statusbar->showMessage(task->getWarmSummary().c_str());
+    }
+    
+    operationFinished();
+}
 
-        imageCreationThread = thread;
-        thread->start();
+void FormMain::runWithPleaseWait(Task* task, std::string message)
+{
+    // a task finishing after the dialog was closed finds no dialog to report to
+    FormPleaseWait form;
+    FormPleaseWait* const previous = formPleaseWait;
+    
+    formPleaseWait = &form;
+    formPleaseWait->setMessage(message);
+    
+    QObject::connect(task, SIGNAL(progress(int)), this, SLOT(showProgress(int)));
+    QObject::connect(formPleaseWait, SIGNAL(cancelRequested()), task, SLOT(cancel()));
+    scheduler.submit(task);
+    
+    form.exec();
+    formPleaseWait = previous;
+}
 
-        formPleaseWait = new FormPleaseWait();
-        formPleaseWait->exec();
+void FormMain::createImage()
+{
+    FormCreateImage form;
+
+    if(form.exec() == QDialog::Accepted)
+    {
+        TRACE_SCOPE("gui: create image");
+        
+        Secret password;
+        
+        form.getPassword(password);
+        
+        CreateImageTask* task = new CreateImageTask(form.getImageFile(), password,
+                                                    form.getImageSize(), form.getFilesystemOptions());
+        
+        QObject::connect(task, SIGNAL(finished()), this, SLOT(imageCreated()));
+        runWithPleaseWait(task, "Please wait while creating the image file...");
     }
 }
 
 void FormMain::imageCreated()
 {
+    Task* task = static_cast<Task*>(sender());
+    
     if(formPleaseWait != 0)
     {
-        CreateImageFileThread* thread = (CreateImageFileThread*) imageCreationThread;
-
-        if(thread->getResult() == CreateImageFileThread::Success)
+        if(task->succeeded())
         {
             formPleaseWait->setMessageAndEnableOkButton("Created the image file.");
         }
         else
         {
-            formPleaseWait->setMessageAndEnableOkButton(thread->getErrorMessage());
+            formPleaseWait->setMessageAndEnableOkButton(task->getErrorMessage());
         }
     }
 }
+
+void FormMain::cloneImage()
+{
+    const QString source = QFileDialog::getOpenFileName(this, "Select Image File to Clone");
+    
+    if(source.isNull())
+    {
+        return;
+    }
+    
+    const QString target = QFileDialog::getSaveFileName(this, "Select Clone File");
+    
+    if(target.isNull())
+    {
+        return;
+    }
+    
+    TRACE_SCOPE("gui: clone image");
+    
+    CloneImageTask* task = new CloneImageTask(source.toStdString(), target.toStdString());
+    
+    QObject::connect(task, SIGNAL(finished()), this, SLOT(imageCloned()));
+    runWithPleaseWait(task, "Please wait while cloning the image file...");
+}
+
+void FormMain::imageCloned()
+{
+    CloneImageTask* task = static_cast<CloneImageTask*>(sender());
+    
+    if(formPleaseWait == 0)
+    {
+        return;
+    }
+    
+    if(!task->succeeded())
+    {
+        formPleaseWait->setMessageAndEnableOkButton(task->getErrorMessage());
+        return;
+    }
+    
+    const CloneResult result = task->getResult();
+    std::ostringstream oss;
+    
+    oss << "Cloned the image file with " << getCloneMethodName(result.method) << ", "
+        << result.dataBytes / (1024 * 1024) << " of " << result.size / (1024 * 1024) << " MB copied.";
+    formPleaseWait->setMessageAndEnableOkButton(oss.str());
+}
+
+void FormMain::backupImage()
+{
+    const QString image = QFileDialog::getOpenFileName(this, "Select Image File to Back Up");
+    
+    if(image.isNull())
+    {
+        return;
+    }
+    
+    const QString directory = QFileDialog::getExistingDirectory(this, "Select Backup Directory");
+    
+    if(directory.isNull())
+    {
+        return;
+    }
+    
+    TRACE_SCOPE("gui: backup image");
+    
+    BackupImageTask* task = new BackupImageTask(image.toStdString(), directory.toStdString());
+    
+    QObject::connect(task, SIGNAL(finished()), this, SLOT(imageBackedUp()));
+    runWithPleaseWait(task, "Please wait while backing up the image file...");
+}
+
+void FormMain::imageBackedUp()
+{
+    BackupImageTask* task = static_cast<BackupImageTask*>(sender());
+    
+    if(formPleaseWait == 0)
+    {
+        return;
+    }
+    
+    if(!task->succeeded())
+    {
+        formPleaseWait->setMessageAndEnableOkButton(task->getErrorMessage());
+        return;
+    }
+    
+    const BackupResult result = task->getResult();
+    std::ostringstream oss;
+    
+    if(result.changedBlocks == 0)
+    {
+        oss << "Nothing changed since backup " << result.delta << ".";
+    }
+    else
+    {
+        oss << "Stored " << result.changedBlocks << " of " << result.blocks << " blocks, "
+            << result.dataBytes / (1024 * 1024) << " MB, as backup " << result.delta << ".";
+    }
+    
+    formPleaseWait->setMessageAndEnableOkButton(oss.str());
+}
+
+void FormMain::restoreImage()
+{
+    const QString directory = QFileDialog::getExistingDirectory(this, "Select Backup Directory");
+    
+    if(directory.isNull())
+    {
+        return;
+    }
+    
+    const QString target = QFileDialog::getSaveFileName(this, "Select Restored Image File");
+    
+    if(target.isNull())
+    {
+        return;
+    }
+    
+    TRACE_SCOPE("gui: restore image");
+    
+    RestoreImageTask* task = new RestoreImageTask(directory.toStdString(), target.toStdString());
+    
+    QObject::connect(task, SIGNAL(finished()), this, SLOT(imageRestored()));
+    runWithPleaseWait(task, "Please wait while restoring the image file...");
+}
+
+void FormMain::imageRestored()
+{
+    Task* task = static_cast<Task*>(sender());
+    
+    if(formPleaseWait != 0)
+    {
+        formPleaseWait->setMessageAndEnableOkButton(task->succeeded() ? "Restored the image file."
+                                                                      : task->getErrorMessage());
+    }
+}
+
+void FormMain::verifyImage()
+{
+    const QString image = QFileDialog::getOpenFileName(this, "Select Image File to Verify");
+    
+    if(image.isNull())
+    {
+        return;
+    }
+    
+    TRACE_SCOPE("gui: verify image");
+    
+    VerifyImageTask* task = new VerifyImageTask(image.toStdString());
+    
+    QObject::connect(task, SIGNAL(finished()), this, SLOT(imageVerified()));
+    runWithPleaseWait(task, "Please wait while reading the whole image file...");
+}
+
+void FormMain::imageVerified()
+{
+    VerifyImageTask* task = static_cast<VerifyImageTask*>(sender());
+    
+    if(formPleaseWait != 0)
+    {
+        formPleaseWait->setMessageAndEnableOkButton(task->succeeded() ? formatScrubResult(task->getResult())
+                                                                      : task->getErrorMessage());
+    }
+}
+
+void FormMain::extractFiles()
+{
+    const QString image = QFileDialog::getOpenFileName(this, "Select Image File to Extract From");
+    
+    if(image.isNull())
+    {
+        return;
+    }
+    
+    bool ok = false;
+    const QString text = QInputDialog::getText(this, "Extract Files", "Password:", QLineEdit::Password, "", &ok);
+    
+    if(!ok)
+    {
+        return;
+    }
+    
+    const QString path = QInputDialog::getText(this, "Extract Files", "File or directory in the volume:",
+                                               QLineEdit::Normal, "/", &ok);
+    
+    if(!ok)
+    {
+        return;
+    }
+    
+    const QString target = QFileDialog::getExistingDirectory(this, "Select Directory to Extract To");
+    
+    if(target.isNull())
+    {
+        return;
+    }
+    
+    TRACE_SCOPE("gui: extract files");
+    
+    Secret password;
+    
+    for(int i = 0; i < text.size(); ++i)
+    {
+        password.append(text[i].toLatin1());
+    }
+    
+    ExtractTask* task = new ExtractTask(image.toStdString(), password, std::vector<std::string>(1, path.toStdString()),
+                                        target.toStdString());
+    
+    QObject::connect(task, SIGNAL(finished()), this, SLOT(filesExtracted()));
+    runWithPleaseWait(task, "Please wait while extracting the files...");
+}
+
+void FormMain::filesExtracted()
+{
+    ExtractTask* task = static_cast<ExtractTask*>(sender());
+    
+    if(formPleaseWait != 0)
+    {
+        formPleaseWait->setMessageAndEnableOkButton(task->succeeded() ? formatExtractResult(task->getResult())
+                                                                      : task->getErrorMessage());
+    }
+}
+
+void FormMain::trimVolumes()
+{
+    TRACE_SCOPE("gui: trim volumes");
+    
+    TrimTask* task = new TrimTask();
+    
+    QObject::connect(task, SIGNAL(finished()), this, SLOT(volumesTrimmed()));
+    runWithPleaseWait(task, "Please wait while discarding the free space of the mounted volumes...");
+}
+
+void FormMain::volumesTrimmed()
+{
+    TrimTask* task = static_cast<TrimTask*>(sender());
+    
+    if(formPleaseWait != 0)
+    {
+        formPleaseWait->setMessageAndEnableOkButton(task->succeeded() ? formatTrimResults(task->getResults())
+                                                                      : task->getErrorMessage());
+    }
+}
+
+void FormMain::toggleScheduledTrim(bool enabled)
+{
+    if(!enabled)
+    {
+        trimTimer.stop();
+        ui.statusbar->showMessage("Scheduled trim stopped.");
+        return;
+    }
+    
+    const int configured = getTrimOptions().intervalHours;
+    
+    // the timer counts milliseconds in an int
+    const int hours = std::min(configured > 0 ? configured : defaultTrimIntervalHours, maxTrimIntervalHours);
+    
+    trimTimer.start(hours * 3600 * 1000);
+    ui.statusbar->showMessage(QString("Trimming the mounted volumes every %1 hours.").arg(hours));
+}
+
+void FormMain::scheduledTrim()
+{
+    TRACE_SCOPE("gui: scheduled trim");
+    
+    TrimTask* task = new TrimTask();
+    
+    QObject::connect(task, SIGNAL(finished()), this, SLOT(scheduledTrimFinished()));
+    scheduler.submit(task);
+}
+
+void FormMain::scheduledTrimFinished()
+{
+    TrimTask* task = static_cast<TrimTask*>(sender());
+    
+    if(!task->succeeded())
+    {
+        ui.statusbar->showMessage(QString("Scheduled trim failed: %1").arg(task->getErrorMessage().c_str()));
+        return;
+    }
+    
+    const TrimResultVec results = task->getResults();
+    long long trimmedBytes = 0;
+    int failed = 0;
+    
+    for(TrimResultVec::const_iterator it = results.begin(); it != results.end(); ++it)
+    {
+        trimmedBytes += it->trimmedBytes;
+        failed += it->error.empty() ? 0 : 1;
+    }
+    
+    ui.statusbar->showMessage(QString("Scheduled trim discarded %1 MB on %2 volumes, %3 could not be trimmed.")
+                              .arg(trimmedBytes / (1024 * 1024)).arg(static_cast<int>(results.size()) - failed)
+                              .arg(failed));
+}
+
+void FormMain::tuneQueues(int index)
+{
+    TRACE_SCOPE("gui: tune queues");
+    
+    const int row = ui.tableMounts->currentRow();
+    
+    if(row < 0 || row >= static_cast<int>(mountInfos.size()))
+    {
+        return;
+    }
+    
+    const std::string tuning = index > 0 ? ui.comboQueueTuning->itemText(index).toStdString() : "";
+    QueueTuningTask* task = new QueueTuningTask(mountInfos[row].imageFile, mountInfos[row].device, tuning);
+    
+    QObject::connect(task, SIGNAL(finished()), this, SLOT(operationFinished()));
+    scheduler.submit(task);
+}
+
+void FormMain::benchmark()
+{
+    const int row = ui.tableMounts->currentRow();
+    
+    if(row < 0 || row >= static_cast<int>(mountInfos.size()))
+    {
+        return;
+    }
+    
+    BenchmarkTask* task = new BenchmarkTask(mountInfos[row]);
+    
+    QObject::connect(task, SIGNAL(finished()), this, SLOT(benchmarkFinished()));
+    runWithPleaseWait(task, "Please wait while benchmarking " + mountInfos[row].mountPoint + "...");
+}
+
+void FormMain::benchmarkFinished()
+{
+    BenchmarkTask* task = static_cast<BenchmarkTask*>(sender());
+    
+    if(formPleaseWait != 0)
+    {
+        formPleaseWait->setMessageAndEnableOkButton(task->succeeded() ? "Benchmark finished."
+                                                                      : task->getErrorMessage());
+    }
+    
+    if(task->succeeded())
+    {
+        QMessageBox::information(0, "Benchmark Results", formatBenchmarkResults(task->getResults()).c_str());
+    }
+}
+
+void FormMain::showProgress(int percent)
+{
+    if(formPleaseWait != 0)
+    {
+        formPleaseWait->setProgress(percent);
+    }
+}
+
+void FormMain::showHistory()
+{
+    FormHistory form;
+    
+    form.exec();
+}
+
+void FormMain::toggleAutoMount(bool enabled)
+{
+    if(!enabled)
+    {
+        autoMounter.stop();
+        ui.statusbar->showMessage("Auto-mount stopped.");
+        return;
+    }
+    
+    try
+    {
+        autoMounter.start();
+        ui.statusbar->showMessage("Watching directories for new images.");
+    }
+    catch(std::runtime_error ex)
+    {
+        ui.actionAutoMount->setChecked(false);
+        QMessageBox::critical(0, "Error!", ex.what());
+    }
+}
+
+void FormMain::toggleTracing(bool enabled)
+{
+    if(enabled == isTracingEnabled())
+    {
+        return;
+    }
+    
+    setTracingEnabled(enabled);
+    
+    if(enabled)
+    {
+        ui.statusbar->showMessage("Recording a trace.");
+        return;
+    }
+    
+    try
+    {
+        std::ostringstream oss;
+        
+        oss << getDataDirectory() << "/trace-" << time(0) << ".json";
+        writeTrace(oss.str());
+        ui.statusbar->showMessage(QString("Trace written to %1, open it in Perfetto or chrome://tracing.")
+                                  .arg(oss.str().c_str()));
+    }
+    catch(std::runtime_error ex)
+    {
+        QMessageBox::critical(0, "Error!", ex.what());
+    }
+}
+
+void FormMain::imageAutoMounted(QString image, QString mountPoint, double latencyMillis)
+{
+    ui.statusbar->showMessage(QString("Mounted %1 on %2, %3 ms after it was written.")
+                              .arg(image).arg(mountPoint).arg(latencyMillis, 0, 'f', 0));
+    updateTableMounts();
+}
+
+void FormMain::autoMountFailed(QString image, QString message)
+{
+    ui.statusbar->showMessage(QString("Could not mount %1: %2").arg(image).arg(message.trimmed()));
+}
@@ -31,6 +31,12 @@
 
 #include "ui_FormMain.h"
 #include "FormPleaseWait.hpp"
+#include "MountInfo.hpp"
+#include "TaskScheduler.hpp"
+#include "AutoMounter.hpp"
+#include "BlockStats.hpp"
+
+#include <QtCore/QTimer>
 
 
 class FormMain : public QMainWindow
@@ -44,15 +50,53 @@ public:
 private:
     Ui::FormMain ui;
     FormPleaseWait* formPleaseWait;
-    QThread* imageCreationThread;
+    TaskScheduler scheduler;
+    AutoMounter autoMounter;
+    MountInfoVec mountInfos;
+    std::vector<std::string> queueTunings;
+    BlockStatSampler blockStats;
+    std::vector<std::string> statPaths;
+    QTimer statsTimer;
+    QTimer trimTimer;
+    
+    void runWithPleaseWait(Task* task, std::string message);
     
 public slots:
     void enableDisableButtons();
     void unmount();
+    void unmountFinished();
     void unmountAll();
     void mountImage();
+    void imageMounted();
     void createImage();
     void imageCreated();
+    void cloneImage();
+    void imageCloned();
+    void backupImage();
+    void imageBackedUp();
+    void restoreImage();
+    void imageRestored();
+    void verifyImage();
+    void imageVerified();
+    void extractFiles();
+    void filesExtracted();
+    void trimVolumes();
+    void volumesTrimmed();
+    void toggleScheduledTrim(bool enabled);
+    void scheduledTrim();
+    void scheduledTrimFinished();
+    void benchmark();
+    void benchmarkFinished();
+    void tuneQueues(int index);
+    void mountsListed();
+    void operationFinished();
+    void updateStats();
+    void showProgress(int percent);
+    void showHistory();
+    void toggleAutoMount(bool enabled);
+    void toggleTracing(bool enabled);
+    void imageAutoMounted(QString image, QString mountPoint, double latencyMillis);
+    void autoMountFailed(QString image, QString message);
 };
 
 #endif
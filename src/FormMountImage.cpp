@@ -25,18 +25,34 @@
  */
 
 #include "FormMountImage.hpp"
+#include "DmCrypt.hpp"
+#include "FormPleaseWait.hpp"
+#include "FormScanImages.hpp"
+#include "TrueCryptTasks.hpp"
 
 #include <QtGui/QFileDialog>
 #include <QtGui/QDialogButtonBox>
+#include <QtGui/QMessageBox>
 
-FormMountImage::FormMountImage(QDialog* parent)
-: QDialog(parent)
+FormMountImage::FormMountImage(TaskScheduler& schedulerp, QDialog* parent)
+: QDialog(parent), scheduler(schedulerp), formPleaseWait(0), checkSucceeded(false), checkMatched(false)
 {
     ui.setupUi(this);
+    
+    profiles = getMountProfiles();
+    
+    for(MountProfileVec::const_iterator it = profiles.begin(); it != profiles.end(); ++it)
+    {
+        ui.inputProfile->addItem(it->name.c_str());
+        ui.inputProfile->setItemData(ui.inputProfile->count() - 1,
+                                     it->options.empty() ? "defaults" : it->options.c_str(), Qt::ToolTipRole);
+    }
 
+    profileChanged(ui.inputProfile->currentIndex());
     enableDisableButtons();
     
     QObject::connect(ui.commandSelectImageFile, SIGNAL(clicked()), this, SLOT(selectImageFile()));
+    QObject::connect(ui.commandScanImages, SIGNAL(clicked()), this, SLOT(scanImages()));
     QObject::connect(ui.commandSelectMountPoint, SIGNAL(clicked()), this, SLOT(selectMountPoint()));
     QObject::connect(ui.inputImageFile, SIGNAL(textChanged(const QString&)),
                      this, SLOT(enableDisableButtons()));
@@ -44,6 +60,7 @@ FormMountImage::FormMountImage(QDialog* parent)
                      this, SLOT(enableDisableButtons()));
     QObject::connect(ui.inputPassword, SIGNAL(textChanged(const QString&)),
                      this, SLOT(enableDisableButtons()));
+    QObject::connect(ui.inputProfile, SIGNAL(currentIndexChanged(int)), this, SLOT(profileChanged(int)));
 }
 
 void FormMountImage::selectImageFile()
@@ -56,6 +73,16 @@ void FormMountImage::selectImageFile()
     }
 }
 
+void FormMountImage::scanImages()
+{
+    FormScanImages formScanImages(scheduler, this);
+    
+    if(formScanImages.exec() == QDialog::Accepted && !formScanImages.getImageFile().empty())
+    {
+        ui.inputImageFile->setText(formScanImages.getImageFile().c_str());
+    }
+}
+
 void FormMountImage::selectMountPoint()
 {
     QString selected = QFileDialog::getExistingDirectory(this, "Select Mount Point");
@@ -70,11 +97,92 @@ void FormMountImage::enableDisableButtons()
 {
     bool mountPointEmpty = getMountPoint().length() == 0;
     bool imageFileEmpty = getImageFile().length() == 0;
-    bool passwordEmpty = getPassword().length() == 0;
+    bool passwordEmpty = ui.inputPassword->text().isEmpty();
     
     ui.buttonBox->button(QDialogButtonBox::Ok)->setEnabled(!mountPointEmpty && !imageFileEmpty && !passwordEmpty);
 }
 
+bool FormMountImage::checkPassword()
+{
+    // a wrong password costs one key derivation instead of a full truecrypt
+    // run, on the scheduler so that the dialog keeps repainting meanwhile
+    Secret password;
+    FormPleaseWait form(this);
+    
+    getPassword(password);
+    checkTask = new CheckPasswordTask(getImageFile(), password);
+    formPleaseWait = &form;
+    form.setMessage("Checking the password...");
+    
+    QObject::connect(checkTask, SIGNAL(finished()), this, SLOT(passwordChecked()));
+    QObject::connect(&form, SIGNAL(cancelRequested()), checkTask, SLOT(cancel()));
+    scheduler.submit(checkTask);
+    
+    const bool finished = form.exec() == QDialog::Accepted;
+    
+    // a check that finishes after the dialog was closed is ignored
+    formPleaseWait = 0;
+    checkTask = 0;
+    
+    if(!finished)
+    {
+        return false;
+    }
+    
+    if(!checkSucceeded)
+    {
+        QMessageBox::critical(this, "Error!", checkError.c_str());
+        return false;
+    }
+    
+    if(checkMatched)
+    {
+        return true;
+    }
+    
+    // only AES headers can be opened here, so this is not proof of a wrong password
+    return QMessageBox::question(this, "Password Not Confirmed",
+                                 "The password does not open the volume as an AES volume. Either the password "
+                                 "is wrong or the volume uses Serpent, Twofish or a cascade, which only "
+                                 "truecrypt can check.\n\nMount anyway?",
+                                 QMessageBox::Yes | QMessageBox::No, QMessageBox::No) == QMessageBox::Yes;
+}
+
+void FormMountImage::passwordChecked()
+{
+    CheckPasswordTask* task = static_cast<CheckPasswordTask*>(sender());
+    
+    if(task != checkTask || formPleaseWait == 0)
+    {
+        return;
+    }
+    
+    checkSucceeded = task->succeeded();
+    checkMatched = task->isMatched();
+    checkError = task->getErrorMessage();
+    
+    if(task->isCancelled())
+    {
+        formPleaseWait->reject();
+    }
+    else
+    {
+        formPleaseWait->accept();
+    }
+}
+
+void FormMountImage::accept()
+{
+    if(ui.inputCheckPassword->isChecked() && !checkPassword())
+    {
+        ui.inputPassword->selectAll();
+        ui.inputPassword->setFocus();
+        return;
+    }
+    
+    QDialog::accept();
+}
+
 std::string FormMountImage::getImageFile()
 {
     return ui.inputImageFile->text().trimmed().toStdString();
@@ -85,7 +193,58 @@ std::string FormMountImage::getMountPoint()
     return ui.inputMountPoint->text().trimmed().toStdString();
 }
 
-std::string FormMountImage::getPassword()
+QCheckBox* FormMountImage::getDmCryptFlagInput(int flag)
+{
+    switch(flag)
+    {
+    case DmCryptNoReadWorkqueue: return ui.inputNoReadWorkqueue;
+    case DmCryptNoWriteWorkqueue: return ui.inputNoWriteWorkqueue;
+    case DmCryptSameCpuCrypt: return ui.inputSameCpuCrypt;
+    case DmCryptSubmitFromCryptCpus: return ui.inputSubmitFromCryptCpus;
+    default: return ui.inputAllowDiscards;
+    }
+}
+
+void FormMountImage::profileChanged(int index)
+{
+    // the boxes start from the profile and may be changed for this mount only
+    for(int i = 0; i < dmCryptFlagCount; ++i)
+    {
+        getDmCryptFlagInput(1 << i)->setChecked(index >= 0 && (profiles[index].dmCryptFlags & (1 << i)) != 0);
+    }
+    
+    ui.inputWarmCache->setChecked(index >= 0 && profiles[index].warmCache);
+}
+
+MountProfile FormMountImage::getMountProfile()
 {
-    return ui.inputPassword->text().toStdString();
+    MountProfile profile = profiles[ui.inputProfile->currentIndex()];
+    
+    profile.dmCryptFlags = 0;
+    
+    for(int i = 0; i < dmCryptFlagCount; ++i)
+    {
+        if(getDmCryptFlagInput(1 << i)->isChecked())
+        {
+            profile.dmCryptFlags |= 1 << i;
+        }
+    }
+    
+    profile.warmCache = ui.inputWarmCache->isChecked();
+    
+    return profile;
+}
+
+void FormMountImage::getPassword(Secret& password)
+{
+    // character by character, the text is shared with the line edit and
+    // the password is not copied anywhere else
+    const QString text = ui.inputPassword->text();
+    
+    password.clear();
+    
+    for(int i = 0; i < text.size(); ++i)
+    {
+        password.append(text[i].toLatin1());
+    }
 }
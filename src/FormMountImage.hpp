@@ -28,27 +28,55 @@
 #define EASYTC_FORMMOUNTIMAGE_HPP_INCLUDED
 
 #include <QtGui/QDialog>
+#include <QtCore/QPointer>
 
 #include "ui_FormMountImage.h"
+#include "MountProfile.hpp"
+#include "Secret.hpp"
+
+class CheckPasswordTask;
+class FormPleaseWait;
+class TaskScheduler;
 
 class FormMountImage : public QDialog
 {
     Q_OBJECT
 
 public:
-    FormMountImage(QDialog* parent = 0);
+    FormMountImage(TaskScheduler& scheduler, QDialog* parent = 0);
     
-    std::string getPassword();
+    void getPassword(Secret& password);
     std::string getMountPoint();
     std::string getImageFile();
+    MountProfile getMountProfile();
+    
+    void accept();
 
 private:
     Ui::FormMountImage ui;
+    TaskScheduler& scheduler;
+    MountProfileVec profiles;
+    
+    /**
+     * The password check running while the please wait dialog is shown,
+     * and what it found.
+     */
+    QPointer<CheckPasswordTask> checkTask;
+    FormPleaseWait* formPleaseWait;
+    bool checkSucceeded;
+    bool checkMatched;
+    std::string checkError;
+    
+    QCheckBox* getDmCryptFlagInput(int flag);
+    bool checkPassword();
     
 public slots:
     void selectImageFile();
+    void scanImages();
     void selectMountPoint();
     void enableDisableButtons();
+    void profileChanged(int index);
+    void passwordChecked();
 };
 
 #endif
@@ -33,11 +33,33 @@ FormPleaseWait::FormPleaseWait(QDialog* parent)
 : QDialog(parent)
 {
     ui.setupUi(this);
+    ui.progressBar->setVisible(false);
+    
+    QObject::connect(ui.commandCancel, SIGNAL(clicked()), this, SLOT(cancel()));
+}
+
+void FormPleaseWait::setMessage(std::string message)
+{
+    ui.labelPleaseWait->setText(message.c_str());
 }
 
 void FormPleaseWait::setMessageAndEnableOkButton(std::string message)
 {
-    ui.labelPleaseWait->setText("Created the image file.");
+    setMessage(message);
     ui.commandOk->setEnabled(true);
+    ui.commandCancel->setEnabled(false);
+}
+
+void FormPleaseWait::setProgress(int percent)
+{
+    ui.progressBar->setVisible(true);
+    ui.progressBar->setValue(percent);
+}
+
+void FormPleaseWait::cancel()
+{
+    ui.commandCancel->setEnabled(false);
+    setMessage("Cancelling...");
+    emit cancelRequested();
 }
 
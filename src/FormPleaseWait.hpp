@@ -37,10 +37,18 @@ class FormPleaseWait : public QDialog
 
 public:
     FormPleaseWait(QDialog* parent = 0);
+    void setMessage(std::string message);
     void setMessageAndEnableOkButton(std::string message);
+    void setProgress(int percent);
     
 private:
     Ui::FormPleaseWait ui;
+    
+private slots:
+    void cancel();
+    
+signals:
+    void cancelRequested();
 };
 
 #endif
@@ -0,0 +1,158 @@
+/**
+ * Copyright (c) 2007, Emir Uner
+ * All rights reserved.
+ * 
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ * 
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "FormScanImages.hpp"
+#include "TrueCryptTasks.hpp"
+
+#include <QtGui/QFileDialog>
+#include <QtGui/QDialogButtonBox>
+#include <QtGui/QHeaderView>
+#include <QtCore/QDir>
+
+namespace
+{
+
+QTableWidgetItem* createTableItem(QString str)
+{
+    QTableWidgetItem* item = new QTableWidgetItem(str);
+    item->setFlags(Qt::ItemIsEnabled | Qt::ItemIsSelectable);
+            
+    return item;
+}
+
+QTableWidgetItem* createNumberItem(double value, int precision)
+{
+    QTableWidgetItem* item = new QTableWidgetItem();
+    item->setFlags(Qt::ItemIsEnabled | Qt::ItemIsSelectable);
+    
+    // a number rather than text so that the column sorts numerically
+    item->setData(Qt::DisplayRole, QString::number(value, 'f', precision).toDouble());
+    
+    return item;
+}
+    
+} // namespace <unnamed>
+
+FormScanImages::FormScanImages(TaskScheduler& schedulerp, QDialog* parent)
+: QDialog(parent), scheduler(schedulerp)
+{
+    ui.setupUi(this);
+    
+    ui.inputDirectory->setText(QDir::homePath());
+    ui.tableCandidates->setHorizontalHeaderLabels(QStringList() << "Image File" << "Size MB" << "Entropy");
+    ui.tableCandidates->horizontalHeader()->setResizeMode(0, QHeaderView::Stretch);
+    
+    enableDisableButtons();
+    
+    QObject::connect(ui.commandSelectDirectory, SIGNAL(clicked()), this, SLOT(selectDirectory()));
+    QObject::connect(ui.commandScan, SIGNAL(clicked()), this, SLOT(scan()));
+    QObject::connect(ui.tableCandidates, SIGNAL(itemSelectionChanged()), this, SLOT(enableDisableButtons()));
+    QObject::connect(ui.tableCandidates, SIGNAL(cellDoubleClicked(int, int)), this, SLOT(accept()));
+}
+
+FormScanImages::~FormScanImages()
+{
+    if(task)
+    {
+        task->cancel();
+    }
+}
+
+void FormScanImages::selectDirectory()
+{
+    QString selected = QFileDialog::getExistingDirectory(this, "Select Directory", ui.inputDirectory->text());
+    
+    if(!selected.isNull())
+    {
+        ui.inputDirectory->setText(selected);
+    }
+}
+
+void FormScanImages::scan()
+{
+    if(task)
+    {
+        task->cancel();
+    }
+    
+    task = new ScanTask(ui.inputDirectory->text().trimmed().toStdString());
+    
+    QObject::connect(task, SIGNAL(finished()), this, SLOT(candidatesFound()));
+    scheduler.submit(task);
+    
+    ui.labelStatus->setText("Scanning...");
+    ui.commandScan->setEnabled(false);
+}
+
+void FormScanImages::candidatesFound()
+{
+    ScanTask* finishedTask = static_cast<ScanTask*>(sender());
+    
+    if(finishedTask != task)
+    {
+        return;
+    }
+    
+    ui.commandScan->setEnabled(true);
+    
+    if(!finishedTask->succeeded())
+    {
+        ui.labelStatus->setText(finishedTask->getErrorMessage().c_str());
+        return;
+    }
+    
+    ContainerCandidateVec candidates = finishedTask->getCandidates();
+    ScanStats stats = finishedTask->getStats();
+    
+    ui.tableCandidates->setSortingEnabled(false);
+    ui.tableCandidates->setRowCount(0);
+    
+    for(ContainerCandidateVec::const_iterator it = candidates.begin(); it != candidates.end(); ++it)
+    {
+        const int row = ui.tableCandidates->rowCount();
+        ui.tableCandidates->insertRow(row);
+        
+        ui.tableCandidates->setItem(row, 0, createTableItem(it->path.c_str()));
+        ui.tableCandidates->setItem(row, 1, createNumberItem(it->size / (1024.0 * 1024.0), 1));
+        ui.tableCandidates->setItem(row, 2, createNumberItem(it->entropy, 3));
+    }
+    
+    ui.tableCandidates->setSortingEnabled(true);
+    ui.labelStatus->setText(QString("%1 images in %2 files, %3 sampled")
+                            .arg(candidates.size()).arg(stats.files).arg(stats.sampled));
+}
+
+void FormScanImages::enableDisableButtons()
+{
+    ui.buttonBox->button(QDialogButtonBox::Ok)->setEnabled(!ui.tableCandidates->selectedItems().isEmpty());
+}
+
+std::string FormScanImages::getImageFile()
+{
+    const int row = ui.tableCandidates->currentRow();
+    
+    return row == -1 ? std::string() : ui.tableCandidates->item(row, 0)->text().toStdString();
+}
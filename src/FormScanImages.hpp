@@ -0,0 +1,64 @@
+/**
+ * Copyright (c) 2007, Emir Uner
+ * All rights reserved.
+ * 
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ * 
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef EASYTC_FORMSCANIMAGES_HPP_INCLUDED
+#define EASYTC_FORMSCANIMAGES_HPP_INCLUDED
+
+#include <QtGui/QDialog>
+#include <QtCore/QPointer>
+
+#include "ui_FormScanImages.h"
+
+class TaskScheduler;
+class ScanTask;
+
+/**
+ * Lists the likely TrueCrypt containers under a directory so one can be
+ * picked without browsing for it.
+ */
+class FormScanImages : public QDialog
+{
+    Q_OBJECT
+
+public:
+    FormScanImages(TaskScheduler& scheduler, QDialog* parent = 0);
+    ~FormScanImages();
+    
+    std::string getImageFile();
+
+private:
+    Ui::FormScanImages ui;
+    TaskScheduler& scheduler;
+    QPointer<ScanTask> task;
+    
+public slots:
+    void selectDirectory();
+    void scan();
+    void candidatesFound();
+    void enableDisableButtons();
+};
+
+#endif
@@ -0,0 +1,721 @@
+/**
+ * Copyright (c) 2007, Emir Uner
+ * All rights reserved.
+ * 
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ * 
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "ImageBackup.hpp"
+#include "MountInfo.hpp"
+#include "OperationLog.hpp"
+#include "Posix.hpp"
+#include "Trace.hpp"
+#include "VolumeLocks.hpp"
+
+#include <fcntl.h>
+#include <stdint.h>
+#include <string.h>
+#include <sys/stat.h>
+
+#include <openssl/evp.h>
+
+#include <algorithm>
+#include <fstream>
+#include <iomanip>
+#include <sstream>
+#include <vector>
+
+namespace
+{
+
+const long long defaultBlockSize = 1024 * 1024;
+const size_t hashSize = 32;
+const char deltaMagic[16] = "EASYTC-DELTA-1";
+const char manifestMagic[] = "easytc-backup-1";
+
+struct DeltaHeader
+{
+    char magic[16];
+    uint64_t blockSize;
+    uint64_t imageSize;
+};
+
+/**
+ * Precedes the data of every block stored in a delta.
+ */
+struct BlockRecord
+{
+    uint64_t index;
+    uint64_t length;
+};
+
+typedef std::vector<unsigned char> HashVec;
+
+/**
+ * What the latest backup looked like, the hashes of all blocks
+ * back to back.
+ */
+struct Manifest
+{
+    long long blockSize;
+    long long imageSize;
+    int deltas;
+    HashVec hashes;
+};
+
+long long getBlockCount(long long imageSize, long long blockSize)
+{
+    return (imageSize + blockSize - 1) / blockSize;
+}
+
+std::string getManifestPath(std::string const& directory)
+{
+    return directory + "/manifest";
+}
+
+std::string getDeltaPath(std::string const& directory, int delta)
+{
+    std::ostringstream oss;
+    
+    oss << directory << "/delta-" << std::setw(6) << std::setfill('0') << delta;
+    
+    return oss.str();
+}
+
+int fromHex(char c)
+{
+    if(c >= '0' && c <= '9')
+    {
+        return c - '0';
+    }
+    
+    if(c >= 'a' && c <= 'f')
+    {
+        return c - 'a' + 10;
+    }
+    
+    return -1;
+}
+
+/**
+ * @return false if there is no manifest yet
+ */
+bool loadManifest(std::string const& directory, Manifest& manifest)
+{
+    const std::string path = getManifestPath(directory);
+    std::ifstream in(path.c_str());
+    
+    if(!in)
+    {
+        return false;
+    }
+    
+    std::string magic;
+    
+    if(!(in >> magic >> manifest.blockSize >> manifest.imageSize >> manifest.deltas) || magic != manifestMagic
+       || manifest.blockSize <= 0 || manifest.imageSize < 0 || manifest.deltas < 1)
+    {
+        throw std::runtime_error(path + " is not a backup manifest.");
+    }
+    
+    const long long blocks = getBlockCount(manifest.imageSize, manifest.blockSize);
+    std::string hex;
+    
+    manifest.hashes.resize(blocks * hashSize);
+    
+    for(long long i = 0; i < blocks; ++i)
+    {
+        if(!(in >> hex) || hex.size() != hashSize * 2)
+        {
+            throw std::runtime_error(path + " is damaged.");
+        }
+        
+        for(size_t j = 0; j < hashSize; ++j)
+        {
+            const int high = fromHex(hex[j * 2]);
+            const int low = fromHex(hex[j * 2 + 1]);
+            
+            if(high < 0 || low < 0)
+            {
+                throw std::runtime_error(path + " is damaged.");
+            }
+            
+            manifest.hashes[i * hashSize + j] = static_cast<unsigned char>(high << 4 | low);
+        }
+    }
+    
+    return true;
+}
+
+void writeAll(int fd, void const* data, size_t length, long long offset)
+{
+    char const* bytes = static_cast<char const*>(data);
+    
+    while(length > 0)
+    {
+        const ssize_t written = pwrite(fd, bytes, length, offset);
+        
+        unix_error::check(written);
+        bytes += written;
+        length -= written;
+        offset += written;
+    }
+}
+
+/**
+ * @return the bytes read, less than asked for only at the end of the file
+ */
+size_t readAll(int fd, void* data, size_t length, long long offset)
+{
+    char* bytes = static_cast<char*>(data);
+    size_t done = 0;
+    
+    while(done < length)
+    {
+        const ssize_t count = pread(fd, bytes + done, length - done, offset + done);
+        
+        unix_error::check(count);
+        
+        if(count == 0)
+        {
+            break;
+        }
+        
+        done += count;
+    }
+    
+    return done;
+}
+
+void syncAndClose(int fd)
+{
+    const int result = fsync(fd);
+    
+    close(fd);
+    unix_error::check(result);
+}
+
+/**
+ * Replaces the manifest atomically, the new one is on disk before the
+ * rename makes it visible.
+ */
+void saveManifest(std::string const& directory, Manifest const& manifest)
+{
+    static const char digits[] = "0123456789abcdef";
+    
+    const std::string path = getManifestPath(directory);
+    const std::string temporary = path + ".new";
+    const long long blocks = getBlockCount(manifest.imageSize, manifest.blockSize);
+    std::ostringstream oss;
+    
+    oss << manifestMagic << ' ' << manifest.blockSize << ' ' << manifest.imageSize << ' ' << manifest.deltas << '\n';
+    
+    std::string contents = oss.str();
+    
+    contents.reserve(contents.size() + blocks * (hashSize * 2 + 1));
+    
+    for(long long i = 0; i < blocks; ++i)
+    {
+        for(size_t j = 0; j < hashSize; ++j)
+        {
+            const unsigned char byte = manifest.hashes[i * hashSize + j];
+            
+            contents += digits[byte >> 4];
+            contents += digits[byte & 15];
+        }
+        
+        contents += '\n';
+    }
+    
+    const int fd = open(temporary.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0600);
+    
+    if(fd == -1)
+    {
+        throw std::runtime_error(temporary + ": " + strerror(errno));
+    }
+    
+    try
+    {
+        writeAll(fd, contents.data(), contents.size(), 0);
+    }
+    catch(...)
+    {
+        close(fd);
+        unlink(temporary.c_str());
+        throw;
+    }
+    
+    syncAndClose(fd);
+    unix_error::check(rename(temporary.c_str(), path.c_str()));
+}
+
+void hashBlock(char const* data, size_t length, unsigned char* hash)
+{
+    unsigned int hashLength;
+    
+    if(EVP_Digest(data, length, hash, &hashLength, EVP_sha256(), 0) != 1 || hashLength != hashSize)
+    {
+        throw std::runtime_error("Could not hash image block.");
+    }
+}
+
+bool isZero(char const* data, size_t length)
+{
+    for(size_t i = 0; i < length; ++i)
+    {
+        if(data[i] != 0)
+        {
+            return false;
+        }
+    }
+    
+    return true;
+}
+
+struct BackupState
+{
+    int imageFd;
+    int deltaFd;
+    long long blockSize;
+    long long imageSize;
+    long long blocks;
+    HashVec const* previousHashes;
+    HashVec* hashes;
+    Progress* progress;
+    volatile long long nextBlock;
+    volatile long long doneBlocks;
+    volatile long long deltaEnd;
+    volatile long long changedBlocks;
+    volatile long long dataBytes;
+};
+
+/**
+ * Hashes blocks until none are left, appending the ones that changed to
+ * the delta. Space in the delta is claimed atomically so writers never
+ * wait for each other.
+ */
+struct BlockHasher
+{
+    BackupState* state;
+    
+    void operator()()
+    {
+        TRACE_SCOPE("backup hasher");
+        
+        std::vector<char> buffer(sizeof(BlockRecord) + state->blockSize);
+        char* data = &buffer[sizeof(BlockRecord)];
+        
+        for(long long i = __atomic_fetch_add(&state->nextBlock, 1, __ATOMIC_RELAXED); i < state->blocks;
+            i = __atomic_fetch_add(&state->nextBlock, 1, __ATOMIC_RELAXED))
+        {
+            operation_cancelled::check(state->progress);
+            
+            const long long offset = i * state->blockSize;
+            const size_t length = static_cast<size_t>(std::min(state->blockSize, state->imageSize - offset));
+            
+            if(readAll(state->imageFd, data, length, offset) != length)
+            {
+                throw std::runtime_error("image shrank while backing up");
+            }
+            
+            unsigned char* hash = &(*state->hashes)[i * hashSize];
+            
+            hashBlock(data, length, hash);
+            
+            if(hasChanged(i, hash))
+            {
+                BlockRecord record;
+                
+                record.index = i;
+                record.length = length;
+                memcpy(&buffer[0], &record, sizeof(record));
+                
+                const size_t recordSize = sizeof(record) + length;
+                
+                writeAll(state->deltaFd, &buffer[0], recordSize,
+                         __atomic_fetch_add(&state->deltaEnd, recordSize, __ATOMIC_RELAXED));
+                __atomic_add_fetch(&state->changedBlocks, 1, __ATOMIC_RELAXED);
+                __atomic_add_fetch(&state->dataBytes, length, __ATOMIC_RELAXED);
+            }
+            
+            reportDone();
+        }
+    }
+    
+    bool hasChanged(long long i, unsigned char const* hash) const
+    {
+        HashVec const& previous = *state->previousHashes;
+        
+        return static_cast<size_t>(i + 1) * hashSize > previous.size()
+               || memcmp(&previous[i * hashSize], hash, hashSize) != 0;
+    }
+    
+    /**
+     * Only the thread that moves the percentage reports it.
+     */
+    void reportDone()
+    {
+        const long long done = __atomic_add_fetch(&state->doneBlocks, 1, __ATOMIC_RELAXED);
+        
+        if(state->progress != 0 && done * 100 / state->blocks != (done - 1) * 100 / state->blocks)
+        {
+            state->progress->report(static_cast<int>(done * 100 / state->blocks));
+        }
+    }
+};
+
+/**
+ * Applies deltas newest first, a block already restored from a newer
+ * delta is skipped in the older ones.
+ */
+class DeltaApplier
+{
+    Manifest const& manifest;
+    int targetFd;
+    Progress* progress;
+    long long blocks;
+    std::vector<bool> restored;
+    std::vector<char> buffer;
+    
+public:
+    long long restoredBlocks;
+    long long dataBytes;
+    
+    DeltaApplier(Manifest const& manifestp, int targetFdp, Progress* progressp)
+    : manifest(manifestp), targetFd(targetFdp), progress(progressp),
+      blocks(getBlockCount(manifest.imageSize, manifest.blockSize)), restored(blocks, false),
+      buffer(manifest.blockSize), restoredBlocks(0), dataBytes(0)
+    {
+    }
+    
+    bool isComplete() const
+    {
+        return restoredBlocks == blocks;
+    }
+    
+    void apply(std::string const& path)
+    {
+        TRACE_SCOPE("apply delta");
+        
+        const int fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+        
+        if(fd == -1)
+        {
+            throw std::runtime_error(path + ": " + strerror(errno));
+        }
+        
+        try
+        {
+            posix_fadvise(fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+            applyRecords(fd, path);
+        }
+        catch(...)
+        {
+            close(fd);
+            throw;
+        }
+        
+        close(fd);
+    }
+    
+private:
+    void applyRecords(int fd, std::string const& path)
+    {
+        DeltaHeader header;
+        
+        if(readAll(fd, &header, sizeof(header), 0) != sizeof(header)
+           || memcmp(header.magic, deltaMagic, sizeof(deltaMagic)) != 0
+           || static_cast<long long>(header.blockSize) != manifest.blockSize)
+        {
+            throw std::runtime_error(path + " is not a delta of this backup.");
+        }
+        
+        long long offset = sizeof(header);
+        BlockRecord record;
+        size_t count;
+        
+        while((count = readAll(fd, &record, sizeof(record), offset)) == sizeof(record))
+        {
+            operation_cancelled::check(progress);
+            
+            offset += sizeof(record);
+            
+            if(record.length > static_cast<uint64_t>(manifest.blockSize))
+            {
+                throw std::runtime_error(path + " is damaged.");
+            }
+            
+            // blocks beyond the end belong to an image that has since shrunk
+            if(record.index < static_cast<uint64_t>(blocks) && !restored[record.index])
+            {
+                restoreBlock(fd, path, record, offset);
+            }
+            
+            offset += record.length;
+        }
+        
+        if(count != 0)
+        {
+            throw std::runtime_error(path + " is truncated.");
+        }
+    }
+    
+    void restoreBlock(int fd, std::string const& path, BlockRecord const& record, long long offset)
+    {
+        const size_t length = static_cast<size_t>(record.length);
+        unsigned char hash[hashSize];
+        
+        if(readAll(fd, &buffer[0], length, offset) != length)
+        {
+            throw std::runtime_error(path + " is truncated.");
+        }
+        
+        hashBlock(&buffer[0], length, hash);
+        
+        if(memcmp(hash, &manifest.hashes[record.index * hashSize], hashSize) != 0)
+        {
+            throw std::runtime_error(path + " is damaged.");
+        }
+        
+        // the target starts out as a hole
+        if(!isZero(&buffer[0], length))
+        {
+            writeAll(targetFd, &buffer[0], length, record.index * manifest.blockSize);
+        }
+        
+        restored[record.index] = true;
+        ++restoredBlocks;
+        dataBytes += length;
+        
+        if(progress != 0)
+        {
+            progress->report(static_cast<int>(restoredBlocks * 100 / blocks));
+        }
+    }
+};
+
+} // namespace <unnamed>
+
+BackupResult backupImage(std::string image, std::string backupDirectory, Progress* progress)
+{
+    TRACE_SCOPE("backup image");
+    
+    const int64_t startTime = wallClockMicroseconds();
+    const long long start = monotonicMicroseconds();
+    
+    // the image can not be mounted read-write until the backup is complete
+    VolumeLock lock(getVolumeKeys(image));
+    const int imageFd = open(image.c_str(), O_RDONLY | O_CLOEXEC);
+    
+    if(imageFd == -1)
+    {
+        throw std::runtime_error(image + ": " + strerror(errno));
+    }
+    
+    std::string temporary;
+    int deltaFd = -1;
+    BackupResult result;
+    
+    try
+    {
+        struct stat st;
+        MountInfo mountInfo("", "", "");
+        
+        unix_error::check(fstat(imageFd, &st));
+        
+        if(findMountInfoLocked(image, mountInfo) && !isMountedReadOnly(mountInfo))
+        {
+            throw std::runtime_error(image + " is mounted read-write on " + mountInfo.mountPoint
+                                     + ", unmount it or mount it read-only to back it up.");
+        }
+        
+        if(mkdir(backupDirectory.c_str(), 0700) == -1 && errno != EEXIST)
+        {
+            throw std::runtime_error(backupDirectory + ": " + strerror(errno));
+        }
+        
+        Manifest previous;
+        
+        previous.blockSize = defaultBlockSize;
+        previous.imageSize = 0;
+        previous.deltas = 0;
+        loadManifest(backupDirectory, previous);
+        
+        Manifest current;
+        
+        current.blockSize = previous.blockSize;
+        current.imageSize = st.st_size;
+        current.deltas = previous.deltas + 1;
+        current.hashes.resize(getBlockCount(current.imageSize, current.blockSize) * hashSize);
+        
+        const std::string deltaPath = getDeltaPath(backupDirectory, current.deltas);
+        
+        temporary = deltaPath + ".new";
+        deltaFd = open(temporary.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0600);
+        
+        if(deltaFd == -1)
+        {
+            throw std::runtime_error(temporary + ": " + strerror(errno));
+        }
+        
+        DeltaHeader header;
+        
+        memset(&header, 0, sizeof(header));
+        memcpy(header.magic, deltaMagic, sizeof(deltaMagic));
+        header.blockSize = current.blockSize;
+        header.imageSize = current.imageSize;
+        writeAll(deltaFd, &header, sizeof(header), 0);
+        posix_fadvise(imageFd, 0, 0, POSIX_FADV_SEQUENTIAL);
+        
+        BackupState state;
+        
+        state.imageFd = imageFd;
+        state.deltaFd = deltaFd;
+        state.blockSize = current.blockSize;
+        state.imageSize = current.imageSize;
+        state.blocks = getBlockCount(current.imageSize, current.blockSize);
+        state.previousHashes = &previous.hashes;
+        state.hashes = &current.hashes;
+        state.progress = progress;
+        state.nextBlock = 0;
+        state.doneBlocks = 0;
+        state.deltaEnd = sizeof(header);
+        state.changedBlocks = 0;
+        state.dataBytes = 0;
+        
+        BlockHasher hasher = { &state };
+        std::vector<BlockHasher> hashers(std::max(1LL, std::min<long long>(getProcessorCount(), state.blocks)),
+                                         hasher);
+        
+        runThreads(hashers);
+        
+        result.blocks = state.blocks;
+        result.changedBlocks = state.changedBlocks;
+        result.dataBytes = state.dataBytes;
+        
+        if(state.changedBlocks == 0 && current.imageSize == previous.imageSize && previous.deltas > 0)
+        {
+            close(deltaFd);
+            deltaFd = -1;
+            unlink(temporary.c_str());
+            result.delta = previous.deltas;
+        }
+        else
+        {
+            const int fd = deltaFd;
+            
+            deltaFd = -1;
+            syncAndClose(fd);
+            unix_error::check(rename(temporary.c_str(), deltaPath.c_str()));
+            saveManifest(backupDirectory, current);
+            result.delta = current.deltas;
+        }
+    }
+    catch(...)
+    {
+        close(imageFd);
+        
+        if(deltaFd != -1)
+        {
+            close(deltaFd);
+            unlink(temporary.c_str());
+        }
+        
+        throw;
+    }
+    
+    close(imageFd);
+    recordOperation(OperationBackup, image, startTime, monotonicMicroseconds() - start, 0, result.dataBytes);
+    
+    return result;
+}
+
+void restoreImage(std::string backupDirectory, std::string target, Progress* progress)
+{
+    TRACE_SCOPE("restore image");
+    
+    const int64_t startTime = wallClockMicroseconds();
+    const long long start = monotonicMicroseconds();
+    Manifest manifest;
+    
+    if(!loadManifest(backupDirectory, manifest))
+    {
+        throw std::runtime_error(backupDirectory + " does not hold a backup.");
+    }
+    
+    // the target can not be mounted until the restored image is in place
+    VolumeLock lock(getVolumeKeys(target));
+    MountInfo mountInfo("", "", "");
+    
+    if(findMountInfoLocked(target, mountInfo))
+    {
+        throw std::runtime_error(target + " is mounted on " + mountInfo.mountPoint + ", unmount it to replace it.");
+    }
+    
+    // an existing target is only replaced by a complete image
+    const std::string temporary = target + ".part";
+    int targetFd = open(temporary.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0600);
+    
+    if(targetFd == -1)
+    {
+        throw std::runtime_error(temporary + ": " + strerror(errno));
+    }
+    
+    long long dataBytes = 0;
+    
+    try
+    {
+        unix_error::check(ftruncate(targetFd, manifest.imageSize));
+        
+        DeltaApplier applier(manifest, targetFd, progress);
+        
+        for(int delta = manifest.deltas; delta > 0 && !applier.isComplete(); --delta)
+        {
+            applier.apply(getDeltaPath(backupDirectory, delta));
+        }
+        
+        if(!applier.isComplete())
+        {
+            throw std::runtime_error(backupDirectory + " is missing blocks of the image.");
+        }
+        
+        dataBytes = applier.dataBytes;
+        
+        const int fd = targetFd;
+        
+        targetFd = -1;
+        syncAndClose(fd);
+        unix_error::check(rename(temporary.c_str(), target.c_str()));
+    }
+    catch(...)
+    {
+        if(targetFd != -1)
+        {
+            close(targetFd);
+        }
+        
+        unlink(temporary.c_str());
+        throw;
+    }
+    
+    recordOperation(OperationRestore, target, startTime, monotonicMicroseconds() - start, 0, dataBytes);
+}
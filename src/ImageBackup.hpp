@@ -0,0 +1,70 @@
+/**
+ * Copyright (c) 2007, Emir Uner
+ * All rights reserved.
+ * 
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ * 
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef EASYTC_IMAGEBACKUP_HPP_INCLUDED
+#define EASYTC_IMAGEBACKUP_HPP_INCLUDED
+
+#include "Progress.hpp"
+
+#include <string>
+
+struct BackupResult
+{
+    /**
+     * Number of the delta written, or of the latest one if nothing changed.
+     */
+    int delta;
+    long long blocks;
+    long long changedBlocks;
+    
+    /**
+     * Image bytes stored in the delta.
+     */
+    long long dataBytes;
+};
+
+/**
+ * Backs the image up into the backup directory, which is created if
+ * needed. The image is split into fixed size blocks which are hashed on
+ * all processors and compared against the manifest of the previous run;
+ * only the blocks that changed go into a new numbered delta file, so the
+ * first backup stores everything. The manifest is replaced only after
+ * the delta is safely on disk. Refuses images that are mounted
+ * read-write since the blocks would not be consistent, and keeps the image
+ * locked against mounting meanwhile.
+ */
+BackupResult backupImage(std::string image, std::string backupDirectory, Progress* progress = 0);
+
+/**
+ * Reassembles the latest backed up state of the image into a new file
+ * by applying the deltas newest first, writing every block only once
+ * and checking it against the manifest. The image is written to
+ * <target>.part and renamed over the target once complete, so an existing
+ * target is replaced only then; a mounted target is refused.
+ */
+void restoreImage(std::string backupDirectory, std::string target, Progress* progress = 0);
+
+#endif
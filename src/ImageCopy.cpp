@@ -0,0 +1,314 @@
+/**
+ * Copyright (c) 2007, Emir Uner
+ * All rights reserved.
+ * 
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ * 
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "ImageCopy.hpp"
+#include "MountInfo.hpp"
+#include "OperationLog.hpp"
+#include "Posix.hpp"
+#include "Trace.hpp"
+#include "VolumeLocks.hpp"
+
+#include <fcntl.h>
+#include <stdlib.h>
+#include <sys/ioctl.h>
+#include <sys/stat.h>
+#include <linux/fs.h>
+
+#include <algorithm>
+#include <vector>
+
+namespace
+{
+
+const size_t chunkSize = 64 * 1024 * 1024;
+const size_t streamBufferSize = 4 * 1024 * 1024;
+
+/**
+ * Copies the data ranges of the source, leaving the holes of the
+ * pre-sized target alone.
+ */
+class RangeCopier
+{
+    int sourceFd;
+    int targetFd;
+    long long size;
+    Progress* progress;
+    bool useCopyRange;
+    std::vector<char> buffer;
+    
+public:
+    long long dataBytes;
+    
+    RangeCopier(int sourceFdp, int targetFdp, long long sizep, Progress* progressp)
+    : sourceFd(sourceFdp), targetFd(targetFdp), size(sizep), progress(progressp), useCopyRange(true),
+      dataBytes(0)
+    {
+    }
+    
+    CloneMethod getMethod() const
+    {
+        return useCopyRange ? CloneCopyRange : CloneStream;
+    }
+    
+    void copy()
+    {
+        long long offset = 0;
+        
+        while(offset < size)
+        {
+            long long dataStart = lseek(sourceFd, offset, SEEK_DATA);
+            
+            if(dataStart == -1 && errno == ENXIO)
+            {
+                // only a hole is left
+                break;
+            }
+            
+            if(dataStart == -1)
+            {
+                // no hole support, everything is data
+                dataStart = offset;
+            }
+            
+            long long dataEnd = lseek(sourceFd, dataStart, SEEK_HOLE);
+            
+            if(dataEnd == -1 || dataEnd > size)
+            {
+                dataEnd = size;
+            }
+            
+            copyRange(dataStart, dataEnd);
+            offset = dataEnd;
+        }
+    }
+    
+private:
+    void copyRange(long long start, long long end)
+    {
+        while(start < end)
+        {
+            operation_cancelled::check(progress);
+            
+            const size_t length = static_cast<size_t>(std::min<long long>(end - start, chunkSize));
+            const ssize_t copied = useCopyRange ? copyKernel(start, length) : -1;
+            
+            if(copied == -1)
+            {
+                stream(start, length);
+            }
+            
+            start += length;
+            dataBytes += length;
+            
+            if(progress != 0)
+            {
+                progress->report(static_cast<int>(start * 100 / size));
+            }
+        }
+    }
+    
+    /**
+     * Returns -1 after switching to streaming if the kernel or the
+     * filesystems cannot copy this pair of files.
+     */
+    ssize_t copyKernel(long long start, size_t length)
+    {
+        loff_t in = start;
+        loff_t out = start;
+        size_t left = length;
+        
+        while(left > 0)
+        {
+            const ssize_t copied = copy_file_range(sourceFd, &in, targetFd, &out, left, 0);
+            
+            if(copied == -1 && left == length
+               && (errno == ENOSYS || errno == EXDEV || errno == EINVAL || errno == EOPNOTSUPP))
+            {
+                useCopyRange = false;
+                return -1;
+            }
+            
+            unix_error::check(copied);
+            
+            if(copied == 0)
+            {
+                throw std::runtime_error("source image shrank while cloning");
+            }
+            
+            left -= copied;
+        }
+        
+        return length;
+    }
+    
+    void stream(long long start, size_t length)
+    {
+        TRACE_SCOPE("clone stream");
+        
+        buffer.resize(streamBufferSize);
+        
+        for(size_t done = 0; done < length;)
+        {
+            const size_t part = std::min(length - done, buffer.size());
+            const ssize_t count = pread(sourceFd, &buffer[0], part, start + done);
+            
+            unix_error::check(count);
+            
+            if(count == 0)
+            {
+                throw std::runtime_error("source image shrank while cloning");
+            }
+            
+            for(ssize_t written = 0; written < count;)
+            {
+                const ssize_t result = pwrite(targetFd, &buffer[written], count - written, start + done + written);
+                
+                unix_error::check(result);
+                written += result;
+            }
+            
+            done += count;
+        }
+    }
+};
+
+} // namespace <unnamed>
+
+CloneResult cloneImage(std::string source, std::string target, Progress* progress)
+{
+    TRACE_SCOPE("clone image");
+    
+    const int64_t startTime = wallClockMicroseconds();
+    const long long start = monotonicMicroseconds();
+    VolumeKeyVec keys = getVolumeKeys(source);
+    const VolumeKeyVec targetKeys = getVolumeKeys(target);
+    
+    keys.insert(keys.end(), targetKeys.begin(), targetKeys.end());
+    
+    // neither image can be mounted or unmounted until the clone is in place
+    VolumeLock lock(keys);
+    const int sourceFd = open(source.c_str(), O_RDONLY | O_CLOEXEC);
+    
+    if(sourceFd == -1)
+    {
+        throw std::runtime_error(source + ": " + strerror(errno));
+    }
+    
+    struct stat st;
+    std::string temporary;
+    int targetFd = -1;
+    CloneResult result;
+    
+    try
+    {
+        unix_error::check(fstat(sourceFd, &st));
+        
+        MountInfo mountInfo("", "", "");
+        
+        if(findMountInfoLocked(source, mountInfo) && !isMountedReadOnly(mountInfo))
+        {
+            throw std::runtime_error(source + " is mounted read-write on " + mountInfo.mountPoint
+                                     + ", unmount it or mount it read-only to clone it.");
+        }
+        
+        if(findMountInfoLocked(target, mountInfo))
+        {
+            throw std::runtime_error(target + " is mounted on " + mountInfo.mountPoint
+                                     + ", unmount it to replace it.");
+        }
+        
+        // an existing target is only replaced by a complete clone
+        const std::string partPath = target + ".part";
+        
+        targetFd = open(partPath.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, st.st_mode & 0777);
+        
+        if(targetFd == -1)
+        {
+            throw std::runtime_error(partPath + ": " + strerror(errno));
+        }
+        
+        temporary = partPath;
+        result.size = st.st_size;
+        
+        if(ioctl(targetFd, FICLONE, sourceFd) == 0)
+        {
+            result.method = CloneReflink;
+            result.dataBytes = 0;
+        }
+        else
+        {
+            unix_error::check(ftruncate(targetFd, st.st_size));
+            
+            RangeCopier copier(sourceFd, targetFd, st.st_size, progress);
+            
+            copier.copy();
+            unix_error::check(fsync(targetFd));
+            
+            result.method = copier.getMethod();
+            result.dataBytes = copier.dataBytes;
+        }
+        
+        const int fd = targetFd;
+        
+        targetFd = -1;
+        unix_error::check(close(fd));
+        unix_error::check(rename(temporary.c_str(), target.c_str()));
+    }
+    catch(...)
+    {
+        close(sourceFd);
+        
+        if(targetFd != -1)
+        {
+            close(targetFd);
+        }
+        
+        if(!temporary.empty())
+        {
+            unlink(temporary.c_str());
+        }
+        
+        throw;
+    }
+    
+    close(sourceFd);
+    recordOperation(OperationClone, source, startTime, monotonicMicroseconds() - start, 0, result.dataBytes);
+    
+    return result;
+}
+
+char const* getCloneMethodName(CloneMethod method)
+{
+    switch(method)
+    {
+    case CloneReflink:
+        return "reflink";
+    case CloneCopyRange:
+        return "copy_file_range";
+    default:
+        return "streaming copy";
+    }
+}
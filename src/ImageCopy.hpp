@@ -0,0 +1,80 @@
+/**
+ * Copyright (c) 2007, Emir Uner
+ * All rights reserved.
+ * 
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ * 
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef EASYTC_IMAGECOPY_HPP_INCLUDED
+#define EASYTC_IMAGECOPY_HPP_INCLUDED
+
+#include "Progress.hpp"
+
+#include <string>
+
+enum CloneMethod
+{
+    /**
+     * The target shares the source's extents until either is written.
+     */
+    CloneReflink,
+    
+    /**
+     * Data ranges copied in the kernel with copy_file_range.
+     */
+    CloneCopyRange,
+    
+    /**
+     * Data ranges read and written through a user space buffer.
+     */
+    CloneStream
+};
+
+struct CloneResult
+{
+    CloneMethod method;
+    long long size;
+    
+    /**
+     * Bytes actually copied, holes are skipped.
+     */
+    long long dataBytes;
+};
+
+/**
+ * Copies the image to a new file as cheaply as the filesystems allow: a
+ * reflink if possible, otherwise only the data ranges found with
+ * SEEK_DATA/SEEK_HOLE, copied with copy_file_range or by streaming, so
+ * holes stay holes. Refuses images that are mounted read-write since
+ * the copy would not be consistent. The clone is written to <target>.part
+ * and renamed over the target once complete, so an existing target is
+ * replaced only then; a mounted target is refused. Both images stay locked
+ * against mounting and unmounting meanwhile.
+ */
+CloneResult cloneImage(std::string source, std::string target, Progress* progress = 0);
+
+/**
+ * Returns a printable name for the clone method.
+ */
+char const* getCloneMethodName(CloneMethod method);
+
+#endif
@@ -0,0 +1,1080 @@
+/**
+ * Copyright (c) 2007, Emir Uner
+ * All rights reserved.
+ * 
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ * 
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "ImageExtract.hpp"
+#include "OperationLog.hpp"
+#include "Posix.hpp"
+#include "Trace.hpp"
+#include "VolumeHeader.hpp"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdint.h>
+#include <string.h>
+#include <strings.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+#include <openssl/evp.h>
+
+#include <algorithm>
+#include <iomanip>
+#include <list>
+#include <map>
+#include <set>
+#include <sstream>
+#include <stdexcept>
+
+namespace
+{
+
+const size_t cacheBlockSize = 4096;
+
+/**
+ * Decrypted blocks of FAT and directories kept, 8 MiB.
+ */
+const size_t cacheBlockCount = 2048;
+
+/**
+ * File data is read in runs of contiguous clusters up to this size.
+ */
+const size_t maxRunBytes = 8 * 1048576;
+
+/**
+ * Runs at least this large are decrypted on all processors.
+ */
+const size_t parallelRunBytes = 1048576;
+
+const size_t directoryEntrySize = 32;
+
+/**
+ * FAT allows no more entries in a directory.
+ */
+const size_t maxDirectoryBytes = 65536 * directoryEntrySize;
+
+const unsigned char attributeVolumeLabel = 0x08;
+const unsigned char attributeDirectory = 0x10;
+const unsigned char attributeLongName = 0x0F;
+
+char const* const damagedMessage = "The filesystem in the volume is damaged.";
+
+size_t readAll(int fd, void* data, size_t length, long long offset)
+{
+    char* bytes = static_cast<char*>(data);
+    size_t done = 0;
+    
+    while(done < length)
+    {
+        const ssize_t count = pread(fd, bytes + done, length - done, offset + done);
+        
+        unix_error::check(count);
+        
+        if(count == 0)
+        {
+            break;
+        }
+        
+        done += count;
+    }
+    
+    return done;
+}
+
+void writeAll(int fd, void const* data, size_t length)
+{
+    char const* bytes = static_cast<char const*>(data);
+    
+    while(length > 0)
+    {
+        const ssize_t written = write(fd, bytes, length);
+        
+        unix_error::check(written);
+        bytes += written;
+        length -= written;
+    }
+}
+
+unsigned int readLittleEndian(unsigned char const* data, int bytes)
+{
+    unsigned int value = 0;
+    
+    for(int i = bytes - 1; i >= 0; --i)
+    {
+        value = (value << 8) | data[i];
+    }
+    
+    return value;
+}
+
+/**
+ * Decrypts XTS data units in place. The key schedule is set up once, only
+ * the tweak changes from unit to unit.
+ */
+class UnitDecryptor
+{
+public:
+    explicit UnitDecryptor(unsigned char const* key)
+    : ctx(EVP_CIPHER_CTX_new())
+    {
+        if(ctx == 0 || EVP_DecryptInit_ex(ctx, EVP_aes_256_xts(), 0, key, 0) != 1)
+        {
+            EVP_CIPHER_CTX_free(ctx);
+            throw std::runtime_error("AES-XTS is not available in this OpenSSL build.");
+        }
+    }
+    
+    ~UnitDecryptor()
+    {
+        EVP_CIPHER_CTX_free(ctx);
+    }
+    
+    void decrypt(unsigned char* data, size_t length, unsigned long long firstUnit)
+    {
+        for(size_t offset = 0; offset < length; offset += dataUnitSize)
+        {
+            // the tweak is the unit number, little endian
+            const unsigned long long unit = firstUnit + offset / dataUnitSize;
+            unsigned char tweak[16] = { 0 };
+            int outLength = 0;
+            
+            for(int i = 0; i < 8; ++i)
+            {
+                tweak[i] = static_cast<unsigned char>(unit >> (8 * i));
+            }
+            
+            if(EVP_DecryptInit_ex(ctx, 0, 0, 0, tweak) != 1
+               || EVP_DecryptUpdate(ctx, data + offset, &outLength, data + offset, dataUnitSize) != 1)
+            {
+                throw std::runtime_error("The volume could not be decrypted.");
+            }
+        }
+    }
+    
+private:
+    UnitDecryptor(UnitDecryptor const&);
+    UnitDecryptor& operator=(UnitDecryptor const&);
+    
+    EVP_CIPHER_CTX* ctx;
+};
+
+struct DecryptSlice
+{
+    unsigned char const* key;
+    unsigned char* data;
+    size_t length;
+    unsigned long long firstUnit;
+    
+    void operator()()
+    {
+        UnitDecryptor decryptor(key);
+        
+        decryptor.decrypt(data, length, firstUnit);
+    }
+};
+
+/**
+ * The decrypted data area of a volume, addressed from its start.
+ */
+class DecryptedVolume
+{
+public:
+    DecryptedVolume(std::string image, Secret const& password);
+    ~DecryptedVolume();
+    
+    unsigned long long getSize() const;
+    
+    /**
+     * Reads and decrypts whole data units, bypassing the cache. Large reads
+     * are decrypted on all processors.
+     */
+    void read(unsigned long long offset, unsigned char* buffer, size_t length);
+    
+    /**
+     * Reads any range through the block cache, meant for the FAT and
+     * directories, which are looked at again and again.
+     */
+    void readCached(unsigned long long offset, unsigned char* buffer, size_t length);
+    
+private:
+    DecryptedVolume(DecryptedVolume const&);
+    DecryptedVolume& operator=(DecryptedVolume const&);
+    
+    struct CachedBlock
+    {
+        unsigned long long index;
+        std::vector<unsigned char> data;
+    };
+    
+    typedef std::list<CachedBlock> CachedBlockList;
+    
+    unsigned char const* getBlock(unsigned long long index, size_t& length);
+    
+    int fd;
+    Secret key;
+    unsigned long long start;
+    unsigned long long size;
+    int threads;
+    UnitDecryptor* decryptor;
+    
+    /**
+     * Most recently used first.
+     */
+    CachedBlockList blocks;
+    std::map<unsigned long long, CachedBlockList::iterator> blockIndex;
+};
+
+DecryptedVolume::DecryptedVolume(std::string image, Secret const& password)
+: fd(-1), start(0), size(0), threads(std::min(getProcessorCount(), 16)), decryptor(0)
+{
+    const VolumeHeaderInfo info = readVolumeHeader(image, password, &key);
+    
+    if(info.encryptedAreaStart == 0 || info.encryptedAreaSize == 0)
+    {
+        throw std::runtime_error("Only volumes created by TrueCrypt 6.0 or later can be read without mounting.");
+    }
+    
+    start = info.encryptedAreaStart;
+    size = info.encryptedAreaSize;
+    fd = open(image.c_str(), O_RDONLY | O_CLOEXEC);
+    
+    if(fd == -1)
+    {
+        throw std::runtime_error(image + ": " + strerror(errno));
+    }
+    
+    try
+    {
+        struct stat st;
+        
+        unix_error::check(fstat(fd, &st));
+        
+        if(start % dataUnitSize != 0 || size % dataUnitSize != 0
+           || static_cast<unsigned long long>(st.st_size) < start + size)
+        {
+            throw std::runtime_error(image + ": The image is truncated.");
+        }
+        
+        decryptor = new UnitDecryptor(reinterpret_cast<unsigned char const*>(key.data()));
+    }
+    catch(...)
+    {
+        close(fd);
+        throw;
+    }
+}
+
+DecryptedVolume::~DecryptedVolume()
+{
+    delete decryptor;
+    close(fd);
+}
+
+unsigned long long DecryptedVolume::getSize() const
+{
+    return size;
+}
+
+void DecryptedVolume::read(unsigned long long offset, unsigned char* buffer, size_t length)
+{
+    if(offset % dataUnitSize != 0 || length % dataUnitSize != 0 || offset > size || length > size - offset)
+    {
+        throw std::runtime_error(damagedMessage);
+    }
+    
+    if(readAll(fd, buffer, length, start + offset) != length)
+    {
+        throw std::runtime_error("The image is truncated.");
+    }
+    
+    const unsigned long long firstUnit = (start + offset) / dataUnitSize;
+    
+    if(length < parallelRunBytes || threads < 2)
+    {
+        decryptor->decrypt(buffer, length, firstUnit);
+        return;
+    }
+    
+    const size_t units = length / dataUnitSize;
+    const size_t unitsPerSlice = (units + threads - 1) / threads;
+    std::vector<DecryptSlice> slices;
+    
+    for(size_t unit = 0; unit < units; unit += unitsPerSlice)
+    {
+        DecryptSlice slice;
+        
+        slice.key = reinterpret_cast<unsigned char const*>(key.data());
+        slice.data = buffer + unit * dataUnitSize;
+        slice.length = std::min(unitsPerSlice, units - unit) * dataUnitSize;
+        slice.firstUnit = firstUnit + unit;
+        slices.push_back(slice);
+    }
+    
+    runThreads(slices);
+}
+
+void DecryptedVolume::readCached(unsigned long long offset, unsigned char* buffer, size_t length)
+{
+    if(offset > size || length > size - offset)
+    {
+        throw std::runtime_error(damagedMessage);
+    }
+    
+    while(length > 0)
+    {
+        size_t blockLength = 0;
+        unsigned char const* block = getBlock(offset / cacheBlockSize, blockLength);
+        const size_t skip = offset % cacheBlockSize;
+        const size_t count = std::min(length, blockLength - skip);
+        
+        memcpy(buffer, block + skip, count);
+        buffer += count;
+        offset += count;
+        length -= count;
+    }
+}
+
+unsigned char const* DecryptedVolume::getBlock(unsigned long long index, size_t& length)
+{
+    std::map<unsigned long long, CachedBlockList::iterator>::iterator found = blockIndex.find(index);
+    
+    if(found != blockIndex.end())
+    {
+        blocks.splice(blocks.begin(), blocks, found->second);
+        length = found->second->data.size();
+        
+        return &found->second->data[0];
+    }
+    
+    if(blocks.size() >= cacheBlockCount)
+    {
+        blockIndex.erase(blocks.back().index);
+        blocks.pop_back();
+    }
+    
+    const unsigned long long offset = index * cacheBlockSize;
+    
+    blocks.push_front(CachedBlock());
+    
+    CachedBlock& block = blocks.front();
+    
+    block.index = index;
+    block.data.resize(static_cast<size_t>(std::min<unsigned long long>(cacheBlockSize, size - offset)));
+    
+    try
+    {
+        read(offset, &block.data[0], block.data.size());
+    }
+    catch(...)
+    {
+        blocks.pop_front();
+        throw;
+    }
+    
+    blockIndex[index] = blocks.begin();
+    length = block.data.size();
+    
+    return &block.data[0];
+}
+
+std::string decodeLongName(std::vector<unsigned int> const& units)
+{
+    std::string name;
+    
+    for(size_t i = 0; i < units.size() && units[i] != 0 && units[i] != 0xFFFF; ++i)
+    {
+        unsigned long code = units[i];
+        
+        if(code >= 0xD800 && code < 0xDC00 && i + 1 < units.size() && units[i + 1] >= 0xDC00 && units[i + 1] < 0xE000)
+        {
+            code = 0x10000 + ((code - 0xD800) << 10) + (units[++i] - 0xDC00);
+        }
+        
+        if(code < 0x80)
+        {
+            name += static_cast<char>(code);
+        }
+        else if(code < 0x800)
+        {
+            name += static_cast<char>(0xC0 | code >> 6);
+            name += static_cast<char>(0x80 | (code & 0x3F));
+        }
+        else if(code < 0x10000)
+        {
+            name += static_cast<char>(0xE0 | code >> 12);
+            name += static_cast<char>(0x80 | ((code >> 6) & 0x3F));
+            name += static_cast<char>(0x80 | (code & 0x3F));
+        }
+        else
+        {
+            name += static_cast<char>(0xF0 | code >> 18);
+            name += static_cast<char>(0x80 | ((code >> 12) & 0x3F));
+            name += static_cast<char>(0x80 | ((code >> 6) & 0x3F));
+            name += static_cast<char>(0x80 | (code & 0x3F));
+        }
+    }
+    
+    return name;
+}
+
+void toLower(std::string& text)
+{
+    for(std::string::iterator it = text.begin(); it != text.end(); ++it)
+    {
+        if(*it >= 'A' && *it <= 'Z')
+        {
+            *it = static_cast<char>(*it - 'A' + 'a');
+        }
+    }
+}
+
+std::string decodeShortName(unsigned char const* raw)
+{
+    std::string base(reinterpret_cast<char const*>(raw), 8);
+    std::string extension(reinterpret_cast<char const*>(raw + 8), 3);
+    
+    base.erase(base.find_last_not_of(' ') + 1);
+    extension.erase(extension.find_last_not_of(' ') + 1);
+    
+    // 0xE5 marks deleted entries, a name really starting with it is stored as 0x05
+    if(!base.empty() && base[0] == 0x05)
+    {
+        base[0] = static_cast<char>(0xE5);
+    }
+    
+    // Windows NT keeps the case of all lower case names in these bits
+    if(raw[12] & 0x08)
+    {
+        toLower(base);
+    }
+    
+    if(raw[12] & 0x10)
+    {
+        toLower(extension);
+    }
+    
+    return extension.empty() ? base : base + "." + extension;
+}
+
+unsigned char getShortNameChecksum(unsigned char const* raw)
+{
+    unsigned char sum = 0;
+    
+    for(int i = 0; i < 11; ++i)
+    {
+        sum = static_cast<unsigned char>(((sum & 1) << 7) + (sum >> 1) + raw[i]);
+    }
+    
+    return sum;
+}
+
+time_t getFatTime(unsigned int date, unsigned int time)
+{
+    if(date == 0)
+    {
+        return 0;
+    }
+    
+    struct tm tm;
+    
+    memset(&tm, 0, sizeof(tm));
+    tm.tm_year = 80 + (date >> 9);
+    tm.tm_mon = ((date >> 5) & 0x0F) - 1;
+    tm.tm_mday = date & 0x1F;
+    tm.tm_hour = time >> 11;
+    tm.tm_min = (time >> 5) & 0x3F;
+    tm.tm_sec = (time & 0x1F) * 2;
+    
+    // FAT keeps local time
+    tm.tm_isdst = -1;
+    
+    const time_t value = mktime(&tm);
+    
+    return value == -1 ? 0 : value;
+}
+
+struct FatEntry
+{
+    ImageFileEntry info;
+    
+    /**
+     * 0 for empty files and the fixed root directory of FAT12 and FAT16.
+     */
+    unsigned int firstCluster;
+};
+
+typedef std::vector<FatEntry> FatEntryVec;
+
+struct CopyProgress
+{
+    Progress* progress;
+    unsigned long long total;
+    unsigned long long done;
+    
+    void add(unsigned long long bytes)
+    {
+        done += bytes;
+        operation_cancelled::check(progress);
+        
+        if(progress != 0)
+        {
+            progress->report(total > 0 ? static_cast<int>(done * 100 / total) : 100);
+        }
+    }
+};
+
+/**
+ * Read-only FAT12, FAT16 and FAT32 with long file names.
+ */
+class FatFilesystem
+{
+public:
+    /**
+     * Throws std::runtime_error if the volume holds another filesystem.
+     */
+    explicit FatFilesystem(DecryptedVolume& volume);
+    
+    unsigned int getClusterBytes() const;
+    FatEntry getRoot() const;
+    FatEntryVec readDirectory(FatEntry const& directory);
+    FatEntry lookup(std::string path);
+    
+    void copyFile(FatEntry const& file, int fd, std::vector<unsigned char>& buffer, CopyProgress& copyProgress);
+    
+private:
+    unsigned long long getClusterOffset(unsigned int cluster) const;
+    
+    /**
+     * Returns the cluster after the given one in its chain, 0 at the end.
+     * steps counts the clusters followed so that a loop is noticed.
+     */
+    unsigned int getNextCluster(unsigned int cluster, unsigned int& steps);
+    
+    FatEntryVec parseDirectory(std::vector<unsigned char> const& data) const;
+    
+    DecryptedVolume& volume;
+    int fatBits;
+    unsigned int clusterBytes;
+    unsigned int clusterCount;
+    unsigned int rootCluster;
+    unsigned int rootBytes;
+    unsigned long long fatOffset;
+    unsigned long long rootOffset;
+    unsigned long long dataOffset;
+};
+
+FatFilesystem::FatFilesystem(DecryptedVolume& volumep)
+: volume(volumep)
+{
+    unsigned char boot[512];
+    
+    if(volume.getSize() < sizeof(boot))
+    {
+        throw std::runtime_error(damagedMessage);
+    }
+    
+    volume.readCached(0, boot, sizeof(boot));
+    
+    const unsigned int sectorSize = readLittleEndian(boot + 11, 2);
+    const unsigned int sectorsPerCluster = boot[13];
+    const unsigned int reservedSectors = readLittleEndian(boot + 14, 2);
+    const unsigned int fatCount = boot[16];
+    const unsigned int rootEntries = readLittleEndian(boot + 17, 2);
+    const unsigned int totalSectors = readLittleEndian(boot + 19, 2) != 0 ? readLittleEndian(boot + 19, 2)
+                                                                          : readLittleEndian(boot + 32, 4);
+    const unsigned int fatSectors = readLittleEndian(boot + 22, 2) != 0 ? readLittleEndian(boot + 22, 2)
+                                                                        : readLittleEndian(boot + 36, 4);
+    
+    if(boot[510] != 0x55 || boot[511] != 0xAA || sectorSize < 512 || sectorSize > 4096
+       || (sectorSize & (sectorSize - 1)) != 0 || sectorsPerCluster == 0
+       || (sectorsPerCluster & (sectorsPerCluster - 1)) != 0 || reservedSectors == 0 || fatCount == 0
+       || fatSectors == 0)
+    {
+        throw std::runtime_error("The volume does not hold a FAT filesystem, mount it to read it.");
+    }
+    
+    clusterBytes = sectorSize * sectorsPerCluster;
+    rootBytes = rootEntries * directoryEntrySize;
+    fatOffset = static_cast<unsigned long long>(reservedSectors) * sectorSize;
+    rootOffset = fatOffset + static_cast<unsigned long long>(fatCount) * fatSectors * sectorSize;
+    dataOffset = rootOffset + (rootBytes + sectorSize - 1) / sectorSize * sectorSize;
+    
+    const unsigned long long filesystemBytes = static_cast<unsigned long long>(totalSectors) * sectorSize;
+    
+    if(dataOffset >= filesystemBytes || filesystemBytes > volume.getSize())
+    {
+        throw std::runtime_error(damagedMessage);
+    }
+    
+    // the type follows from the number of clusters alone
+    clusterCount = static_cast<unsigned int>((filesystemBytes - dataOffset) / clusterBytes);
+    fatBits = clusterCount < 4085 ? 12 : clusterCount < 65525 ? 16 : 32;
+    rootCluster = fatBits == 32 ? readLittleEndian(boot + 44, 4) : 0;
+    
+    if(static_cast<unsigned long long>(fatSectors) * sectorSize * 8 < (clusterCount + 2ULL) * fatBits
+       || (fatBits == 32 && (rootCluster < 2 || rootCluster >= clusterCount + 2)))
+    {
+        throw std::runtime_error(damagedMessage);
+    }
+}
+
+unsigned int FatFilesystem::getClusterBytes() const
+{
+    return clusterBytes;
+}
+
+FatEntry FatFilesystem::getRoot() const
+{
+    FatEntry root;
+    
+    root.info.directory = true;
+    root.info.size = 0;
+    root.info.modified = 0;
+    root.firstCluster = rootCluster;
+    
+    return root;
+}
+
+unsigned long long FatFilesystem::getClusterOffset(unsigned int cluster) const
+{
+    if(cluster < 2 || cluster >= clusterCount + 2)
+    {
+        throw std::runtime_error(damagedMessage);
+    }
+    
+    return dataOffset + static_cast<unsigned long long>(cluster - 2) * clusterBytes;
+}
+
+unsigned int FatFilesystem::getNextCluster(unsigned int cluster, unsigned int& steps)
+{
+    unsigned char bytes[4];
+    unsigned int next;
+    unsigned int last;
+    
+    if(fatBits == 12)
+    {
+        volume.readCached(fatOffset + cluster + cluster / 2, bytes, 2);
+        next = readLittleEndian(bytes, 2);
+        next = cluster % 2 == 0 ? next & 0xFFF : next >> 4;
+        last = 0xFF8;
+    }
+    else if(fatBits == 16)
+    {
+        volume.readCached(fatOffset + cluster * 2ULL, bytes, 2);
+        next = readLittleEndian(bytes, 2);
+        last = 0xFFF8;
+    }
+    else
+    {
+        volume.readCached(fatOffset + cluster * 4ULL, bytes, 4);
+        next = readLittleEndian(bytes, 4) & 0x0FFFFFFF;
+        last = 0x0FFFFFF8;
+    }
+    
+    if(next >= last)
+    {
+        return 0;
+    }
+    
+    if(next < 2 || next >= clusterCount + 2 || ++steps > clusterCount)
+    {
+        throw std::runtime_error(damagedMessage);
+    }
+    
+    return next;
+}
+
+FatEntryVec FatFilesystem::readDirectory(FatEntry const& directory)
+{
+    std::vector<unsigned char> data;
+    
+    if(directory.firstCluster == 0)
+    {
+        data.resize(rootBytes);
+        
+        if(!data.empty())
+        {
+            volume.readCached(rootOffset, &data[0], data.size());
+        }
+    }
+    else
+    {
+        unsigned int steps = 0;
+        
+        for(unsigned int cluster = directory.firstCluster; cluster != 0; cluster = getNextCluster(cluster, steps))
+        {
+            if(data.size() >= maxDirectoryBytes)
+            {
+                throw std::runtime_error(damagedMessage);
+            }
+            
+            data.resize(data.size() + clusterBytes);
+            volume.readCached(getClusterOffset(cluster), &data[data.size() - clusterBytes], clusterBytes);
+        }
+    }
+    
+    return parseDirectory(data);
+}
+
+FatEntryVec FatFilesystem::parseDirectory(std::vector<unsigned char> const& data) const
+{
+    // long name characters sit at these offsets of each long name entry
+    static const int longNameOffsets[13] = { 1, 3, 5, 7, 9, 14, 16, 18, 20, 22, 24, 28, 30 };
+    
+    FatEntryVec entries;
+    std::vector<unsigned int> longName;
+    unsigned char longNameChecksum = 0;
+    
+    for(size_t offset = 0; offset + directoryEntrySize <= data.size(); offset += directoryEntrySize)
+    {
+        unsigned char const* raw = &data[offset];
+        
+        if(raw[0] == 0x00)
+        {
+            break;
+        }
+        
+        if(raw[0] == 0xE5)
+        {
+            longName.clear();
+            continue;
+        }
+        
+        if((raw[11] & 0x3F) == attributeLongName)
+        {
+            // the parts come last first, each carrying its position
+            const size_t sequence = raw[0] & 0x1F;
+            
+            if(raw[0] & 0x40)
+            {
+                longName.assign(sequence * 13, 0xFFFF);
+                longNameChecksum = raw[13];
+            }
+            
+            if(sequence == 0 || sequence * 13 > longName.size() || raw[13] != longNameChecksum)
+            {
+                longName.clear();
+                continue;
+            }
+            
+            for(int i = 0; i < 13; ++i)
+            {
+                longName[(sequence - 1) * 13 + i] = readLittleEndian(raw + longNameOffsets[i], 2);
+            }
+            
+            continue;
+        }
+        
+        if(raw[11] & attributeVolumeLabel)
+        {
+            longName.clear();
+            continue;
+        }
+        
+        FatEntry entry;
+        
+        entry.info.name = !longName.empty() && getShortNameChecksum(raw) == longNameChecksum ? decodeLongName(longName)
+                                                                                            : decodeShortName(raw);
+        longName.clear();
+        
+        if(entry.info.name == "." || entry.info.name == "..")
+        {
+            continue;
+        }
+        
+        entry.info.directory = (raw[11] & attributeDirectory) != 0;
+        entry.info.size = entry.info.directory ? 0 : readLittleEndian(raw + 28, 4);
+        entry.info.modified = getFatTime(readLittleEndian(raw + 24, 2), readLittleEndian(raw + 22, 2));
+        
+        // FAT12 and FAT16 leave the high half to other uses
+        entry.firstCluster = (fatBits == 32 ? readLittleEndian(raw + 20, 2) << 16 : 0) | readLittleEndian(raw + 26, 2);
+        entries.push_back(entry);
+    }
+    
+    return entries;
+}
+
+FatEntry FatFilesystem::lookup(std::string path)
+{
+    FatEntry entry = getRoot();
+    std::istringstream parts(path);
+    std::string part;
+    
+    while(std::getline(parts, part, '/'))
+    {
+        if(part.empty() || part == ".")
+        {
+            continue;
+        }
+        
+        if(!entry.info.directory)
+        {
+            throw std::runtime_error(path + ": Not a directory");
+        }
+        
+        const FatEntryVec children = readDirectory(entry);
+        FatEntryVec::const_iterator it = children.begin();
+        
+        while(it != children.end() && strcasecmp(it->info.name.c_str(), part.c_str()) != 0)
+        {
+            ++it;
+        }
+        
+        if(it == children.end())
+        {
+            throw std::runtime_error(path + ": No such file or directory");
+        }
+        
+        entry = *it;
+    }
+    
+    return entry;
+}
+
+void FatFilesystem::copyFile(FatEntry const& file, int fd, std::vector<unsigned char>& buffer,
+                             CopyProgress& copyProgress)
+{
+    unsigned long long remaining = file.info.size;
+    unsigned int cluster = remaining > 0 ? file.firstCluster : 0;
+    unsigned int steps = 0;
+    
+    while(remaining > 0)
+    {
+        // a chain shorter than the size
+        if(cluster == 0)
+        {
+            throw std::runtime_error(damagedMessage);
+        }
+        
+        // consecutive clusters are read in one go
+        const unsigned long long runOffset = getClusterOffset(cluster);
+        size_t runBytes = 0;
+        
+        do
+        {
+            runBytes += clusterBytes;
+            cluster = getNextCluster(cluster, steps);
+        }
+        while(cluster != 0 && runBytes < remaining && runBytes + clusterBytes <= buffer.size()
+              && getClusterOffset(cluster) == runOffset + runBytes);
+        
+        volume.read(runOffset, &buffer[0], runBytes);
+        
+        const size_t used = static_cast<size_t>(std::min<unsigned long long>(runBytes, remaining));
+        
+        writeAll(fd, &buffer[0], used);
+        remaining -= used;
+        copyProgress.add(used);
+    }
+}
+
+struct ExtractItem
+{
+    FatEntry entry;
+    std::string target;
+};
+
+typedef std::vector<ExtractItem> ExtractItemVec;
+
+/**
+ * Adds the entry and everything below it. A directory seen twice means
+ * a loop in a damaged filesystem.
+ */
+void collectItems(FatFilesystem& filesystem, FatEntry const& entry, std::string target, ExtractItemVec& items,
+                  std::set<unsigned int>& visited)
+{
+    ExtractItem item;
+    
+    item.entry = entry;
+    item.target = target;
+    items.push_back(item);
+    
+    if(!entry.info.directory)
+    {
+        return;
+    }
+    
+    if(!visited.insert(entry.firstCluster).second)
+    {
+        throw std::runtime_error(damagedMessage);
+    }
+    
+    const FatEntryVec children = filesystem.readDirectory(entry);
+    
+    for(FatEntryVec::const_iterator it = children.begin(); it != children.end(); ++it)
+    {
+        // names come from the volume and must not lead out of the target
+        if(it->info.name.empty() || it->info.name.find_first_of(std::string("/\0", 2)) != std::string::npos)
+        {
+            throw std::runtime_error(damagedMessage);
+        }
+        
+        collectItems(filesystem, *it, target + "/" + it->info.name, items, visited);
+    }
+}
+
+void extractFile(FatFilesystem& filesystem, ExtractItem const& item, std::vector<unsigned char>& buffer,
+                 CopyProgress& copyProgress)
+{
+    const std::string temporary = item.target + ".part";
+    int fd = open(temporary.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    
+    if(fd == -1)
+    {
+        throw std::runtime_error(temporary + ": " + strerror(errno));
+    }
+    
+    try
+    {
+        filesystem.copyFile(item.entry, fd, buffer, copyProgress);
+        
+        if(item.entry.info.modified != 0)
+        {
+            struct timespec times[2];
+            
+            times[0].tv_sec = 0;
+            times[0].tv_nsec = UTIME_OMIT;
+            times[1].tv_sec = item.entry.info.modified;
+            times[1].tv_nsec = 0;
+            unix_error::check(futimens(fd, times));
+        }
+        
+        const int closing = fd;
+        
+        fd = -1;
+        unix_error::check(close(closing));
+        unix_error::check(rename(temporary.c_str(), item.target.c_str()));
+    }
+    catch(...)
+    {
+        if(fd != -1)
+        {
+            close(fd);
+        }
+        
+        unlink(temporary.c_str());
+        throw;
+    }
+}
+
+} // namespace <unnamed>
+
+ImageFileEntryVec listImageFiles(std::string image, Secret const& password, std::string directory)
+{
+    TRACE_SCOPE("list image files");
+    
+    DecryptedVolume volume(image, password);
+    FatFilesystem filesystem(volume);
+    const FatEntry entry = filesystem.lookup(directory);
+    
+    if(!entry.info.directory)
+    {
+        throw std::runtime_error(directory + ": Not a directory");
+    }
+    
+    const FatEntryVec children = filesystem.readDirectory(entry);
+    ImageFileEntryVec entries;
+    
+    for(FatEntryVec::const_iterator it = children.begin(); it != children.end(); ++it)
+    {
+        entries.push_back(it->info);
+    }
+    
+    return entries;
+}
+
+ExtractResult extractImageFiles(std::string image, Secret const& password, std::vector<std::string> const& paths,
+                                std::string targetDirectory, Progress* progress)
+{
+    TRACE_SCOPE("extract image files");
+    
+    const int64_t startTime = wallClockMicroseconds();
+    const long long start = monotonicMicroseconds();
+    DecryptedVolume volume(image, password);
+    FatFilesystem filesystem(volume);
+    ExtractItemVec items;
+    
+    for(std::vector<std::string>::const_iterator it = paths.begin(); it != paths.end(); ++it)
+    {
+        const FatEntry entry = filesystem.lookup(*it);
+        std::set<unsigned int> visited;
+        
+        collectItems(filesystem, entry, entry.info.name.empty() ? targetDirectory
+                                                                : targetDirectory + "/" + entry.info.name,
+                     items, visited);
+    }
+    
+    CopyProgress copyProgress;
+    
+    copyProgress.progress = progress;
+    copyProgress.total = 0;
+    copyProgress.done = 0;
+    
+    for(ExtractItemVec::const_iterator it = items.begin(); it != items.end(); ++it)
+    {
+        copyProgress.total += it->entry.info.size;
+    }
+    
+    ExtractResult result;
+    std::vector<unsigned char> buffer(std::max<size_t>(maxRunBytes, filesystem.getClusterBytes()));
+    
+    result.files = 0;
+    result.bytes = 0;
+    
+    for(ExtractItemVec::const_iterator it = items.begin(); it != items.end(); ++it)
+    {
+        if(it->entry.info.directory)
+        {
+            if(mkdir(it->target.c_str(), 0755) == -1 && errno != EEXIST)
+            {
+                throw std::runtime_error(it->target + ": " + strerror(errno));
+            }
+            
+            continue;
+        }
+        
+        extractFile(filesystem, *it, buffer, copyProgress);
+        ++result.files;
+        result.bytes += it->entry.info.size;
+    }
+    
+    const long long duration = monotonicMicroseconds() - start;
+    
+    result.mbPerSecond = duration > 0 ? result.bytes / (duration / 1e6) / (1024 * 1024) : 0;
+    recordOperation(OperationExtract, image, startTime, duration, 0, result.bytes);
+    
+    return result;
+}
+
+std::string formatExtractResult(ExtractResult const& result)
+{
+    std::ostringstream oss;
+    
+    oss << std::fixed << std::setprecision(1);
+    oss << "Extracted " << result.files << (result.files == 1 ? " file, " : " files, ")
+        << result.bytes / (1024 * 1024) << " MB at " << result.mbPerSecond << " MB/s.";
+    
+    return oss.str();
+}
@@ -0,0 +1,82 @@
+/**
+ * Copyright (c) 2007, Emir Uner
+ * All rights reserved.
+ * 
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ * 
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef EASYTC_IMAGEEXTRACT_HPP_INCLUDED
+#define EASYTC_IMAGEEXTRACT_HPP_INCLUDED
+
+#include "Progress.hpp"
+#include "Secret.hpp"
+
+#include <time.h>
+
+#include <string>
+#include <vector>
+
+struct ImageFileEntry
+{
+    /**
+     * The long name where there is one, otherwise the 8.3 name.
+     */
+    std::string name;
+    bool directory;
+    unsigned long long size;
+    
+    /**
+     * Last write time, 0 if the filesystem did not record it.
+     */
+    time_t modified;
+};
+
+typedef std::vector<ImageFileEntry> ImageFileEntryVec;
+
+struct ExtractResult
+{
+    int files;
+    long long bytes;
+    double mbPerSecond;
+};
+
+/**
+ * Lists a directory of the FAT filesystem inside an AES volume without
+ * mounting it, so neither root nor truecrypt is needed. Paths are separated
+ * by "/" and matched without regard to case, as FAT does.
+ */
+ImageFileEntryVec listImageFiles(std::string image, Secret const& password, std::string directory);
+
+/**
+ * Copies files out of the FAT filesystem inside an AES volume into the
+ * target directory without mounting it. The data area is decrypted in
+ * process, large reads on all processors; directories are copied with
+ * everything below them. A file only gets its name once it is complete.
+ * Throws std::runtime_error for a wrong password, an unsupported volume or
+ * filesystem, and paths that do not exist.
+ */
+ExtractResult extractImageFiles(std::string image, Secret const& password, std::vector<std::string> const& paths,
+                                std::string targetDirectory, Progress* progress = 0);
+
+std::string formatExtractResult(ExtractResult const& result);
+
+#endif
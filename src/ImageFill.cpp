@@ -0,0 +1,484 @@
+/**
+ * Copyright (c) 2007, Emir Uner
+ * All rights reserved.
+ * 
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ * 
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "ImageFill.hpp"
+#include "IoRing.hpp"
+#include "Posix.hpp"
+#include "Trace.hpp"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <openssl/crypto.h>
+#include <openssl/evp.h>
+#include <openssl/rand.h>
+
+#include <algorithm>
+#include <deque>
+#include <stdexcept>
+
+namespace
+{
+
+const long long sectorSize = 4096;
+const int writerThreads = 4;
+
+// a few cores with AES instructions already outrun an NVMe drive
+const int maxDefaultGenerators = 16;
+
+struct FilledChunk
+{
+    int buffer;
+    long long offset;
+    long long length;
+};
+
+/**
+ * Hands chunk buffers from the generators to the writers and back. Every
+ * wait also ends when the fill has failed, so that one thread's error
+ * cannot leave the others blocked.
+ */
+class FillPipeline
+{
+    pthread_mutex_t mutex;
+    pthread_cond_t changed;
+    std::deque<int> freeBuffers;
+    std::deque<FilledChunk> filledChunks;
+    long long nextOffset;
+    long long end;
+    int generating;
+    bool failed;
+    
+    FillPipeline(FillPipeline const&);
+    FillPipeline& operator=(FillPipeline const&);
+    
+public:
+    FillPipeline(int buffers, long long offset, long long length, int generators)
+    : nextOffset(offset), end(offset + length), generating(generators), failed(false)
+    {
+        pthread_mutex_init(&mutex, 0);
+        pthread_cond_init(&changed, 0);
+        
+        for(int i = 0; i < buffers; ++i)
+        {
+            freeBuffers.push_back(i);
+        }
+    }
+    
+    ~FillPipeline()
+    {
+        pthread_cond_destroy(&changed);
+        pthread_mutex_destroy(&mutex);
+    }
+    
+    /**
+     * Gives a generator a free buffer and the next range to fill, false
+     * once everything has been handed out.
+     */
+    bool takeFree(FilledChunk& chunk, long long chunkSize)
+    {
+        pthread_mutex_lock(&mutex);
+        
+        while(!failed && nextOffset < end && freeBuffers.empty())
+        {
+            pthread_cond_wait(&changed, &mutex);
+        }
+        
+        const bool taken = !failed && nextOffset < end;
+        
+        if(taken)
+        {
+            chunk.buffer = freeBuffers.front();
+            chunk.offset = nextOffset;
+            chunk.length = std::min(chunkSize, end - nextOffset);
+            freeBuffers.pop_front();
+            nextOffset += chunk.length;
+        }
+        else if(--generating == 0)
+        {
+            pthread_cond_broadcast(&changed);
+        }
+        
+        pthread_mutex_unlock(&mutex);
+        
+        return taken;
+    }
+    
+    void putFilled(FilledChunk const& chunk)
+    {
+        pthread_mutex_lock(&mutex);
+        filledChunks.push_back(chunk);
+        pthread_cond_broadcast(&changed);
+        pthread_mutex_unlock(&mutex);
+    }
+    
+    /**
+     * Gives a writer the next filled chunk, waiting for one if asked to.
+     * False when there is none, always so after a failure or once the
+     * generators are done and everything has been taken.
+     */
+    bool takeFilled(FilledChunk& chunk, bool wait)
+    {
+        pthread_mutex_lock(&mutex);
+        
+        while(wait && !failed && filledChunks.empty() && generating > 0)
+        {
+            pthread_cond_wait(&changed, &mutex);
+        }
+        
+        const bool taken = !failed && !filledChunks.empty();
+        
+        if(taken)
+        {
+            chunk = filledChunks.front();
+            filledChunks.pop_front();
+        }
+        
+        pthread_mutex_unlock(&mutex);
+        
+        return taken;
+    }
+    
+    void putFree(int buffer)
+    {
+        pthread_mutex_lock(&mutex);
+        freeBuffers.push_back(buffer);
+        pthread_cond_broadcast(&changed);
+        pthread_mutex_unlock(&mutex);
+    }
+    
+    void fail()
+    {
+        pthread_mutex_lock(&mutex);
+        failed = true;
+        pthread_cond_broadcast(&changed);
+        pthread_mutex_unlock(&mutex);
+    }
+};
+
+struct FillState
+{
+    int fd;
+    long long chunkSize;
+    char* buffers;
+    unsigned char key[32];
+    unsigned char nonce[8];
+    FillPipeline* pipeline;
+    Progress* progress;
+    long long total;
+    volatile long long doneBytes;
+};
+
+void reportDone(FillState* state, long long length)
+{
+    const long long done = __atomic_add_fetch(&state->doneBytes, length, __ATOMIC_RELAXED);
+    
+    if(state->progress != 0 && done * 100 / state->total != (done - length) * 100 / state->total)
+    {
+        state->progress->report(static_cast<int>(done * 100 / state->total));
+    }
+}
+
+/**
+ * Encrypts zeros in counter mode. The counter block is the nonce followed
+ * by the 16 byte block number of the offset, so chunks can be generated in
+ * any order on any thread without reusing keystream.
+ */
+void generateKeystream(EVP_CIPHER_CTX* ctx, FillState* state, char* buffer, FilledChunk const& chunk)
+{
+    unsigned char counter[16];
+    unsigned long long block = static_cast<unsigned long long>(chunk.offset) / 16;
+    int outLength;
+    
+    memcpy(counter, state->nonce, sizeof(state->nonce));
+    
+    for(int i = 15; i >= 8; --i, block >>= 8)
+    {
+        counter[i] = static_cast<unsigned char>(block);
+    }
+    
+    memset(buffer, 0, chunk.length);
+    
+    if(EVP_EncryptInit_ex(ctx, EVP_aes_256_ctr(), 0, state->key, counter) != 1
+       || EVP_EncryptUpdate(ctx, reinterpret_cast<unsigned char*>(buffer), &outLength,
+                            reinterpret_cast<unsigned char*>(buffer), static_cast<int>(chunk.length)) != 1)
+    {
+        throw std::runtime_error("could not generate random data");
+    }
+}
+
+void generate(FillState* state)
+{
+    EVP_CIPHER_CTX* ctx = EVP_CIPHER_CTX_new();
+    FilledChunk chunk;
+    
+    if(ctx == 0)
+    {
+        throw std::runtime_error("could not generate random data");
+    }
+    
+    try
+    {
+        while(state->pipeline->takeFree(chunk, state->chunkSize))
+        {
+            operation_cancelled::check(state->progress);
+            generateKeystream(ctx, state, state->buffers + chunk.buffer * state->chunkSize, chunk);
+            state->pipeline->putFilled(chunk);
+        }
+    }
+    catch(...)
+    {
+        EVP_CIPHER_CTX_free(ctx);
+        throw;
+    }
+    
+    EVP_CIPHER_CTX_free(ctx);
+}
+
+void writeChunk(FillState* state, FilledChunk const& chunk, long long result)
+{
+    if(result != chunk.length)
+    {
+        throw std::runtime_error(std::string("could not write random data: ")
+                                 + (result < 0 ? strerror(static_cast<int>(-result)) : "short write"));
+    }
+    
+    reportDone(state, chunk.length);
+    state->pipeline->putFree(chunk.buffer);
+}
+
+void writeWithRing(FillState* state, int queueDepth)
+{
+    IoRing ring(queueDepth);
+    std::vector<FilledChunk> inFlight(queueDepth);
+    std::vector<int> freeSlots;
+    std::string error;
+    FilledChunk chunk;
+    
+    for(int slot = queueDepth - 1; slot >= 0; --slot)
+    {
+        freeSlots.push_back(slot);
+    }
+    
+    // the kernel reads from the buffers, so drain the ring before leaving
+    for(;;)
+    {
+        if(error.empty() && !freeSlots.empty() && state->pipeline->takeFilled(chunk, ring.getPending() == 0))
+        {
+            const int slot = freeSlots.back();
+            
+            freeSlots.pop_back();
+            inFlight[slot] = chunk;
+            ring.prepareWrite(state->fd, state->buffers + chunk.buffer * state->chunkSize,
+                              static_cast<unsigned>(chunk.length), chunk.offset, slot);
+            continue;
+        }
+        
+        if(ring.getPending() == 0)
+        {
+            break;
+        }
+        
+        const IoCompletion completion = ring.submitAndWait();
+        const int slot = static_cast<int>(completion.userData);
+        
+        try
+        {
+            writeChunk(state, inFlight[slot], completion.result);
+        }
+        catch(std::runtime_error const& ex)
+        {
+            if(error.empty())
+            {
+                error = ex.what();
+                state->pipeline->fail();
+            }
+        }
+        
+        freeSlots.push_back(slot);
+    }
+    
+    if(!error.empty())
+    {
+        throw std::runtime_error(error);
+    }
+}
+
+void writeWithPwrite(FillState* state)
+{
+    FilledChunk chunk;
+    
+    while(state->pipeline->takeFilled(chunk, true))
+    {
+        writeChunk(state, chunk, pwrite(state->fd, state->buffers + chunk.buffer * state->chunkSize, chunk.length,
+                                        chunk.offset) == chunk.length ? chunk.length : -errno);
+    }
+}
+
+struct FillWorker
+{
+    enum Role
+    {
+        RoleGenerate,
+        RoleRingWriter,
+        RoleWriter
+    };
+    
+    FillState* state;
+    Role role;
+    int queueDepth;
+    
+    void operator()()
+    {
+        try
+        {
+            if(role == RoleGenerate)
+            {
+                TRACE_SCOPE("fill generator");
+                generate(state);
+            }
+            else if(role == RoleRingWriter)
+            {
+                TRACE_SCOPE("fill ring writer");
+                writeWithRing(state, queueDepth);
+            }
+            else
+            {
+                TRACE_SCOPE("fill writer");
+                writeWithPwrite(state);
+            }
+        }
+        catch(...)
+        {
+            state->pipeline->fail();
+            throw;
+        }
+    }
+};
+
+} // namespace <unnamed>
+
+FillResult fillRandom(std::string path, long long offset, long long length, FillOptions const& options,
+                      Progress* progress)
+{
+    TRACE_SCOPE("fill random");
+    
+    if(offset % sectorSize != 0 || length % sectorSize != 0 || length <= 0)
+    {
+        throw std::runtime_error("the range to fill has to be made of whole 4 KiB sectors");
+    }
+    
+    const long long start = monotonicMicroseconds();
+    const int generators = options.threads > 0 ? options.threads
+                                               : std::min(getProcessorCount(), maxDefaultGenerators);
+    const int queueDepth = std::max(1, options.queueDepth);
+    int fd = open(path.c_str(), O_WRONLY | O_CLOEXEC | O_DIRECT);
+    
+    // tmpfs and a few others refuse O_DIRECT
+    if(fd == -1 && errno == EINVAL)
+    {
+        fd = open(path.c_str(), O_WRONLY | O_CLOEXEC);
+    }
+    
+    if(fd == -1)
+    {
+        throw std::runtime_error(path + ": " + strerror(errno));
+    }
+    
+    FillResult result;
+    FillState state;
+    
+    state.fd = fd;
+    state.chunkSize = std::max(4, options.chunkKBytes / 4 * 4) * 1024LL;
+    state.buffers = 0;
+    state.progress = progress;
+    state.total = length;
+    state.doneBytes = 0;
+    result.bytes = length;
+    result.usedIoRing = IoRing::isSupported();
+    
+    // a generator needs a buffer while the writers hold a queue's worth
+    FillPipeline pipeline(generators + queueDepth, offset, length, generators);
+    const int errorCode = posix_memalign(reinterpret_cast<void**>(&state.buffers), sectorSize,
+                                         (generators + queueDepth) * state.chunkSize);
+    
+    state.pipeline = &pipeline;
+    
+    try
+    {
+        if(errorCode != 0)
+        {
+            throw unix_error(errorCode);
+        }
+        
+        if(RAND_bytes(state.key, sizeof(state.key)) != 1 || RAND_bytes(state.nonce, sizeof(state.nonce)) != 1)
+        {
+            throw std::runtime_error("could not get a random key");
+        }
+        
+        FillWorker worker;
+        std::vector<FillWorker> workers;
+        
+        worker.state = &state;
+        worker.queueDepth = queueDepth;
+        worker.role = result.usedIoRing ? FillWorker::RoleRingWriter : FillWorker::RoleWriter;
+        workers.insert(workers.end(), result.usedIoRing ? 1 : std::min(queueDepth, writerThreads), worker);
+        worker.role = FillWorker::RoleGenerate;
+        workers.insert(workers.end(), generators, worker);
+        
+        try
+        {
+            runThreads(workers);
+        }
+        catch(std::runtime_error const&)
+        {
+            operation_cancelled::check(progress);
+            throw;
+        }
+        
+        unix_error::check(fdatasync(fd));
+    }
+    catch(...)
+    {
+        OPENSSL_cleanse(state.key, sizeof(state.key));
+        free(state.buffers);
+        close(fd);
+        throw;
+    }
+    
+    OPENSSL_cleanse(state.key, sizeof(state.key));
+    free(state.buffers);
+    close(fd);
+    
+    const long long elapsed = monotonicMicroseconds() - start;
+    
+    result.mbPerSecond = length / (elapsed > 0 ? elapsed / 1e6 : 1e-6) / (1024 * 1024);
+    
+    return result;
+}
@@ -0,0 +1,76 @@
+/**
+ * Copyright (c) 2007, Emir Uner
+ * All rights reserved.
+ * 
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ * 
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef EASYTC_IMAGEFILL_HPP_INCLUDED
+#define EASYTC_IMAGEFILL_HPP_INCLUDED
+
+#include "Progress.hpp"
+
+#include <string>
+
+struct FillOptions
+{
+    /**
+     * Threads generating random data, 0 for one per processor up to 16.
+     */
+    int threads;
+    int chunkKBytes;
+    
+    /**
+     * Number of writes kept in flight.
+     */
+    int queueDepth;
+    
+    inline FillOptions()
+    : threads(0), chunkKBytes(4096), queueDepth(8)
+    {
+    }
+};
+
+struct FillResult
+{
+    long long bytes;
+    double mbPerSecond;
+    
+    /**
+     * Whether the writes went through io_uring rather than threads.
+     */
+    bool usedIoRing;
+};
+
+/**
+ * Overwrites length bytes of the file from offset on with AES-256-CTR
+ * keystream under a random key, which is as good as random data and is
+ * generated at memory speed with the CPU's AES instructions. Generator
+ * threads fill page aligned chunks that are written, bypassing the page
+ * cache where the filesystem allows, through io_uring or by writer
+ * threads, so generating and writing overlap. Offset and length have to be
+ * multiples of 4 KiB.
+ */
+FillResult fillRandom(std::string path, long long offset, long long length, FillOptions const& options = FillOptions(),
+                      Progress* progress = 0);
+
+#endif
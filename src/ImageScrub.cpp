@@ -0,0 +1,464 @@
+/**
+ * Copyright (c) 2007, Emir Uner
+ * All rights reserved.
+ * 
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ * 
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "ImageScrub.hpp"
+#include "Config.hpp"
+#include "IoRing.hpp"
+#include "OperationLog.hpp"
+#include "Posix.hpp"
+#include "Trace.hpp"
+
+#include <fcntl.h>
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+
+#include <algorithm>
+#include <sstream>
+
+namespace
+{
+
+const long long sectorSize = 4096;
+const long long backupHeaderDistance = 131072;
+const int headerSize = 512;
+const double headerEntropyThreshold = 7.2;
+const size_t maxListedRanges = 10;
+
+/**
+ * Page aligned memory as O_DIRECT needs it.
+ */
+class AlignedMemory
+{
+    void* data;
+    
+    AlignedMemory(AlignedMemory const&);
+    AlignedMemory& operator=(AlignedMemory const&);
+    
+public:
+    explicit AlignedMemory(size_t size)
+    : data(0)
+    {
+        const int errorCode = posix_memalign(&data, sectorSize, size);
+        
+        if(errorCode != 0)
+        {
+            throw unix_error(errorCode);
+        }
+    }
+    
+    ~AlignedMemory()
+    {
+        free(data);
+    }
+    
+    char* get()
+    {
+        return static_cast<char*>(data);
+    }
+};
+
+void addRange(ScrubRangeVec& ranges, long long offset, long long length)
+{
+    if(!ranges.empty() && ranges.back().offset + ranges.back().length == offset)
+    {
+        ranges.back().length += length;
+        return;
+    }
+    
+    ScrubRange range;
+    
+    range.offset = offset;
+    range.length = length;
+    ranges.push_back(range);
+}
+
+bool isBefore(ScrubRange const& a, ScrubRange const& b)
+{
+    return a.offset < b.offset;
+}
+
+ScrubRangeVec mergeRanges(ScrubRangeVec ranges)
+{
+    ScrubRangeVec merged;
+    
+    std::sort(ranges.begin(), ranges.end(), &isBefore);
+    
+    for(ScrubRangeVec::const_iterator it = ranges.begin(); it != ranges.end(); ++it)
+    {
+        addRange(merged, it->offset, it->length);
+    }
+    
+    return merged;
+}
+
+/**
+ * Rereads a range that failed as a whole sector by sector, recording the
+ * sectors that still fail.
+ */
+void narrowFailure(int fd, char* buffer, long long offset, long long length, ScrubRangeVec& ranges)
+{
+    TRACE_SCOPE("scrub narrow failure");
+    
+    const long long end = offset + length;
+    
+    for(long long at = offset; at < end; at += sectorSize)
+    {
+        const ssize_t count = pread(fd, buffer, sectorSize, at);
+        
+        if(count == 0)
+        {
+            break;
+        }
+        
+        if(count == -1)
+        {
+            addRange(ranges, at, std::min(sectorSize, end - at));
+        }
+    }
+}
+
+/**
+ * Sleeps until reading from the given offset on keeps the scrub within its
+ * bandwidth limit.
+ */
+void throttle(long long startTime, long long offset, int maxMBytesPerSecond)
+{
+    if(maxMBytesPerSecond <= 0)
+    {
+        return;
+    }
+    
+    const long long due = startTime + static_cast<long long>(offset / (maxMBytesPerSecond * 1048576.0) * 1e6);
+    const long long now = monotonicMicroseconds();
+    
+    if(due > now)
+    {
+        usleep(static_cast<useconds_t>(due - now));
+    }
+}
+
+double computeEntropy(unsigned char const* data, int length)
+{
+    unsigned int histogram[256] = { 0 };
+    double entropy = 0;
+    
+    for(int i = 0; i < length; ++i)
+    {
+        ++histogram[data[i]];
+    }
+    
+    for(int i = 0; i < 256; ++i)
+    {
+        if(histogram[i] != 0)
+        {
+            const double p = static_cast<double>(histogram[i]) / length;
+            
+            entropy -= p * log(p) / log(2.0);
+        }
+    }
+    
+    return entropy;
+}
+
+HeaderState checkHeader(int fd, char* buffer, long long offset, long long size)
+{
+    if(offset < 0 || offset + headerSize > size)
+    {
+        return HeaderMissing;
+    }
+    
+    // O_DIRECT reads have to start on a sector boundary
+    const long long sectorOffset = offset / sectorSize * sectorSize;
+    const long long skip = offset - sectorOffset;
+    
+    if(pread(fd, buffer, 2 * sectorSize, sectorOffset) < skip + headerSize)
+    {
+        return HeaderUnreadable;
+    }
+    
+    return computeEntropy(reinterpret_cast<unsigned char*>(buffer + skip), headerSize) >= headerEntropyThreshold
+           ? HeaderIntact : HeaderBlank;
+}
+
+struct ScrubState
+{
+    int fd;
+    long long size;
+    long long chunkSize;
+    int maxMBytesPerSecond;
+    long long startTime;
+    Progress* progress;
+    volatile long long nextOffset;
+    volatile long long doneBytes;
+};
+
+void reportDone(ScrubState* state, long long length)
+{
+    const long long done = __atomic_add_fetch(&state->doneBytes, length, __ATOMIC_RELAXED);
+    
+    if(state->progress != 0 && done * 100 / state->size != (done - length) * 100 / state->size)
+    {
+        state->progress->report(static_cast<int>(done * 100 / state->size));
+    }
+}
+
+/**
+ * Handles a read that returned fewer bytes than asked for.
+ */
+void checkRead(ScrubState* state, char* buffer, long long offset, long long result, ScrubRangeVec& unreadable)
+{
+    const long long length = std::min(state->chunkSize, state->size - offset);
+    
+    if(result < length)
+    {
+        const long long done = std::max(0LL, result);
+        
+        narrowFailure(state->fd, buffer, offset + done, length - done, unreadable);
+    }
+    
+    reportDone(state, length);
+}
+
+void scrubWithRing(ScrubState* state, int queueDepth, ScrubRangeVec& unreadable)
+{
+    // declared first, so that the ring waits for the reads in flight before
+    // the buffers are freed, also when a check throws
+    AlignedMemory buffers(queueDepth * state->chunkSize);
+    IoRing ring(queueDepth);
+    std::vector<long long> offsets(queueDepth);
+    bool cancelled = false;
+    
+    for(int slot = 0; slot < queueDepth && state->nextOffset < state->size; ++slot)
+    {
+        offsets[slot] = state->nextOffset;
+        state->nextOffset += state->chunkSize;
+        ring.prepareRead(state->fd, buffers.get() + slot * state->chunkSize, state->chunkSize, offsets[slot], slot);
+    }
+    
+    // the kernel writes into the buffers, so drain the ring before leaving
+    while(ring.getPending() > 0)
+    {
+        const IoCompletion completion = ring.submitAndWait();
+        const int slot = static_cast<int>(completion.userData);
+        char* buffer = buffers.get() + slot * state->chunkSize;
+        
+        checkRead(state, buffer, offsets[slot], completion.result, unreadable);
+        cancelled = cancelled || (state->progress != 0 && state->progress->isCancelled());
+        
+        if(!cancelled && state->nextOffset < state->size)
+        {
+            throttle(state->startTime, state->nextOffset, state->maxMBytesPerSecond);
+            offsets[slot] = state->nextOffset;
+            state->nextOffset += state->chunkSize;
+            ring.prepareRead(state->fd, buffer, state->chunkSize, offsets[slot], slot);
+        }
+    }
+    
+    if(cancelled)
+    {
+        throw operation_cancelled();
+    }
+}
+
+struct ScrubWorker
+{
+    ScrubState* state;
+    ScrubRangeVec unreadable;
+    
+    void operator()()
+    {
+        TRACE_SCOPE("scrub worker");
+        
+        AlignedMemory buffer(state->chunkSize);
+        
+        for(long long offset = __atomic_fetch_add(&state->nextOffset, state->chunkSize, __ATOMIC_RELAXED);
+            offset < state->size;
+            offset = __atomic_fetch_add(&state->nextOffset, state->chunkSize, __ATOMIC_RELAXED))
+        {
+            operation_cancelled::check(state->progress);
+            throttle(state->startTime, offset, state->maxMBytesPerSecond);
+            checkRead(state, buffer.get(), offset, pread(state->fd, buffer.get(), state->chunkSize, offset),
+                      unreadable);
+        }
+    }
+};
+
+void scrubWithThreads(ScrubState* state, int queueDepth, ScrubRangeVec& unreadable)
+{
+    ScrubWorker worker;
+    
+    worker.state = state;
+    
+    std::vector<ScrubWorker> workers(queueDepth, worker);
+    
+    runThreads(workers);
+    
+    for(std::vector<ScrubWorker>::const_iterator it = workers.begin(); it != workers.end(); ++it)
+    {
+        unreadable.insert(unreadable.end(), it->unreadable.begin(), it->unreadable.end());
+    }
+}
+
+} // namespace <unnamed>
+
+ScrubOptions getScrubOptions()
+{
+    Config config(getConfigPath("scrub.conf"));
+    ScrubOptions options;
+    
+    options.queueDepth = std::max(1, config.getInt("", "queuedepth", options.queueDepth));
+    options.chunkKBytes = std::max(4, config.getInt("", "chunkkb", options.chunkKBytes)) / 4 * 4;
+    options.maxMBytesPerSecond = std::max(0, config.getInt("", "bandwidth", options.maxMBytesPerSecond));
+    
+    return options;
+}
+
+ScrubResult scrubImage(std::string image, ScrubOptions const& options, Progress* progress)
+{
+    TRACE_SCOPE("scrub image");
+    
+    const int64_t startTime = wallClockMicroseconds();
+    const long long start = monotonicMicroseconds();
+    int fd = open(image.c_str(), O_RDONLY | O_CLOEXEC | O_DIRECT);
+    
+    // tmpfs and a few others refuse O_DIRECT
+    if(fd == -1 && errno == EINVAL)
+    {
+        fd = open(image.c_str(), O_RDONLY | O_CLOEXEC);
+    }
+    
+    if(fd == -1)
+    {
+        throw std::runtime_error(image + ": " + strerror(errno));
+    }
+    
+    ScrubResult result;
+    
+    try
+    {
+        struct stat st;
+        
+        unix_error::check(fstat(fd, &st));
+        
+        ScrubState state;
+        
+        state.fd = fd;
+        state.size = st.st_size;
+        state.chunkSize = options.chunkKBytes * 1024LL;
+        state.maxMBytesPerSecond = options.maxMBytesPerSecond;
+        state.startTime = start;
+        state.progress = progress;
+        state.nextOffset = 0;
+        state.doneBytes = 0;
+        
+        result.size = state.size;
+        result.usedIoRing = IoRing::isSupported();
+        
+        if(result.usedIoRing)
+        {
+            scrubWithRing(&state, options.queueDepth, result.unreadable);
+        }
+        else
+        {
+            scrubWithThreads(&state, options.queueDepth, result.unreadable);
+        }
+        
+        const long long elapsed = monotonicMicroseconds() - start;
+        AlignedMemory buffer(2 * sectorSize);
+        
+        result.mbPerSecond = state.size / (elapsed > 0 ? elapsed / 1e6 : 1e-6) / (1024 * 1024);
+        result.unreadable = mergeRanges(result.unreadable);
+        result.header = checkHeader(fd, buffer.get(), 0, state.size);
+        result.backupHeader = state.size >= 2 * backupHeaderDistance
+                              ? checkHeader(fd, buffer.get(), state.size - backupHeaderDistance, state.size)
+                              : HeaderMissing;
+    }
+    catch(...)
+    {
+        close(fd);
+        throw;
+    }
+    
+    close(fd);
+    recordOperation(OperationVerify, image, startTime, monotonicMicroseconds() - start,
+                    result.unreadable.empty() ? 0 : 1, result.size);
+    
+    return result;
+}
+
+char const* getHeaderStateName(HeaderState state)
+{
+    switch(state)
+    {
+    case HeaderIntact:
+        return "intact";
+    case HeaderBlank:
+        return "blank";
+    case HeaderUnreadable:
+        return "unreadable";
+    default:
+        return "missing";
+    }
+}
+
+std::string formatScrubResult(ScrubResult const& result)
+{
+    std::ostringstream oss;
+    
+    oss << "Read " << result.size / (1024 * 1024) << " MB at " << static_cast<int>(result.mbPerSecond)
+        << " MB/s using " << (result.usedIoRing ? "io_uring" : "threads") << ".\n"
+        << "Header: " << getHeaderStateName(result.header)
+        << ", backup header: " << getHeaderStateName(result.backupHeader) << ".\n";
+    
+    if(result.unreadable.empty())
+    {
+        oss << "The whole image is readable.";
+        return oss.str();
+    }
+    
+    long long unreadableBytes = 0;
+    
+    for(ScrubRangeVec::const_iterator it = result.unreadable.begin(); it != result.unreadable.end(); ++it)
+    {
+        unreadableBytes += it->length;
+    }
+    
+    oss << unreadableBytes / 1024 << " KB in " << result.unreadable.size() << " ranges could not be read:";
+    
+    for(size_t i = 0; i < result.unreadable.size() && i < maxListedRanges; ++i)
+    {
+        oss << "\n    " << result.unreadable[i].offset << " +" << result.unreadable[i].length;
+    }
+    
+    if(result.unreadable.size() > maxListedRanges)
+    {
+        oss << "\n    ...";
+    }
+    
+    return oss.str();
+}
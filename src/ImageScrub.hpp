@@ -0,0 +1,124 @@
+/**
+ * Copyright (c) 2007, Emir Uner
+ * All rights reserved.
+ * 
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ * 
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef EASYTC_IMAGESCRUB_HPP_INCLUDED
+#define EASYTC_IMAGESCRUB_HPP_INCLUDED
+
+#include "Progress.hpp"
+
+#include <string>
+#include <vector>
+
+/**
+ * What a header sector looks like. Without the password a header can only
+ * be checked for being readable and random looking, as encrypted data is.
+ */
+enum HeaderState
+{
+    HeaderIntact,
+    
+    /**
+     * Readable but too uniform to be an encrypted header, e.g. zeroed.
+     */
+    HeaderBlank,
+    HeaderUnreadable,
+    
+    /**
+     * The image is too small to have the header area.
+     */
+    HeaderMissing
+};
+
+struct ScrubRange
+{
+    long long offset;
+    long long length;
+};
+
+typedef std::vector<ScrubRange> ScrubRangeVec;
+
+struct ScrubOptions
+{
+    /**
+     * Number of reads kept in flight.
+     */
+    int queueDepth;
+    int chunkKBytes;
+    
+    /**
+     * Bandwidth the scrub keeps below, 0 for no limit.
+     */
+    int maxMBytesPerSecond;
+    
+    inline ScrubOptions()
+    : queueDepth(32), chunkKBytes(1024), maxMBytesPerSecond(0)
+    {
+    }
+};
+
+struct ScrubResult
+{
+    long long size;
+    double mbPerSecond;
+    
+    /**
+     * Whether the reads went through io_uring rather than threads.
+     */
+    bool usedIoRing;
+    
+    /**
+     * Sorted, merged ranges that could not be read, narrowed to 4 KiB.
+     */
+    ScrubRangeVec unreadable;
+    HeaderState header;
+    HeaderState backupHeader;
+};
+
+/**
+ * Reads the scrub options from ~/.easytc/scrub.conf, the keys are
+ * queuedepth, chunkkb and bandwidth in MB/s.
+ */
+ScrubOptions getScrubOptions();
+
+/**
+ * Reads the whole image, bypassing the page cache where the filesystem
+ * allows, to find out whether it is still readable. Reads are queued
+ * through io_uring or, where that is not available, issued by a thread
+ * per queue slot. A failed read is retried 4 KiB at a time to narrow down
+ * the unreadable range. The primary header at the start and the backup
+ * header 128 KiB before the end, which TrueCrypt 6 and later write, are
+ * checked separately.
+ */
+ScrubResult scrubImage(std::string image, ScrubOptions const& options, Progress* progress = 0);
+
+char const* getHeaderStateName(HeaderState state);
+
+/**
+ * Returns a few lines describing the result for the user.
+ */
+std::string formatScrubResult(ScrubResult const& result);
+
+#endif
@@ -0,0 +1,257 @@
+/**
+ * Copyright (c) 2007, Emir Uner
+ * All rights reserved.
+ * 
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ * 
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "IoRing.hpp"
+#include "Posix.hpp"
+
+#include <linux/io_uring.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+
+namespace
+{
+
+int ioUringSetup(unsigned entries, struct io_uring_params* params)
+{
+    return static_cast<int>(syscall(__NR_io_uring_setup, entries, params));
+}
+
+int ioUringEnter(int fd, unsigned toSubmit, unsigned minComplete, unsigned flags)
+{
+    return static_cast<int>(syscall(__NR_io_uring_enter, fd, toSubmit, minComplete, flags, 0, 0));
+}
+
+template <typename T>
+T* ringField(void* ring, unsigned offset)
+{
+    return reinterpret_cast<T*>(static_cast<char*>(ring) + offset);
+}
+
+} // namespace <unnamed>
+
+IoRing::IoRing(unsigned entriesp)
+: ringFd(-1), entries(0), prepared(0), pending(0), sqRing(MAP_FAILED), sqRingSize(0),
+  cqRing(MAP_FAILED), cqRingSize(0), sqes(MAP_FAILED), sqesSize(0)
+{
+    struct io_uring_params params;
+    
+    memset(&params, 0, sizeof(params));
+    
+    ringFd = ioUringSetup(entriesp, &params);
+    unix_error::check(ringFd);
+    
+    entries = params.sq_entries;
+    sqRingSize = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+    cqRingSize = params.cq_off.cqes + params.cq_entries * sizeof(struct io_uring_cqe);
+    sqesSize = params.sq_entries * sizeof(struct io_uring_sqe);
+    
+    sqRing = mmap(0, sqRingSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ringFd, IORING_OFF_SQ_RING);
+    cqRing = mmap(0, cqRingSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ringFd, IORING_OFF_CQ_RING);
+    sqes = mmap(0, sqesSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ringFd, IORING_OFF_SQES);
+    
+    if(sqRing == MAP_FAILED || cqRing == MAP_FAILED || sqes == MAP_FAILED)
+    {
+        const int errorCode = errno;
+        
+        release();
+        throw unix_error(errorCode);
+    }
+    
+    sqHead = ringField<unsigned>(sqRing, params.sq_off.head);
+    sqTail = ringField<unsigned>(sqRing, params.sq_off.tail);
+    sqMask = ringField<unsigned>(sqRing, params.sq_off.ring_mask);
+    sqArray = ringField<unsigned>(sqRing, params.sq_off.array);
+    cqHead = ringField<unsigned>(cqRing, params.cq_off.head);
+    cqTail = ringField<unsigned>(cqRing, params.cq_off.tail);
+    cqMask = ringField<unsigned>(cqRing, params.cq_off.ring_mask);
+    cqes = ringField<void>(cqRing, params.cq_off.cqes);
+}
+
+IoRing::~IoRing()
+{
+    release();
+}
+
+void IoRing::release()
+{
+    // closing the ring only cancels the requests, they may still complete
+    // into their buffers afterwards
+    if(sqRing != MAP_FAILED && cqRing != MAP_FAILED && sqes != MAP_FAILED)
+    {
+        drain();
+    }
+    
+    if(sqes != MAP_FAILED)
+    {
+        munmap(sqes, sqesSize);
+    }
+    
+    if(cqRing != MAP_FAILED)
+    {
+        munmap(cqRing, cqRingSize);
+    }
+    
+    if(sqRing != MAP_FAILED)
+    {
+        munmap(sqRing, sqRingSize);
+    }
+    
+    if(ringFd != -1)
+    {
+        close(ringFd);
+    }
+}
+
+void IoRing::drain()
+{
+    // prepared requests the kernel has not been told about never start
+    prepared = 0;
+    
+    while(pending > 0)
+    {
+        const unsigned head = *cqHead;
+        
+        if(head != __atomic_load_n(cqTail, __ATOMIC_ACQUIRE))
+        {
+            __atomic_store_n(cqHead, head + 1, __ATOMIC_RELEASE);
+            --pending;
+            continue;
+        }
+        
+        // published but not yet taken by the kernel, if a submit failed
+        const unsigned unsubmitted = *sqTail - __atomic_load_n(sqHead, __ATOMIC_ACQUIRE);
+        
+        if(ioUringEnter(ringFd, unsubmitted, 1, IORING_ENTER_GETEVENTS) == -1
+           && errno != EINTR && errno != EAGAIN && errno != EBUSY)
+        {
+            return;
+        }
+    }
+}
+
+bool IoRing::isSupported()
+{
+    struct io_uring_params params;
+    
+    memset(&params, 0, sizeof(params));
+    
+    const int fd = ioUringSetup(1, &params);
+    
+    if(fd == -1)
+    {
+        return false;
+    }
+    
+    close(fd);
+    return true;
+}
+
+void IoRing::prepareRead(int fd, void* buffer, unsigned length, off_t offset, unsigned long long userData)
+{
+    prepare(IORING_OP_READ, fd, buffer, length, offset, userData);
+}
+
+void IoRing::prepareWrite(int fd, void const* buffer, unsigned length, off_t offset, unsigned long long userData)
+{
+    prepare(IORING_OP_WRITE, fd, buffer, length, offset, userData);
+}
+
+void IoRing::prepare(int opcode, int fd, void const* buffer, unsigned length, off_t offset,
+                     unsigned long long userData)
+{
+    if(pending + prepared >= entries)
+    {
+        throw std::runtime_error("io_uring submission queue is full");
+    }
+    
+    const unsigned tail = *sqTail + prepared;
+    const unsigned index = tail & *sqMask;
+    struct io_uring_sqe* sqe = static_cast<struct io_uring_sqe*>(sqes) + index;
+    
+    memset(sqe, 0, sizeof(*sqe));
+    sqe->opcode = static_cast<unsigned char>(opcode);
+    sqe->fd = fd;
+    sqe->addr = reinterpret_cast<unsigned long>(buffer);
+    sqe->len = length;
+    sqe->off = offset;
+    sqe->user_data = userData;
+    
+    sqArray[index] = index;
+    ++prepared;
+}
+
+IoCompletion IoRing::submitAndWait()
+{
+    unsigned toSubmit = prepared;
+    
+    if(prepared > 0)
+    {
+        __atomic_store_n(sqTail, *sqTail + prepared, __ATOMIC_RELEASE);
+        pending += prepared;
+        prepared = 0;
+    }
+    
+    if(pending == 0)
+    {
+        throw std::runtime_error("no io_uring request to wait for");
+    }
+    
+    const unsigned head = *cqHead;
+    
+    while(toSubmit > 0 || head == __atomic_load_n(cqTail, __ATOMIC_ACQUIRE))
+    {
+        const bool mustWait = head == __atomic_load_n(cqTail, __ATOMIC_ACQUIRE);
+        const int submitted = ioUringEnter(ringFd, toSubmit, mustWait ? 1 : 0, mustWait ? IORING_ENTER_GETEVENTS : 0);
+        
+        if(submitted == -1)
+        {
+            if(errno != EINTR)
+            {
+                throw unix_error(errno);
+            }
+            
+            continue;
+        }
+        
+        toSubmit -= static_cast<unsigned>(submitted);
+    }
+    
+    struct io_uring_cqe* cqe = static_cast<struct io_uring_cqe*>(cqes) + (head & *cqMask);
+    IoCompletion completion;
+    
+    completion.userData = cqe->user_data;
+    completion.result = cqe->res;
+    
+    __atomic_store_n(cqHead, head + 1, __ATOMIC_RELEASE);
+    --pending;
+    
+    return completion;
+}
+
+unsigned IoRing::getPending() const
+{
+    return pending + prepared;
+}
@@ -0,0 +1,108 @@
+/**
+ * Copyright (c) 2007, Emir Uner
+ * All rights reserved.
+ * 
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ * 
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef EASYTC_IORING_HPP_INCLUDED
+#define EASYTC_IORING_HPP_INCLUDED
+
+#include <sys/types.h>
+
+struct IoCompletion
+{
+    unsigned long long userData;
+    int result;
+};
+
+/**
+ * Minimal io_uring submission/completion queue pair used for deep-queue
+ * asynchronous reads and writes. Talks to the kernel with raw system calls
+ * so no liburing is needed.
+ */
+class IoRing
+{
+public:
+    /**
+     * Sets up a ring with room for the given number of in-flight requests.
+     * Throws unix_error if io_uring is not available.
+     */
+    explicit IoRing(unsigned entries);
+    
+    /**
+     * Waits for the requests still in flight before tearing the ring down,
+     * so their buffers may be freed right after it.
+     */
+    ~IoRing();
+    
+    /**
+     * Checks whether the running kernel lets us use io_uring.
+     */
+    static bool isSupported();
+    
+    void prepareRead(int fd, void* buffer, unsigned length, off_t offset, unsigned long long userData);
+    void prepareWrite(int fd, void const* buffer, unsigned length, off_t offset, unsigned long long userData);
+    
+    /**
+     * Hands all prepared requests to the kernel and waits until at least
+     * one completion is available.
+     */
+    IoCompletion submitAndWait();
+    
+    /**
+     * Number of requests submitted or prepared but not yet completed.
+     */
+    unsigned getPending() const;
+    
+private:
+    IoRing(IoRing const&);
+    IoRing& operator=(IoRing const&);
+    
+    void release();
+    void drain();
+    void prepare(int opcode, int fd, void const* buffer, unsigned length, off_t offset,
+                 unsigned long long userData);
+    
+    int ringFd;
+    unsigned entries;
+    unsigned prepared;
+    unsigned pending;
+    
+    void* sqRing;
+    size_t sqRingSize;
+    void* cqRing;
+    size_t cqRingSize;
+    void* sqes;
+    size_t sqesSize;
+    
+    unsigned* sqHead;
+    unsigned* sqTail;
+    unsigned* sqMask;
+    unsigned* sqArray;
+    unsigned* cqHead;
+    unsigned* cqTail;
+    unsigned* cqMask;
+    void* cqes;
+};
+
+#endif
@@ -27,13 +27,30 @@
 #include "FormMain.hpp"
 #include "MountInfo.hpp"
 #include "Posix.hpp"
+#include "QueueTuning.hpp"
+#include "Trace.hpp"
 
 #include <QtGui/QApplication>
 #include <QtGui/QMessageBox>
 
+#include <stdlib.h>
+
+#include <iostream>
+
 int main(int argc, char *argv[])
 {
     QApplication app(argc, argv);
+    
+    // EASYTC_TRACE=<file> records a trace of the whole session
+    char const* tracePath = getenv("EASYTC_TRACE");
+    
+    setTracingEnabled(tracePath != 0);
+    
+    // EASYTC_SYSFS_ROOT=<directory> tunes the queues of a copied sysfs tree
+    if(getenv("EASYTC_SYSFS_ROOT") != 0)
+    {
+        setSysfsRoot(getenv("EASYTC_SYSFS_ROOT"));
+    }
 
     if(!amIRoot())
     {
@@ -43,5 +60,20 @@ int main(int argc, char *argv[])
     FormMain formMain;
 
     formMain.show();
-    return app.exec();
+    
+    const int result = app.exec();
+    
+    if(tracePath != 0)
+    {
+        try
+        {
+            writeTrace(tracePath);
+        }
+        catch(std::runtime_error ex)
+        {
+            std::cerr << ex.what() << std::endl;
+        }
+    }
+    
+    return result;
 }
@@ -25,8 +25,14 @@
  */
 
 #include "MountInfo.hpp"
+#include "OperationLog.hpp"
 #include "Posix.hpp"
+#include "Trace.hpp"
+#include "VolumeLocks.hpp"
 
+#include <sys/stat.h>
+
+#include <map>
 #include <sstream>
 #include <iostream>
 #include <stdexcept>
@@ -69,14 +75,16 @@ StringVec splitToWords(std::string line)
     
     return words;
 }
-    
-} // namespace <unnamed>
 
-MountInfoVec getMountInfo()
+MountInfoVec listMountInfo()
 {
     int exitCode;
+    const int64_t startTime = wallClockMicroseconds();
+    const long long start = monotonicMicroseconds();
     
     StringVec tcOutput = splitToLines(executeCommand("truecrypt", "-l", exitCode));
+    
+    recordOperation(OperationList, "", startTime, monotonicMicroseconds() - start, exitCode, 0);
 
     if(exitCode != 0)
     {
@@ -90,30 +98,143 @@ MountInfoVec getMountInfo()
         }
     }
     
-    StringVec mntOutput = splitToLines(executeCommand("mount", exitCode));
+    return parseMountInfo(tcOutput, splitToLines(executeCommand("mount", exitCode)));
+}
+
+bool findImage(MountInfoVec (*list)(), std::string const& image, MountInfo& info)
+{
+    MountInfoVec mountInfos;
+    
+    try
+    {
+        mountInfos = list();
+    }
+    catch(std::runtime_error const& ex)
+    {
+        // truecrypt fails when nothing is mapped
+        if(std::string(ex.what()).find("No volumes mapped") == std::string::npos)
+        {
+            throw;
+        }
+    }
+    
+    struct stat imageStat;
+    const bool haveStat = stat(image.c_str(), &imageStat) == 0;
+    
+    for(MountInfoVec::const_iterator it = mountInfos.begin(); it != mountInfos.end(); ++it)
+    {
+        struct stat st;
+        
+        if(it->imageFile == image || (haveStat && stat(it->imageFile.c_str(), &st) == 0
+                                      && st.st_dev == imageStat.st_dev && st.st_ino == imageStat.st_ino))
+        {
+            info = *it;
+            return true;
+        }
+    }
+    
+    return false;
+}
+    
+} // namespace <unnamed>
+
+MountInfoVec getMountInfo()
+{
+    VolumeLock lock((VolumeKeyVec()));
+    
+    return listMountInfo();
+}
+
+MountInfoVec parseMountInfo(std::vector<std::string> const& tcOutput, std::vector<std::string> const& mntOutput)
+{
+    TRACE_SCOPE("parse mount info");
+    
+    typedef std::map<std::string, StringVec::size_type> DeviceIndex;
+    
+    // index mount output by device once instead of rescanning it per volume
+    DeviceIndex mntIndex;
+    std::vector<StringVec> mntWordsVec(mntOutput.size());
+    
+    for(StringVec::size_type i = 0; i < mntOutput.size(); ++i)
+    {
+        mntWordsVec[i] = splitToWords(mntOutput[i]);
+        
+        if(mntWordsVec[i].size() > 2)
+        {
+            mntIndex.insert(DeviceIndex::value_type(mntWordsVec[i][0], i));
+        }
+    }
+    
     MountInfoVec info;
     
     for(StringVec::const_iterator tcIt = tcOutput.begin(); tcIt != tcOutput.end(); ++tcIt)
     {
         StringVec tcWords = splitToWords(*tcIt);
         
+        if(tcWords.size() < 2)
+        {
+            continue;
+        }
+        
         std::string device = tcWords[0];
         std::string image = tcWords[1];
         
-        for(StringVec::const_iterator mntIt = mntOutput.begin(); mntIt != mntOutput.end(); ++mntIt) 
+        DeviceIndex::const_iterator mntIt = mntIndex.find(device);
+        
+        if(mntIt != mntIndex.end())
         {
-            StringVec mntWords = splitToWords(*mntIt);
+            StringVec const& mntWords = mntWordsVec[mntIt->second];
             
-            std::string mntDev = mntWords[0];
             std::string mntPoint = mntWords[2];
+            std::string mntType = mntWords.size() > 4 ? mntWords[4] : "";
+            std::string mntOptions = mntWords.size() > 5 ? mntWords[5] : "";
             
-            if(mntDev == device)
+            // "(rw,noatime)"
+            if(mntOptions.size() >= 2 && mntOptions[0] == '(' && mntOptions[mntOptions.size() - 1] == ')')
             {
-                info.push_back(MountInfo(image, mntPoint));
-                break;
+                mntOptions = mntOptions.substr(1, mntOptions.size() - 2);
             }
+            
+            info.push_back(MountInfo(image, mntPoint, mntType, mntOptions, device));
         }
     }
 
     return info;
 }
+
+bool findMountInfo(std::string image, MountInfo& info)
+{
+    return findImage(&getMountInfo, image, info);
+}
+
+bool findMountInfoLocked(std::string image, MountInfo& info)
+{
+    return findImage(&listMountInfo, image, info);
+}
+
+bool isMountedReadOnly(MountInfo const& info)
+{
+    return info.options == "ro" || info.options.compare(0, 3, "ro,") == 0;
+}
+
+std::string getMappedDevice(std::string image)
+{
+    int exitCode;
+    
+    StringVec tcOutput = splitToLines(executeCommand("truecrypt", "-l", exitCode));
+
+    if(exitCode == 0)
+    {
+        for(StringVec::const_iterator tcIt = tcOutput.begin(); tcIt != tcOutput.end(); ++tcIt)
+        {
+            StringVec tcWords = splitToWords(*tcIt);
+            
+            if(tcWords.size() >= 2 && tcWords[1] == image)
+            {
+                return tcWords[0];
+            }
+        }
+    }
+    
+    throw std::runtime_error("image is not mapped: " + image);
+}
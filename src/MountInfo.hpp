@@ -34,9 +34,21 @@ struct MountInfo
 {
     std::string imageFile;
     std::string mountPoint;
+    std::string filesystem;
+    
+    /**
+     * Options the filesystem is mounted with, as listed by mount.
+     */
+    std::string options;
+    
+    /**
+     * The device the image is mapped to, e.g. /dev/mapper/truecrypt0.
+     */
+    std::string device;
 
-    inline MountInfo(std::string file, std::string mpoint)
-    : imageFile(file), mountPoint(mpoint)
+    inline MountInfo(std::string file, std::string mpoint, std::string fs, std::string opts = "",
+                     std::string dev = "")
+    : imageFile(file), mountPoint(mpoint), filesystem(fs), options(opts), device(dev)
     {
     }
 };
@@ -45,4 +57,35 @@ typedef std::vector<MountInfo> MountInfoVec;
 
 MountInfoVec getMountInfo();
 
+/**
+ * Matches the lines of "truecrypt -l" against the lines of "mount".
+ */
+MountInfoVec parseMountInfo(std::vector<std::string> const& tcOutput, std::vector<std::string> const& mntOutput);
+
+/**
+ * Looks the image up among the mounted ones, by path or by inode. Having
+ * nothing mapped at all is not an error.
+ *
+ * @return true and fills info if the image is mounted
+ */
+bool findMountInfo(std::string image, MountInfo& info);
+
+/**
+ * Like findMountInfo, for callers that hold a volume lock on the image so
+ * that it cannot be mounted or unmounted meanwhile. Lists without the list
+ * lock, which could wait behind an exclusive request queued after theirs.
+ */
+bool findMountInfoLocked(std::string image, MountInfo& info);
+
+/**
+ * Whether the mount options start with "ro".
+ */
+bool isMountedReadOnly(MountInfo const& info);
+
+/**
+ * Returns the device the image is mapped to, mounted or not. Takes no
+ * volume lock since it runs while image creation holds one.
+ */
+std::string getMappedDevice(std::string image);
+
 #endif
@@ -0,0 +1,122 @@
+/**
+ * Copyright (c) 2007, Emir Uner
+ * All rights reserved.
+ * 
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ * 
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "MountProfile.hpp"
+#include "Config.hpp"
+#include "DmCrypt.hpp"
+
+#include <stdexcept>
+
+namespace
+{
+
+MountProfile makeProfile(std::string name, bool readOnly, std::string options, int dmCryptFlags = 0)
+{
+    MountProfile profile;
+    
+    profile.name = name;
+    profile.readOnly = readOnly;
+    profile.options = options;
+    profile.dmCryptFlags = dmCryptFlags;
+    
+    return profile;
+}
+
+std::string joinOptions(std::vector<std::string> const& options)
+{
+    std::string joined;
+    
+    for(std::vector<std::string>::const_iterator it = options.begin(); it != options.end(); ++it)
+    {
+        if(!it->empty())
+        {
+            joined += (joined.empty() ? "" : ",") + *it;
+        }
+    }
+    
+    return joined;
+}
+
+} // namespace <unnamed>
+
+MountProfileVec getMountProfiles()
+{
+    Config config(getConfigPath("profiles.conf"));
+    std::vector<std::string> sections = config.getSections();
+    MountProfileVec profiles(1);
+    
+    if(sections.empty())
+    {
+        profiles.push_back(makeProfile("Read-only", true, ""));
+        profiles.push_back(makeProfile("No atime", false, "noatime,nodiratime"));
+        profiles.push_back(makeProfile("Low latency", false, "noatime",
+                                       DmCryptNoReadWorkqueue | DmCryptNoWriteWorkqueue));
+        
+        return profiles;
+    }
+    
+    for(std::vector<std::string>::const_iterator it = sections.begin(); it != sections.end(); ++it)
+    {
+        if(it->empty())
+        {
+            continue;
+        }
+        
+        MountProfile profile = makeProfile(*it, config.getInt(*it, "readonly", 0) != 0,
+                                           joinOptions(config.getAll(*it, "options")),
+                                           parseDmCryptFlags(config.get(*it, "dmflags")));
+        
+        profile.warmCache = config.getInt(*it, "warm", 0) != 0;
+        profile.hotFiles = config.getAll(*it, "hotfiles");
+        
+        // a configured Default replaces the built-in one
+        if(*it == profiles[0].name)
+        {
+            profiles[0] = profile;
+        }
+        else
+        {
+            profiles.push_back(profile);
+        }
+    }
+    
+    return profiles;
+}
+
+MountProfile getMountProfile(std::string name)
+{
+    MountProfileVec profiles = getMountProfiles();
+    
+    for(MountProfileVec::const_iterator it = profiles.begin(); it != profiles.end(); ++it)
+    {
+        if(it->name == name)
+        {
+            return *it;
+        }
+    }
+    
+    throw std::runtime_error("unknown mount profile: " + name);
+}
@@ -0,0 +1,98 @@
+/**
+ * Copyright (c) 2007, Emir Uner
+ * All rights reserved.
+ * 
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ * 
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef EASYTC_MOUNTPROFILE_HPP_INCLUDED
+#define EASYTC_MOUNTPROFILE_HPP_INCLUDED
+
+#include <string>
+#include <vector>
+
+/**
+ * A named set of options an image is mounted with.
+ */
+struct MountProfile
+{
+    std::string name;
+    
+    /**
+     * Map the volume read-only as well, not just the filesystem.
+     */
+    bool readOnly;
+    
+    /**
+     * Comma separated filesystem options handed to mount, e.g.
+     * "noatime,nodiratime" or "commit=60,barrier=0" for ext4 scratch
+     * volumes.
+     */
+    std::string options;
+    
+    /**
+     * DmCryptFlag values the mapping is reloaded with after mounting.
+     */
+    int dmCryptFlags;
+    
+    /**
+     * Crawl the filesystem after mounting so that its metadata is cached.
+     */
+    bool warmCache;
+    
+    /**
+     * Patterns of files, relative to the mount point, read ahead by the
+     * warm-up, e.g. "*.db".
+     */
+    std::vector<std::string> hotFiles;
+    
+    inline MountProfile()
+    : name("Default"), readOnly(false), dmCryptFlags(0), warmCache(false)
+    {
+    }
+};
+
+typedef std::vector<MountProfile> MountProfileVec;
+
+/**
+ * Reads the profiles from ~/.easytc/profiles.conf, one section each:
+ *
+ *   [Scratch]
+ *   options = noatime,nodiratime   (repeatable, joined with commas)
+ *   options = commit=60,barrier=0
+ *   readonly = 0
+ *   dmflags = no_read_workqueue,no_write_workqueue
+ *   warm = 1
+ *   hotfiles = *.db                (repeatable)
+ *
+ * "Default" always comes first. Built-in "Read-only", "No atime" and "Low
+ * latency" profiles are returned when the file does not exist. Throws
+ * std::runtime_error for unknown dm-crypt flags.
+ */
+MountProfileVec getMountProfiles();
+
+/**
+ * Returns the named profile. Throws std::runtime_error if there is none.
+ */
+MountProfile getMountProfile(std::string name);
+
+#endif
@@ -0,0 +1,460 @@
+/**
+ * Copyright (c) 2007, Emir Uner
+ * All rights reserved.
+ * 
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ * 
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "OperationLog.hpp"
+#include "Posix.hpp"
+#include "Statistics.hpp"
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+
+namespace
+{
+
+const char logMagic[8] = { 'E', 'T', 'C', 'O', 'P', 'L', 'O', 'G' };
+const uint32_t logVersion = 1;
+
+/**
+ * Records are grown in chunks of this many entries (512 KiB).
+ */
+const uint64_t growRecords = 4096;
+
+/**
+ * When the log holds this many records (128 MiB), months of heavy use, it
+ * is renamed to history.log.1 and a new one is started. Records are never
+ * rewritten in place.
+ */
+const uint64_t rotateRecords = 1048576;
+
+struct LogHeader
+{
+    char magic[8];
+    uint32_t version;
+    uint32_t recordSize;
+    
+    /**
+     * Number of complete records, published after the record is written.
+     */
+    uint64_t count;
+    
+    char reserved[40];
+};
+
+LogHeader* header(void* mapping)
+{
+    return static_cast<LogHeader*>(mapping);
+}
+
+OperationRecord* records(void* mapping)
+{
+    return reinterpret_cast<OperationRecord*>(static_cast<char*>(mapping) + sizeof(LogHeader));
+}
+
+/**
+ * Read-only mapping of a rotated log, empty if there is none or it is not
+ * a log.
+ */
+class RotatedLog
+{
+    void* mapping;
+    size_t mappingSize;
+    uint64_t count;
+    
+    RotatedLog(RotatedLog const&);
+    RotatedLog& operator=(RotatedLog const&);
+    
+public:
+    explicit RotatedLog(std::string path)
+    : mapping(MAP_FAILED), mappingSize(0), count(0)
+    {
+        const int fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+        struct stat st;
+        
+        if(fd == -1)
+        {
+            return;
+        }
+        
+        if(fstat(fd, &st) == 0 && st.st_size >= static_cast<off_t>(sizeof(LogHeader)))
+        {
+            mappingSize = st.st_size;
+            mapping = mmap(0, mappingSize, PROT_READ, MAP_SHARED, fd, 0);
+        }
+        
+        close(fd);
+        
+        if(mapping != MAP_FAILED && memcmp(header(mapping)->magic, logMagic, sizeof(logMagic)) == 0
+           && header(mapping)->recordSize == sizeof(OperationRecord))
+        {
+            const uint64_t room = (mappingSize - sizeof(LogHeader)) / sizeof(OperationRecord);
+            
+            count = header(mapping)->count < room ? header(mapping)->count : room;
+        }
+    }
+    
+    ~RotatedLog()
+    {
+        if(mapping != MAP_FAILED)
+        {
+            munmap(mapping, mappingSize);
+        }
+    }
+    
+    uint64_t getCount() const
+    {
+        return count;
+    }
+    
+    OperationRecord const* getRecords() const
+    {
+        return records(mapping);
+    }
+};
+
+void collectDurations(OperationRecord const* first, uint64_t count, int64_t since,
+                      std::vector<std::vector<double> >& durations, std::vector<double>& sums)
+{
+    for(uint64_t i = 0; i < count; ++i)
+    {
+        OperationRecord const& record = first[i];
+        
+        if(record.timestamp >= since && record.kind >= 0 && record.kind < OperationKindCount)
+        {
+            const double millis = record.durationMicros / 1000.0;
+            
+            durations[record.kind].push_back(millis);
+            sums[record.kind] += millis;
+        }
+    }
+}
+
+class MutexLock
+{
+    pthread_mutex_t* mutex;
+    
+public:
+    explicit MutexLock(pthread_mutex_t* mutexp)
+    : mutex(mutexp)
+    {
+        pthread_mutex_lock(mutex);
+    }
+    
+    ~MutexLock()
+    {
+        pthread_mutex_unlock(mutex);
+    }
+};
+
+pthread_once_t defaultLogOnce = PTHREAD_ONCE_INIT;
+OperationLog* defaultLog = 0;
+
+void openDefaultLog()
+{
+    try
+    {
+        defaultLog = new OperationLog(getDataDirectory() + "/history.log");
+    }
+    catch(std::exception const&)
+    {
+        defaultLog = 0;
+    }
+}
+
+} // namespace <unnamed>
+
+char const* getOperationName(int kind)
+{
+    switch(kind)
+    {
+    case OperationList:
+        return "List";
+    case OperationMount:
+        return "Mount";
+    case OperationUnmount:
+        return "Unmount";
+    case OperationUnmountAll:
+        return "Unmount All";
+    case OperationCreate:
+        return "Create";
+    case OperationAutoMount:
+        return "Auto Mount";
+    case OperationClone:
+        return "Clone";
+    case OperationBackup:
+        return "Backup";
+    case OperationRestore:
+        return "Restore";
+    case OperationVerify:
+        return "Verify";
+    case OperationTrim:
+        return "Trim";
+    case OperationExtract:
+        return "Extract";
+    default:
+        return "Unknown";
+    }
+}
+
+OperationLog::OperationLog(std::string pathp)
+: path(pathp), mapping(MAP_FAILED), mappingSize(0), capacity(0)
+{
+    openFile();
+    pthread_mutex_init(&mutex, 0);
+}
+
+OperationLog::~OperationLog()
+{
+    msync(mapping, mappingSize, MS_ASYNC);
+    munmap(mapping, mappingSize);
+    close(fd);
+    pthread_mutex_destroy(&mutex);
+}
+
+void OperationLog::openFile()
+{
+    fd = open(path.c_str(), O_RDWR | O_CREAT | O_CLOEXEC, 0600);
+    unix_error::check(fd);
+    
+    struct stat st;
+    
+    if(fstat(fd, &st) == -1)
+    {
+        const int errorCode = errno;
+        
+        close(fd);
+        throw unix_error(errorCode);
+    }
+    
+    const bool fresh = st.st_size < static_cast<off_t>(sizeof(LogHeader));
+    const uint64_t existing = fresh ? 0 : (st.st_size - sizeof(LogHeader)) / sizeof(OperationRecord);
+    
+    try
+    {
+        mapFile(existing > growRecords ? existing : growRecords);
+    }
+    catch(...)
+    {
+        close(fd);
+        throw;
+    }
+    
+    if(fresh)
+    {
+        memcpy(header(mapping)->magic, logMagic, sizeof(logMagic));
+        header(mapping)->version = logVersion;
+        header(mapping)->recordSize = sizeof(OperationRecord);
+        header(mapping)->count = 0;
+    }
+    else if(memcmp(header(mapping)->magic, logMagic, sizeof(logMagic)) != 0
+            || header(mapping)->recordSize != sizeof(OperationRecord)
+            || header(mapping)->count > capacity)
+    {
+        munmap(mapping, mappingSize);
+        mapping = MAP_FAILED;
+        close(fd);
+        throw std::runtime_error("not an easytc operation log: " + path);
+    }
+}
+
+void OperationLog::rotate()
+{
+    const std::string rotatedPath = path + ".1";
+    const int oldFd = fd;
+    void* const oldMapping = mapping;
+    const size_t oldMappingSize = mappingSize;
+    const uint64_t oldCapacity = capacity;
+    
+    msync(mapping, mappingSize, MS_ASYNC);
+    unix_error::check(rename(path.c_str(), rotatedPath.c_str()));
+    mapping = MAP_FAILED;
+    
+    try
+    {
+        openFile();
+    }
+    catch(...)
+    {
+        // keep appending to the full log rather than losing records
+        rename(rotatedPath.c_str(), path.c_str());
+        fd = oldFd;
+        mapping = oldMapping;
+        mappingSize = oldMappingSize;
+        capacity = oldCapacity;
+        throw;
+    }
+    
+    munmap(oldMapping, oldMappingSize);
+    close(oldFd);
+}
+
+void OperationLog::mapFile(uint64_t newCapacity)
+{
+    const size_t newSize = sizeof(LogHeader) + newCapacity * sizeof(OperationRecord);
+    
+    // allocate for real, a write to a hole in a mapping on a full disk is SIGBUS
+    const int errorCode = posix_fallocate(fd, 0, newSize);
+    
+    if(errorCode != 0)
+    {
+        throw unix_error(errorCode);
+    }
+    
+    void* newMapping = mmap(0, newSize, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    
+    if(newMapping == MAP_FAILED)
+    {
+        throw unix_error(errno);
+    }
+    
+    if(mapping != MAP_FAILED)
+    {
+        munmap(mapping, mappingSize);
+    }
+    
+    mapping = newMapping;
+    mappingSize = newSize;
+    capacity = newCapacity;
+}
+
+void OperationLog::append(OperationRecord const& record)
+{
+    MutexLock lock(&mutex);
+    
+    if(header(mapping)->count >= rotateRecords)
+    {
+        rotate();
+    }
+    
+    const uint64_t count = header(mapping)->count;
+    
+    if(count == capacity)
+    {
+        mapFile(capacity + growRecords);
+    }
+    
+    records(mapping)[count] = record;
+    __atomic_store_n(&header(mapping)->count, count + 1, __ATOMIC_RELEASE);
+}
+
+long long OperationLog::getRecordCount()
+{
+    MutexLock lock(&mutex);
+    RotatedLog rotated(path + ".1");
+    
+    return static_cast<long long>(header(mapping)->count + rotated.getCount());
+}
+
+OperationStatsVec OperationLog::computeStats(int64_t since)
+{
+    std::vector<std::vector<double> > durations(OperationKindCount);
+    std::vector<double> sums(OperationKindCount);
+    
+    {
+        MutexLock lock(&mutex);
+        RotatedLog rotated(path + ".1");
+        
+        collectDurations(rotated.getRecords(), rotated.getCount(), since, durations, sums);
+        collectDurations(records(mapping), header(mapping)->count, since, durations, sums);
+    }
+    
+    OperationStatsVec stats;
+    
+    for(int kind = 0; kind < OperationKindCount; ++kind)
+    {
+        std::vector<double>& samples = durations[kind];
+        
+        if(samples.empty())
+        {
+            continue;
+        }
+        
+        OperationStats entry;
+        
+        entry.kind = kind;
+        entry.count = static_cast<long long>(samples.size());
+        entry.meanMillis = sums[kind] / samples.size();
+        entry.p50Millis = percentile(samples, 0.50);
+        entry.p90Millis = percentile(samples, 0.90);
+        entry.p99Millis = percentile(samples, 0.99);
+        entry.maxMillis = percentile(samples, 1.0);
+        
+        stats.push_back(entry);
+    }
+    
+    return stats;
+}
+
+OperationLog* getOperationLog()
+{
+    pthread_once(&defaultLogOnce, &openDefaultLog);
+    
+    return defaultLog;
+}
+
+void recordOperation(OperationKind kind, std::string const& image, int64_t startTime,
+                     int64_t durationMicros, int exitCode, int64_t bytes)
+{
+    OperationLog* log = getOperationLog();
+    
+    if(log == 0)
+    {
+        return;
+    }
+    
+    OperationRecord record;
+    
+    memset(&record, 0, sizeof(record));
+    record.timestamp = startTime;
+    record.durationMicros = durationMicros;
+    record.bytes = bytes;
+    record.kind = kind;
+    record.exitCode = exitCode;
+    
+    // keep the tail of long paths, it tells images apart better than the head
+    const size_t maxLength = sizeof(record.image) - 1;
+    const size_t offset = image.size() > maxLength ? image.size() - maxLength : 0;
+    
+    image.copy(record.image, maxLength, offset);
+    
+    try
+    {
+        log->append(record);
+    }
+    catch(std::exception const&)
+    {
+    }
+}
+
+int64_t wallClockMicroseconds()
+{
+    struct timeval tv;
+    
+    gettimeofday(&tv, 0);
+    
+    return static_cast<int64_t>(tv.tv_sec) * 1000000 + tv.tv_usec;
+}
@@ -0,0 +1,155 @@
+/**
+ * Copyright (c) 2007, Emir Uner
+ * All rights reserved.
+ * 
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ * 
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef EASYTC_OPERATIONLOG_HPP_INCLUDED
+#define EASYTC_OPERATIONLOG_HPP_INCLUDED
+
+#include <pthread.h>
+#include <stdint.h>
+
+#include <string>
+#include <vector>
+
+enum OperationKind
+{
+    OperationList,
+    OperationMount,
+    OperationUnmount,
+    OperationUnmountAll,
+    OperationCreate,
+    
+    /**
+     * Time from an image being closed in a watched directory until it
+     * has been mounted.
+     */
+    OperationAutoMount,
+    OperationClone,
+    OperationBackup,
+    OperationRestore,
+    OperationVerify,
+    OperationTrim,
+    OperationExtract,
+    OperationKindCount
+};
+
+/**
+ * Returns a printable name for the operation kind.
+ */
+char const* getOperationName(int kind);
+
+/**
+ * One fixed size entry of the operation log.
+ */
+struct OperationRecord
+{
+    /**
+     * Wall clock time the operation started, microseconds since the epoch.
+     */
+    int64_t timestamp;
+    int64_t durationMicros;
+    int64_t bytes;
+    int32_t kind;
+    int32_t exitCode;
+    
+    /**
+     * Image path, truncated to fit and always null terminated.
+     */
+    char image[96];
+};
+
+struct OperationStats
+{
+    int kind;
+    long long count;
+    double meanMillis;
+    double p50Millis;
+    double p90Millis;
+    double p99Millis;
+    double maxMillis;
+};
+
+typedef std::vector<OperationStats> OperationStatsVec;
+
+/**
+ * Append-only binary log of operations, written through a shared memory
+ * mapping of the log file so that appending a record is a memcpy. The file
+ * is grown in large steps so that remapping is rare. A full log is renamed
+ * to <path>.1 and a new one started; the counts and statistics cover both.
+ */
+class OperationLog
+{
+public:
+    /**
+     * Opens or creates the log file. Throws unix_error on failure.
+     */
+    explicit OperationLog(std::string path);
+    ~OperationLog();
+    
+    void append(OperationRecord const& record);
+    
+    long long getRecordCount();
+    
+    /**
+     * Duration statistics per operation kind over the records that started
+     * at or after the given timestamp. Kinds without records are left out.
+     */
+    OperationStatsVec computeStats(int64_t since);
+    
+private:
+    OperationLog(OperationLog const&);
+    OperationLog& operator=(OperationLog const&);
+    
+    void openFile();
+    void rotate();
+    void mapFile(uint64_t capacity);
+    
+    std::string path;
+    int fd;
+    pthread_mutex_t mutex;
+    void* mapping;
+    size_t mappingSize;
+    uint64_t capacity;
+};
+
+/**
+ * Returns the log in ~/.easytc/history.log, or null if it can not be
+ * opened. Opened on first use.
+ */
+OperationLog* getOperationLog();
+
+/**
+ * Appends an entry to the default log if there is one. Never throws, a
+ * broken log must not break the operation being logged.
+ */
+void recordOperation(OperationKind kind, std::string const& image, int64_t startTime,
+                     int64_t durationMicros, int exitCode, int64_t bytes);
+
+/**
+ * Wall clock time in microseconds since the epoch.
+ */
+int64_t wallClockMicroseconds();
+
+#endif
@@ -25,27 +25,24 @@
  */
 
 #include "Posix.hpp"
+#include "Secret.hpp"
 
+#include <fcntl.h>
+#include <limits.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
 #include <unistd.h>
+#include <sys/stat.h>
 #include <sys/wait.h>
 #include <sstream>
 
 namespace
 {
-    void execProcess(char const* executable, std::vector<std::string> args)
+    void closePipe(PipeResult const& pipeResult)
     {
-        char** arguments = new char*[args.size() + 2];
-    
-        arguments[0] = const_cast<char*>(executable);
-        
-        for(unsigned int i = 0; i < args.size(); ++i)
-        {
-            arguments[i + 1] = const_cast<char*>(args[i].c_str());
-        }
-        
-        arguments[args.size() + 1] = 0;
-    
-        unix_error::check(execvp(executable, arguments));
+        close(pipeResult.readFd);
+        close(pipeResult.writeFd);
     }
 
     struct ChildProcess
@@ -53,20 +50,57 @@ namespace
         PipeResult pipeResult;
         char const* executable;
         std::vector<std::string> args;
+        PipeResult const* inputPipe;
         
-        inline ChildProcess(PipeResult pipeResultp, char const* execp, std::vector<std::string> argsp)
-        :pipeResult(pipeResultp), executable(execp), args(argsp)
+        /**
+         * The argument vector for execvp, pointing into args. It is built
+         * before forking, as the child of a threaded process must not
+         * allocate.
+         */
+        std::vector<char*> arguments;
+        
+        inline ChildProcess(PipeResult pipeResultp, char const* execp, std::vector<std::string> argsp,
+                            PipeResult const* inputPipep = 0)
+        :pipeResult(pipeResultp), executable(execp), args(argsp), inputPipe(inputPipep)
         {
+            arguments.push_back(const_cast<char*>(executable));
+            
+            for(std::vector<std::string>::iterator it = args.begin(); it != args.end(); ++it)
+            {
+                arguments.push_back(const_cast<char*>(it->c_str()));
+            }
+            
+            arguments.push_back(0);
         }
         
         inline void operator()()
         {
             close(pipeResult.readFd);
             
+            if(inputPipe != 0)
+            {
+                close(inputPipe->writeFd);
+                replaceFileDescriptor(inputPipe->readFd, STDIN_FILENO);
+            }
+            
             replaceStdout(pipeResult.writeFd);
             replaceStderr(pipeResult.writeFd);
-            execProcess(executable, args);
+            execvp(executable, &arguments[0]);
+            
+            // like a shell, the caller sees the reason as output and exit code
+            char const* reason = strerror(errno);
+            
+            write(STDERR_FILENO, executable, strlen(executable));
+            write(STDERR_FILENO, ": ", 2);
+            write(STDERR_FILENO, reason, strlen(reason));
+            write(STDERR_FILENO, "\n", 1);
+            _exit(127);
         }
+        
+    private:
+        // arguments points into the own args
+        ChildProcess(ChildProcess const&);
+        ChildProcess& operator=(ChildProcess const&);
     };
     
     struct ParentProcess
@@ -74,32 +108,74 @@ namespace
         PipeResult pipeResult;
         std::string output;
         int exitCode;
+        PipeResult const* inputPipe;
         
-        inline ParentProcess(PipeResult pipeResultp)
-        :pipeResult(pipeResultp)
+        /**
+         * Receives the output instead of output if set.
+         */
+        Secret* secretOutput;
+        
+        /**
+         * Whether the pipes were handed over, from then on they are closed
+         * here whatever happens.
+         */
+        bool started;
+        
+        inline ParentProcess(PipeResult pipeResultp, PipeResult const* inputPipep = 0, Secret* secretOutputp = 0)
+        :pipeResult(pipeResultp), inputPipe(inputPipep), secretOutput(secretOutputp), started(false)
         {
         }
         
         inline void operator()(int childPid)
         {
+            started = true;
             close(pipeResult.writeFd);
+            
+            if(inputPipe != 0)
+            {
+                close(inputPipe->readFd);
+                close(inputPipe->writeFd);
+            }
+            
             std::ostringstream oss;
             
             char ch;
             int count;
             int readFd = pipeResult.readFd;
             
-            count = read(readFd, &ch, 1);
-            while(count != 0)
-            {        
-                oss << ch;
-                
-                count = read(readFd, &ch, 1);            
-                unix_error::check(count);
+            TRACE_SCOPE("pipe drain");
+            
+            try
+            {
+                while((count = read(readFd, &ch, 1)) != 0)
+                {
+                    unix_error::check(count);
+                    
+                    if(secretOutput == 0)
+                    {
+                        oss << ch;
+                    }
+                    else if(secretOutput->size() < Secret::capacity)
+                    {
+                        secretOutput->append(ch);
+                    }
+                    else
+                    {
+                        throw std::runtime_error("command output is too long to be kept secret");
+                    }
+                }
+            }
+            catch(...)
+            {
+                close(readFd);
+                waitpid(childPid, &exitCode, 0);
+                throw;
             }
             
+            close(readFd);
             output = oss.str();
 
+            TRACE_SCOPE("waitpid");
             unix_error::check(waitpid(childPid, &exitCode, 0));
         }
         
@@ -113,6 +189,56 @@ namespace
             return exitCode;
         }
     };
+    
+    /**
+     * Runs the executable capturing its output, into the secret output if
+     * given. The input pipe, if there is one, is closed in any case.
+     */
+    std::string spawn(char const* executable, std::vector<std::string> const& args, PipeResult const* inputPipe,
+                      int& exitCode, Secret* secretOutput = 0)
+    {
+        int pipeEnds[2];
+        
+        if(pipe2(pipeEnds, O_CLOEXEC) == -1)
+        {
+            const int errorCode = errno;
+            
+            if(inputPipe != 0)
+            {
+                closePipe(*inputPipe);
+            }
+            
+            throw unix_error(errorCode);
+        }
+        
+        PipeResult pipeResult(pipeEnds);
+        ChildProcess child(pipeResult, executable, args, inputPipe);
+        ParentProcess parent(pipeResult, inputPipe, secretOutput);
+        
+        try
+        {
+            forkProcess(parent, child);
+        }
+        catch(...)
+        {
+            // once started, the parent side has closed the pipes itself
+            if(!parent.started)
+            {
+                closePipe(pipeResult);
+                
+                if(inputPipe != 0)
+                {
+                    closePipe(*inputPipe);
+                }
+            }
+            
+            throw;
+        }
+        
+        exitCode = parent.getExitCode();
+        
+        return parent.getOutput();
+    }
 }
 
 bool amIRoot()
@@ -120,14 +246,110 @@ bool amIRoot()
     return getuid() == 0;
 }
 
-PipeResult createPipe()
+std::string getDataDirectory()
 {
-    int pipeEnds[2];
+    char const* home = getenv("HOME");
+    std::string directory = std::string(home != 0 ? home : "/tmp") + "/.easytc";
     
-    if(pipe(pipeEnds) == -1)
+    if(mkdir(directory.c_str(), 0700) == -1 && errno != EEXIST)
     {
-        unix_error::check(pipe(pipeEnds));
+        throw unix_error(errno);
     }
+    
+    return directory;
+}
+
+std::string getCanonicalPath(std::string const& path)
+{
+    char resolved[PATH_MAX];
+    
+    return realpath(path.c_str(), resolved) != 0 ? std::string(resolved) : path;
+}
+
+long long monotonicMicroseconds()
+{
+    struct timespec ts;
+    
+    unix_error::check(clock_gettime(CLOCK_MONOTONIC, &ts));
+    
+    return static_cast<long long>(ts.tv_sec) * 1000000 + ts.tv_nsec / 1000;
+}
+
+int getProcessorCount()
+{
+    const long count = sysconf(_SC_NPROCESSORS_ONLN);
+    
+    return count > 0 ? static_cast<int>(count) : 1;
+}
+
+void* detail::threadEntry(void* slotp)
+{
+    ThreadSlot* slot = static_cast<ThreadSlot*>(slotp);
+    
+    try
+    {
+        slot->call(slot->functor);
+    }
+    catch(std::exception const& ex)
+    {
+        slot->errorMessage = ex.what();
+    }
+    catch(...)
+    {
+        slot->errorMessage = "unknown error in worker thread";
+    }
+    
+    return 0;
+}
+
+void detail::runThreadSlots(std::vector<ThreadSlot>& slots)
+{
+    std::vector<pthread_t> threads(slots.size());
+    unsigned int started = 0;
+    int errorCode = 0;
+    
+    // the first slot runs on the calling thread
+    for(unsigned int i = 1; i < slots.size(); ++i, ++started)
+    {
+        errorCode = pthread_create(&threads[i], 0, &threadEntry, &slots[i]);
+        
+        if(errorCode != 0)
+        {
+            break;
+        }
+    }
+    
+    if(errorCode == 0 && !slots.empty())
+    {
+        threadEntry(&slots[0]);
+    }
+    
+    for(unsigned int i = 1; i <= started; ++i)
+    {
+        pthread_join(threads[i], 0);
+    }
+    
+    if(errorCode != 0)
+    {
+        throw unix_error(errorCode);
+    }
+    
+    for(unsigned int i = 0; i < slots.size(); ++i)
+    {
+        if(!slots[i].errorMessage.empty())
+        {
+            throw std::runtime_error(slots[i].errorMessage);
+        }
+    }
+}
+
+PipeResult createPipe()
+{
+    int pipeEnds[2];
+    
+    // not inherited by the children other threads start meanwhile; dup2
+    // clears the flag on the child's standard descriptors
+    unix_error::check(pipe2(pipeEnds, O_CLOEXEC));
 
     return PipeResult(pipeEnds);
 }
@@ -149,13 +371,40 @@ void replaceStderr(int source)
 
 std::string executeCommand(char const* executable, std::vector<std::string> args, int& exitCode)
 {
-    PipeResult pipeResult = createPipe();
-    ChildProcess child(pipeResult, executable, args);
-    ParentProcess parent(pipeResult);
+    TRACE_SCOPE("spawn");
     
-    forkProcess(parent, child);
+    return spawn(executable, args, 0, exitCode);
+}
+
+std::string executeCommand(char const* executable, std::vector<std::string> args,
+                           char const* input, size_t inputLength, int& exitCode)
+{
+    TRACE_SCOPE("spawn");
+    
+    // written before forking so that it sits in the pipe buffer, neither
+    // side can block on it and the child may exit without reading it
+    if(inputLength > PIPE_BUF)
+    {
+        throw std::runtime_error("command input does not fit into a pipe");
+    }
+    
+    PipeResult inputPipe = createPipe();
     
-    exitCode = parent.getExitCode();
+    if(write(inputPipe.writeFd, input, inputLength) != static_cast<ssize_t>(inputLength))
+    {
+        const int errorCode = errno;
+        
+        closePipe(inputPipe);
+        throw unix_error(errorCode);
+    }
+    
+    return spawn(executable, args, &inputPipe, exitCode);
+}
+
+void executeCommand(char const* executable, std::vector<std::string> args, Secret& output, int& exitCode)
+{
+    TRACE_SCOPE("spawn");
     
-    return parent.getOutput();
+    output.clear();
+    spawn(executable, args, 0, exitCode, &output);
 }
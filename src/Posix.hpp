@@ -28,13 +28,18 @@
 #define EASYTC_POSIX_HPP_INCLUDED
 
 #include <errno.h>
+#include <pthread.h>
 #include <string.h>
 #include <unistd.h>
 
+#include "Trace.hpp"
+
 #include <stdexcept>
 #include <vector>
 #include <string>
 
+class Secret;
+
 struct unix_error : public std::runtime_error
 {
     inline unix_error(int errorCode)
@@ -65,6 +70,23 @@ struct unix_error : public std::runtime_error
  */
 bool amIRoot();
 
+/**
+ * Returns the directory easytc keeps its settings and records in
+ * (~/.easytc), creating it if it does not exist.
+ */
+std::string getDataDirectory();
+
+/**
+ * Resolves symbolic links and relative parts of the path. A path that does
+ * not exist is returned as given.
+ */
+std::string getCanonicalPath(std::string const& path);
+
+/**
+ * Returns a monotonic timestamp in microseconds.
+ */
+long long monotonicMicroseconds();
+
 struct PipeResult
 {
     int readFd;
@@ -101,6 +123,23 @@ void replaceStderr(int source);
  */
 std::string executeCommand(char const* executable, std::vector<std::string> args, int& exitCode);
 
+/**
+ * Execute the executable with args, feeding it input on its standard input
+ * through a pipe, and capture the output. Used to pass secrets, which
+ * would be visible to everyone in the command line.
+ *
+ * @return the output of the execution
+ */
+std::string executeCommand(char const* executable, std::vector<std::string> args,
+                           char const* input, size_t inputLength, int& exitCode);
+
+/**
+ * Execute the executable with args, capturing the output into the secret
+ * instead of the heap. Used for commands that print keys. Throws
+ * std::runtime_error if the output does not fit.
+ */
+void executeCommand(char const* executable, std::vector<std::string> args, Secret& output, int& exitCode);
+
 inline std::string executeCommand(char const* executable, int& exitCode)
 {
     return executeCommand(executable,  std::vector<std::string>(), exitCode);
@@ -125,19 +164,53 @@ inline std::string executeCommand(char const* executable, std::string arg0, std:
     return executeCommand(executable, args, exitCode);
 }
 
+inline std::string executeCommand(char const* executable, std::string arg0, std::string arg1, std::string arg2,
+                                  int& exitCode)
+{
+    std::vector<std::string> args;
+    
+    args.push_back(arg0);
+    args.push_back(arg1);
+    args.push_back(arg2);
+
+    return executeCommand(executable, args, exitCode);
+}
+
 /**
  * Calls fork(2) and executes given functors in the appropriate process.
  */
 template <typename ParentFunctionT, typename ChildFunctionT>
 void forkProcess(ParentFunctionT& parentFun, ChildFunctionT& childFun)
 {
+#ifdef EASYTC_TRACING
+    const long long forkStart = isTracingEnabled() ? detail::traceClock() : -1;
+#endif
+    
     const pid_t forkResult = fork();
     
+#ifdef EASYTC_TRACING
+    // only the parent records the span, the child of a threaded process
+    // must not take the tracer's locks or allocate
+    if(forkResult > 0 && forkStart >= 0)
+    {
+        recordTraceSpan("fork", forkStart, detail::traceClock() - forkStart);
+    }
+#endif
+    
     unix_error::check(forkResult);
     
     if(forkResult == 0)
     {
-        childFun();
+        // an error must not unwind the child back into the parent's code
+        try
+        {
+            childFun();
+        }
+        catch(...)
+        {
+        }
+        
+        _exit(127);
     }
     else
     {
@@ -145,4 +218,51 @@ void forkProcess(ParentFunctionT& parentFun, ChildFunctionT& childFun)
     }
 }
 
+namespace detail
+{
+
+struct ThreadSlot
+{
+    void* functor;
+    void (*call)(void*);
+    std::string errorMessage;
+};
+
+template <typename FunctorT>
+void callFunctor(void* functor)
+{
+    (*static_cast<FunctorT*>(functor))();
+}
+
+void* threadEntry(void* slot);
+
+void runThreadSlots(std::vector<ThreadSlot>& threadSlots);
+
+} // namespace detail
+
+/**
+ * Runs each functor on its own thread and waits until all of them return.
+ * If any of them throws, a std::runtime_error with the first error message
+ * is thrown after all threads have finished.
+ */
+template <typename FunctorT>
+void runThreads(std::vector<FunctorT>& functors)
+{
+    // not "slots", which Qt defines as a macro
+    std::vector<detail::ThreadSlot> threadSlots(functors.size());
+    
+    for(unsigned int i = 0; i < functors.size(); ++i)
+    {
+        threadSlots[i].functor = &functors[i];
+        threadSlots[i].call = &detail::callFunctor<FunctorT>;
+    }
+    
+    detail::runThreadSlots(threadSlots);
+}
+
+/**
+ * Number of processors available to run threads on.
+ */
+int getProcessorCount();
+
 #endif
@@ -0,0 +1,67 @@
+/**
+ * Copyright (c) 2007, Emir Uner
+ * All rights reserved.
+ * 
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ * 
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef EASYTC_PROGRESS_HPP_INCLUDED
+#define EASYTC_PROGRESS_HPP_INCLUDED
+
+#include <stdexcept>
+
+/**
+ * Lets long running operations report how far they got and notice when
+ * the user is no longer interested in the result.
+ */
+class Progress
+{
+public:
+    virtual ~Progress()
+    {
+    }
+    
+    virtual void report(int percent) = 0;
+    virtual bool isCancelled() = 0;
+};
+
+struct operation_cancelled : public std::runtime_error
+{
+    inline operation_cancelled()
+    : std::runtime_error("Operation cancelled.")
+    {
+    }
+    
+    /**
+     * Throws if the operation the progress belongs to has been cancelled.
+     * A null progress is never cancelled.
+     */
+    static inline void check(Progress* progress)
+    {
+        if(progress != 0 && progress->isCancelled())
+        {
+            throw operation_cancelled();
+        }
+    }
+};
+
+#endif
@@ -0,0 +1,530 @@
+/**
+ * Copyright (c) 2007, Emir Uner
+ * All rights reserved.
+ * 
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ * 
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "QueueTuning.hpp"
+#include "Config.hpp"
+#include "Posix.hpp"
+
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <fstream>
+#include <sstream>
+#include <stdexcept>
+
+namespace
+{
+
+/**
+ * A queue setting as found before tuning, kept until it is reverted.
+ */
+struct SavedSetting
+{
+    std::string image;
+    std::string path;
+    std::string value;
+};
+
+typedef std::vector<SavedSetting> SavedSettingVec;
+
+class MutexLock
+{
+    pthread_mutex_t* mutex;
+    
+public:
+    explicit MutexLock(pthread_mutex_t* mutexp)
+    : mutex(mutexp)
+    {
+        pthread_mutex_lock(mutex);
+    }
+    
+    ~MutexLock()
+    {
+        pthread_mutex_unlock(mutex);
+    }
+};
+
+// serialises the read-modify-write of the files below between the
+// operations of different images, which run concurrently
+pthread_mutex_t stateMutex = PTHREAD_MUTEX_INITIALIZER;
+std::string sysfsRoot = "/sys";
+
+QueueTuning makeTuning(std::string name, int readAheadKBytes, int requests, int maxSectorsKBytes,
+                       std::string scheduler)
+{
+    QueueTuning tuning;
+    
+    tuning.name = name;
+    tuning.readAheadKBytes = readAheadKBytes;
+    tuning.requests = requests;
+    tuning.maxSectorsKBytes = maxSectorsKBytes;
+    tuning.scheduler = scheduler;
+    
+    return tuning;
+}
+
+std::string toString(int value)
+{
+    std::ostringstream oss;
+    
+    oss << value;
+    
+    return oss.str();
+}
+
+std::string getAssignmentsPath()
+{
+    return getDataDirectory() + "/tuned-images";
+}
+
+std::string getSavedSettingsPath()
+{
+    return getDataDirectory() + "/tuning-saved";
+}
+
+/**
+ * Reads lines of tab separated fields.
+ */
+std::vector<std::vector<std::string> > readFields(std::string path, size_t count)
+{
+    std::vector<std::vector<std::string> > lines;
+    std::ifstream in(path.c_str());
+    std::string line;
+    
+    while(std::getline(in, line))
+    {
+        std::vector<std::string> fields;
+        std::string::size_type start = 0;
+        
+        // the last field takes the rest of the line, tabs and all
+        while(fields.size() + 1 < count && line.find('\t', start) != std::string::npos)
+        {
+            const std::string::size_type tab = line.find('\t', start);
+            
+            fields.push_back(line.substr(start, tab - start));
+            start = tab + 1;
+        }
+        
+        fields.push_back(line.substr(start));
+        
+        if(fields.size() == count)
+        {
+            lines.push_back(fields);
+        }
+    }
+    
+    return lines;
+}
+
+/**
+ * Replaces the file with the lines, through a temporary file.
+ */
+void writeFields(std::string path, std::vector<std::vector<std::string> > const& lines)
+{
+    const std::string temporary = path + ".new";
+    std::ofstream out(temporary.c_str(), std::ios::trunc);
+    
+    for(std::vector<std::vector<std::string> >::const_iterator it = lines.begin(); it != lines.end(); ++it)
+    {
+        for(std::vector<std::string>::const_iterator field = it->begin(); field != it->end(); ++field)
+        {
+            out << (field == it->begin() ? "" : "\t") << *field;
+        }
+        
+        out << '\n';
+    }
+    
+    out.close();
+    
+    if(!out || rename(temporary.c_str(), path.c_str()) == -1)
+    {
+        throw std::runtime_error("could not write " + path);
+    }
+}
+
+SavedSettingVec loadSavedSettings()
+{
+    const std::vector<std::vector<std::string> > lines = readFields(getSavedSettingsPath(), 3);
+    SavedSettingVec settings;
+    
+    for(std::vector<std::vector<std::string> >::const_iterator it = lines.begin(); it != lines.end(); ++it)
+    {
+        SavedSetting setting;
+        
+        setting.image = (*it)[0];
+        setting.path = (*it)[1];
+        setting.value = (*it)[2];
+        settings.push_back(setting);
+    }
+    
+    return settings;
+}
+
+void storeSavedSettings(SavedSettingVec const& settings)
+{
+    std::vector<std::vector<std::string> > lines;
+    
+    for(SavedSettingVec::const_iterator it = settings.begin(); it != settings.end(); ++it)
+    {
+        std::vector<std::string> fields;
+        
+        fields.push_back(it->image);
+        fields.push_back(it->path);
+        fields.push_back(it->value);
+        lines.push_back(fields);
+    }
+    
+    writeFields(getSavedSettingsPath(), lines);
+}
+
+/**
+ * Reads a sysfs attribute, returning the errno on failure. The scheduler
+ * file lists all schedulers with the active one in brackets, only that one
+ * is returned.
+ */
+int readAttribute(std::string const& path, std::string& value)
+{
+    const int fd = open(path.c_str(), O_RDONLY);
+    
+    if(fd == -1)
+    {
+        return errno;
+    }
+    
+    char buffer[256];
+    const ssize_t length = read(fd, buffer, sizeof(buffer) - 1);
+    const int error = errno;
+    
+    close(fd);
+    
+    if(length == -1)
+    {
+        return error;
+    }
+    
+    value.assign(buffer, length);
+    value.erase(value.find_last_not_of(" \n") + 1);
+    
+    const std::string::size_type active = value.find('[');
+    const std::string::size_type end = value.find(']', active);
+    
+    if(active != std::string::npos && end != std::string::npos)
+    {
+        value = value.substr(active + 1, end - active - 1);
+    }
+    
+    return 0;
+}
+
+/**
+ * Writes a sysfs attribute with a single write, returning the errno on
+ * failure. Like the shell's redirection it truncates, which sysfs ignores
+ * and a copied tree needs.
+ */
+int writeAttribute(std::string const& path, std::string const& value)
+{
+    const int fd = open(path.c_str(), O_WRONLY | O_TRUNC);
+    
+    if(fd == -1)
+    {
+        return errno;
+    }
+    
+    const int error = write(fd, value.data(), value.size()) == -1 ? errno : 0;
+    
+    close(fd);
+    
+    return error;
+}
+
+/**
+ * Lists the attributes the tuning sets as "name value" pairs.
+ */
+std::vector<std::pair<std::string, std::string> > getTuningAttributes(QueueTuning const& tuning)
+{
+    std::vector<std::pair<std::string, std::string> > attributes;
+    
+    if(!tuning.scheduler.empty())
+    {
+        // nr_requests is checked against the limits of the scheduler, so it comes after it
+        attributes.push_back(std::make_pair("scheduler", tuning.scheduler));
+    }
+    
+    if(tuning.requests > 0)
+    {
+        attributes.push_back(std::make_pair("nr_requests", toString(tuning.requests)));
+    }
+    
+    if(tuning.maxSectorsKBytes > 0)
+    {
+        attributes.push_back(std::make_pair("max_sectors_kb", toString(tuning.maxSectorsKBytes)));
+    }
+    
+    if(tuning.readAheadKBytes >= 0)
+    {
+        attributes.push_back(std::make_pair("read_ahead_kb", toString(tuning.readAheadKBytes)));
+    }
+    
+    return attributes;
+}
+
+bool isUnsupported(int error)
+{
+    return error == ENOENT || error == EINVAL || error == EOPNOTSUPP;
+}
+
+/**
+ * Writes back the saved settings of the image, or of all images when it
+ * is empty, and drops them. Devices that are gone are skipped.
+ */
+void revertLocked(std::string const& image)
+{
+    SavedSettingVec settings = loadSavedSettings();
+    SavedSettingVec kept;
+    
+    // in reverse so that nr_requests goes back before the scheduler does
+    for(SavedSettingVec::const_reverse_iterator it = settings.rbegin(); it != settings.rend(); ++it)
+    {
+        if(image.empty() || it->image == image)
+        {
+            writeAttribute(it->path, it->value);
+        }
+        else
+        {
+            kept.insert(kept.begin(), *it);
+        }
+    }
+    
+    if(kept.size() != settings.size())
+    {
+        storeSavedSettings(kept);
+    }
+}
+
+} // namespace <unnamed>
+
+QueueTuningVec getQueueTunings()
+{
+    Config config(getConfigPath("tuning.conf"));
+    std::vector<std::string> sections = config.getSections();
+    QueueTuningVec tunings;
+    
+    if(sections.empty())
+    {
+        tunings.push_back(makeTuning("Sequential streaming", 4096, 128, 1024, "mq-deadline"));
+        tunings.push_back(makeTuning("Random small I/O", 16, 256, 128, "none"));
+        
+        return tunings;
+    }
+    
+    for(std::vector<std::string>::const_iterator it = sections.begin(); it != sections.end(); ++it)
+    {
+        if(!it->empty())
+        {
+            tunings.push_back(makeTuning(*it, config.getInt(*it, "readaheadkb", -1),
+                                         config.getInt(*it, "nrrequests", -1),
+                                         config.getInt(*it, "maxsectorskb", -1), config.get(*it, "scheduler")));
+        }
+    }
+    
+    return tunings;
+}
+
+QueueTuning getQueueTuning(std::string name)
+{
+    QueueTuningVec tunings = getQueueTunings();
+    
+    for(QueueTuningVec::const_iterator it = tunings.begin(); it != tunings.end(); ++it)
+    {
+        if(it->name == name)
+        {
+            return *it;
+        }
+    }
+    
+    throw std::runtime_error("unknown queue tuning: " + name);
+}
+
+std::string formatQueueTuning(QueueTuning const& tuning)
+{
+    const std::vector<std::pair<std::string, std::string> > attributes = getTuningAttributes(tuning);
+    std::string formatted;
+    
+    for(size_t i = 0; i < attributes.size(); ++i)
+    {
+        formatted += (i == 0 ? "" : " ") + attributes[i].first + "=" + attributes[i].second;
+    }
+    
+    return formatted;
+}
+
+std::string getSysfsRoot()
+{
+    return sysfsRoot;
+}
+
+void setSysfsRoot(std::string root)
+{
+    sysfsRoot = root;
+}
+
+std::vector<std::string> getQueueDirectories(std::string device)
+{
+    // /dev/mapper/truecrypt1 links to /dev/dm-3, the name sysfs knows it by
+    const std::string resolved = getCanonicalPath(device);
+    const std::string blockDirectory = sysfsRoot + "/class/block/";
+    const std::string name = resolved.substr(resolved.rfind('/') + 1);
+    std::vector<std::string> directories(1, blockDirectory + name + "/queue");
+    DIR* slaves = opendir((blockDirectory + name + "/slaves").c_str());
+    
+    if(slaves != 0)
+    {
+        while(struct dirent* entry = readdir(slaves))
+        {
+            if(entry->d_name[0] != '.')
+            {
+                directories.push_back(blockDirectory + entry->d_name + "/queue");
+            }
+        }
+        
+        closedir(slaves);
+    }
+    
+    return directories;
+}
+
+void applyQueueTuning(std::string image, std::string device, QueueTuning const& tuning)
+{
+    image = getCanonicalPath(image);
+    
+    const std::vector<std::string> directories = getQueueDirectories(device);
+    const std::vector<std::pair<std::string, std::string> > attributes = getTuningAttributes(tuning);
+    MutexLock lock(&stateMutex);
+    SavedSettingVec settings = loadSavedSettings();
+    std::string failures;
+    
+    for(std::vector<std::string>::const_iterator directory = directories.begin(); directory != directories.end();
+        ++directory)
+    {
+        for(size_t i = 0; i < attributes.size(); ++i)
+        {
+            const std::string path = *directory + "/" + attributes[i].first;
+            SavedSetting saved;
+            bool known = false;
+            
+            for(SavedSettingVec::const_iterator it = settings.begin(); it != settings.end(); ++it)
+            {
+                known = known || (it->image == image && it->path == path);
+            }
+            
+            // a value saved by an earlier tuning of this mount is the original one
+            if(!known && readAttribute(path, saved.value) != 0)
+            {
+                continue;
+            }
+            
+            const int error = writeAttribute(path, attributes[i].second);
+            
+            if(error != 0 && !isUnsupported(error))
+            {
+                failures += "\n" + path + ": " + strerror(error);
+            }
+            else if(error == 0 && !known)
+            {
+                saved.image = image;
+                saved.path = path;
+                settings.push_back(saved);
+            }
+        }
+    }
+    
+    storeSavedSettings(settings);
+    
+    if(!failures.empty())
+    {
+        throw std::runtime_error("could not apply the queue tuning " + tuning.name + ":" + failures);
+    }
+}
+
+void revertQueueTuning(std::string image)
+{
+    MutexLock lock(&stateMutex);
+    
+    revertLocked(getCanonicalPath(image));
+}
+
+void revertAllQueueTunings()
+{
+    MutexLock lock(&stateMutex);
+    
+    revertLocked("");
+}
+
+std::string getImageQueueTuning(std::string image)
+{
+    image = getCanonicalPath(image);
+    
+    MutexLock lock(&stateMutex);
+    const std::vector<std::vector<std::string> > lines = readFields(getAssignmentsPath(), 2);
+    
+    for(std::vector<std::vector<std::string> >::const_iterator it = lines.begin(); it != lines.end(); ++it)
+    {
+        if((*it)[1] == image)
+        {
+            return (*it)[0];
+        }
+    }
+    
+    return "";
+}
+
+void setImageQueueTuning(std::string image, std::string name)
+{
+    image = getCanonicalPath(image);
+    
+    MutexLock lock(&stateMutex);
+    std::vector<std::vector<std::string> > lines = readFields(getAssignmentsPath(), 2);
+    
+    for(std::vector<std::vector<std::string> >::iterator it = lines.begin(); it != lines.end();)
+    {
+        it = (*it)[1] == image ? lines.erase(it) : it + 1;
+    }
+    
+    if(!name.empty())
+    {
+        std::vector<std::string> fields;
+        
+        fields.push_back(name);
+        fields.push_back(image);
+        lines.push_back(fields);
+    }
+    
+    writeFields(getAssignmentsPath(), lines);
+}
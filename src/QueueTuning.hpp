@@ -0,0 +1,140 @@
+/**
+ * Copyright (c) 2007, Emir Uner
+ * All rights reserved.
+ * 
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ * 
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef EASYTC_QUEUETUNING_HPP_INCLUDED
+#define EASYTC_QUEUETUNING_HPP_INCLUDED
+
+#include <string>
+#include <vector>
+
+/**
+ * A named set of block queue settings for the device behind a mounted
+ * volume. Settings left at -1 or empty are not touched.
+ */
+struct QueueTuning
+{
+    std::string name;
+    
+    /**
+     * queue/read_ahead_kb.
+     */
+    int readAheadKBytes;
+    
+    /**
+     * queue/nr_requests.
+     */
+    int requests;
+    
+    /**
+     * queue/max_sectors_kb.
+     */
+    int maxSectorsKBytes;
+    
+    /**
+     * queue/scheduler, e.g. "mq-deadline" or "none".
+     */
+    std::string scheduler;
+    
+    inline QueueTuning()
+    : readAheadKBytes(-1), requests(-1), maxSectorsKBytes(-1)
+    {
+    }
+};
+
+typedef std::vector<QueueTuning> QueueTuningVec;
+
+/**
+ * Returns the tunings in ~/.easytc/tuning.conf, one section per tuning:
+ *
+ *   [Streaming]
+ *   readaheadkb = 8192
+ *   nrrequests = 128
+ *   maxsectorskb = 1024
+ *   scheduler = mq-deadline
+ *
+ * Built-in "Sequential streaming" and "Random small I/O" tunings are
+ * returned when the file does not exist.
+ */
+QueueTuningVec getQueueTunings();
+
+/**
+ * Throws std::runtime_error if there is no tuning with the name.
+ */
+QueueTuning getQueueTuning(std::string name);
+
+/**
+ * Returns the settings the tuning changes, e.g. "scheduler=none
+ * read_ahead_kb=16".
+ */
+std::string formatQueueTuning(QueueTuning const& tuning);
+
+/**
+ * The directory sysfs is read from, "/sys" unless changed. Pointing it at
+ * a copied tree lets the tuning run without root.
+ */
+std::string getSysfsRoot();
+void setSysfsRoot(std::string root);
+
+/**
+ * Returns the queue directories that tune the mapped device: its own and
+ * those of the devices under it, such as the loop device of an image
+ * file. A bio-based dm-crypt mapping has no scheduler or request queue of
+ * its own, those are only found on the devices below.
+ */
+std::vector<std::string> getQueueDirectories(std::string device);
+
+/**
+ * Writes the tuning to the queue directories of the device, remembering
+ * the values found there so that revertQueueTuning can put them back.
+ * Settings a device does not have or rejects as invalid are skipped. Throws
+ * std::runtime_error with the settings that could not be written for any
+ * other reason, after writing the rest.
+ */
+void applyQueueTuning(std::string image, std::string device, QueueTuning const& tuning);
+
+/**
+ * Writes back the values applyQueueTuning found for the image, as far as
+ * the devices still exist, and forgets them.
+ */
+void revertQueueTuning(std::string image);
+
+/**
+ * Reverts the tunings of all images.
+ */
+void revertAllQueueTunings();
+
+/**
+ * Returns the name of the tuning kept for the image, empty if none. It is
+ * applied whenever the image is mounted.
+ */
+std::string getImageQueueTuning(std::string image);
+
+/**
+ * Keeps the tuning for the image, an empty name removes it.
+ */
+void setImageQueueTuning(std::string image, std::string name);
+
+#endif
@@ -0,0 +1,227 @@
+/**
+ * Copyright (c) 2007, Emir Uner
+ * All rights reserved.
+ * 
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ * 
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "Secret.hpp"
+#include "Posix.hpp"
+
+#include <sys/mman.h>
+
+#include <sstream>
+
+#include <openssl/crypto.h>
+
+namespace
+{
+
+/**
+ * The arena grows in chunks of this many slots, each locked on its own, up
+ * to maxChunks. Chunks are kept once made.
+ */
+const size_t slotsPerChunk = 64;
+const size_t maxChunks = maxSecrets / slotsPerChunk;
+const size_t chunkSize = slotsPerChunk * Secret::capacity;
+
+struct ArenaChunk
+{
+    char* memory;
+    bool locked;
+    bool used[slotsPerChunk];
+};
+
+pthread_mutex_t arenaMutex = PTHREAD_MUTEX_INITIALIZER;
+
+// a fixed table, so that growing the arena does not touch the heap either
+ArenaChunk chunks[maxChunks];
+size_t chunkCount = 0;
+
+class ArenaLock
+{
+public:
+    ArenaLock()
+    {
+        pthread_mutex_lock(&arenaMutex);
+    }
+    
+    ~ArenaLock()
+    {
+        pthread_mutex_unlock(&arenaMutex);
+    }
+};
+
+/**
+ * Maps, locks and adds a chunk. Called with the arena mutex held.
+ */
+void addChunk()
+{
+    void* memory = mmap(0, chunkSize, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    
+    if(memory == MAP_FAILED)
+    {
+        throw std::runtime_error("cannot allocate memory for passwords");
+    }
+    
+    ArenaChunk& chunk = chunks[chunkCount];
+    
+    chunk.locked = mlock(memory, chunkSize) == 0;
+    madvise(memory, chunkSize, MADV_DONTDUMP);
+    madvise(memory, chunkSize, MADV_DONTFORK);
+    chunk.memory = static_cast<char*>(memory);
+    memset(chunk.used, 0, sizeof(chunk.used));
+    ++chunkCount;
+}
+
+char* allocateSlot()
+{
+    ArenaLock lock;
+    
+    for(size_t i = 0; i < chunkCount; ++i)
+    {
+        for(size_t j = 0; j < slotsPerChunk; ++j)
+        {
+            if(!chunks[i].used[j])
+            {
+                chunks[i].used[j] = true;
+                
+                return chunks[i].memory + j * Secret::capacity;
+            }
+        }
+    }
+    
+    if(chunkCount == maxChunks)
+    {
+        std::ostringstream oss;
+        
+        oss << "too many passwords in use, at most " << maxSecrets << " can be held at once";
+        throw std::runtime_error(oss.str());
+    }
+    
+    addChunk();
+    chunks[chunkCount - 1].used[0] = true;
+    
+    return chunks[chunkCount - 1].memory;
+}
+
+void releaseSlot(char* slot)
+{
+    OPENSSL_cleanse(slot, Secret::capacity);
+    
+    ArenaLock lock;
+    
+    for(size_t i = 0; i < chunkCount; ++i)
+    {
+        if(slot >= chunks[i].memory && slot < chunks[i].memory + chunkSize)
+        {
+            chunks[i].used[(slot - chunks[i].memory) / Secret::capacity] = false;
+            return;
+        }
+    }
+}
+
+} // namespace <unnamed>
+
+Secret::Secret()
+: buffer(allocateSlot()), length(0)
+{
+}
+
+Secret::~Secret()
+{
+    releaseSlot(buffer);
+}
+
+void Secret::append(char ch)
+{
+    if(length == capacity)
+    {
+        throw std::runtime_error("password is too long");
+    }
+    
+    buffer[length++] = ch;
+}
+
+void Secret::assign(char const* data, size_t dataLength)
+{
+    if(dataLength > capacity)
+    {
+        throw std::runtime_error("password is too long");
+    }
+    
+    clear();
+    memcpy(buffer, data, dataLength);
+    length = dataLength;
+}
+
+void Secret::clear()
+{
+    OPENSSL_cleanse(buffer, length);
+    length = 0;
+}
+
+char const* Secret::data() const
+{
+    return buffer;
+}
+
+size_t Secret::size() const
+{
+    return length;
+}
+
+bool Secret::empty() const
+{
+    return length == 0;
+}
+
+void Secret::swap(Secret& other)
+{
+    char* const otherBuffer = other.buffer;
+    const size_t otherLength = other.length;
+    
+    other.buffer = buffer;
+    other.length = length;
+    buffer = otherBuffer;
+    length = otherLength;
+}
+
+bool isSecretMemoryLocked()
+{
+    ArenaLock lock;
+    
+    if(chunkCount == 0)
+    {
+        addChunk();
+    }
+    
+    for(size_t i = 0; i < chunkCount; ++i)
+    {
+        if(!chunks[i].locked)
+        {
+            return false;
+        }
+    }
+    
+    return true;
+}
@@ -0,0 +1,88 @@
+/**
+ * Copyright (c) 2007, Emir Uner
+ * All rights reserved.
+ * 
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ * 
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef EASYTC_SECRET_HPP_INCLUDED
+#define EASYTC_SECRET_HPP_INCLUDED
+
+#include <stddef.h>
+
+/**
+ * A password held in a fixed slot of a small memory arena that is locked
+ * into RAM and excluded from core dumps. The arena grows in locked chunks
+ * of 64 slots, up to maxSecrets. The slot is wiped when the secret is
+ * cleared or destroyed. Secrets never touch the heap and cannot be copied,
+ * ownership moves with swap().
+ */
+class Secret
+{
+public:
+    /**
+     * Bytes a secret can hold. TrueCrypt passwords are at most 64
+     * characters, the rest is room for the prompt answers built from them
+     * and for a dm table line, which carries the volume key.
+     */
+    static const size_t capacity = 512;
+    
+    /**
+     * Takes a slot from the arena. Throws std::runtime_error if maxSecrets
+     * secrets are in use or the arena cannot grow.
+     */
+    Secret();
+    ~Secret();
+    
+    /**
+     * Throws std::runtime_error if the secret would exceed the capacity.
+     */
+    void append(char ch);
+    void assign(char const* data, size_t length);
+    void clear();
+    
+    char const* data() const;
+    size_t size() const;
+    bool empty() const;
+    
+    void swap(Secret& other);
+    
+private:
+    Secret(Secret const&);
+    Secret& operator=(Secret const&);
+    
+    char* buffer;
+    size_t length;
+};
+
+/**
+ * Number of secrets that can be held at once.
+ */
+const size_t maxSecrets = 4096;
+
+/**
+ * Whether the arena could be locked into RAM. RLIMIT_MEMLOCK may forbid it,
+ * secrets are still wiped then but may reach swap.
+ */
+bool isSecretMemoryLocked();
+
+#endif
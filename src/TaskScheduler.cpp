@@ -0,0 +1,145 @@
+/**
+ * Copyright (c) 2007, Emir Uner
+ * All rights reserved.
+ * 
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ * 
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "TaskScheduler.hpp"
+#include "Posix.hpp"
+#include "Trace.hpp"
+
+#include <QtCore/QThread>
+#include <QtCore/QMutexLocker>
+
+#include <stdexcept>
+
+Task::Task(Priority priorityp)
+: priority(priorityp), cancelled(false), success(false), createTime(isTracingEnabled() ? monotonicMicroseconds() : -1)
+{
+    setAutoDelete(false);
+}
+
+Task::Priority Task::getPriority() const
+{
+    return priority;
+}
+
+bool Task::succeeded() const
+{
+    return success;
+}
+
+std::string Task::getErrorMessage() const
+{
+    return errorMessage;
+}
+
+void Task::cancel()
+{
+    cancelled = true;
+}
+
+bool Task::isCancelled()
+{
+    return cancelled;
+}
+
+void Task::report(int percent)
+{
+    emit progress(percent);
+}
+
+void Task::run()
+{
+    if(createTime >= 0)
+    {
+        // tasks are submitted right after they are created
+        recordTraceSpan("queued", createTime, monotonicMicroseconds() - createTime);
+    }
+    
+    try
+    {
+        operation_cancelled::check(this);
+        execute();
+        success = true;
+    }
+    catch(std::exception const& ex)
+    {
+        errorMessage = ex.what();
+    }
+    
+    emit finished();
+}
+
+TaskScheduler::TaskScheduler(QObject* parent)
+: QObject(parent)
+{
+    pool.setMaxThreadCount(QThread::idealThreadCount() > 2 ? QThread::idealThreadCount() : 2);
+    pool.setExpiryTimeout(-1);
+}
+
+TaskScheduler::~TaskScheduler()
+{
+    cancelAll();
+    pool.waitForDone();
+    
+    QMutexLocker locker(&mutex);
+    
+    qDeleteAll(tasks);
+}
+
+void TaskScheduler::submit(Task* task)
+{
+    {
+        QMutexLocker locker(&mutex);
+        
+        tasks.append(task);
+    }
+    
+    // connected last so that it runs after the submitter's own slots
+    QObject::connect(task, SIGNAL(finished()), this, SLOT(taskFinished()), Qt::QueuedConnection);
+    pool.start(task, task->getPriority());
+}
+
+void TaskScheduler::cancelAll()
+{
+    QMutexLocker locker(&mutex);
+    
+    for(QList<Task*>::const_iterator it = tasks.begin(); it != tasks.end(); ++it)
+    {
+        (*it)->cancel();
+    }
+}
+
+void TaskScheduler::taskFinished()
+{
+    Task* task = static_cast<Task*>(sender());
+    
+    {
+        QMutexLocker locker(&mutex);
+        
+        tasks.removeAll(task);
+    }
+    
+    task->deleteLater();
+}
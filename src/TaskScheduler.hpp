@@ -0,0 +1,126 @@
+/**
+ * Copyright (c) 2007, Emir Uner
+ * All rights reserved.
+ * 
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ * 
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef EASYTC_TASKSCHEDULER_HPP_INCLUDED
+#define EASYTC_TASKSCHEDULER_HPP_INCLUDED
+
+#include <QtCore/QObject>
+#include <QtCore/QRunnable>
+#include <QtCore/QThreadPool>
+#include <QtCore/QMutex>
+#include <QtCore/QList>
+
+#include "Progress.hpp"
+
+#include <string>
+
+/**
+ * A unit of work run by the TaskScheduler on one of its worker threads.
+ * Signals are emitted from the worker thread and reach receivers living
+ * in the GUI thread through queued connections.
+ */
+class Task : public QObject, public QRunnable, public Progress
+{
+    Q_OBJECT
+
+public:
+    /**
+     * Higher priorities are picked from the queue first.
+     */
+    enum Priority
+    {
+        PriorityCreate,
+        PriorityMount,
+        PriorityUnmount,
+        PriorityList
+    };
+    
+    Task(Priority priority);
+    
+    Priority getPriority() const;
+    bool succeeded() const;
+    std::string getErrorMessage() const;
+    
+    void run();
+    void report(int percent);
+    bool isCancelled();
+    
+protected:
+    /**
+     * Does the actual work, reporting failure by throwing.
+     */
+    virtual void execute() = 0;
+    
+private:
+    Priority priority;
+    volatile bool cancelled;
+    bool success;
+    std::string errorMessage;
+    long long createTime;
+    
+public slots:
+    void cancel();
+    
+signals:
+    void progress(int percent);
+    void finished();
+};
+
+/**
+ * Runs all truecrypt operations on a fixed pool of worker threads so that
+ * the GUI thread never blocks on them. Operations on the same volume are
+ * kept apart by the volume locks the truecrypt calls take.
+ */
+class TaskScheduler : public QObject
+{
+    Q_OBJECT
+
+public:
+    TaskScheduler(QObject* parent = 0);
+    ~TaskScheduler();
+    
+    /**
+     * Queues the task according to its priority. The scheduler takes
+     * ownership and deletes the task after its finished() signal has been
+     * delivered.
+     */
+    void submit(Task* task);
+    
+    /**
+     * Cancels every queued or running task.
+     */
+    void cancelAll();
+    
+private:
+    QThreadPool pool;
+    QMutex mutex;
+    QList<Task*> tasks;
+    
+private slots:
+    void taskFinished();
+};
+
+#endif
@@ -0,0 +1,331 @@
+/**
+ * Copyright (c) 2007, Emir Uner
+ * All rights reserved.
+ * 
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ * 
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "Trace.hpp"
+#include "Posix.hpp"
+
+#include <sys/syscall.h>
+
+#include <algorithm>
+#include <fstream>
+#include <vector>
+
+namespace
+{
+
+const int bufferCapacity = 65536;
+
+/**
+ * Spans of ended threads kept for writing out (24 MiB), more are dropped
+ * and counted.
+ */
+const size_t maxEndedSpans = 1048576;
+
+/**
+ * Buffers of ended threads kept for new threads to take over, the others
+ * are freed.
+ */
+const size_t maxIdleBuffers = 4;
+
+struct TraceSpan
+{
+    char const* name;
+    long long start;
+    long long duration;
+};
+
+/**
+ * Written only by its thread. The count is published with release
+ * semantics after the span, so the writer never waits for a reader.
+ */
+struct ThreadBuffer
+{
+    pid_t tid;
+    int generation;
+    int count;
+    int dropped;
+    
+    /**
+     * Set under the registry mutex when the thread ends and its spans have
+     * been moved out. The buffer then waits for a new thread.
+     */
+    bool exited;
+    TraceSpan spans[bufferCapacity];
+};
+
+struct EndedSpan
+{
+    TraceSpan span;
+    pid_t tid;
+};
+
+/**
+ * Incremented when tracing starts. A thread whose buffer is from an
+ * earlier generation starts over.
+ */
+int generation = 0;
+
+pthread_mutex_t registryMutex = PTHREAD_MUTEX_INITIALIZER;
+std::vector<ThreadBuffer*> registry;
+__thread ThreadBuffer* threadBuffer = 0;
+
+/**
+ * Spans of the current generation recorded by threads that have ended,
+ * guarded by the registry mutex.
+ */
+std::vector<EndedSpan> endedSpans;
+int endedGeneration = 0;
+int endedDropped = 0;
+
+pthread_once_t exitKeyOnce = PTHREAD_ONCE_INIT;
+pthread_key_t exitKey;
+
+/**
+ * Moves the spans of an ending thread out of its buffer, which is then
+ * kept for a new thread or freed, so that short lived pool threads do not
+ * each leave a buffer behind.
+ */
+void releaseBuffer(void* data)
+{
+    ThreadBuffer* buffer = static_cast<ThreadBuffer*>(data);
+    
+    pthread_mutex_lock(&registryMutex);
+    
+    const int current = __atomic_load_n(&generation, __ATOMIC_ACQUIRE);
+    
+    if(endedGeneration != current)
+    {
+        std::vector<EndedSpan>().swap(endedSpans);
+        endedGeneration = current;
+        endedDropped = 0;
+    }
+    
+    if(buffer->generation == current)
+    {
+        const size_t room = maxEndedSpans - endedSpans.size();
+        const size_t kept = static_cast<size_t>(buffer->count) < room ? buffer->count : room;
+        
+        for(size_t i = 0; i < kept; ++i)
+        {
+            const EndedSpan ended = { buffer->spans[i], buffer->tid };
+            
+            endedSpans.push_back(ended);
+        }
+        
+        endedDropped += buffer->dropped + static_cast<int>(buffer->count - kept);
+    }
+    
+    size_t idle = 0;
+    
+    for(std::vector<ThreadBuffer*>::const_iterator it = registry.begin(); it != registry.end(); ++it)
+    {
+        idle += (*it)->exited ? 1 : 0;
+    }
+    
+    if(idle < maxIdleBuffers)
+    {
+        // its spans are in endedSpans now, the writer must not see them twice
+        __atomic_store_n(&buffer->generation, -1, __ATOMIC_RELEASE);
+        buffer->exited = true;
+    }
+    else
+    {
+        registry.erase(std::find(registry.begin(), registry.end(), buffer));
+        delete buffer;
+    }
+    
+    pthread_mutex_unlock(&registryMutex);
+    
+    // a destructor running later on this thread gets a new buffer
+    threadBuffer = 0;
+}
+
+void createExitKey()
+{
+    pthread_key_create(&exitKey, &releaseBuffer);
+}
+
+ThreadBuffer* getThreadBuffer()
+{
+    const int current = __atomic_load_n(&generation, __ATOMIC_ACQUIRE);
+    
+    if(threadBuffer == 0)
+    {
+        pthread_once(&exitKeyOnce, &createExitKey);
+        pthread_mutex_lock(&registryMutex);
+        
+        for(std::vector<ThreadBuffer*>::const_iterator it = registry.begin(); it != registry.end(); ++it)
+        {
+            if((*it)->exited)
+            {
+                threadBuffer = *it;
+                break;
+            }
+        }
+        
+        if(threadBuffer == 0)
+        {
+            threadBuffer = new ThreadBuffer();
+            registry.push_back(threadBuffer);
+        }
+        
+        threadBuffer->tid = static_cast<pid_t>(syscall(SYS_gettid));
+        threadBuffer->generation = -1;
+        threadBuffer->count = 0;
+        threadBuffer->dropped = 0;
+        threadBuffer->exited = false;
+        pthread_mutex_unlock(&registryMutex);
+        pthread_setspecific(exitKey, threadBuffer);
+    }
+    
+    if(threadBuffer->generation != current)
+    {
+        __atomic_store_n(&threadBuffer->count, 0, __ATOMIC_RELEASE);
+        threadBuffer->dropped = 0;
+        __atomic_store_n(&threadBuffer->generation, current, __ATOMIC_RELEASE);
+    }
+    
+    return threadBuffer;
+}
+
+void writeJsonString(std::ostream& out, char const* str)
+{
+    out << '"';
+    
+    for(; *str != '\0'; ++str)
+    {
+        if(*str == '"' || *str == '\\')
+        {
+            out << '\\';
+        }
+        
+        out << *str;
+    }
+    
+    out << '"';
+}
+
+void writeSpan(std::ostream& out, bool& first, TraceSpan const& span, pid_t pid, pid_t tid)
+{
+    out << (first ? "\n" : ",\n") << "{\"name\":";
+    writeJsonString(out, span.name);
+    out << ",\"ph\":\"X\",\"ts\":" << span.start << ",\"dur\":" << span.duration
+        << ",\"pid\":" << pid << ",\"tid\":" << tid << "}";
+    first = false;
+}
+
+} // namespace <unnamed>
+
+bool detail::tracingEnabled = false;
+
+long long detail::traceClock()
+{
+    return monotonicMicroseconds();
+}
+
+void setTracingEnabled(bool enabled)
+{
+    if(enabled && !isTracingEnabled())
+    {
+        __atomic_add_fetch(&generation, 1, __ATOMIC_RELEASE);
+    }
+    
+    __atomic_store_n(&detail::tracingEnabled, enabled, __ATOMIC_RELAXED);
+}
+
+void recordTraceSpan(char const* name, long long start, long long duration)
+{
+    ThreadBuffer* buffer = getThreadBuffer();
+    const int count = buffer->count;
+    
+    if(count == bufferCapacity)
+    {
+        ++buffer->dropped;
+        return;
+    }
+    
+    buffer->spans[count].name = name;
+    buffer->spans[count].start = start;
+    buffer->spans[count].duration = duration;
+    __atomic_store_n(&buffer->count, count + 1, __ATOMIC_RELEASE);
+}
+
+void writeTrace(std::string path)
+{
+    std::ofstream out(path.c_str(), std::ios::trunc);
+    const pid_t pid = getpid();
+    bool first = true;
+    int dropped = 0;
+    
+    if(!out)
+    {
+        throw std::runtime_error("cannot write " + path);
+    }
+    
+    out << "{\"traceEvents\":[";
+    
+    pthread_mutex_lock(&registryMutex);
+    
+    const int current = __atomic_load_n(&generation, __ATOMIC_ACQUIRE);
+    
+    for(std::vector<ThreadBuffer*>::const_iterator it = registry.begin(); it != registry.end(); ++it)
+    {
+        // threads that have not recorded anything since tracing started
+        if(__atomic_load_n(&(*it)->generation, __ATOMIC_ACQUIRE) != current)
+        {
+            continue;
+        }
+        
+        const int count = __atomic_load_n(&(*it)->count, __ATOMIC_ACQUIRE);
+        
+        for(int i = 0; i < count; ++i)
+        {
+            writeSpan(out, first, (*it)->spans[i], pid, (*it)->tid);
+        }
+        
+        dropped += (*it)->dropped;
+    }
+    
+    if(endedGeneration == current)
+    {
+        for(std::vector<EndedSpan>::const_iterator it = endedSpans.begin(); it != endedSpans.end(); ++it)
+        {
+            writeSpan(out, first, it->span, pid, it->tid);
+        }
+        
+        dropped += endedDropped;
+    }
+    
+    pthread_mutex_unlock(&registryMutex);
+    
+    out << "\n],\"displayTimeUnit\":\"ms\",\"otherData\":{\"droppedSpans\":" << dropped << "}}\n";
+    out.close();
+    
+    if(!out)
+    {
+        throw std::runtime_error("cannot write " + path);
+    }
+}
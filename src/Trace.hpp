@@ -0,0 +1,104 @@
+/**
+ * Copyright (c) 2007, Emir Uner
+ * All rights reserved.
+ * 
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ * 
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef EASYTC_TRACE_HPP_INCLUDED
+#define EASYTC_TRACE_HPP_INCLUDED
+
+#include <string>
+
+/**
+ * Opt-in tracer for latency investigations. Spans are recorded into a
+ * fixed buffer per thread that only its own thread writes, and are written
+ * out as Chrome trace event JSON, which chrome://tracing and Perfetto load.
+ *
+ * Tracing is compiled in with the EASYTC_TRACING CMake option and then
+ * switched on at run time; while switched off a span costs one relaxed
+ * load. Without the option TRACE_SCOPE expands to nothing.
+ *
+ * Span names must be string literals, only the pointer is stored.
+ */
+
+namespace detail
+{
+
+extern bool tracingEnabled;
+
+long long traceClock();
+
+} // namespace detail
+
+inline bool isTracingEnabled()
+{
+    return __atomic_load_n(&detail::tracingEnabled, __ATOMIC_RELAXED);
+}
+
+/**
+ * Starting discards the spans recorded before.
+ */
+void setTracingEnabled(bool enabled);
+
+/**
+ * Records a span that started at start (monotonicMicroseconds) and lasted
+ * duration microseconds on the calling thread. Spans that do not fit into
+ * the thread's buffer are dropped and counted.
+ */
+void recordTraceSpan(char const* name, long long start, long long duration);
+
+/**
+ * Writes the recorded spans as a Chrome trace JSON file. Throws
+ * std::runtime_error if the file cannot be written.
+ */
+void writeTrace(std::string path);
+
+class TraceScope
+{
+    char const* name;
+    long long start;
+    
+public:
+    inline explicit TraceScope(char const* namep)
+    : name(namep), start(isTracingEnabled() ? detail::traceClock() : -1)
+    {
+    }
+    
+    inline ~TraceScope()
+    {
+        if(start >= 0)
+        {
+            recordTraceSpan(name, start, detail::traceClock() - start);
+        }
+    }
+};
+
+#ifdef EASYTC_TRACING
+#define EASYTC_TRACE_CONCAT2(a, b) a##b
+#define EASYTC_TRACE_CONCAT(a, b) EASYTC_TRACE_CONCAT2(a, b)
+#define TRACE_SCOPE(name) TraceScope EASYTC_TRACE_CONCAT(traceScope, __LINE__)(name)
+#else
+#define TRACE_SCOPE(name)
+#endif
+
+#endif
@@ -25,28 +25,131 @@
  */
 
 #include "TrueCrypt.hpp"
+#include "DmCrypt.hpp"
+#include "ImageFill.hpp"
+#include "MountInfo.hpp"
+#include "OperationLog.hpp"
 #include "Posix.hpp"
+#include "QueueTuning.hpp"
+#include "Trace.hpp"
+#include "VolumeLocks.hpp"
+
+#include <sys/stat.h>
 
 #include <stdexcept>
 #include <sstream>
 
-void unmount(char const* image)
+namespace
 {
+
+// size of each of the header areas at the start and at the end of a volume
+const int64_t volumeHeaderAreaSize = 131072;
+
+/**
+ * Runs truecrypt answering each of its password prompts with the password
+ * on standard input, so that it does not show up on the command line.
+ */
+std::string executeTrueCrypt(std::vector<std::string> args, Secret const& password, int prompts, int& exitCode)
+{
+    Secret input;
+    
+    for(int i = 0; i < prompts; ++i)
+    {
+        for(size_t j = 0; j < password.size(); ++j)
+        {
+            input.append(password.data()[j]);
+        }
+        
+        input.append('\n');
+    }
+    
+    return executeCommand("truecrypt", args, input.data(), input.size(), exitCode);
+}
+
+/**
+ * Runs truecrypt with the given arguments, records the run in the
+ * operation log and throws with truecrypt's output if it fails.
+ */
+std::string runTrueCrypt(std::vector<std::string> args, OperationKind kind, std::string image, int64_t bytes,
+                         Secret const* password = 0, int prompts = 1)
+{
+    TRACE_SCOPE("truecrypt");
+    
+    const int64_t startTime = wallClockMicroseconds();
+    const long long start = monotonicMicroseconds();
     int exitCode;
     
-    std::string output = executeCommand("truecrypt", "-d", image, exitCode);
+    std::string output = password != 0 ? executeTrueCrypt(args, *password, prompts, exitCode)
+                                       : executeCommand("truecrypt", args, exitCode);
+    
+    recordOperation(kind, image, startTime, monotonicMicroseconds() - start, exitCode, bytes);
 
     if(exitCode != 0)
     {
         throw std::runtime_error(output);
     }
+    
+    return output;
 }
 
-void unmountAll()
+int64_t getFileSize(std::string file)
 {
-    int exitCode;
+    struct stat st;
+    
+    return stat(file.c_str(), &st) == 0 ? st.st_size : 0;
+}
 
-    std::string output = executeCommand("truecrypt", "-d", exitCode);
+void makeFilesystem(std::string device, FilesystemOptions fsOptions)
+{
+    std::vector<std::string> args;
+    std::ostringstream oss;
+    char const* executable;
+    
+    if(fsOptions.filesystem == FilesystemExt4)
+    {
+        // stride and stripe width are given in 4K filesystem blocks
+        const int stride = fsOptions.stripeKBytes / 4 > 0 ? fsOptions.stripeKBytes / 4 : 1;
+        
+        oss << "stride=" << stride << ",stripe_width=" << stride;
+        
+        if(fsOptions.lazyInit)
+        {
+            oss << ",lazy_itable_init=1,lazy_journal_init=1";
+        }
+        
+        executable = "mkfs.ext4";
+        args.push_back("-q");
+        args.push_back("-b");
+        args.push_back("4096");
+        args.push_back("-E");
+        args.push_back(oss.str());
+        
+        if(!fsOptions.journal)
+        {
+            args.push_back("-O");
+            args.push_back("^has_journal");
+        }
+    }
+    else if(fsOptions.filesystem == FilesystemFAT)
+    {
+        executable = "mkfs.vfat";
+    }
+    else
+    {
+        oss << "su=" << fsOptions.stripeKBytes << "k,sw=1";
+        
+        executable = "mkfs.xfs";
+        args.push_back("-q");
+        args.push_back("-f");
+        args.push_back("-d");
+        args.push_back(oss.str());
+    }
+    
+    args.push_back(device);
+    
+    int exitCode;
+    
+    std::string output = executeCommand(executable, args, exitCode);
 
     if(exitCode != 0)
     {
@@ -54,26 +157,140 @@ void unmountAll()
     }
 }
 
-void mount(std::string image, std::string mountPoint, std::string password)
+/**
+ * Applies the dm-crypt flags of the profile and the queue tuning kept for
+ * the image to its freshly mapped device.
+ */
+void tuneMappedDevice(std::string const& image, MountProfile const& profile)
+{
+    const std::string tuning = getImageQueueTuning(image);
+    
+    if(profile.dmCryptFlags == 0 && tuning.empty())
+    {
+        return;
+    }
+    
+    try
+    {
+        const std::string device = getMappedDevice(image);
+        
+        if(profile.dmCryptFlags != 0)
+        {
+            setDmCryptFlags(device, profile.dmCryptFlags);
+        }
+        
+        if(!tuning.empty())
+        {
+            applyQueueTuning(image, device, getQueueTuning(tuning));
+        }
+    }
+    catch(std::runtime_error const& ex)
+    {
+        throw std::runtime_error(std::string("The image is mounted but could not be tuned. ") + ex.what());
+    }
+}
+
+void unmountLocked(std::string const& image)
 {
     std::vector<std::string> args;
     
-    args.push_back("-p");
-    args.push_back(password);
+    args.push_back("-d");
+    args.push_back(image);
+    
+    // the queues go back to how they were found while the device still exists
+    revertQueueTuning(image);
+    
+    try
+    {
+        runTrueCrypt(args, OperationUnmount, image, getFileSize(image));
+    }
+    catch(std::runtime_error const&)
+    {
+        // still mounted, so it keeps its tuning; the unmount error is the one to report
+        try
+        {
+            const std::string tuning = getImageQueueTuning(image);
+            
+            if(!tuning.empty())
+            {
+                applyQueueTuning(image, getMappedDevice(image), getQueueTuning(tuning));
+            }
+        }
+        catch(std::runtime_error const&)
+        {
+        }
+        
+        throw;
+    }
+}
+
+} // namespace <unnamed>
+
+void unmount(char const* image, std::string mountPoint)
+{
+    MountInfo info("", "", "");
+    
+    // looked up before locking, a thread must not ask for a lock it holds
+    if(mountPoint.empty() && findMountInfo(image, info))
+    {
+        mountPoint = info.mountPoint;
+    }
+    
+    VolumeLock lock(getVolumeKeys(image, mountPoint));
+    
+    unmountLocked(image);
+}
+
+void unmountAll()
+{
+    VolumeLock lock(VolumeKeyVec(), true);
+    
+    revertAllQueueTunings();
+    runTrueCrypt(std::vector<std::string>(1, "-d"), OperationUnmountAll, "", 0);
+}
+
+void mount(std::string image, std::string mountPoint, Secret const& password, MountProfile const& profile)
+{
+    std::vector<std::string> args;
+    
+    if(profile.readOnly)
+    {
+        args.push_back("--read-only");
+    }
+    
+    if(!profile.options.empty())
+    {
+        args.push_back("--mount-options");
+        args.push_back(profile.options);
+    }
+    
     args.push_back(image);
     args.push_back(mountPoint);
 
-    int exitCode;
+    VolumeLock lock(getVolumeKeys(image, mountPoint));
     
-    std::string output = executeCommand("truecrypt", args, exitCode);
+    runTrueCrypt(args, OperationMount, image, getFileSize(image), &password);
+    tuneMappedDevice(image, profile);
+}
 
-    if(exitCode != 0)
+void setQueueTuning(std::string image, std::string device, std::string tuning)
+{
+    VolumeLock lock(getVolumeKeys(image, "", device));
+    
+    // checked before anything changes
+    const QueueTuning queueTuning = tuning.empty() ? QueueTuning() : getQueueTuning(tuning);
+    
+    setImageQueueTuning(image, tuning);
+    revertQueueTuning(image);
+    
+    if(!tuning.empty() && !device.empty())
     {
-        throw std::runtime_error(output);
+        applyQueueTuning(image, device, queueTuning);
     }
 }
 
-void createImage(std::string imageFile, std::string password, int size)
+void createImage(std::string imageFile, Secret const& password, int size, FilesystemOptions fsOptions,
+                 Progress* progress)
 {
     std::vector<std::string> args;
     std::ostringstream oss;
@@ -83,28 +300,60 @@ void createImage(std::string imageFile, std::string password, int size)
     args.push_back("--type");
     args.push_back("normal");
     args.push_back("--filesystem");
-    args.push_back("FAT");
+    args.push_back(fsOptions.filesystem == FilesystemFAT && !fsOptions.randomFill ? "FAT" : "none");
     args.push_back("--size");
     args.push_back(oss.str());
     args.push_back("--hash");
     args.push_back("RIPEMD-160");
     args.push_back("--encryption");
     args.push_back("AES");
-    args.push_back("-p");
-    args.push_back(password);    
     args.push_back("-k");
     args.push_back("/dev/null");
     args.push_back("--random-source");
     args.push_back("/dev/urandom");
+    
+    if(fsOptions.randomFill)
+    {
+        args.push_back("--quick");
+    }
+    
     args.push_back("--create");
     args.push_back(imageFile);
     
-    int exitCode;
+    VolumeLock lock(getVolumeKeys(imageFile));
     
-    std::string output = executeCommand("truecrypt", args, exitCode);
+    // the new password is asked for twice
+    runTrueCrypt(args, OperationCreate, imageFile, static_cast<int64_t>(size) * 1024 * 1024, &password, 2);
+    
+    if(fsOptions.randomFill)
+    {
+        const int64_t dataSize = static_cast<int64_t>(size) * 1024 * 1024 - 2 * volumeHeaderAreaSize;
+        
+        fillRandom(imageFile, volumeHeaderAreaSize, dataSize, FillOptions(), progress);
+    }
+    else if(fsOptions.filesystem == FilesystemFAT)
+    {
+        return;
+    }
+    
+    // Map the new volume without mounting it and put the filesystem on it.
+    int exitCode;
+    std::string output = executeTrueCrypt(std::vector<std::string>(1, imageFile), password, 1, exitCode);
 
     if(exitCode != 0)
     {
         throw std::runtime_error(output);
     }
+    
+    try
+    {
+        makeFilesystem(getMappedDevice(imageFile), fsOptions);
+    }
+    catch(...)
+    {
+        executeCommand("truecrypt", "-d", imageFile, exitCode);
+        throw;
+    }
+    
+    unmountLocked(imageFile);
 }
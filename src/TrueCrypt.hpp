@@ -27,12 +27,17 @@
 #ifndef EASYTC_TRUECRYPT_HPP_INCLUDED
 #define EASYTC_TRUECRYPT_HPP_INCLUDED
 
+#include "MountProfile.hpp"
+#include "Progress.hpp"
+#include "Secret.hpp"
+
 #include <string>
 
 /**
- * Unmounts a mounted TrueCrypt image.
+ * Unmounts a mounted TrueCrypt image. Locks its mount point as well, so a
+ * trim or a mount there waits; if no mount point is given it is looked up.
  */
-void unmount(char const* image);
+void unmount(char const* image, std::string mountPoint = "");
 
 /**
  * Unmounts all mounted TrueCrypt images.
@@ -40,13 +45,73 @@ void unmount(char const* image);
 void unmountAll();
 
 /**
- * Mounts the image under given mount point.
+ * Mounts the image under given mount point with the options of the profile.
+ * When the profile has dm-crypt flags the mapping is reloaded with them
+ * once mounted, and the queue tuning kept for the image is applied; if
+ * either fails the image stays mounted and the error says so.
+ */
+void mount(std::string image, std::string mountPoint, Secret const& password,
+           MountProfile const& profile = MountProfile());
+
+/**
+ * Keeps the named queue tuning for the image and applies it to the device
+ * the image is mapped to, after putting back the values an earlier tuning
+ * replaced. An empty name only puts them back. Unmounting reverts the
+ * tuning and the next mount applies it again.
+ */
+void setQueueTuning(std::string image, std::string device, std::string tuning);
+
+/**
+ * Filesystems a new image can be formatted with.
+ */
+enum Filesystem
+{
+    FilesystemFAT,
+    FilesystemExt4,
+    FilesystemXfs
+};
+
+/**
+ * Formatting options for a new image. Only FAT is created by truecrypt
+ * itself, the others are created with mkfs on the mapped volume.
  */
-void mount(std::string image, std::string mountPoint, std::string password);
+struct FilesystemOptions
+{
+    Filesystem filesystem;
+    
+    /**
+     * Initialise ext4 inode tables lazily after mounting.
+     */
+    bool lazyInit;
+    
+    /**
+     * Whether ext4 gets a journal. Scratch volumes are faster without one.
+     */
+    bool journal;
+    
+    /**
+     * Stripe size the filesystem allocations are aligned to.
+     */
+    int stripeKBytes;
+    
+    /**
+     * Fill the data area with random data on all cores instead of letting
+     * truecrypt encrypt it on one. FAT is then made with mkfs too.
+     */
+    bool randomFill;
+    
+    inline FilesystemOptions()
+    : filesystem(FilesystemFAT), lazyInit(true), journal(true), stripeKBytes(128), randomFill(false)
+    {
+    }
+};
 
 /**
- * Create an image file.
+ * Create an image file. With randomFill truecrypt quick formats the image,
+ * writing only the headers, and fillRandom overwrites the data area before
+ * the filesystem is made; the progress covers the fill.
  */
-void createImage(std::string imageFile, std::string password, int size);
+void createImage(std::string imageFile, Secret const& password, int size,
+                 FilesystemOptions fsOptions = FilesystemOptions(), Progress* progress = 0);
 
 #endif
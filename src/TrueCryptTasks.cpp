@@ -0,0 +1,368 @@
+/**
+ * Copyright (c) 2007, Emir Uner
+ * All rights reserved.
+ * 
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ * 
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "TrueCryptTasks.hpp"
+#include "QueueTuning.hpp"
+#include "Trace.hpp"
+
+ListTask::ListTask()
+: Task(PriorityList)
+{
+}
+
+MountInfoVec ListTask::getMountInfos() const
+{
+    return mountInfos;
+}
+
+CryptoReportVec ListTask::getCryptoReports() const
+{
+    return cryptoReports;
+}
+
+std::vector<std::string> ListTask::getQueueTunings() const
+{
+    return queueTunings;
+}
+
+void ListTask::execute()
+{
+    TRACE_SCOPE("list task");
+    
+    mountInfos = getMountInfo();
+    cryptoReports = ::getCryptoReports(mountInfos);
+    
+    for(MountInfoVec::const_iterator it = mountInfos.begin(); it != mountInfos.end(); ++it)
+    {
+        queueTunings.push_back(getImageQueueTuning(it->imageFile));
+    }
+}
+
+MountTask::MountTask(std::string imagep, std::string mountPointp, Secret& passwordp, MountProfile profilep)
+: Task(PriorityMount), image(imagep), mountPoint(mountPointp), profile(profilep)
+{
+    password.swap(passwordp);
+}
+
+std::string MountTask::getImage() const
+{
+    return image;
+}
+
+std::string MountTask::getMountPoint() const
+{
+    return mountPoint;
+}
+
+std::string MountTask::getWarmSummary() const
+{
+    if(!profile.warmCache)
+    {
+        return std::string();
+    }
+    
+    return warmError.empty() ? formatWarmResult(warmResult) : "Cache warm-up failed: " + warmError;
+}
+
+void MountTask::execute()
+{
+    TRACE_SCOPE("mount task");
+    
+    ::mount(image, mountPoint, password, profile);
+    
+    if(profile.warmCache)
+    {
+        WarmOptions options = getWarmOptions();
+        
+        options.hotFiles = profile.hotFiles;
+        
+        try
+        {
+            warmResult = warmCache(mountPoint, options);
+        }
+        catch(std::exception const& e)
+        {
+            warmError = e.what();
+        }
+    }
+}
+
+UnmountTask::UnmountTask(std::string imagep, std::string mountPointp, BusyProcessVec terminateFirstp)
+: Task(PriorityUnmount), image(imagep), mountPoint(mountPointp), terminateFirst(terminateFirstp)
+{
+}
+
+std::string UnmountTask::getImage() const
+{
+    return image;
+}
+
+std::string UnmountTask::getMountPoint() const
+{
+    return mountPoint;
+}
+
+BusyProcessVec UnmountTask::getBusyProcesses() const
+{
+    return busyProcesses;
+}
+
+void UnmountTask::execute()
+{
+    TRACE_SCOPE("unmount task");
+    
+    if(!terminateFirst.empty())
+    {
+        terminateProcesses(terminateFirst, 3000);
+    }
+    
+    try
+    {
+        ::unmount(image.c_str(), mountPoint);
+    }
+    catch(std::runtime_error const&)
+    {
+        if(!mountPoint.empty())
+        {
+            busyProcesses = findBusyProcesses(mountPoint);
+        }
+        
+        throw;
+    }
+}
+
+UnmountAllTask::UnmountAllTask()
+: Task(PriorityUnmount)
+{
+}
+
+void UnmountAllTask::execute()
+{
+    TRACE_SCOPE("unmount all task");
+    
+    ::unmountAll();
+}
+
+QueueTuningTask::QueueTuningTask(std::string imagep, std::string devicep, std::string tuningp)
+: Task(PriorityMount), image(imagep), device(devicep), tuning(tuningp)
+{
+}
+
+void QueueTuningTask::execute()
+{
+    TRACE_SCOPE("queue tuning task");
+    
+    ::setQueueTuning(image, device, tuning);
+}
+
+CreateImageTask::CreateImageTask(std::string imageFilep, Secret& passwordp, int sizep,
+                                 FilesystemOptions fsOptionsp)
+: Task(PriorityCreate), imageFile(imageFilep), size(sizep), fsOptions(fsOptionsp)
+{
+    password.swap(passwordp);
+}
+
+void CreateImageTask::execute()
+{
+    TRACE_SCOPE("create image task");
+    
+    ::createImage(imageFile, password, size, fsOptions, this);
+}
+
+BenchmarkTask::BenchmarkTask(MountInfo mountInfop)
+: Task(PriorityCreate), mountInfo(mountInfop)
+{
+}
+
+BenchmarkResultVec BenchmarkTask::getResults() const
+{
+    return results;
+}
+
+void BenchmarkTask::execute()
+{
+    TRACE_SCOPE("benchmark task");
+    
+    results = runBenchmark(mountInfo.mountPoint, BenchmarkOptions(), this);
+    saveBenchmarkResults(mountInfo, results);
+}
+
+CloneImageTask::CloneImageTask(std::string sourcep, std::string targetp)
+: Task(PriorityCreate), source(sourcep), target(targetp)
+{
+}
+
+CloneResult CloneImageTask::getResult() const
+{
+    return result;
+}
+
+void CloneImageTask::execute()
+{
+    TRACE_SCOPE("clone image task");
+    
+    result = cloneImage(source, target, this);
+}
+
+BackupImageTask::BackupImageTask(std::string imagep, std::string backupDirectoryp)
+: Task(PriorityCreate), image(imagep), backupDirectory(backupDirectoryp)
+{
+}
+
+BackupResult BackupImageTask::getResult() const
+{
+    return result;
+}
+
+void BackupImageTask::execute()
+{
+    TRACE_SCOPE("backup image task");
+    
+    result = backupImage(image, backupDirectory, this);
+}
+
+RestoreImageTask::RestoreImageTask(std::string backupDirectoryp, std::string targetp)
+: Task(PriorityCreate), backupDirectory(backupDirectoryp), target(targetp)
+{
+}
+
+void RestoreImageTask::execute()
+{
+    TRACE_SCOPE("restore image task");
+    
+    restoreImage(backupDirectory, target, this);
+}
+
+VerifyImageTask::VerifyImageTask(std::string imagep)
+: Task(PriorityCreate), image(imagep)
+{
+}
+
+ScrubResult VerifyImageTask::getResult() const
+{
+    return result;
+}
+
+void VerifyImageTask::execute()
+{
+    TRACE_SCOPE("verify image task");
+    
+    result = scrubImage(image, getScrubOptions(), this);
+}
+
+ExtractTask::ExtractTask(std::string imagep, Secret& passwordp, std::vector<std::string> pathsp,
+                         std::string targetDirectoryp)
+: Task(PriorityCreate), image(imagep), paths(pathsp), targetDirectory(targetDirectoryp)
+{
+    password.swap(passwordp);
+}
+
+ExtractResult ExtractTask::getResult() const
+{
+    return result;
+}
+
+void ExtractTask::execute()
+{
+    TRACE_SCOPE("extract task");
+    
+    result = extractImageFiles(image, password, paths, targetDirectory, this);
+}
+
+TrimTask::TrimTask()
+: Task(PriorityCreate)
+{
+}
+
+TrimResultVec TrimTask::getResults() const
+{
+    return results;
+}
+
+void TrimTask::execute()
+{
+    TRACE_SCOPE("trim task");
+    
+    MountInfoVec mountInfos;
+    
+    try
+    {
+        mountInfos = getMountInfo();
+    }
+    catch(std::runtime_error const& ex)
+    {
+        // truecrypt fails when nothing is mapped
+        if(std::string(ex.what()).find("No volumes mapped") == std::string::npos)
+        {
+            throw;
+        }
+    }
+    
+    results = trimVolumes(mountInfos, getTrimOptions(), this);
+}
+
+ScanTask::ScanTask(std::string rootp)
+: Task(PriorityCreate), root(rootp)
+{
+    stats.directories = stats.files = stats.sampled = stats.cached = 0;
+}
+
+ContainerCandidateVec ScanTask::getCandidates() const
+{
+    return candidates;
+}
+
+ScanStats ScanTask::getStats() const
+{
+    return stats;
+}
+
+void ScanTask::execute()
+{
+    TRACE_SCOPE("scan task");
+    
+    candidates = scanForContainers(root, stats, this);
+}
+
+CheckPasswordTask::CheckPasswordTask(std::string imagep, Secret& passwordp)
+: Task(PriorityMount), image(imagep), matched(false)
+{
+    password.swap(passwordp);
+}
+
+bool CheckPasswordTask::isMatched() const
+{
+    return matched;
+}
+
+void CheckPasswordTask::execute()
+{
+    TRACE_SCOPE("check password task");
+    
+    VolumeHeaderInfo info;
+    
+    matched = findVolumeHeader(image, password, info);
+}
@@ -0,0 +1,321 @@
+/**
+ * Copyright (c) 2007, Emir Uner
+ * All rights reserved.
+ * 
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ * 
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef EASYTC_TRUECRYPTTASKS_HPP_INCLUDED
+#define EASYTC_TRUECRYPTTASKS_HPP_INCLUDED
+
+#include "TaskScheduler.hpp"
+#include "TrueCrypt.hpp"
+#include "MountInfo.hpp"
+#include "Benchmark.hpp"
+#include "BusyProcesses.hpp"
+#include "CacheWarmer.hpp"
+#include "ContainerScanner.hpp"
+#include "CryptoAcceleration.hpp"
+#include "ImageBackup.hpp"
+#include "ImageCopy.hpp"
+#include "ImageExtract.hpp"
+#include "ImageScrub.hpp"
+#include "VolumeHeader.hpp"
+#include "VolumeTrim.hpp"
+
+/**
+ * Queries the mounted images, the cipher drivers behind them and their
+ * queue tunings.
+ */
+class ListTask : public Task
+{
+    MountInfoVec mountInfos;
+    CryptoReportVec cryptoReports;
+    std::vector<std::string> queueTunings;
+    
+public:
+    ListTask();
+    MountInfoVec getMountInfos() const;
+    
+    /**
+     * One report per mounted image, empty if the listing failed.
+     */
+    CryptoReportVec getCryptoReports() const;
+    
+    /**
+     * The name of the queue tuning kept for each mounted image.
+     */
+    std::vector<std::string> getQueueTunings() const;
+    
+protected:
+    void execute();
+};
+
+class MountTask : public Task
+{
+    std::string image;
+    std::string mountPoint;
+    Secret password;
+    MountProfile profile;
+    WarmResult warmResult;
+    std::string warmError;
+    
+public:
+    /**
+     * Takes over the password, leaving the given secret empty.
+     */
+    MountTask(std::string image, std::string mountPoint, Secret& password,
+              MountProfile profile = MountProfile());
+    std::string getImage() const;
+    std::string getMountPoint() const;
+    
+    /**
+     * A summary of the cache warm-up after mounting, empty if the profile
+     * does not warm the cache. A failed warm-up does not fail the mount.
+     */
+    std::string getWarmSummary() const;
+    
+protected:
+    void execute();
+};
+
+/**
+ * Unmounts an image. If that fails, the processes keeping the mount point
+ * busy are looked up. Processes to terminate before unmounting can be
+ * given for a retry.
+ */
+class UnmountTask : public Task
+{
+    std::string image;
+    std::string mountPoint;
+    BusyProcessVec terminateFirst;
+    BusyProcessVec busyProcesses;
+    
+public:
+    UnmountTask(std::string image, std::string mountPoint = "",
+                BusyProcessVec terminateFirst = BusyProcessVec());
+    std::string getImage() const;
+    std::string getMountPoint() const;
+    BusyProcessVec getBusyProcesses() const;
+    
+protected:
+    void execute();
+};
+
+class UnmountAllTask : public Task
+{
+public:
+    UnmountAllTask();
+    
+protected:
+    void execute();
+};
+
+class QueueTuningTask : public Task
+{
+    std::string image;
+    std::string device;
+    std::string tuning;
+    
+public:
+    QueueTuningTask(std::string image, std::string device, std::string tuning);
+    
+protected:
+    void execute();
+};
+
+class CreateImageTask : public Task
+{
+    std::string imageFile;
+    Secret password;
+    int size;
+    FilesystemOptions fsOptions;
+    
+public:
+    /**
+     * Takes over the password, leaving the given secret empty.
+     */
+    CreateImageTask(std::string imageFile, Secret& password, int size, FilesystemOptions fsOptions);
+    
+protected:
+    void execute();
+};
+
+/**
+ * Benchmarks a mounted volume and records the results.
+ */
+class BenchmarkTask : public Task
+{
+    MountInfo mountInfo;
+    BenchmarkResultVec results;
+    
+public:
+    BenchmarkTask(MountInfo mountInfo);
+    BenchmarkResultVec getResults() const;
+    
+protected:
+    void execute();
+};
+
+/**
+ * Copies an image to a new file.
+ */
+class CloneImageTask : public Task
+{
+    std::string source;
+    std::string target;
+    CloneResult result;
+    
+public:
+    CloneImageTask(std::string source, std::string target);
+    CloneResult getResult() const;
+    
+protected:
+    void execute();
+};
+
+/**
+ * Stores the blocks of an image that changed since its last backup.
+ */
+class BackupImageTask : public Task
+{
+    std::string image;
+    std::string backupDirectory;
+    BackupResult result;
+    
+public:
+    BackupImageTask(std::string image, std::string backupDirectory);
+    BackupResult getResult() const;
+    
+protected:
+    void execute();
+};
+
+/**
+ * Reassembles an image from its backup.
+ */
+class RestoreImageTask : public Task
+{
+    std::string backupDirectory;
+    std::string target;
+    
+public:
+    RestoreImageTask(std::string backupDirectory, std::string target);
+    
+protected:
+    void execute();
+};
+
+/**
+ * Reads a whole image to check that it is still readable.
+ */
+class VerifyImageTask : public Task
+{
+    std::string image;
+    ScrubResult result;
+    
+public:
+    VerifyImageTask(std::string image);
+    ScrubResult getResult() const;
+    
+protected:
+    void execute();
+};
+
+/**
+ * Copies files out of an image without mounting it.
+ */
+class ExtractTask : public Task
+{
+    std::string image;
+    Secret password;
+    std::vector<std::string> paths;
+    std::string targetDirectory;
+    ExtractResult result;
+    
+public:
+    /**
+     * Takes over the password, leaving the given secret empty.
+     */
+    ExtractTask(std::string image, Secret& password, std::vector<std::string> paths, std::string targetDirectory);
+    ExtractResult getResult() const;
+    
+protected:
+    void execute();
+};
+
+/**
+ * Trims every mounted volume.
+ */
+class TrimTask : public Task
+{
+    TrimResultVec results;
+    
+public:
+    TrimTask();
+    TrimResultVec getResults() const;
+    
+protected:
+    void execute();
+};
+
+/**
+ * Searches a directory tree for likely TrueCrypt containers.
+ */
+class ScanTask : public Task
+{
+    std::string root;
+    ContainerCandidateVec candidates;
+    ScanStats stats;
+    
+public:
+    ScanTask(std::string root);
+    ContainerCandidateVec getCandidates() const;
+    ScanStats getStats() const;
+    
+protected:
+    void execute();
+};
+
+/**
+ * Tries the password on the headers of the image before it is mounted.
+ * Not matching is not an error: only AES headers can be opened here, so
+ * the password may still be right for another cipher.
+ */
+class CheckPasswordTask : public Task
+{
+    std::string image;
+    Secret password;
+    bool matched;
+    
+public:
+    /**
+     * Takes over the password, leaving the given secret empty.
+     */
+    CheckPasswordTask(std::string image, Secret& password);
+    bool isMatched() const;
+    
+protected:
+    void execute();
+};
+
+#endif
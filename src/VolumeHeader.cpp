@@ -0,0 +1,306 @@
+/**
+ * Copyright (c) 2007, Emir Uner
+ * All rights reserved.
+ * 
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ * 
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "VolumeHeader.hpp"
+#include "Posix.hpp"
+
+#include <fcntl.h>
+#include <stdint.h>
+
+#include <openssl/evp.h>
+
+#if OPENSSL_VERSION_NUMBER >= 0x30000000L
+#include <openssl/provider.h>
+#endif
+
+#include <stdexcept>
+
+namespace
+{
+
+const int saltSize = 64;
+const int keySize = 64;
+const off_t hiddenHeaderOffset = 65536;
+
+struct Prf
+{
+    char const* name;
+    EVP_MD const* (*digest)();
+    int iterations;
+};
+
+const Prf prfs[] =
+{
+    { "RIPEMD-160", &EVP_ripemd160, 2000 },
+    { "SHA-512", &EVP_sha512, 1000 },
+#ifndef OPENSSL_NO_WHIRLPOOL
+    { "Whirlpool", &EVP_whirlpool, 1000 },
+#endif
+    { "SHA-1", &EVP_sha1, 2000 }
+};
+
+const int prfCount = sizeof(prfs) / sizeof(prfs[0]);
+
+pthread_once_t providersOnce = PTHREAD_ONCE_INIT;
+
+/**
+ * OpenSSL 3 only has Whirlpool in the legacy provider, and loading that
+ * one unloads the implicit default provider unless it is loaded as well.
+ */
+void loadProviders()
+{
+#if OPENSSL_VERSION_NUMBER >= 0x30000000L
+    OSSL_PROVIDER_load(0, "legacy");
+    OSSL_PROVIDER_load(0, "default");
+#endif
+}
+
+Prf const* findPrf(std::string const& name)
+{
+    for(int i = 0; i < prfCount; ++i)
+    {
+        if(name == prfs[i].name)
+        {
+            return &prfs[i];
+        }
+    }
+    
+    return 0;
+}
+
+struct Crc32Table
+{
+    uint32_t values[256];
+    
+    Crc32Table()
+    {
+        for(uint32_t i = 0; i < 256; ++i)
+        {
+            uint32_t value = i;
+            
+            for(int bit = 0; bit < 8; ++bit)
+            {
+                value = (value & 1) ? (value >> 1) ^ 0xEDB88320u : value >> 1;
+            }
+            
+            values[i] = value;
+        }
+    }
+};
+
+// built before main so that the key derivation threads only read it
+const Crc32Table crcTable;
+
+uint32_t crc32(unsigned char const* data, int length)
+{
+    uint32_t crc = 0xFFFFFFFFu;
+    
+    for(int i = 0; i < length; ++i)
+    {
+        crc = crcTable.values[(crc ^ data[i]) & 0xFF] ^ (crc >> 8);
+    }
+    
+    return crc ^ 0xFFFFFFFFu;
+}
+
+uint64_t readBigEndian(unsigned char const* data, int bytes)
+{
+    uint64_t value = 0;
+    
+    for(int i = 0; i < bytes; ++i)
+    {
+        value = (value << 8) | data[i];
+    }
+    
+    return value;
+}
+
+bool decryptXts(unsigned char const* key, unsigned char const* input, unsigned char* output, int length)
+{
+    EVP_CIPHER_CTX* ctx = EVP_CIPHER_CTX_new();
+    unsigned char tweak[16] = { 0 };
+    int outLength = 0;
+    
+    const bool ok = ctx != 0
+                    && EVP_DecryptInit_ex(ctx, EVP_aes_256_xts(), 0, key, tweak) == 1
+                    && EVP_DecryptUpdate(ctx, output, &outLength, input, length) == 1;
+    
+    EVP_CIPHER_CTX_free(ctx);
+    
+    return ok && outLength == length;
+}
+
+/**
+ * Checks the decrypted header, which starts at offset 64 of the on disk
+ * header, i.e. right after the salt.
+ */
+bool isValidHeader(unsigned char const* plain)
+{
+    if(plain[0] != 'T' || plain[1] != 'R' || plain[2] != 'U' || plain[3] != 'E')
+    {
+        return false;
+    }
+    
+    // both checksums are stored at fixed offsets of the on disk header
+    const uint32_t keyAreaCrc = static_cast<uint32_t>(readBigEndian(plain + 72 - saltSize, 4));
+    const uint32_t headerCrc = static_cast<uint32_t>(readBigEndian(plain + 252 - saltSize, 4));
+    
+    return crc32(plain + 256 - saltSize, 256) == keyAreaCrc && crc32(plain, 252 - saltSize) == headerCrc;
+}
+
+struct PrfAttempt
+{
+    unsigned char const* header;
+    Secret const* password;
+    Prf const* prf;
+    bool matched;
+    unsigned char plain[volumeHeaderSize - saltSize];
+    
+    void operator()()
+    {
+        unsigned char key[keySize];
+        
+        matched = false;
+        
+        if(!deriveHeaderKey(prf->name, *password, header, saltSize, 0, key, keySize))
+        {
+            // hash not available in this OpenSSL build
+            return;
+        }
+        
+        matched = decryptXts(key, header + saltSize, plain, sizeof(plain)) && isValidHeader(plain);
+        
+        memset(key, 0, sizeof(key));
+    }
+};
+
+} // namespace <unnamed>
+
+std::vector<std::string> getHeaderKeyHashes()
+{
+    std::vector<std::string> names;
+    
+    for(int i = 0; i < prfCount; ++i)
+    {
+        names.push_back(prfs[i].name);
+    }
+    
+    return names;
+}
+
+bool deriveHeaderKey(std::string hash, Secret const& password, unsigned char const* salt, int saltLength,
+                     int iterations, unsigned char* key, int keyLength)
+{
+    Prf const* prf = findPrf(hash);
+    
+    pthread_once(&providersOnce, &loadProviders);
+    
+    return prf != 0 && PKCS5_PBKDF2_HMAC(password.data(), static_cast<int>(password.size()), salt, saltLength,
+                                         iterations > 0 ? iterations : prf->iterations, prf->digest(),
+                                         keyLength, key) == 1;
+}
+
+bool decryptVolumeHeader(unsigned char const* header, Secret const& password, VolumeHeaderInfo& info,
+                         Secret* masterKey)
+{
+    std::vector<PrfAttempt> attempts(prfCount);
+    
+    for(int i = 0; i < prfCount; ++i)
+    {
+        attempts[i].header = header;
+        attempts[i].password = &password;
+        attempts[i].prf = &prfs[i];
+    }
+    
+    runThreads(attempts);
+    
+    bool matched = false;
+    
+    for(int i = 0; i < prfCount; ++i)
+    {
+        if(attempts[i].matched && !matched)
+        {
+            unsigned char const* plain = attempts[i].plain;
+            
+            info.hash = prfs[i].name;
+            info.encryption = "AES";
+            info.hidden = readBigEndian(plain + 92 - saltSize, 8) != 0;
+            info.version = static_cast<unsigned short>(readBigEndian(plain + 68 - saltSize, 2));
+            info.volumeSize = readBigEndian(plain + 100 - saltSize, 8);
+            info.encryptedAreaStart = readBigEndian(plain + 108 - saltSize, 8);
+            info.encryptedAreaSize = readBigEndian(plain + 116 - saltSize, 8);
+            matched = true;
+            
+            if(masterKey != 0)
+            {
+                masterKey->assign(reinterpret_cast<char const*>(plain + 256 - saltSize), masterKeySize);
+            }
+        }
+        
+        memset(attempts[i].plain, 0, sizeof(attempts[i].plain));
+    }
+    
+    return matched;
+}
+
+bool findVolumeHeader(std::string image, Secret const& password, VolumeHeaderInfo& info, Secret* masterKey)
+{
+    const int fd = open(image.c_str(), O_RDONLY | O_CLOEXEC);
+    
+    if(fd == -1)
+    {
+        throw std::runtime_error(image + ": " + strerror(errno));
+    }
+    
+    unsigned char header[volumeHeaderSize];
+    bool matched = false;
+    
+    if(pread(fd, header, sizeof(header), 0) == volumeHeaderSize)
+    {
+        matched = decryptVolumeHeader(header, password, info, masterKey);
+    }
+    
+    if(!matched && pread(fd, header, sizeof(header), hiddenHeaderOffset) == volumeHeaderSize)
+    {
+        matched = decryptVolumeHeader(header, password, info, masterKey);
+    }
+    
+    close(fd);
+    
+    return matched;
+}
+
+VolumeHeaderInfo readVolumeHeader(std::string image, Secret const& password, Secret* masterKey)
+{
+    VolumeHeaderInfo info;
+    
+    if(!findVolumeHeader(image, password, info, masterKey))
+    {
+        throw std::runtime_error("Incorrect password or not an AES TrueCrypt volume.");
+    }
+    
+    return info;
+}
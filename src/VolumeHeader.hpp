@@ -0,0 +1,113 @@
+/**
+ * Copyright (c) 2007, Emir Uner
+ * All rights reserved.
+ * 
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ * 
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef EASYTC_VOLUMEHEADER_HPP_INCLUDED
+#define EASYTC_VOLUMEHEADER_HPP_INCLUDED
+
+#include "Secret.hpp"
+
+#include <string>
+#include <vector>
+
+/**
+ * Size of a TrueCrypt volume header on disk.
+ */
+const int volumeHeaderSize = 512;
+
+struct VolumeHeaderInfo
+{
+    /**
+     * Name of the header key derivation hash, as truecrypt spells it.
+     */
+    std::string hash;
+    std::string encryption;
+    bool hidden;
+    unsigned short version;
+    unsigned long long volumeSize;
+    
+    /**
+     * Where the data area starts in the image and how long it is, 0 in
+     * headers written before TrueCrypt 6.0.
+     */
+    unsigned long long encryptedAreaStart;
+    unsigned long long encryptedAreaSize;
+};
+
+/**
+ * Size of the XTS data unit, which stays 512 bytes whatever the sector size
+ * of the volume. Units are numbered from the start of the image.
+ */
+const int dataUnitSize = 512;
+
+/**
+ * Size of the AES-256 XTS master key, the data key followed by the tweak key.
+ */
+const int masterKeySize = 64;
+
+/**
+ * Names of the header key derivation hashes, in the order they are tried.
+ */
+std::vector<std::string> getHeaderKeyHashes();
+
+/**
+ * Derives a header key with PBKDF2 and the named hash, with the given
+ * number of iterations or, if 0, the number TrueCrypt uses with the hash.
+ *
+ * @return false if the hash is unknown or missing from this OpenSSL
+ */
+bool deriveHeaderKey(std::string hash, Secret const& password, unsigned char const* salt, int saltLength,
+                     int iterations, unsigned char* key, int keyLength);
+
+/**
+ * Tries the password on a raw 512 byte header with every supported hash.
+ * The key derivations run in parallel, one thread per hash. Only AES in XTS
+ * mode, as used by TrueCrypt 5.0 and later, can be decrypted; Serpent,
+ * Twofish and cascades are left to truecrypt.
+ *
+ * @return true and fills info, and the master key if one is asked for, if
+ *         the header opened and its magic and checksums are intact
+ */
+bool decryptVolumeHeader(unsigned char const* header, Secret const& password, VolumeHeaderInfo& info,
+                         Secret* masterKey = 0);
+
+/**
+ * Reads the normal and hidden volume headers of the image and tries the
+ * password on both. Throws std::runtime_error only if the image cannot be
+ * opened.
+ *
+ * @return true and fills info, and the master key if one is asked for, if
+ *         either header opened
+ */
+bool findVolumeHeader(std::string image, Secret const& password, VolumeHeaderInfo& info, Secret* masterKey = 0);
+
+/**
+ * Reads the normal and hidden volume headers of the image and tries the
+ * password on both. Throws std::runtime_error if neither opens, which means
+ * a wrong password or a file that is not an AES TrueCrypt volume.
+ */
+VolumeHeaderInfo readVolumeHeader(std::string image, Secret const& password, Secret* masterKey = 0);
+
+#endif
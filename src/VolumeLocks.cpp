@@ -0,0 +1,159 @@
+/**
+ * Copyright (c) 2007, Emir Uner
+ * All rights reserved.
+ * 
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ * 
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "VolumeLocks.hpp"
+#include "Posix.hpp"
+#include "Trace.hpp"
+
+#include <algorithm>
+
+namespace
+{
+
+class MutexLock
+{
+    pthread_mutex_t* mutex;
+    
+public:
+    explicit MutexLock(pthread_mutex_t* mutexp)
+    : mutex(mutexp)
+    {
+        pthread_mutex_lock(mutex);
+    }
+    
+    ~MutexLock()
+    {
+        pthread_mutex_unlock(mutex);
+    }
+};
+
+bool haveCommonKey(VolumeKeyVec const& a, VolumeKeyVec const& b)
+{
+    for(VolumeKeyVec::const_iterator it = a.begin(); it != a.end(); ++it)
+    {
+        if(std::find(b.begin(), b.end(), *it) != b.end())
+        {
+            return true;
+        }
+    }
+    
+    return false;
+}
+
+} // namespace <unnamed>
+
+VolumeLockManager::VolumeLockManager()
+: nextTicket(0)
+{
+    pthread_mutex_init(&mutex, 0);
+    pthread_cond_init(&changed, 0);
+}
+
+VolumeLockManager::~VolumeLockManager()
+{
+    pthread_cond_destroy(&changed);
+    pthread_mutex_destroy(&mutex);
+}
+
+bool VolumeLockManager::mayProceed(RequestList::const_iterator request) const
+{
+    for(RequestList::const_iterator it = requests.begin(); it != request; ++it)
+    {
+        if(it->exclusive || request->exclusive || haveCommonKey(it->keys, request->keys))
+        {
+            return false;
+        }
+    }
+    
+    return true;
+}
+
+unsigned long long VolumeLockManager::lock(VolumeKeyVec const& keys, bool exclusive)
+{
+    MutexLock lock(&mutex);
+    Request request;
+    
+    request.ticket = nextTicket++;
+    request.exclusive = exclusive;
+    request.keys = keys;
+    
+    const RequestList::iterator it = requests.insert(requests.end(), request);
+    
+    if(!mayProceed(it))
+    {
+        TRACE_SCOPE("wait for volume lock");
+        
+        do
+        {
+            pthread_cond_wait(&changed, &mutex);
+        }
+        while(!mayProceed(it));
+    }
+    
+    return request.ticket;
+}
+
+void VolumeLockManager::unlock(unsigned long long ticket)
+{
+    MutexLock lock(&mutex);
+    
+    for(RequestList::iterator it = requests.begin(); it != requests.end(); ++it)
+    {
+        if(it->ticket == ticket)
+        {
+            requests.erase(it);
+            break;
+        }
+    }
+    
+    pthread_cond_broadcast(&changed);
+}
+
+VolumeLockManager& getVolumeLockManager()
+{
+    static VolumeLockManager manager;
+    
+    return manager;
+}
+
+VolumeKeyVec getVolumeKeys(std::string image, std::string mountPoint, std::string device)
+{
+    VolumeKeyVec keys;
+    
+    keys.push_back("image:" + getCanonicalPath(image));
+    
+    if(!mountPoint.empty())
+    {
+        keys.push_back("mount:" + getCanonicalPath(mountPoint));
+    }
+    
+    if(!device.empty())
+    {
+        keys.push_back("device:" + device);
+    }
+    
+    return keys;
+}
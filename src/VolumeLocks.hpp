@@ -0,0 +1,120 @@
+/**
+ * Copyright (c) 2007, Emir Uner
+ * All rights reserved.
+ * 
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ * 
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef EASYTC_VOLUMELOCKS_HPP_INCLUDED
+#define EASYTC_VOLUMELOCKS_HPP_INCLUDED
+
+#include <pthread.h>
+
+#include <list>
+#include <string>
+#include <vector>
+
+typedef std::vector<std::string> VolumeKeyVec;
+
+/**
+ * Orders truecrypt operations. An operation on a volume names it by keys,
+ * see getVolumeKeys; operations whose keys do not overlap run in parallel,
+ * the others run one after another in the order they asked. Operations
+ * that affect every volume ask for exclusive access and wait for all
+ * earlier ones, reads of the whole list ask with no keys and only wait
+ * for exclusive ones. Since requests are granted strictly in order among
+ * those that conflict nothing starves, and since all keys of an operation
+ * are taken at once nothing deadlocks as long as a thread never asks
+ * while it holds a lock.
+ */
+class VolumeLockManager
+{
+public:
+    VolumeLockManager();
+    ~VolumeLockManager();
+    
+    /**
+     * Blocks until no earlier request conflicts and returns the ticket to
+     * unlock with.
+     */
+    unsigned long long lock(VolumeKeyVec const& keys, bool exclusive);
+    void unlock(unsigned long long ticket);
+    
+private:
+    VolumeLockManager(VolumeLockManager const&);
+    VolumeLockManager& operator=(VolumeLockManager const&);
+    
+    struct Request
+    {
+        unsigned long long ticket;
+        bool exclusive;
+        VolumeKeyVec keys;
+    };
+    
+    typedef std::list<Request> RequestList;
+    
+    bool mayProceed(RequestList::const_iterator request) const;
+    
+    pthread_mutex_t mutex;
+    pthread_cond_t changed;
+    unsigned long long nextTicket;
+    
+    /**
+     * Held and waiting requests in ticket order.
+     */
+    RequestList requests;
+};
+
+/**
+ * The manager all truecrypt operations of the process go through.
+ */
+VolumeLockManager& getVolumeLockManager();
+
+/**
+ * Returns the keys naming a volume: the canonical image path and, when
+ * given, the canonical mount point and the mapped device.
+ */
+VolumeKeyVec getVolumeKeys(std::string image, std::string mountPoint = "", std::string device = "");
+
+/**
+ * Holds a lock of the process wide manager while alive.
+ */
+class VolumeLock
+{
+    unsigned long long ticket;
+    
+    VolumeLock(VolumeLock const&);
+    VolumeLock& operator=(VolumeLock const&);
+    
+public:
+    inline VolumeLock(VolumeKeyVec const& keys, bool exclusive = false)
+    : ticket(getVolumeLockManager().lock(keys, exclusive))
+    {
+    }
+    
+    inline ~VolumeLock()
+    {
+        getVolumeLockManager().unlock(ticket);
+    }
+};
+
+#endif
@@ -0,0 +1,267 @@
+/**
+ * Copyright (c) 2007, Emir Uner
+ * All rights reserved.
+ * 
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ * 
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "VolumeTrim.hpp"
+#include "Config.hpp"
+#include "OperationLog.hpp"
+#include "Posix.hpp"
+#include "Trace.hpp"
+#include "VolumeLocks.hpp"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <sys/statvfs.h>
+#include <linux/fs.h>
+
+#include <algorithm>
+#include <sstream>
+
+namespace
+{
+
+struct TrimState
+{
+    MountInfoVec const* volumes;
+    TrimResultVec* results;
+    TrimOptions options;
+    Progress* progress;
+    volatile int nextVolume;
+    long long totalBytes;
+    volatile long long doneBytes;
+};
+
+void reportDone(TrimState* state, long long length)
+{
+    const long long done = __atomic_add_fetch(&state->doneBytes, length, __ATOMIC_RELAXED);
+    
+    if(state->progress != 0 && state->totalBytes > 0
+       && done * 100 / state->totalBytes != (done - length) * 100 / state->totalBytes)
+    {
+        state->progress->report(static_cast<int>(done * 100 / state->totalBytes));
+    }
+}
+
+long long getFilesystemSize(std::string const& mountPoint)
+{
+    struct statvfs st;
+    
+    return statvfs(mountPoint.c_str(), &st) == 0 ? static_cast<long long>(st.f_blocks) * st.f_frsize : 0;
+}
+
+/**
+ * Sleeps until having discarded the given number of bytes keeps the volume
+ * within its bandwidth limit.
+ */
+void throttle(long long startTime, long long trimmed, int maxMBytesPerSecond)
+{
+    if(maxMBytesPerSecond <= 0)
+    {
+        return;
+    }
+    
+    const long long due = startTime + static_cast<long long>(trimmed / (maxMBytesPerSecond * 1048576.0) * 1e6);
+    const long long now = monotonicMicroseconds();
+    
+    if(due > now)
+    {
+        usleep(static_cast<useconds_t>(due - now));
+    }
+}
+
+std::string describeTrimError(int errorCode)
+{
+    if(errorCode == EOPNOTSUPP || errorCode == ENOTTY)
+    {
+        return "discards are not passed on, the dm-crypt mapping needs allow_discards and the filesystem and "
+               "drive have to support them";
+    }
+    
+    return strerror(errorCode);
+}
+
+void trimVolume(TrimState* state, MountInfo const& volume, TrimResult& result)
+{
+    TRACE_SCOPE("trim volume");
+    
+    // keeps the volume from being unmounted under the trim
+    VolumeLock lock(getVolumeKeys(volume.imageFile, volume.mountPoint));
+    const int64_t startTime = wallClockMicroseconds();
+    const long long start = monotonicMicroseconds();
+    const long long size = getFilesystemSize(volume.mountPoint);
+    const long long chunkSize = std::max(1, state->options.chunkMBytes) * 1048576LL;
+    const int fd = open(volume.mountPoint.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    long long offset = 0;
+    
+    if(fd == -1)
+    {
+        result.error = strerror(errno);
+    }
+    
+    for(; fd != -1 && offset < size; offset += chunkSize)
+    {
+        if(state->progress != 0 && state->progress->isCancelled())
+        {
+            result.error = "cancelled";
+            break;
+        }
+        
+        struct fstrim_range range;
+        
+        range.start = offset;
+        range.len = chunkSize;
+        range.minlen = state->options.minimumExtentKBytes * 1024ULL;
+        
+        if(ioctl(fd, FITRIM, &range) == -1)
+        {
+            result.error = describeTrimError(errno);
+            break;
+        }
+        
+        // the kernel replaces the length with the number of bytes discarded
+        result.trimmedBytes += range.len;
+        reportDone(state, std::min(chunkSize, size - offset));
+        throttle(start, result.trimmedBytes, state->options.maxMBytesPerSecond);
+    }
+    
+    if(fd != -1)
+    {
+        close(fd);
+    }
+    
+    // what was skipped still counts as done for the progress
+    reportDone(state, std::max(0LL, size - offset));
+    
+    const long long duration = monotonicMicroseconds() - start;
+    
+    result.seconds = duration / 1e6;
+    recordOperation(OperationTrim, volume.imageFile, startTime, duration, result.error.empty() ? 0 : 1,
+                    result.trimmedBytes);
+}
+
+struct TrimWorker
+{
+    TrimState* state;
+    
+    void operator()()
+    {
+        TRACE_SCOPE("trim worker");
+        
+        for(int i = __atomic_fetch_add(&state->nextVolume, 1, __ATOMIC_RELAXED);
+            i < static_cast<int>(state->volumes->size());
+            i = __atomic_fetch_add(&state->nextVolume, 1, __ATOMIC_RELAXED))
+        {
+            trimVolume(state, (*state->volumes)[i], (*state->results)[i]);
+        }
+    }
+};
+
+} // namespace <unnamed>
+
+TrimOptions getTrimOptions()
+{
+    Config config(getConfigPath("trim.conf"));
+    TrimOptions options;
+    
+    options.parallelism = std::max(1, config.getInt("", "parallel", options.parallelism));
+    options.maxMBytesPerSecond = std::max(0, config.getInt("", "bandwidth", options.maxMBytesPerSecond));
+    options.chunkMBytes = std::max(1, config.getInt("", "chunkmb", options.chunkMBytes));
+    options.minimumExtentKBytes = std::max(0, config.getInt("", "minextentkb", options.minimumExtentKBytes));
+    options.intervalHours = std::max(0, config.getInt("", "interval", options.intervalHours));
+    
+    return options;
+}
+
+TrimResultVec trimVolumes(MountInfoVec const& volumes, TrimOptions const& options, Progress* progress)
+{
+    TRACE_SCOPE("trim volumes");
+    
+    TrimResultVec results(volumes.size());
+    TrimState state;
+    
+    state.volumes = &volumes;
+    state.results = &results;
+    state.options = options;
+    state.progress = progress;
+    state.nextVolume = 0;
+    state.totalBytes = 0;
+    state.doneBytes = 0;
+    
+    for(size_t i = 0; i < volumes.size(); ++i)
+    {
+        results[i].image = volumes[i].imageFile;
+        results[i].mountPoint = volumes[i].mountPoint;
+        results[i].trimmedBytes = 0;
+        results[i].seconds = 0;
+        state.totalBytes += getFilesystemSize(volumes[i].mountPoint);
+    }
+    
+    TrimWorker worker;
+    
+    worker.state = &state;
+    
+    std::vector<TrimWorker> workers(std::min(std::max(1, options.parallelism), std::max<int>(1, volumes.size())),
+                                    worker);
+    
+    runThreads(workers);
+    operation_cancelled::check(progress);
+    
+    return results;
+}
+
+std::string formatTrimResults(TrimResultVec const& results)
+{
+    std::ostringstream oss;
+    long long trimmedBytes = 0;
+    
+    if(results.empty())
+    {
+        return "No volumes are mounted.";
+    }
+    
+    for(TrimResultVec::const_iterator it = results.begin(); it != results.end(); ++it)
+    {
+        oss << it->mountPoint << ": ";
+        
+        if(it->error.empty())
+        {
+            oss << it->trimmedBytes / (1024 * 1024) << " MB trimmed";
+        }
+        else
+        {
+            oss << it->error;
+        }
+        
+        oss << " (" << static_cast<int>(it->seconds * 10) / 10.0 << " s)\n";
+        trimmedBytes += it->trimmedBytes;
+    }
+    
+    oss << "Trimmed " << trimmedBytes / (1024 * 1024) << " MB in total.";
+    
+    return oss.str();
+}
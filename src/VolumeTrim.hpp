@@ -0,0 +1,109 @@
+/**
+ * Copyright (c) 2007, Emir Uner
+ * All rights reserved.
+ * 
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ * 
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef EASYTC_VOLUMETRIM_HPP_INCLUDED
+#define EASYTC_VOLUMETRIM_HPP_INCLUDED
+
+#include "MountInfo.hpp"
+#include "Progress.hpp"
+
+#include <string>
+#include <vector>
+
+struct TrimOptions
+{
+    /**
+     * Number of volumes trimmed at the same time.
+     */
+    int parallelism;
+    
+    /**
+     * Discard bandwidth each volume keeps below, 0 for no limit.
+     */
+    int maxMBytesPerSecond;
+    
+    /**
+     * Size of the filesystem ranges handed to each FITRIM call. Smaller
+     * ranges keep the filesystem locked for shorter times and let the
+     * rate limit act more smoothly.
+     */
+    int chunkMBytes;
+    
+    /**
+     * Free extents shorter than this are not discarded.
+     */
+    int minimumExtentKBytes;
+    
+    /**
+     * Hours between scheduled trims, 0 if they are off.
+     */
+    int intervalHours;
+    
+    inline TrimOptions()
+    : parallelism(2), maxMBytesPerSecond(0), chunkMBytes(1024), minimumExtentKBytes(0), intervalHours(0)
+    {
+    }
+};
+
+struct TrimResult
+{
+    std::string image;
+    std::string mountPoint;
+    long long trimmedBytes;
+    double seconds;
+    
+    /**
+     * Empty if the volume was trimmed.
+     */
+    std::string error;
+};
+
+typedef std::vector<TrimResult> TrimResultVec;
+
+/**
+ * Reads the trim options from ~/.easytc/trim.conf, the keys are parallel,
+ * bandwidth in MB/s, chunkmb, minextentkb and interval in hours.
+ */
+TrimOptions getTrimOptions();
+
+/**
+ * Discards the free space of each mounted volume with FITRIM, so that the
+ * SSD under the container learns which blocks are unused. Volumes are
+ * trimmed by options.parallelism threads, each volume a chunk at a time
+ * within the bandwidth limit. A volume that cannot be trimmed, e.g. because
+ * its dm-crypt mapping does not allow discards, gets an error in its
+ * result and does not stop the others. Each volume is recorded in the
+ * operation log.
+ */
+TrimResultVec trimVolumes(MountInfoVec const& volumes, TrimOptions const& options = TrimOptions(),
+                          Progress* progress = 0);
+
+/**
+ * Returns a few lines describing the results for the user.
+ */
+std::string formatTrimResults(TrimResultVec const& results);
+
+#endif